@@ -50,6 +50,12 @@ static int32_t FF_WritePartial( FF_FILE *pxFile, uint32_t ulItemLBA, uint32_t ul
 
 static uint32_t FF_SetCluster( FF_FILE *pxFile, FF_Error_t *pxError );
 static uint32_t FF_FileLBA( FF_FILE *pxFile );
+static FF_Error_t prvAddFileHandle( FF_IOManager_t *pxIOManager, FF_FILE *pxFile );
+
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+	static void prvBuildExtentMap( FF_FILE *pxFile );
+	static BaseType_t prvGetExtent( FF_FILE *pxFile, uint32_t ulFileCluster, uint32_t *pulAddress, uint32_t *pulContiguous );
+#endif
 
 /*-----------------------------------------------------------*/
 
@@ -211,7 +217,6 @@ FF_FILE *FF_Open( FF_IOManager_t *pxIOManager, const char *pcPath, uint8_t ucMod
 #endif
 {
 FF_FILE *pxFile = NULL;
-FF_FILE *pxFileChain;
 FF_DirEnt_t xDirEntry;
 uint32_t ulFileCluster;
 FF_Error_t xError;
@@ -367,46 +372,7 @@ FF_FindParams_t xFindParams;
 		pxFile->ulEndOfChain = 0;
 		pxFile->ulValidFlags &= ~( FF_VALID_FLAG_DELETED );
 
-		/* Add pxFile onto the end of our linked list of FF_FILE objects.
-		But first make sure that there are not 2 handles with write access
-		to the same object. */
-		FF_PendSemaphore( pxIOManager->pvSemaphore );
-		{
-			pxFileChain = ( FF_FILE * ) pxIOManager->FirstFile;
-			if( pxFileChain == NULL )
-			{
-				pxIOManager->FirstFile = pxFile;
-			}
-			else
-			{
-				for( ; ; )
-				{
-					/* See if two file handles point to the same object. */
-					if( ( pxFileChain->ulObjectCluster == pxFile->ulObjectCluster ) &&
-						( pxFileChain->ulDirCluster == pxFile->ulDirCluster ) &&
-						( pxFileChain->usDirEntry == pxFile->usDirEntry ) )
-					{
-						/* Fail if any of the two has write access to the object. */
-						if( ( ( pxFileChain->ucMode | pxFile->ucMode ) & ( FF_MODE_WRITE | FF_MODE_APPEND ) ) != 0 )
-						{
-							/* File is already open! DON'T ALLOW IT! */
-							xError = ( FF_Error_t ) ( FF_ERR_FILE_ALREADY_OPEN | FF_OPEN );
-							break;
-						}
-					}
-
-					if( pxFileChain->pxNext == NULL )
-					{
-						pxFileChain->pxNext = pxFile;
-						break;
-					}
-
-					pxFileChain = ( FF_FILE * ) pxFileChain->pxNext;
-				}
-			}
-		}
-
-		FF_ReleaseSemaphore( pxIOManager->pvSemaphore );
+		xError = prvAddFileHandle( pxIOManager, pxFile );
 	}
 
 	if( FF_isERR( xError ) == pdFALSE )
@@ -420,6 +386,18 @@ FF_FindParams_t xFindParams;
 		}
 	}
 
+	#if( ffconfigFILE_EXTENT_MAP != 0 )
+	{
+		/* The cluster chain of a file can only change when it has write
+		access, and no other handle can have it while this one is open. */
+		if( ( FF_isERR( xError ) == pdFALSE ) &&
+			( ( ucMode & ( FF_MODE_WRITE | FF_MODE_APPEND | FF_MODE_TRUNCATE | FF_MODE_DIR ) ) == 0 ) )
+		{
+			prvBuildExtentMap( pxFile );
+		}
+	}
+	#endif
+
 	if( FF_isERR( xError ) != pdFALSE )
 	{
 		if( pxFile != NULL )
@@ -443,6 +421,266 @@ FF_FindParams_t xFindParams;
 }  /* FF_Open() */
 /*-----------------------------------------------------------*/
 
+/**
+ *	@public
+ *	@brief	Opens a file for reading from the location of its directory entry,
+ *			as found by FF_FindFirst()/FF_FindNext(). Unlike FF_Open(), the path
+ *			of the file is not looked up, so a directory can be listed once and
+ *			its files opened without comparing their names again.
+ *
+ *	@param	pxLocation	Location of the file. The location is only valid while the
+ *			directory is not modified.
+ *	@param	ucMode		Access Mode required. Only FF_MODE_READ is allowed.
+ *	@param	pxError		Pointer to a signed byte for error checking. Can be NULL if not required.
+ *
+ *	@return	NULL pointer on error, in which case pxError should be checked for more information.
+ **/
+FF_FILE *FF_OpenLocation( const FF_FileLocation_t *pxLocation, uint8_t ucMode, FF_Error_t *pxError )
+{
+FF_FILE *pxFile = NULL;
+FF_IOManager_t *pxIOManager = NULL;
+FF_Error_t xError;
+
+	if( pxLocation != NULL )
+	{
+		pxIOManager = pxLocation->pxIOManager;
+	}
+
+	if( pxIOManager == NULL )
+	{
+		xError = ( FF_Error_t ) ( FF_ERR_NULL_POINTER | FF_OPEN );
+	}
+#if( ffconfigREMOVABLE_MEDIA != 0 )
+	else if( ( pxIOManager->ucFlags & FF_IOMAN_DEVICE_IS_EXTRACTED ) != 0 )
+	{
+		xError = ( FF_Error_t ) ( FF_ERR_IOMAN_DRIVER_NOMEDIUM | FF_OPEN );
+	}
+#endif /* ffconfigREMOVABLE_MEDIA */
+	else if( ( ucMode & ( FF_MODE_WRITE | FF_MODE_APPEND | FF_MODE_CREATE | FF_MODE_TRUNCATE | FF_MODE_DIR ) ) != 0 )
+	{
+		/* The directory entry is not updated through a location, so the
+		file can only be read. */
+		xError = ( FF_Error_t ) ( FF_ERR_FILE_IS_READ_ONLY | FF_OPEN );
+	}
+	else if( ( pxLocation->ucAttrib & FF_FAT_ATTR_DIR ) != 0 )
+	{
+		xError = ( FF_Error_t ) ( FF_ERR_FILE_OBJECT_IS_A_DIR | FF_OPEN );
+	}
+	else
+	{
+		xError = FF_ERR_NONE;
+		pxFile = prvAllocFileHandle( pxIOManager, &xError );
+	}
+
+	if( FF_isERR( xError ) == pdFALSE )
+	{
+		pxFile->ucMode = ucMode;
+		pxFile->pxIOManager = pxIOManager;
+		pxFile->ulFilePointer = 0;
+		pxFile->ulObjectCluster = pxLocation->ulObjectCluster;
+		pxFile->ulFileSize = pxLocation->ulFileSize;
+		pxFile->ulCurrentCluster = 0;
+		pxFile->ulAddrCurrentCluster = pxFile->ulObjectCluster;
+
+		pxFile->pxNext = NULL;
+		pxFile->ulDirCluster = pxLocation->ulDirCluster;
+		pxFile->usDirEntry = pxLocation->usDirEntry;
+		pxFile->ulChainLength = 0;
+		pxFile->ulEndOfChain = 0;
+
+		xError = prvAddFileHandle( pxIOManager, pxFile );
+	}
+
+	#if( ffconfigFILE_EXTENT_MAP != 0 )
+	{
+		if( FF_isERR( xError ) == pdFALSE )
+		{
+			prvBuildExtentMap( pxFile );
+		}
+	}
+	#endif
+
+	if( FF_isERR( xError ) != pdFALSE )
+	{
+		if( pxFile != NULL )
+		{
+			#if( ffconfigOPTIMISE_UNALIGNED_ACCESS != 0 )
+			{
+				ffconfigFREE( pxFile->pucBuffer );
+			}
+			#endif
+			ffconfigFREE( pxFile );
+		}
+		pxFile = NULL;
+	}
+
+	if( pxError != NULL )
+	{
+		*pxError = xError;
+	}
+
+	return pxFile;
+}	/* FF_OpenLocation() */
+/*-----------------------------------------------------------*/
+
+/* Add pxFile onto the end of our linked list of FF_FILE objects.
+But first make sure that there are not 2 handles with write access
+to the same object. */
+static FF_Error_t prvAddFileHandle( FF_IOManager_t *pxIOManager, FF_FILE *pxFile )
+{
+FF_FILE *pxFileChain;
+FF_Error_t xError = FF_ERR_NONE;
+
+	FF_PendSemaphore( pxIOManager->pvSemaphore );
+	{
+		pxFileChain = ( FF_FILE * ) pxIOManager->FirstFile;
+		if( pxFileChain == NULL )
+		{
+			pxIOManager->FirstFile = pxFile;
+		}
+		else
+		{
+			for( ; ; )
+			{
+				/* See if two file handles point to the same object. */
+				if( ( pxFileChain->ulObjectCluster == pxFile->ulObjectCluster ) &&
+					( pxFileChain->ulDirCluster == pxFile->ulDirCluster ) &&
+					( pxFileChain->usDirEntry == pxFile->usDirEntry ) )
+				{
+					/* Fail if any of the two has write access to the object. */
+					if( ( ( pxFileChain->ucMode | pxFile->ucMode ) & ( FF_MODE_WRITE | FF_MODE_APPEND ) ) != 0 )
+					{
+						/* File is already open! DON'T ALLOW IT! */
+						xError = ( FF_Error_t ) ( FF_ERR_FILE_ALREADY_OPEN | FF_OPEN );
+						break;
+					}
+				}
+
+				if( pxFileChain->pxNext == NULL )
+				{
+					pxFileChain->pxNext = pxFile;
+					break;
+				}
+
+				pxFileChain = ( FF_FILE * ) pxFileChain->pxNext;
+			}
+		}
+	}
+	FF_ReleaseSemaphore( pxIOManager->pvSemaphore );
+
+	return xError;
+}	/* prvAddFileHandle() */
+/*-----------------------------------------------------------*/
+
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+/* Map the runs of physically contiguous clusters of a file (its extents), by
+following its cluster chain once. The reads and the seeks then find the
+clusters in the map instead of following the FAT. If the chain has more than
+ffconfigFILE_EXTENT_MAP extents, only its first part is mapped. The map is
+left empty when the FAT can not be read. */
+static void prvBuildExtentMap( FF_FILE *pxFile )
+{
+FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+uint32_t ulBytesPerCluster = pxIOManager->xPartition.usBlkSize * pxIOManager->xPartition.ulSectorsPerCluster;
+uint32_t ulClusters = ( pxFile->ulFileSize + ulBytesPerCluster - 1 ) / ulBytesPerCluster;
+uint32_t ulCurrentCluster = pxFile->ulObjectCluster;
+uint32_t ulNextCluster;
+uint32_t ulMappedClusters = 1;
+FF_FileExtent_t *pxExtent = &( pxFile->xExtents[ 0 ] );
+FF_FATBuffers_t xFATBuffers;
+FF_Error_t xError = FF_ERR_NONE;
+FF_Error_t xTempError;
+
+	pxFile->usExtentCount = 0;
+	pxFile->ulMappedClusters = 0;
+
+	/* Empty files have no chain (pseudo cluster 1). */
+	if( ( ulClusters != 0 ) && ( pxFile->ulObjectCluster >= 2 ) )
+	{
+		pxExtent->ulFirstCluster = ulCurrentCluster;
+		pxExtent->ulClusterCount = 1;
+		pxFile->usExtentCount = 1;
+
+		FF_InitFATBuffers( &xFATBuffers, FF_MODE_READ );
+
+		FF_LockFAT( pxIOManager );
+		while( ulMappedClusters < ulClusters )
+		{
+			ulNextCluster = FF_getFATEntry( pxIOManager, ulCurrentCluster, &xError, &xFATBuffers );
+			if( ( FF_isERR( xError ) != pdFALSE ) || ( FF_isEndOfChain( pxIOManager, ulNextCluster ) != pdFALSE ) )
+			{
+				break;
+			}
+
+			if( ulNextCluster == ( ulCurrentCluster + 1 ) )
+			{
+				pxExtent->ulClusterCount++;
+			}
+			else if( pxFile->usExtentCount < ffconfigFILE_EXTENT_MAP )
+			{
+				pxExtent++;
+				pxExtent->ulFirstCluster = ulNextCluster;
+				pxExtent->ulClusterCount = 1;
+				pxFile->usExtentCount++;
+			}
+			else
+			{
+				/* The map is full. */
+				break;
+			}
+
+			ulMappedClusters++;
+			ulCurrentCluster = ulNextCluster;
+		}
+		FF_UnlockFAT( pxIOManager );
+
+		xTempError = FF_ReleaseFATBuffers( pxIOManager, &xFATBuffers );
+		if( FF_isERR( xError ) == pdFALSE )
+		{
+			xError = xTempError;
+		}
+
+		if( FF_isERR( xError ) == pdFALSE )
+		{
+			pxFile->ulMappedClusters = ulMappedClusters;
+		}
+		else
+		{
+			pxFile->usExtentCount = 0;
+		}
+	}
+}	/* prvBuildExtentMap() */
+/*-----------------------------------------------------------*/
+
+/* Find a cluster of the file (0 = first cluster) in its extent map. Returns
+its address and the number of clusters that are contiguous from it. Returns
+pdFALSE if the cluster is not mapped. */
+static BaseType_t prvGetExtent( FF_FILE *pxFile, uint32_t ulFileCluster, uint32_t *pulAddress, uint32_t *pulContiguous )
+{
+BaseType_t xIndex;
+uint32_t ulExtentStart = 0;	/* Cluster of the file where the extent starts. */
+FF_FileExtent_t *pxExtent;
+
+	if( ulFileCluster < pxFile->ulMappedClusters )
+	{
+		for( xIndex = 0; xIndex < ( BaseType_t ) pxFile->usExtentCount; xIndex++ )
+		{
+			pxExtent = &( pxFile->xExtents[ xIndex ] );
+			if( ulFileCluster < ( ulExtentStart + pxExtent->ulClusterCount ) )
+			{
+				*pulAddress = pxExtent->ulFirstCluster + ( ulFileCluster - ulExtentStart );
+				*pulContiguous = pxExtent->ulClusterCount - ( ulFileCluster - ulExtentStart );
+				return pdTRUE;
+			}
+			ulExtentStart += pxExtent->ulClusterCount;
+		}
+	}
+
+	return pdFALSE;
+}	/* prvGetExtent() */
+#endif /* ffconfigFILE_EXTENT_MAP */
+/*-----------------------------------------------------------*/
+
 /**
  *	@public
  *	@brief	Tests if a Directory contains any other files or folders.
@@ -1157,9 +1395,25 @@ uint32_t ulSectors;
 uint32_t ulSequentialClusters = 0;
 uint32_t ulItemLBA;
 FF_Error_t xError = FF_ERR_NONE;
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+	uint32_t ulAddress;
+	uint32_t ulContiguous;
+	BaseType_t xMapped;
+#endif
 
 	while( ulCount != 0 )
 	{
+		#if( ffconfigFILE_EXTENT_MAP != 0 )
+		{
+			/* The whole contiguous part is read with a single FF_BlockRead(). */
+			xMapped = prvGetExtent( pxFile, pxFile->ulCurrentCluster, &ulAddress, &ulContiguous );
+			if( xMapped != pdFALSE )
+			{
+				ulSequentialClusters = ( ( ulContiguous < ulCount ) ? ulContiguous : ulCount ) - 1;
+			}
+		}
+		if( xMapped == pdFALSE )
+		#endif
 		if( ( ulCount - 1 ) > 0 )
 		{
 			ulSequentialClusters =
@@ -1182,12 +1436,24 @@ FF_Error_t xError = FF_ERR_NONE;
 
 		ulCount -= ( ulSequentialClusters + 1 );
 
-		FF_LockFAT( pxFile->pxIOManager );
+		#if( ffconfigFILE_EXTENT_MAP != 0 )
 		{
-			pxFile->ulAddrCurrentCluster =
-				FF_TraverseFAT( pxFile->pxIOManager, pxFile->ulAddrCurrentCluster, ulSequentialClusters + 1, &xError );
+			xMapped = prvGetExtent( pxFile, pxFile->ulCurrentCluster + ulSequentialClusters + 1, &ulAddress, &ulContiguous );
+			if( xMapped != pdFALSE )
+			{
+				pxFile->ulAddrCurrentCluster = ulAddress;
+			}
+		}
+		if( xMapped == pdFALSE )
+		#endif
+		{
+			FF_LockFAT( pxFile->pxIOManager );
+			{
+				pxFile->ulAddrCurrentCluster =
+					FF_TraverseFAT( pxFile->pxIOManager, pxFile->ulAddrCurrentCluster, ulSequentialClusters + 1, &xError );
+			}
+			FF_UnlockFAT( pxFile->pxIOManager );
 		}
-		FF_UnlockFAT( pxFile->pxIOManager );
 		if( FF_isERR( xError ) )
 		{
 			break;
@@ -1449,7 +1715,20 @@ FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
 uint32_t ulNewCluster = FF_getClusterChainNumber( pxIOManager, pxFile->ulFilePointer, 1 );
 FF_Error_t xResult = FF_ERR_NONE;
 uint32_t ulReturn;
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+	uint32_t ulAddress;
+	uint32_t ulContiguous;
+#endif
 
+	#if( ffconfigFILE_EXTENT_MAP != 0 )
+	if( ( ulNewCluster != pxFile->ulCurrentCluster ) &&
+		( prvGetExtent( pxFile, ulNewCluster, &ulAddress, &ulContiguous ) != pdFALSE ) )
+	{
+		/* A seek in a mapped file doesn't follow the FAT. */
+		pxFile->ulAddrCurrentCluster = ulAddress;
+	}
+	else
+	#endif
 	if( ulNewCluster > pxFile->ulCurrentCluster )
 	{
 		FF_LockFAT( pxIOManager );
@@ -178,6 +178,22 @@ uint8_t ucMode;
 }
 /*-----------------------------------------------------------*/
 
+/* Open a file found by ff_findfirst()/ff_findnext() from the location given by
+ff_getlocation(). The path is not looked up again, so the files of a directory
+can be listed once and then opened without comparing their names. Only reading
+is allowed. */
+FF_FILE *ff_fopenlocation( const FF_FileLocation_t *pxLocation, const char *pcMode )
+{
+FF_FILE *pxStream;
+FF_Error_t xError;
+
+	pxStream = FF_OpenLocation( pxLocation, FF_GetModeBits( pcMode ), &xError );
+	stdioSET_ERRNO( prvFFErrorToErrno( xError ) );
+
+	return pxStream;
+}
+/*-----------------------------------------------------------*/
+
 int ff_fclose( FF_FILE *pxStream )
 {
 FF_Error_t xError;
@@ -1478,6 +1494,46 @@ FF_Error_t xError;
 }
 /*-----------------------------------------------------------*/
 
+/* Get the location of the entry last found by ff_findfirst()/ff_findnext().
+It stays valid as long as the directory isn't modified. Returns -1 for the
+entries that are not in the directory itself, such as the mounted file
+systems and "." and "..". */
+int ff_getlocation( const FF_FindData_t *pxFindData, FF_FileLocation_t *pxLocation )
+{
+int iReturn = 0;
+
+	if( ( pxFindData->xDirectoryHandler.pxManager == NULL ) ||
+		( pxFindData->xDirectoryHandler.u.bits.bEndOfDir != pdFALSE ) ||
+		( pxFindData->xDirectoryEntry.usCurrentItem == 0 ) )
+	{
+		iReturn = -1;
+	}
+	#if( ffconfigDEV_SUPPORT != 0 )
+	else if( pxFindData->bIsDeviceDir != pdFALSE )
+	{
+		iReturn = -1;
+	}
+	#endif
+	else
+	{
+		pxLocation->pxIOManager = pxFindData->xDirectoryHandler.pxManager;
+		pxLocation->ulDirCluster = pxFindData->xDirectoryEntry.ulDirCluster;
+		pxLocation->ulObjectCluster = pxFindData->xDirectoryEntry.ulObjectCluster;
+		pxLocation->ulFileSize = pxFindData->xDirectoryEntry.ulFileSize;
+		/* 'usCurrentItem' points to the entry after the one found. */
+		pxLocation->usDirEntry = pxFindData->xDirectoryEntry.usCurrentItem - 1;
+		pxLocation->ucAttrib = pxFindData->xDirectoryEntry.ucAttrib;
+	}
+
+	if( iReturn != 0 )
+	{
+		stdioSET_ERRNO( pdFREERTOS_ERRNO_EINVAL );
+	}
+
+	return iReturn;
+}
+/*-----------------------------------------------------------*/
+
 /*-----------------------------------------------------------
  * ff_isdirempty() returns 1 if a given directory is empty
  * (has no entries)
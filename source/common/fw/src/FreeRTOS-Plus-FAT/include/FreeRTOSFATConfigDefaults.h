@@ -156,6 +156,15 @@ will be removed. */
 	#define	ffconfigOPTIMISE_UNALIGNED_ACCESS	0
 #endif
 
+#if !defined( ffconfigFILE_EXTENT_MAP )
+	/* When non-zero, a file that is opened for reading only keeps a map of up
+	to ffconfigFILE_EXTENT_MAP runs of contiguous clusters, built from its
+	cluster chain when it is opened.  Large reads are then sent to the driver
+	one contiguous run at a time, and seeks don't follow the FAT.  Each run
+	takes 8 bytes of the file handle. */
+	#define	ffconfigFILE_EXTENT_MAP				0
+#endif
+
 #if !defined( ffconfigCACHE_WRITE_THROUGH )
 	/* Input and output to a disk uses buffers that are only flushed at the
 	following times:
@@ -53,6 +53,15 @@ struct xDEV_NODE
 };
 #endif
 
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+	/* Run of physically contiguous clusters of a file. */
+	typedef struct _FF_FILE_EXTENT
+	{
+		uint32_t ulFirstCluster;	/* Address of the first cluster. */
+		uint32_t ulClusterCount;
+	} FF_FileExtent_t;
+#endif
+
 typedef struct _FF_FILE
 {
 	FF_IOManager_t *pxIOManager;			/* Ioman Pointer! */
@@ -75,6 +84,11 @@ typedef struct _FF_FILE
 
 #if( ffconfigDEV_SUPPORT != 0 )
 	struct SFileCache *pxDevNode;
+#endif
+#if( ffconfigFILE_EXTENT_MAP != 0 )
+	FF_FileExtent_t xExtents[ ffconfigFILE_EXTENT_MAP ];	/* Extents of a file opened for reading only. */
+	uint32_t ulMappedClusters;		/* Clusters of the chain covered by xExtents. 0 if there is no map. */
+	uint16_t usExtentCount;
 #endif
 	struct _FF_FILE *pxNext;		/* Pointer to the next file object in the linked list. */
 } FF_FILE;
@@ -82,6 +96,18 @@ typedef struct _FF_FILE
 #define FF_VALID_FLAG_INVALID	0x00000001
 #define FF_VALID_FLAG_DELETED	0x00000002
 
+/* Location of the directory entry of a file, as found by FF_FindFirst()/
+FF_FindNext(). FF_OpenLocation() opens the file without looking up its path. */
+typedef struct _FF_FILE_LOCATION
+{
+	FF_IOManager_t *pxIOManager;
+	uint32_t ulDirCluster;			/* Cluster Number that the Dirent is in. */
+	uint32_t ulObjectCluster;		/* File's Start Cluster. */
+	uint32_t ulFileSize;
+	uint16_t usDirEntry;			/* Dirent Entry Number describing this file. */
+	uint8_t ucAttrib;
+} FF_FileLocation_t;
+
 /*---------- PROTOTYPES */
 /* PUBLIC (Interfaces): */
 
@@ -101,6 +127,8 @@ typedef struct _FF_FILE
 		BaseType_t bDeleteIfExists );
 #endif	/* ffconfigUNICODE_UTF16_SUPPORT */
 
+FF_FILE *FF_OpenLocation( const FF_FileLocation_t *pxLocation, uint8_t ucMode, FF_Error_t *pxError );
+
 #if( ffconfigTIME_SUPPORT != 0 )
 	enum {
 		ETimeCreate = 1,
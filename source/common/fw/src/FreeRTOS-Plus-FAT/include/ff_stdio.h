@@ -169,6 +169,7 @@ void *pvResult;
  * http://www.freertos.org/FreeRTOS-Plus/FreeRTOS_Plus_FAT/Standard_File_System_API.html
  *-----------------------------------------------------------*/
 FF_FILE *ff_fopen( const char *pcFile, const char *pcMode );
+FF_FILE *ff_fopenlocation( const FF_FileLocation_t *pxLocation, const char *pcMode );
 int ff_fclose( FF_FILE *pxStream );
 
 
@@ -320,6 +321,7 @@ size_t ff_filelength( FF_FILE *pxFile );
 
 int ff_findfirst( const char *pcDirectory, FF_FindData_t *pxFindData );
 int ff_findnext( FF_FindData_t *pxFindData );
+int ff_getlocation( const FF_FindData_t *pxFindData, FF_FileLocation_t *pxLocation );
 int ff_isdirempty(const char *pcPath );
 
 
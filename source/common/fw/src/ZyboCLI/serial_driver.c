@@ -29,12 +29,12 @@
 	BASIC INTERRUPT DRIVEN SERIAL PORT DRIVER.
 
 	Note1:  This driver is used specifically to provide an interface to the
-	FreeRTOS+CLI command interpreter.  It is *not* intended to be a generic
-	serial port driver.  Nor is it intended to be used as an example of an
-	efficient implementation.  In particular, a queue is used to buffer
-	received characters, which is fine in this case as key presses arrive
-	slowly, but a DMA and/or RAM buffer should be used in place of the queue in
-	applications that expect higher throughput.
+	FreeRTOS+CLI command interpreter and to the serial MIDI listener.  It is
+	*not* intended to be a generic serial port driver.  Received characters are
+	drained from the UART FIFO in bulk on each interrupt and placed into a
+	stream buffer with a single send, so a burst of bytes (i.e. a MIDI chord)
+	wakes the reading task once instead of once per byte.  Only one task can
+	read from the port at a time (the CLI console or the MIDI listener).
 
 	Note2:  This driver does not attempt to handle UART errors.
 */
@@ -44,6 +44,7 @@
 #include "task.h"
 #include "queue.h"
 #include "semphr.h"
+#include "stream_buffer.h"
 
 /* Demo application includes. */
 #include "serial_driver.h"
@@ -56,6 +57,10 @@
 /* The UART interrupts of interest when receiving. */
 #define serRECEIVE_INTERRUPT_MASK	( XUARTPS_IXR_RXOVR | XUARTPS_IXR_RXFULL | XUARTPS_IXR_TOUT )
 
+/* Depth of the UART RX FIFO. This is the most that can be drained on one
+interrupt. */
+#define serRX_FIFO_DEPTH			64
+
 /* The UART interrupts of interest when transmitting. */
 #define serTRANSMIT_IINTERRUPT_MASK ( XUARTPS_IXR_TXEMPTY )
 
@@ -68,9 +73,11 @@ static XUartPs xUARTInstance;
 defined in main(). */
 extern XScuGic xInterruptController;
 
-/* The queue into which received key presses are placed.  NOTE THE COMMENTS AT
-THE TOP OF THIS FILE REGARDING THE USE OF QUEUES FOR THIS PURPOSE. */
-static QueueHandle_t xRxQueue = NULL;
+/* The stream buffer into which received characters are placed.  The ISR is
+the only writer and a stream buffer only allows one reader at a time: the
+console hands the port over to the MIDI listener and doesn't read again until
+the listener stops (see StartMIDIListenerCMD.c). */
+static StreamBufferHandle_t xRxStreamBuffer = NULL;
 
 /* The semaphore used to indicate the end of a transmission. */
 static SemaphoreHandle_t xTxCompleteSemaphore = NULL;
@@ -93,10 +100,10 @@ xComPortHandle xSerialPortInitMinimal( uint32_t ulWantedBaud, UBaseType_t uxQueu
 BaseType_t xStatus;
 XUartPs_Config *pxConfig;
 
-	/* Create the queue used to hold received characters.  NOTE THE COMMENTS AT
-	THE TOP OF THIS FILE REGARDING THE USE OF QUEUES FOR THIS PURPSOE. */
-	xRxQueue = xQueueCreate( uxQueueLength, sizeof( char ) );
-	configASSERT( xRxQueue );
+	/* Create the stream buffer used to hold received characters.  The reader
+	is unblocked as soon as one character is available. */
+	xRxStreamBuffer = xStreamBufferCreate( uxQueueLength, 1 );
+	configASSERT( xRxStreamBuffer );
 
 	/* Create the semaphore used to signal the end of a transmission, then take
 	the semaphore so it is in the correct state the first time
@@ -149,14 +156,25 @@ BaseType_t xReturn;
 	/* Only a single port is supported. */
 	( void ) pxPort;
 
-	/* Obtain a received character from the queue - entering the Blocked state
-	(so not consuming any processing time) to wait for a character if one is not
-	already available. */
-	xReturn = xQueueReceive( xRxQueue, pcRxedChar, xBlockTime );
+	/* Obtain a received character from the stream buffer - entering the
+	Blocked state (so not consuming any processing time) to wait for a
+	character if one is not already available. */
+	xReturn = ( xStreamBufferReceive( xRxStreamBuffer, pcRxedChar, sizeof( char ), xBlockTime ) == sizeof( char ) ) ? pdPASS : pdFAIL;
 	return xReturn;
 }
 /*-----------------------------------------------------------*/
 
+size_t xSerialGetBytes( xComPortHandle pxPort, uint8_t *pucRxedBytes, size_t xMaxBytes, TickType_t xBlockTime )
+{
+	/* Only a single port is supported. */
+	( void ) pxPort;
+
+	/* Obtain all the received characters (up to xMaxBytes) from the stream
+	buffer.  The task only blocks if there are no characters available. */
+	return xStreamBufferReceive( xRxStreamBuffer, pucRxedBytes, xMaxBytes, xBlockTime );
+}
+/*-----------------------------------------------------------*/
+
 void vSerialPutString( xComPortHandle pxPort, const signed char * const pcString, unsigned short usStringLength )
 {
 	const TickType_t xMaxWait = 500UL / portTICK_PERIOD_MS;
@@ -214,7 +232,8 @@ void prvUART_Handler( void *pvNotUsed )
 extern unsigned int XUartPs_SendBuffer( XUartPs *InstancePtr );
 uint32_t ulActiveInterrupts, ulChannelStatusRegister;
 BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-char cChar;
+uint8_t ucRxedBytes[ serRX_FIFO_DEPTH ];
+size_t xRxedByteCount = 0;
 
 	configASSERT( pvNotUsed == &xUARTInstance );
 
@@ -232,23 +251,25 @@ char cChar;
 		the RX FIFO. */
 		ulChannelStatusRegister = XUartPs_ReadReg( XPAR_PS7_UART_1_BASEADDR, XUARTPS_SR_OFFSET );
 
-		/* Move data from the Rx FIFO to the Rx queue.  NOTE THE COMMENTS AT THE
-		TOP OF THIS FILE ABOUT USING QUEUES FOR THIS PURPSOE. */
-		while( ( ulChannelStatusRegister & XUARTPS_SR_RXEMPTY ) == 0 )
+		/* Drain the Rx FIFO into a local buffer. */
+		while( ( ( ulChannelStatusRegister & XUARTPS_SR_RXEMPTY ) == 0 ) && ( xRxedByteCount < serRX_FIFO_DEPTH ) )
 		{
-			cChar =	XUartPs_ReadReg( XPAR_PS7_UART_1_BASEADDR, XUARTPS_FIFO_OFFSET );
-
-			/* If writing to the queue unblocks a task, and the unblocked task
-			has a priority above the currently running task (the task that this
-			interrupt interrupted), then xHigherPriorityTaskWoken will be set
-			to pdTRUE inside the xQueueSendFromISR() function.
-			xHigherPriorityTaskWoken is then passed to portYIELD_FROM_ISR() at
-			the end of this interrupt handler to request a context switch so the
-			interrupt returns directly to the (higher priority) unblocked
-			task. */
-			xQueueSendFromISR( xRxQueue, &cChar, &xHigherPriorityTaskWoken );
+			ucRxedBytes[ xRxedByteCount++ ] = ( uint8_t ) XUartPs_ReadReg( XPAR_PS7_UART_1_BASEADDR, XUARTPS_FIFO_OFFSET );
 			ulChannelStatusRegister = XUartPs_ReadReg( XPAR_PS7_UART_1_BASEADDR, XUARTPS_SR_OFFSET );
 		}
+
+		/* Move the whole batch to the stream buffer with a single call.  If
+		this unblocks a task, and the unblocked task has a priority above the
+		currently running task (the task that this interrupt interrupted), then
+		xHigherPriorityTaskWoken will be set to pdTRUE inside the
+		xStreamBufferSendFromISR() function.  xHigherPriorityTaskWoken is then
+		passed to portYIELD_FROM_ISR() at the end of this interrupt handler to
+		request a context switch so the interrupt returns directly to the
+		(higher priority) unblocked task. */
+		if( xRxedByteCount > 0 )
+		{
+			xStreamBufferSendFromISR( xRxStreamBuffer, ucRxedBytes, xRxedByteCount, &xHigherPriorityTaskWoken );
+		}
 	}
 
 	/* Are any transmit events of interest active? */
@@ -281,7 +302,7 @@ char cChar;
 	interrupt handler caused a task to leave the blocked state, and the task
 	that left the blocked state has a higher priority than the currently running
 	task (the task this interrupt interrupted).  See the comment above the calls
-	to xSemaphoreGiveFromISR() and xQueueSendFromISR() within this function. */
+	to xSemaphoreGiveFromISR() and xStreamBufferSendFromISR() within this function. */
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 
 	/* Clear the interrupt status. */
@@ -4,9 +4,9 @@
 /* Dimensions the buffer into which input characters are placed. */
 #define cmdMAX_INPUT_SIZE		100
 
-/* Dimentions a buffer to be used by the UART driver, if the UART driver uses a
-buffer at all. */
-#define cmdQUEUE_LENGTH			25
+/* Dimentions the RX stream buffer used by the UART driver.  It must be able to
+hold several full RX FIFOs (64 bytes each) as the ISR drains them in bulk. */
+#define cmdQUEUE_LENGTH			256
 
 /* Escape Characters */
 #define cmdASCII_BACKSPACE           ( 0x08 ) /* DEL acts as a backspace. */
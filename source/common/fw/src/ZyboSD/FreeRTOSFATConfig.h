@@ -144,6 +144,11 @@ than 512 bytes are being used.  When set to 1 each file handle will
 allocate a 512-byte character buffer to facilitate "unaligned access". */
 #define	ffconfigOPTIMISE_UNALIGNED_ACCESS	1
 
+/* A file opened for reading only keeps a map of its runs of contiguous
+clusters, so the samples are read with the largest possible SD transfers
+and the seeks don't follow the FAT. */
+#define ffconfigFILE_EXTENT_MAP 16
+
 /* Input and output to a disk uses buffers that are only flushed at the
 following times:
 
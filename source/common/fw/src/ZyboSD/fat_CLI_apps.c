@@ -54,6 +54,11 @@ static BaseType_t prvTYPECommand( char *pcWriteBuffer, size_t xWriteBufferLen, c
  */
 static BaseType_t prvPWDCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
+/*
+ * Implements the sd_stats command.
+ */
+static BaseType_t prvSDStatsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
 
 ////////////////////////////////////////////////////////
 // Command Register
@@ -106,6 +111,15 @@ static const CLI_Command_Definition_t xPWD =
 	0 /* No parameters are expected. */
 };
 
+/* Structure that defines the sd_stats command line command, which prints the statistics of the SD-card transfers. */
+static const CLI_Command_Definition_t xSDStats =
+{
+	"sd_stats", /* The command string to type. */
+	"\r\nsd_stats:\r\n Prints the statistics of the SD card transfers (count, errors, queue depth and timing of the reads, read-ahead hits and misses)\r\n",
+	prvSDStatsCommand, /* The function to run. */
+	0 /* No parameters are expected. */
+};
+
 ////////////////////////////////////////////////////////
 // Functions
 ////////////////////////////////////////////////////////
@@ -237,6 +251,7 @@ void vRegisterFATCLICommands( void ) {
     FreeRTOS_CLIRegisterCommand( &xCD );
     FreeRTOS_CLIRegisterCommand( &xTYPE );
     FreeRTOS_CLIRegisterCommand( &xPWD );
+    FreeRTOS_CLIRegisterCommand( &xSDStats );
 
 }
 
@@ -469,3 +484,15 @@ static BaseType_t prvPWDCommand( char *pcWriteBuffer, size_t xWriteBufferLen, co
 	ff_getcwd( pcWriteBuffer, xWriteBufferLen );
 	return pdFALSE;
 }
+
+static BaseType_t prvSDStatsCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString )
+{
+	/* Remove compile time warnings about unused parameters. */
+	( void ) pcCommandString;
+	( void ) xWriteBufferLen;
+
+	FF_SDDiskShowStats();
+	pcWriteBuffer[ 0 ] = 0x00;
+
+	return pdFALSE;
+}
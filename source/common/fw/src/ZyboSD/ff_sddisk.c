@@ -35,6 +35,7 @@
 #include "xil_types.h"
 #include "xsdps.h"		/* SD device driver */
 #include "xsdps_info.h"	/* SD info */
+#include "xil_cache.h"
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
@@ -50,6 +51,7 @@
 #if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
 	#include "xil_exception.h"
 	#include "xscugic_hw.h"
+	#include "xtime_l.h"
 #endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
 
 #include "uncached_memory.h"
@@ -82,9 +84,13 @@
 #define BYTES_PER_MB			( 1024ull * 1024ull )
 #define SECTORS_PER_MB			( BYTES_PER_MB / 512ull )
 
-#define XSDPS_INTR_NORMAL_ENABLE ( XSDPS_INTR_CC_MASK | XSDPS_INTR_TC_MASK | \
-	XSDPS_INTR_DMA_MASK | XSDPS_INTR_CARD_INSRT_MASK | XSDPS_INTR_CARD_REM_MASK | \
-	XSDPS_INTR_ERR_MASK )
+/* Only the end of a read is signalled. The interrupt signals are enabled
+while reads are queued, so the polled commands of the driver never race the
+interrupt handler for the status bits. */
+#define XSDPS_INTR_READ_ENABLE ( XSDPS_INTR_TC_MASK | XSDPS_INTR_ERR_MASK )
+
+/* L1/L2 cache line of the Cortex-A9 */
+#define sdCACHE_LINE_SIZE 32
 
 /* Based on the descriptor sizes inside  xsdps.c */
 #define XSDPS_MAX_NUM_OF_DESCRIPTORS 32
@@ -103,6 +109,39 @@
 /* Define a short timeout, used during card-detection only (CMD1): */
 #define sdQUICK_WAIT_INT_TIME_OUT_MS	1000UL
 
+/* Number of reads that can be queued on the controller. The interrupt
+handler starts the next one as soon as a transfer completes. */
+#ifndef sdREAD_QUEUE_DEPTH
+	#define sdREAD_QUEUE_DEPTH			4
+#endif
+
+/* Largest read sent with a single command. The queued reads have their own
+descriptor tables, so they are only limited by the 16-bit block count. The
+polled reads use the 32 descriptors of the Xilinx driver. */
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	#define sdMAX_READ_SECTORS			0xFFFFUL
+#else
+	#define sdMAX_READ_SECTORS			( ( XSDPS_DESC_MAX_LENGTH * XSDPS_MAX_NUM_OF_DESCRIPTORS ) / XSDPS_BLK_SIZE_512_MASK )
+#endif
+
+/* Descriptors of a queued read. Each one moves up to 64KB. */
+#define sdREAD_DESCRIPTORS			( ( ( sdMAX_READ_SECTORS * XSDPS_BLK_SIZE_512_MASK ) + XSDPS_DESC_MAX_LENGTH - 1 ) / XSDPS_DESC_MAX_LENGTH )
+
+/* Global timer counts per microsecond, for the read statistics. */
+#define sdCOUNTS_PER_US				( COUNTS_PER_SECOND / 1000000UL )
+
+/* Read-ahead of sequential reads. When a read of up to sdREADAHEAD_SECTORS
+follows the previous one, the sectors after it are prefetched into a ring of
+sdREADAHEAD_BLOCKS blocks, and the next reads are copied from there. Set the
+number of blocks to 0 to disable it. */
+#ifndef sdREADAHEAD_BLOCKS
+	#define sdREADAHEAD_BLOCKS			4
+#endif
+
+#ifndef sdREADAHEAD_SECTORS
+	#define sdREADAHEAD_SECTORS			8
+#endif
+
 /* XSdPs xSDCardInstance; */
 static XSdPs *pxSDCardInstance;
 
@@ -121,6 +160,57 @@ static int vSDMMC_Status( int iDriveNumber );
 	static void vInstallInterrupt( void );
 #endif
 
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* Read queued on the controller. The descriptor table of a request is
+	the one with the same index in pxCacheMem->xReadDescriptors. */
+	typedef struct xSD_READ_REQUEST
+	{
+		uint32_t ulArgument;	/* Sector (or byte) address sent with the command. */
+		uint32_t ulBlockCount;
+		XTime xQueuedTime;
+		XTime xStartTime;
+	} SDReadRequest_t;
+
+	static SDReadRequest_t xReadQueue[ sdREAD_QUEUE_DEPTH ];
+	static volatile uint32_t ulReadQueueHead = 0;		/* Request being transferred. */
+	static volatile uint32_t ulReadQueueCount = 0;		/* Queued requests, including the one being transferred. */
+	static volatile BaseType_t xReadQueueError = pdFALSE;	/* Set by the interrupt when a transfer fails. */
+	static uint32_t ulReadSubmitCount = 0;				/* Requests queued since the start. */
+	static volatile uint32_t ulReadDropCount = 0;		/* Times the queued requests were dropped after an error. */
+
+	static int32_t prvSubmitRead( uint32_t ulArgument, uint32_t ulBlockCount, uint8_t *pucBuffer );
+	static int32_t prvWaitReads( uint32_t ulMaxQueued );
+	static void prvStartReadFromISR( uint32_t ulIndex );
+	static void prvReadInterrupt( uint32_t ulStatusReg );
+
+	u32 XSdPs_FrameCmd( XSdPs *InstancePtr, u32 Cmd );
+#endif
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Sectors held by a read-ahead block. The data is in the block with the
+	same index in pxCacheMem->pucReadAheadMemory. */
+	typedef struct xSD_READAHEAD_BLOCK
+	{
+		uint32_t ulFirstSector;
+		uint32_t ulSectorCount;		/* 0 when the block is empty. */
+	#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+		uint32_t ulSequence;		/* ulReadSubmitCount once the read of the block was queued. */
+		uint32_t ulDropCount;		/* ulReadDropCount before the read was queued. */
+	#endif
+	} SDReadAheadBlock_t;
+
+	static SDReadAheadBlock_t xReadAhead[ sdREADAHEAD_BLOCKS ];
+	static uint32_t ulReadAheadNext = 0;			/* Block of the ring that is filled next. */
+	static uint32_t ulReadAheadEnd = 0;				/* Sector after the last prefetched one. */
+	static uint32_t ulReadAheadNextSector = 0;		/* Sector after the previous read. */
+
+	static BaseType_t prvReadAheadRead( uint8_t *pucBuffer, uint32_t ulSectorNumber, uint32_t ulSectorCount );
+	static BaseType_t prvReadAheadReady( uint32_t ulIndex );
+	static void prvReadAheadFill( uint32_t ulSectorNumber, FF_Disk_t *pxDisk );
+	static void prvReadAheadWait( void );
+	static void prvReadAheadDiscard( uint32_t ulSectorNumber, uint32_t ulSectorCount );
+#endif
+
 struct xCACHE_MEMORY_INFO
 {
 	/* Reserve 'uncached' memory for caching sectors, will be passed to the +FAT library. */
@@ -128,23 +218,24 @@ struct xCACHE_MEMORY_INFO
 	/* Reserve 'uncached' memory for i/o to the SD-card. */
 	uint8_t pucHelpMemory[ 0x40000 ];
 	XSdPs xSDCardInstance;
-};
-
-struct xCACHE_STATS
-{
-	uint32_t xMemcpyReadCount;
-	uint32_t xMemcpyWriteCount;
-	uint32_t xPassReadCount;
-	uint32_t xPassWriteCount;
-	uint32_t xFailReadCount;
-	uint32_t xFailWriteCount;
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* ADMA2 descriptor tables of the queued reads. They are rewritten in place
+	for each read and, being uncached, never need to be flushed. */
+	XSdPs_Adma2Descriptor xReadDescriptors[ sdREAD_QUEUE_DEPTH ][ sdREAD_DESCRIPTORS ] __attribute__ ((aligned(32)));
+#endif
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Prefetched sectors. Being uncached, they are copied without any cache
+	maintenance. */
+	uint8_t pucReadAheadMemory[ sdREADAHEAD_BLOCKS ][ sdREADAHEAD_SECTORS * 512 ] __attribute__ ((aligned(32)));
+#endif
 };
 
 struct xCACHE_STATS xCacheStats;
 struct xCACHE_MEMORY_INFO *pxCacheMem = NULL;
 
 static const uint8_t *prvStoreSDCardData( const uint8_t *pucBuffer, uint32_t ulByteCount );
-static uint8_t *prvReadSDCardData( uint8_t *pucBuffer, uint32_t ulByteCount );
+static int32_t prvReadSectors( uint32_t ulSectorNumber, uint32_t ulSectorCount, uint8_t *pucBuffer );
+static void prvInvalidateReadBuffer( uint8_t *pucBuffer, uint32_t ulByteCount );
 
 #if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
 	void XSdPs_IntrHandler(void *XSdPsPtr);
@@ -155,14 +246,11 @@ static int32_t prvFFRead( uint8_t *pucBuffer, uint32_t ulSectorNumber, uint32_t
 int32_t lReturnCode;
 int iResult;
 uint32_t ulPresentStatusReg;
-uint8_t *pucReadBuffer;
-uint32_t ulNumOfTransfers;
-uint32_t ulTransferNumber;
-uint32_t ulCurrSectorCount;
-uint32_t ulCurrSectorCount_bytes;
-uint32_t ulSectorsRead;
-uint32_t ulCurrSectorNumber;
-uint8_t *pucCurrBuffer;
+uint32_t ulFirstDirectSector;
+uint32_t ulDirectSectorCount;
+#if( sdREADAHEAD_BLOCKS != 0 )
+	BaseType_t xSequential = pdFALSE;
+#endif
 
 	if( ( pxDisk != NULL ) &&		/*_RB_ Could this be changed to an assert? */
 		( pxDisk->ulSignature == sdSIGNATURE ) &&
@@ -171,6 +259,33 @@ uint8_t *pucCurrBuffer;
 		( pxDisk->ulNumberOfSectors - ulSectorNumber ) >= ulSectorCount )
 	{
 		iResult = vSDMMC_Status( drive_nr );
+
+		#if( sdREADAHEAD_BLOCKS != 0 )
+		{
+			if( ( iResult & ( STA_NODISK | STA_NOINIT ) ) != 0 )
+			{
+				prvReadAheadDiscard( 0, 0xFFFFFFFFUL );
+			}
+			else if( ( ulSectorCount != 0ul ) && ( prvReadAheadRead( pucBuffer, ulSectorNumber, ulSectorCount ) != pdFALSE ) )
+			{
+				/* Copied from the prefetched blocks. Keep ahead of the stream. */
+				ulReadAheadNextSector = ulSectorNumber + ulSectorCount;
+				prvReadAheadFill( ulReadAheadNextSector, pxDisk );
+				lReturnCode = 0;
+				goto returnPath;
+			}
+			else
+			{
+				/* The controller is idle now: prvReadAheadRead() ended the prefetches.
+				Nothing is prefetched before the scheduler runs, as the reads are
+				polled then. */
+				xSequential = ( ulSectorNumber == ulReadAheadNextSector ) && ( ulSectorCount <= sdREADAHEAD_SECTORS ) &&
+					( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING );
+				ulReadAheadNextSector = ulSectorNumber + ulSectorCount;
+			}
+		}
+		#endif
+
 		ulPresentStatusReg = XSdPs_GetPresentStatusReg( XPAR_XSDPS_0_BASEADDR );
 		if( ( iResult & STA_NODISK ) != 0 )
 		{
@@ -182,6 +297,11 @@ uint8_t *pucCurrBuffer;
 			lReturnCode = FF_ERR_IOMAN_OUT_OF_BOUNDS_READ | FF_ERRFLAG;
 			FF_PRINTF( "prvFFRead: NOINIT\n\r" );
 		} 
+		else if( ulSectorCount == 0ul )
+		{
+			/* Nothing to read. The prefetches may still be using the data lines. */
+			lReturnCode = 0;
+		}
 		else if ( ulPresentStatusReg & XSDPS_PSR_INHIBIT_CMD_MASK ) {
 			lReturnCode = FF_ERRFLAG;
 			FF_PRINTF( "prvFFRead: XSDPS_PSR_INHIBIT_CMD_MASK\n\r" );
@@ -190,87 +310,64 @@ uint8_t *pucCurrBuffer;
 			lReturnCode = FF_ERRFLAG;
 			FF_PRINTF( "prvFFRead: XSDPS_PSR_INHIBIT_DAT_MASK\n\r" );
 		}
-		else if( ulSectorCount == 0ul )
-		{
-			lReturnCode = 0;
-		}
 		else
 		{
-			/* Calculate the maximum number of sectors that can be read given the maximum amount of descriptors    */
-			/* and the size of the transfer.                                                                       */
-			/* The maximum amount of descriptors was obtained by looking at the XSdPs_Setup32ADMA2DescTbl function */
-			/* inside the xsdps.c driver source code from Xilinx                                                   */
-			if ( (ulSectorCount*XSDPS_BLK_SIZE_512_MASK) < (XSDPS_DESC_MAX_LENGTH * XSDPS_MAX_NUM_OF_DESCRIPTORS) ) {
-				ulNumOfTransfers  = 1;
-				ulCurrSectorCount = ulSectorCount;
-			} else {
-				ulNumOfTransfers = (ulSectorCount*XSDPS_BLK_SIZE_512_MASK)/(XSDPS_DESC_MAX_LENGTH * XSDPS_MAX_NUM_OF_DESCRIPTORS); /* 32 == Max number of descriptors */
-				if ( (ulSectorCount*XSDPS_BLK_SIZE_512_MASK)%(XSDPS_DESC_MAX_LENGTH * XSDPS_MAX_NUM_OF_DESCRIPTORS) != 0 ) {
-					ulNumOfTransfers += 1;
-				}
-				ulCurrSectorCount = (XSDPS_DESC_MAX_LENGTH * XSDPS_MAX_NUM_OF_DESCRIPTORS)/XSDPS_BLK_SIZE_512_MASK;
-			}
-
-			ulCurrSectorNumber = ulSectorNumber;
-			pucCurrBuffer      = pucBuffer;
-			ulSectorsRead      = 0;
-			lReturnCode        = 0l;
-
-			for ( ulTransferNumber = 0; ulTransferNumber < ulNumOfTransfers; ulTransferNumber++ ) {
-  			/* Update for the next sector read */
-				ulCurrSectorNumber = ulSectorNumber + ulSectorsRead;
-
-				/* Convert LBA to byte address if needed */
-				if( pxSDCardInstance->HCS == 0 )
-				{
-					ulCurrSectorNumber *= XSDPS_BLK_SIZE_512_MASK;
-				}
-
-				/* Calculate the number of bytes */
-				ulCurrSectorCount_bytes = 512UL * ulCurrSectorCount;
-
-				/* Get the address of the current buffer */
-				pucReadBuffer = prvReadSDCardData( pucCurrBuffer, ulCurrSectorCount_bytes );
-
-				/* Update statistics */
-				if( ucIsCachedMemory( pucReadBuffer ) != pdFALSE )
+			lReturnCode         = 0l;
+			ulFirstDirectSector = 0;
+			ulDirectSectorCount = ulSectorCount;
+
+			/* The DMA writes straight into the buffer of the caller. When a cached
+			buffer is not aligned to the cache lines, its first and last lines are
+			shared with other data. The first and last sectors are then read into
+			the helper memory and copied, and the DMA only writes the sectors in
+			between. */
+			if( ( ucIsCachedMemory( pucBuffer ) != pdFALSE ) && ( ( ( UINTPTR ) pucBuffer & ( sdCACHE_LINE_SIZE - 1 ) ) != 0 ) )
+			{
+				iResult = prvReadSectors( ulSectorNumber, 1, pxCacheMem->pucHelpMemory );
+				if( iResult != XST_SUCCESS )
 				{
-					xCacheStats.xFailReadCount++;
+					lReturnCode = FF_ERRFLAG;
+					FF_PRINTF( "prvFFRead: SD read Failed\n\r" );
+					goto returnPath;
 				}
+				memcpy( pucBuffer, pxCacheMem->pucHelpMemory, 512UL );
+				xCacheStats.xMemcpyReadCount++;
 
-				/* Read the sectors and store them in the pucReadBuffer */
-				iResult       = XSdPs_ReadPolled( pxSDCardInstance, ulCurrSectorNumber, ulCurrSectorCount, pucReadBuffer );
-				ulSectorsRead += ulCurrSectorCount;
-
-				/* Update statistics */
-				if( pucCurrBuffer != pucReadBuffer )
+				if( ulSectorCount > 1 )
 				{
+					iResult = prvReadSectors( ulSectorNumber + ulSectorCount - 1, 1, pxCacheMem->pucHelpMemory );
+					if( iResult != XST_SUCCESS )
+					{
+						lReturnCode = FF_ERRFLAG;
+						FF_PRINTF( "prvFFRead: SD read Failed\n\r" );
+						goto returnPath;
+					}
+					memcpy( pucBuffer + ( 512UL * ( ulSectorCount - 1 ) ), pxCacheMem->pucHelpMemory, 512UL );
 					xCacheStats.xMemcpyReadCount++;
-					memcpy( pucCurrBuffer, pucReadBuffer, ulCurrSectorCount_bytes );
-				}
-				else
-				{
-					xCacheStats.xPassReadCount++;
 				}
 
-				/* Check if there was a read error */
+				ulFirstDirectSector = 1;
+				ulDirectSectorCount = ( ulSectorCount > 2 ) ? ( ulSectorCount - 2 ) : 0;
+			}
+
+			if( ulDirectSectorCount != 0 )
+			{
+				iResult = prvReadSectors( ulSectorNumber + ulFirstDirectSector, ulDirectSectorCount, pucBuffer + ( 512UL * ulFirstDirectSector ) );
 				if( iResult != XST_SUCCESS )
 				{
 					lReturnCode = FF_ERRFLAG;
-					FF_PRINTF( "prvFFRead: XSdPs_ReadPolled Failed\n\r" );
-					goto returnPath;
+					FF_PRINTF( "prvFFRead: SD read Failed\n\r" );
 				}
+			}
 
-				/* Update the buffer address */
-				pucCurrBuffer += ulCurrSectorCount_bytes;
-
-				/* Last sector. Check if the number of sectors left is lower than the default */
-				if ( ulTransferNumber == ulNumOfTransfers - 2 ) {
-					if (( ulSectorsRead + ulCurrSectorCount ) > ulSectorCount) {
-						ulCurrSectorCount = ulSectorCount - ulSectorsRead;
-					}
+			#if( sdREADAHEAD_BLOCKS != 0 )
+			{
+				if( ( lReturnCode == 0 ) && ( xSequential != pdFALSE ) )
+				{
+					prvReadAheadFill( ulSectorNumber + ulSectorCount, pxDisk );
 				}
 			}
+			#endif
 		}
 	}
 	else
@@ -291,6 +388,342 @@ returnPath:
 }
 /*-----------------------------------------------------------*/
 
+/* Read sectors with the DMA into pucBuffer, which must be cache-line aligned
+at both ends or not cached. The read is split in transfers of up to
+sdMAX_READ_SECTORS. A contiguous extent of a file is normally a single
+transfer. */
+static int32_t prvReadSectors( uint32_t ulSectorNumber, uint32_t ulSectorCount, uint8_t *pucBuffer )
+{
+int32_t lResult = XST_SUCCESS;
+uint32_t ulMaxTransferSectors = sdMAX_READ_SECTORS;
+uint32_t ulSectorsRead = 0;
+uint32_t ulCurrSectorCount;
+uint32_t ulCurrSectorNumber;
+BaseType_t xIsCached = ucIsCachedMemory( pucBuffer );
+
+	/* Drop the cache lines of the buffer before the DMA writes it, so no
+	dirty line can be evicted on top of the new data. */
+	if( xIsCached != pdFALSE )
+	{
+		xCacheStats.xFailReadCount++;
+		prvInvalidateReadBuffer( pucBuffer, 512UL * ulSectorCount );
+	}
+
+	while( ulSectorsRead < ulSectorCount )
+	{
+		ulCurrSectorCount = ulSectorCount - ulSectorsRead;
+		if( ulCurrSectorCount > ulMaxTransferSectors )
+		{
+			ulCurrSectorCount = ulMaxTransferSectors;
+		}
+
+		/* Convert LBA to byte address if needed */
+		ulCurrSectorNumber = ulSectorNumber + ulSectorsRead;
+		if( pxSDCardInstance->HCS == 0 )
+		{
+			ulCurrSectorNumber *= XSDPS_BLK_SIZE_512_MASK;
+		}
+
+		/* The transfers are queued back to back. They are all waited for below.
+		FF_SDDiskInit() mounts the disk before the scheduler is started: the
+		interrupts are masked and the task can't block, so it polls. */
+		#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+		{
+			if( xTaskGetSchedulerState() != taskSCHEDULER_RUNNING )
+			{
+				lResult = XSdPs_ReadPolled( pxSDCardInstance, ulCurrSectorNumber, ulCurrSectorCount, pucBuffer + ( 512UL * ulSectorsRead ) );
+			}
+			else
+			{
+				lResult = prvSubmitRead( ulCurrSectorNumber, ulCurrSectorCount, pucBuffer + ( 512UL * ulSectorsRead ) );
+			}
+		}
+		#else
+		{
+			lResult = XSdPs_ReadPolled( pxSDCardInstance, ulCurrSectorNumber, ulCurrSectorCount, pucBuffer + ( 512UL * ulSectorsRead ) );
+		}
+		#endif
+
+		if( lResult != XST_SUCCESS )
+		{
+			break;
+		}
+
+		xCacheStats.xPassReadCount++;
+		ulSectorsRead += ulCurrSectorCount;
+	}
+
+	#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	{
+		/* Never return with reads queued on the buffer */
+		if( prvWaitReads( 0 ) != XST_SUCCESS )
+		{
+			lResult = XST_FAILURE;
+		}
+	}
+	#endif
+
+	/* The CPU may have loaded lines of the buffer speculatively while the DMA
+	was writing it. */
+	if( xIsCached != pdFALSE )
+	{
+		prvInvalidateReadBuffer( pucBuffer, 512UL * ulSectorCount );
+	}
+
+	return lResult;
+}
+/*-----------------------------------------------------------*/
+
+/* Invalidate the cache lines of a DMA destination. A line the buffer only
+partly covers is flushed instead, so the data around the buffer is kept. Such
+a line is clean after the DMA, so flushing it again only invalidates it. */
+static void prvInvalidateReadBuffer( uint8_t *pucBuffer, uint32_t ulByteCount )
+{
+UINTPTR xStart = ( UINTPTR ) pucBuffer;
+UINTPTR xEnd = xStart + ulByteCount;
+UINTPTR xAlignedStart = ( xStart + ( sdCACHE_LINE_SIZE - 1 ) ) & ~( ( UINTPTR ) sdCACHE_LINE_SIZE - 1 );
+UINTPTR xAlignedEnd = xEnd & ~( ( UINTPTR ) sdCACHE_LINE_SIZE - 1 );
+
+	if( xAlignedStart >= xAlignedEnd )
+	{
+		Xil_DCacheFlushRange( ( INTPTR ) xStart, ulByteCount );
+		return;
+	}
+
+	if( xStart != xAlignedStart )
+	{
+		Xil_DCacheFlushRange( ( INTPTR ) xStart, xAlignedStart - xStart );
+	}
+	if( xEnd != xAlignedEnd )
+	{
+		Xil_DCacheFlushRange( ( INTPTR ) xAlignedEnd, xEnd - xAlignedEnd );
+	}
+	Xil_DCacheInvalidateRange( ( INTPTR ) xAlignedStart, xAlignedEnd - xAlignedStart );
+}
+/*-----------------------------------------------------------*/
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Copy the sectors from the read-ahead blocks, waiting for a block that is
+	still being read. Returns pdFALSE if a sector is not held by a block; the
+	prefetches have then ended, so the controller is idle. */
+	static BaseType_t prvReadAheadRead( uint8_t *pucBuffer, uint32_t ulSectorNumber, uint32_t ulSectorCount )
+	{
+	SDReadAheadBlock_t *pxBlock = NULL;
+	BaseType_t xHit = pdTRUE;
+	uint32_t ulIndex = 0;
+	uint32_t ulOffset;
+	uint32_t ulCount;
+
+		/* The larger reads go straight to the card. */
+		if( ulSectorCount > sdREADAHEAD_SECTORS )
+		{
+			prvReadAheadWait();
+			return pdFALSE;
+		}
+
+		while( ( ulSectorCount != 0 ) && ( xHit != pdFALSE ) )
+		{
+			xHit = pdFALSE;
+			for( ulIndex = 0; ulIndex < sdREADAHEAD_BLOCKS; ulIndex++ )
+			{
+				pxBlock = &( xReadAhead[ ulIndex ] );
+				if( ( pxBlock->ulSectorCount != 0 ) &&
+					( ulSectorNumber >= pxBlock->ulFirstSector ) &&
+					( ( ulSectorNumber - pxBlock->ulFirstSector ) < pxBlock->ulSectorCount ) )
+				{
+					xHit = prvReadAheadReady( ulIndex );
+					break;
+				}
+			}
+
+			if( xHit != pdFALSE )
+			{
+				/* A read may continue in the next block. */
+				ulOffset = ulSectorNumber - pxBlock->ulFirstSector;
+				ulCount = pxBlock->ulSectorCount - ulOffset;
+				if( ulCount > ulSectorCount )
+				{
+					ulCount = ulSectorCount;
+				}
+				memcpy( pucBuffer, pxCacheMem->pucReadAheadMemory[ ulIndex ] + ( 512UL * ulOffset ), 512UL * ulCount );
+				pucBuffer += 512UL * ulCount;
+				ulSectorNumber += ulCount;
+				ulSectorCount -= ulCount;
+			}
+		}
+
+		if( xHit != pdFALSE )
+		{
+			xCacheStats.ulReadAheadHitCount++;
+		}
+		else
+		{
+			xCacheStats.ulReadAheadMissCount++;
+			prvReadAheadWait();
+		}
+
+		return xHit;
+	}
+#endif /* sdREADAHEAD_BLOCKS */
+/*-----------------------------------------------------------*/
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Wait for the read of a block. Returns pdFALSE if it failed, after all
+	the blocks have been emptied. */
+	static BaseType_t prvReadAheadReady( uint32_t ulIndex )
+	{
+	#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+		SDReadAheadBlock_t *pxBlock = &( xReadAhead[ ulIndex ] );
+		/* The queue is in order: the block is read when no more than the
+		requests queued after it are left. */
+		uint32_t ulQueuedAfter = ulReadSubmitCount - pxBlock->ulSequence;
+
+		if( ulReadQueueCount > ulQueuedAfter )
+		{
+			xCacheStats.ulReadAheadWaitCount++;
+		}
+
+		/* A request dropped after an error looks completed too. */
+		if( ( prvWaitReads( ulQueuedAfter ) != XST_SUCCESS ) ||
+			( pxBlock->ulDropCount != ulReadDropCount ) )
+		{
+			prvReadAheadDiscard( 0, 0xFFFFFFFFUL );
+			return pdFALSE;
+		}
+	#else
+		( void ) ulIndex;
+	#endif
+
+		return pdTRUE;
+	}
+#endif /* sdREADAHEAD_BLOCKS */
+/*-----------------------------------------------------------*/
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Prefetch the sectors that follow a sequential read, which ended before
+	ulSectorNumber. The blocks the stream has gone past are filled again. The
+	reads are queued and not waited for. Without the interrupt, a single
+	block is read each time. */
+	static void prvReadAheadFill( uint32_t ulSectorNumber, FF_Disk_t *pxDisk )
+	{
+	SDReadAheadBlock_t *pxBlock;
+	uint32_t ulCount;
+	uint32_t ulArgument;
+
+		/* A new stream, or one that left the prefetched sectors. */
+		if( ( ulReadAheadEnd < ulSectorNumber ) ||
+			( ( ulReadAheadEnd - ulSectorNumber ) > ( sdREADAHEAD_BLOCKS * sdREADAHEAD_SECTORS ) ) )
+		{
+			ulReadAheadEnd = ulSectorNumber;
+		}
+
+		while( ulReadAheadEnd < pxDisk->ulNumberOfSectors )
+		{
+			pxBlock = &( xReadAhead[ ulReadAheadNext ] );
+
+			/* The oldest block still holds sectors the stream will read. */
+			if( ( pxBlock->ulSectorCount != 0 ) &&
+				( ( pxBlock->ulFirstSector + pxBlock->ulSectorCount ) > ulSectorNumber ) &&
+				( pxBlock->ulFirstSector < ulReadAheadEnd ) )
+			{
+				break;
+			}
+
+			ulCount = pxDisk->ulNumberOfSectors - ulReadAheadEnd;
+			if( ulCount > sdREADAHEAD_SECTORS )
+			{
+				ulCount = sdREADAHEAD_SECTORS;
+			}
+
+			/* Convert LBA to byte address if needed */
+			ulArgument = ulReadAheadEnd;
+			if( pxSDCardInstance->HCS == 0 )
+			{
+				ulArgument *= XSDPS_BLK_SIZE_512_MASK;
+			}
+
+			pxBlock->ulSectorCount = 0;
+
+			#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+			{
+				pxBlock->ulDropCount = ulReadDropCount;
+				if( prvSubmitRead( ulArgument, ulCount, pxCacheMem->pucReadAheadMemory[ ulReadAheadNext ] ) != XST_SUCCESS )
+				{
+					break;
+				}
+				pxBlock->ulSequence = ulReadSubmitCount;
+			}
+			#else
+			{
+				if( XSdPs_ReadPolled( pxSDCardInstance, ulArgument, ulCount, pxCacheMem->pucReadAheadMemory[ ulReadAheadNext ] ) != XST_SUCCESS )
+				{
+					break;
+				}
+			}
+			#endif
+
+			pxBlock->ulFirstSector = ulReadAheadEnd;
+			pxBlock->ulSectorCount = ulCount;
+			ulReadAheadEnd += ulCount;
+			ulReadAheadNext = ( ulReadAheadNext + 1 ) % sdREADAHEAD_BLOCKS;
+			xCacheStats.ulReadAheadFillCount++;
+
+			#if( ffconfigSDIO_DRIVER_USES_INTERRUPT == 0 )
+			{
+				break;
+			}
+			#endif
+		}
+	}
+#endif /* sdREADAHEAD_BLOCKS */
+/*-----------------------------------------------------------*/
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* End the prefetches that are still queued, before a command that is not
+	queued. The blocks are emptied if one failed. */
+	static void prvReadAheadWait( void )
+	{
+		#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+		{
+			if( prvWaitReads( 0 ) != XST_SUCCESS )
+			{
+				prvReadAheadDiscard( 0, 0xFFFFFFFFUL );
+			}
+		}
+		#endif
+	}
+#endif /* sdREADAHEAD_BLOCKS */
+/*-----------------------------------------------------------*/
+
+#if( sdREADAHEAD_BLOCKS != 0 )
+	/* Empty the blocks that hold any of the sectors. */
+	static void prvReadAheadDiscard( uint32_t ulSectorNumber, uint32_t ulSectorCount )
+	{
+	SDReadAheadBlock_t *pxBlock;
+	uint32_t ulIndex;
+	BaseType_t xOverlaps;
+
+		for( ulIndex = 0; ulIndex < sdREADAHEAD_BLOCKS; ulIndex++ )
+		{
+			pxBlock = &( xReadAhead[ ulIndex ] );
+			if( pxBlock->ulFirstSector < ulSectorNumber )
+			{
+				xOverlaps = ( ( pxBlock->ulFirstSector + pxBlock->ulSectorCount ) > ulSectorNumber );
+			}
+			else
+			{
+				xOverlaps = ( ( pxBlock->ulFirstSector - ulSectorNumber ) < ulSectorCount );
+			}
+
+			if( xOverlaps != pdFALSE )
+			{
+				pxBlock->ulSectorCount = 0;
+			}
+		}
+	}
+#endif /* sdREADAHEAD_BLOCKS */
+/*-----------------------------------------------------------*/
+
 static int32_t prvFFWrite( uint8_t *pucBuffer, uint32_t ulSectorNumber, uint32_t ulSectorCount, FF_Disk_t *pxDisk )
 {
 int32_t lReturnCode;
@@ -322,6 +755,15 @@ int32_t lReturnCode;
 			}
 			else
 			{
+				#if( sdREADAHEAD_BLOCKS != 0 )
+				{
+					/* The write is a polled command, so the prefetches must have
+					ended. The blocks must not keep the old data. */
+					prvReadAheadWait();
+					prvReadAheadDiscard( ulSectorNumber, ulSectorCount );
+				}
+				#endif
+
 				/* Convert LBA to byte address if needed */
 				if (!(pxSDCardInstance->HCS)) ulSectorNumber *= XSDPS_BLK_SIZE_512_MASK;
 
@@ -392,23 +834,6 @@ const uint8_t *pucReturn;
 }
 /*-----------------------------------------------------------*/
 
-static uint8_t *prvReadSDCardData( uint8_t *pucBuffer, uint32_t ulByteCount )
-{
-uint8_t *pucReturn;
-
-	if( ( ucIsCachedMemory( pucBuffer ) != pdFALSE ) && ( ulByteCount <= sizeof( pxCacheMem->pucHelpMemory ) ) )
-	{
-		pucReturn = pxCacheMem->pucHelpMemory;
-	}
-	else
-	{
-		pucReturn = pucBuffer;
-	}
-
-	return pucReturn;
-}
-/*-----------------------------------------------------------*/
-
 static struct xCACHE_MEMORY_INFO *pucGetSDIOCacheMemory( )
 {
 	if( pxCacheMem == NULL )
@@ -723,6 +1148,45 @@ BaseType_t xReturn = pdPASS;
 }
 /*-----------------------------------------------------------*/
 
+/* Print the statistics of the SD-card transfers */
+void FF_SDDiskShowStats( void )
+{
+	FF_PRINTF( "Reads  : %lu DMA transfers, %lu sectors through the helper memory, %lu reads to cached memory\n\r",
+		xCacheStats.xPassReadCount, xCacheStats.xMemcpyReadCount, xCacheStats.xFailReadCount );
+	FF_PRINTF( "Writes : %lu direct, %lu through the helper memory, %lu from cached memory\n\r",
+		xCacheStats.xPassWriteCount, xCacheStats.xMemcpyWriteCount, xCacheStats.xFailWriteCount );
+
+	#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	{
+		/* It is better not to use the 64-bit format such as %Lu because it
+		might not be implemented. */
+		FF_PRINTF( "Read transfers   %8lu (%lu KB)\n\r", xCacheStats.ulReadCount, ( uint32_t ) ( xCacheStats.ullReadBytes / 1024ull ) );
+		FF_PRINTF( "Errors/Time-outs %8lu / %lu\n\r", xCacheStats.ulReadErrorCount, xCacheStats.ulReadTimeoutCount );
+		FF_PRINTF( "Max queued       %8lu (depth %d)\n\r", xCacheStats.ulReadMaxQueued, sdREAD_QUEUE_DEPTH );
+		if( xCacheStats.ulReadCount != 0 )
+		{
+			FF_PRINTF( "Transfer time    %8lu us avg, %lu us min, %lu us max\n\r",
+				( uint32_t ) ( xCacheStats.ullReadTimeTotalUs / xCacheStats.ulReadCount ),
+				xCacheStats.ulReadTimeMinUs, xCacheStats.ulReadTimeMaxUs );
+			FF_PRINTF( "Queued time      %8lu us max\n\r", xCacheStats.ulReadQueuedTimeMaxUs );
+			if( xCacheStats.ullReadTimeTotalUs != 0 )
+			{
+				FF_PRINTF( "Throughput       %8lu KB/s\n\r", ( uint32_t ) ( ( xCacheStats.ullReadBytes * 1000000ull ) / ( xCacheStats.ullReadTimeTotalUs * 1024ull ) ) );
+			}
+		}
+	}
+	#endif
+
+	#if( sdREADAHEAD_BLOCKS != 0 )
+	{
+		FF_PRINTF( "Read-ahead hits  %8lu (%lu waited for the prefetch)\n\r", xCacheStats.ulReadAheadHitCount, xCacheStats.ulReadAheadWaitCount );
+		FF_PRINTF( "Read-ahead miss  %8lu\n\r", xCacheStats.ulReadAheadMissCount );
+		FF_PRINTF( "Prefetched       %8lu blocks of %d sectors (%d blocks)\n\r", xCacheStats.ulReadAheadFillCount, sdREADAHEAD_SECTORS, sdREADAHEAD_BLOCKS );
+	}
+	#endif
+}
+/*-----------------------------------------------------------*/
+
 #if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
 	static void vInstallInterrupt( void )
 	{
@@ -734,10 +1198,10 @@ BaseType_t xReturn = pdPASS;
 		/* Enable this interrupt. */
 		XScuGic_EnableIntr( INTC_DIST_BASE_ADDR, SCUGIC_SDIO_0_INTR );
 
-		/* Choose the signals. */
+		/* No signals until a read is queued (see prvStartReadFromISR). */
 		XSdPs_WriteReg16(pxSDCardInstance->Config.BaseAddress,
 				XSDPS_NORM_INTR_SIG_EN_OFFSET,
-				XSDPS_INTR_NORMAL_ENABLE );
+				0x0 );
 		XSdPs_WriteReg16(pxSDCardInstance->Config.BaseAddress,
 				XSDPS_ERR_INTR_SIG_EN_OFFSET,
 				0x0 );
@@ -745,6 +1209,283 @@ BaseType_t xReturn = pdPASS;
 #endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
 /*-----------------------------------------------------------*/
 
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* Queue a read of ulBlockCount sectors. The read is started at once when
+	the controller is idle, otherwise by the interrupt that ends the previous
+	one. Blocks while the queue is full. prvFFRead() is protected by the +FAT
+	mutex, so there is a single task adding requests. */
+	static int32_t prvSubmitRead( uint32_t ulArgument, uint32_t ulBlockCount, uint8_t *pucBuffer )
+	{
+	XSdPs_Adma2Descriptor *pxDescriptors;
+	uint32_t ulByteCount = ulBlockCount * XSDPS_BLK_SIZE_512_MASK;
+	uint32_t ulIndex;
+	uint32_t ulDescriptor;
+	uint32_t ulLength;
+
+		/* Wait for a free entry. */
+		if( prvWaitReads( sdREAD_QUEUE_DEPTH - 1 ) != XST_SUCCESS )
+		{
+			return XST_FAILURE;
+		}
+
+		/* The queued reads don't set the block size, so it is done here
+		while the controller is idle. Only this task adds requests, so the
+		queue can't be filled in the meantime. */
+		if( ( ulReadQueueCount == 0 ) &&
+			( ( XSdPs_ReadReg16( pxSDCardInstance->Config.BaseAddress, XSDPS_BLK_SIZE_OFFSET ) & XSDPS_BLK_SIZE_MASK ) != XSDPS_BLK_SIZE_512_MASK ) )
+		{
+			if( XSdPs_SetBlkSize( pxSDCardInstance, XSDPS_BLK_SIZE_512_MASK ) != XST_SUCCESS )
+			{
+				FF_PRINTF( "prvSubmitRead: XSdPs_SetBlkSize Failed\n\r" );
+				return XST_FAILURE;
+			}
+		}
+
+		/* The interrupt moves the head and the count together, so the
+		free entry after the last request doesn't change. */
+		taskENTER_CRITICAL();
+		{
+			ulIndex = ( ulReadQueueHead + ulReadQueueCount ) % sdREAD_QUEUE_DEPTH;
+		}
+		taskEXIT_CRITICAL();
+
+		/* Setup ADMA2 in the same way as XSdPs_SetupADMA2DescTbl(). The
+		tables are in uncached memory, so they don't have to be flushed. */
+		pxDescriptors = pxCacheMem->xReadDescriptors[ ulIndex ];
+		for( ulDescriptor = 0; ( ulDescriptor * XSDPS_DESC_MAX_LENGTH ) < ulByteCount; ulDescriptor++ )
+		{
+			ulLength = ulByteCount - ( ulDescriptor * XSDPS_DESC_MAX_LENGTH );
+			if( ulLength > XSDPS_DESC_MAX_LENGTH )
+			{
+				ulLength = XSDPS_DESC_MAX_LENGTH;
+			}
+			pxDescriptors[ ulDescriptor ].Address = ( u32 ) ( ( UINTPTR ) pucBuffer + ( ulDescriptor * XSDPS_DESC_MAX_LENGTH ) );
+			pxDescriptors[ ulDescriptor ].Attribute = XSDPS_DESC_TRAN | XSDPS_DESC_VALID;
+			/* A length of 0 means 65536 bytes. */
+			pxDescriptors[ ulDescriptor ].Length = ( u16 ) ulLength;
+		}
+		pxDescriptors[ ulDescriptor - 1 ].Attribute |= XSDPS_DESC_END;
+
+		xReadQueue[ ulIndex ].ulArgument = ulArgument;
+		xReadQueue[ ulIndex ].ulBlockCount = ulBlockCount;
+		XTime_GetTime( &( xReadQueue[ ulIndex ].xQueuedTime ) );
+
+		taskENTER_CRITICAL();
+		{
+			if( xReadQueueError == pdFALSE )
+			{
+				ulReadSubmitCount++;
+				ulReadQueueCount++;
+				if( ulReadQueueCount > xCacheStats.ulReadMaxQueued )
+				{
+					xCacheStats.ulReadMaxQueued = ulReadQueueCount;
+				}
+				if( ulReadQueueCount == 1 )
+				{
+					prvStartReadFromISR( ulIndex );
+				}
+			}
+		}
+		taskEXIT_CRITICAL();
+
+		/* A transfer failed while the request was prepared. */
+		if( xReadQueueError != pdFALSE )
+		{
+			return prvWaitReads( 0 );
+		}
+
+		return XST_SUCCESS;
+	}
+#endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
+/*-----------------------------------------------------------*/
+
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* Block until no more than ulMaxQueued reads are queued. The task sleeps
+	on the SD semaphore, which is given by the interrupt that ends each
+	transfer. The time-out is restarted each time a transfer ends, so it
+	applies to every transfer and not to the whole queue. Returns XST_FAILURE
+	if a transfer failed or timed out, after the controller has been made
+	ready for the next command. */
+	static int32_t prvWaitReads( uint32_t ulMaxQueued )
+	{
+	u32 ulBaseAddress = pxSDCardInstance->Config.BaseAddress;
+	TickType_t xRemainingTime = pdMS_TO_TICKS( sdWAIT_INT_TIME_OUT_MS );
+	TimeOut_t xTimeOut;
+	uint32_t ulLastCount = ulReadQueueCount;
+
+		vTaskSetTimeOutState( &xTimeOut );
+		while( ulReadQueueCount > ulMaxQueued )
+		{
+			xSemaphoreTake( xSDSemaphores[ 0 ], xRemainingTime );
+
+			if( ulReadQueueCount < ulLastCount )
+			{
+				/* A transfer ended, the next one gets a full time-out. */
+				ulLastCount = ulReadQueueCount;
+				xRemainingTime = pdMS_TO_TICKS( sdWAIT_INT_TIME_OUT_MS );
+				vTaskSetTimeOutState( &xTimeOut );
+			}
+			else if( ( ulReadQueueCount > ulMaxQueued ) &&
+				( xTaskCheckForTimeOut( &xTimeOut, &xRemainingTime ) != pdFALSE ) )
+			{
+				/* The transfer never ended. Drop the queued reads. */
+				taskENTER_CRITICAL();
+				{
+					XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_SIG_EN_OFFSET, 0x0 );
+					XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_SIG_EN_OFFSET, 0x0 );
+					ulReadQueueHead = ( ulReadQueueHead + ulReadQueueCount ) % sdREAD_QUEUE_DEPTH;
+					ulReadQueueCount = 0;
+					ulReadDropCount++;
+					xReadQueueError = pdTRUE;
+				}
+				taskEXIT_CRITICAL();
+
+				xCacheStats.ulReadTimeoutCount++;
+				FF_PRINTF( "prvWaitReads: time-out after %lu ms\n\r", sdWAIT_INT_TIME_OUT_MS );
+			}
+		}
+
+		if( xReadQueueError == pdFALSE )
+		{
+			return XST_SUCCESS;
+		}
+
+		/* Reset the command and data lines, otherwise the inhibit bits could
+		stay set and block the next command. */
+		XSdPs_WriteReg8( ulBaseAddress, XSDPS_SW_RST_OFFSET, XSDPS_SWRST_CMD_LINE_MASK | XSDPS_SWRST_DAT_LINE_MASK );
+		xRemainingTime = pdMS_TO_TICKS( sdQUICK_WAIT_INT_TIME_OUT_MS );
+		vTaskSetTimeOutState( &xTimeOut );
+		while( ( ( XSdPs_ReadReg8( ulBaseAddress, XSDPS_SW_RST_OFFSET ) & ( XSDPS_SWRST_CMD_LINE_MASK | XSDPS_SWRST_DAT_LINE_MASK ) ) != 0 ) &&
+			   ( xTaskCheckForTimeOut( &xTimeOut, &xRemainingTime ) == pdFALSE ) )
+		{
+			vTaskDelay( 1 );
+		}
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_STS_OFFSET, XSDPS_NORM_INTR_ALL_MASK );
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_STS_OFFSET, XSDPS_ERROR_INTR_ALL_MASK );
+
+		xReadQueueError = pdFALSE;
+
+		return XST_FAILURE;
+	}
+#endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
+/*-----------------------------------------------------------*/
+
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* Send the read command of a queued request, in the same way as
+	XSdPs_ReadPolled() and XSdPs_CmdTransfer(). The completion is signalled by
+	the Transfer Complete interrupt. Called from the interrupt or from a
+	critical section. */
+	static void prvStartReadFromISR( uint32_t ulIndex )
+	{
+	SDReadRequest_t *pxRequest = &( xReadQueue[ ulIndex ] );
+	u32 ulBaseAddress = pxSDCardInstance->Config.BaseAddress;
+	u32 ulTransferMode;
+	u32 ulCommand;
+
+		XTime_GetTime( &( pxRequest->xStartTime ) );
+
+		XSdPs_WriteReg( ulBaseAddress, XSDPS_ADMA_SAR_OFFSET, ( u32 ) ( UINTPTR ) pxCacheMem->xReadDescriptors[ ulIndex ] );
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_BLK_CNT_OFFSET, ( u16 ) pxRequest->ulBlockCount );
+		XSdPs_WriteReg8( ulBaseAddress, XSDPS_TIMEOUT_CTRL_OFFSET, 0xEU );
+		XSdPs_WriteReg( ulBaseAddress, XSDPS_ARGMT_OFFSET, pxRequest->ulArgument );
+
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_STS_OFFSET, XSDPS_NORM_INTR_ALL_MASK );
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_STS_OFFSET, XSDPS_ERROR_INTR_ALL_MASK );
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_SIG_EN_OFFSET, XSDPS_INTR_READ_ENABLE );
+		XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_SIG_EN_OFFSET, XSDPS_ERROR_INTR_ALL_MASK );
+
+		if( pxRequest->ulBlockCount == 1U )
+		{
+			ulTransferMode = XSDPS_TM_BLK_CNT_EN_MASK | XSDPS_TM_DAT_DIR_SEL_MASK | XSDPS_TM_DMA_EN_MASK;
+			ulCommand = XSdPs_FrameCmd( pxSDCardInstance, CMD17 );
+		}
+		else
+		{
+			ulTransferMode = XSDPS_TM_AUTO_CMD12_EN_MASK | XSDPS_TM_BLK_CNT_EN_MASK | XSDPS_TM_DAT_DIR_SEL_MASK |
+				XSDPS_TM_DMA_EN_MASK | XSDPS_TM_MUL_SIN_BLK_SEL_MASK;
+			ulCommand = XSdPs_FrameCmd( pxSDCardInstance, CMD18 );
+		}
+
+		/* Mask to avoid writing to reserved bits 31-30 (see XSdPs_CmdTransfer). */
+		XSdPs_WriteReg( ulBaseAddress, XSDPS_XFER_MODE_OFFSET, ( ( ulCommand & 0x3FFFU ) << 16 ) | ulTransferMode );
+	}
+#endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
+/*-----------------------------------------------------------*/
+
+#if( ffconfigSDIO_DRIVER_USES_INTERRUPT != 0 )
+	/* Called by the interrupt handler. Ends the read being transferred and
+	starts the next one. An error drops all the queued reads; the task that
+	waits for them resets the controller. */
+	static void prvReadInterrupt( uint32_t ulStatusReg )
+	{
+	SDReadRequest_t *pxRequest;
+	u32 ulBaseAddress = pxSDCardInstance->Config.BaseAddress;
+	XTime xNow;
+	uint32_t ulTransferTimeUs;
+	uint32_t ulQueuedTimeUs;
+
+		if( ulReadQueueCount == 0 )
+		{
+			return;
+		}
+
+		if( ( ulStatusReg & XSDPS_INTR_ERR_MASK ) != 0 )
+		{
+			XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_SIG_EN_OFFSET, 0x0 );
+			XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_SIG_EN_OFFSET, 0x0 );
+			ulReadQueueHead = ( ulReadQueueHead + ulReadQueueCount ) % sdREAD_QUEUE_DEPTH;
+			ulReadQueueCount = 0;
+			ulReadDropCount++;
+			xReadQueueError = pdTRUE;
+			xCacheStats.ulReadErrorCount++;
+			return;
+		}
+
+		if( ( ulStatusReg & XSDPS_INTR_TC_MASK ) == 0 )
+		{
+			return;
+		}
+
+		/* Timing of the request */
+		pxRequest = &( xReadQueue[ ulReadQueueHead ] );
+		XTime_GetTime( &xNow );
+		ulTransferTimeUs = ( uint32_t ) ( ( xNow - pxRequest->xStartTime ) / sdCOUNTS_PER_US );
+		ulQueuedTimeUs = ( uint32_t ) ( ( pxRequest->xStartTime - pxRequest->xQueuedTime ) / sdCOUNTS_PER_US );
+
+		if( ( xCacheStats.ulReadCount == 0 ) || ( ulTransferTimeUs < xCacheStats.ulReadTimeMinUs ) )
+		{
+			xCacheStats.ulReadTimeMinUs = ulTransferTimeUs;
+		}
+		if( ulTransferTimeUs > xCacheStats.ulReadTimeMaxUs )
+		{
+			xCacheStats.ulReadTimeMaxUs = ulTransferTimeUs;
+		}
+		if( ulQueuedTimeUs > xCacheStats.ulReadQueuedTimeMaxUs )
+		{
+			xCacheStats.ulReadQueuedTimeMaxUs = ulQueuedTimeUs;
+		}
+		xCacheStats.ullReadTimeTotalUs += ulTransferTimeUs;
+		xCacheStats.ullReadBytes += pxRequest->ulBlockCount * XSDPS_BLK_SIZE_512_MASK;
+		xCacheStats.ulReadCount++;
+
+		/* Next request */
+		ulReadQueueHead = ( ulReadQueueHead + 1 ) % sdREAD_QUEUE_DEPTH;
+		ulReadQueueCount--;
+
+		if( ulReadQueueCount != 0 )
+		{
+			prvStartReadFromISR( ulReadQueueHead );
+		}
+		else
+		{
+			/* Back to the polled commands */
+			XSdPs_WriteReg16( ulBaseAddress, XSDPS_NORM_INTR_SIG_EN_OFFSET, 0x0 );
+			XSdPs_WriteReg16( ulBaseAddress, XSDPS_ERR_INTR_SIG_EN_OFFSET, 0x0 );
+		}
+	}
+#endif /* ffconfigSDIO_DRIVER_USES_INTERRUPT */
+/*-----------------------------------------------------------*/
+
 static int vSDMMC_Init( int iDriveNumber, FF_Disk_t *pxDisk )
 {
 int iReturnCode, iStatus;
@@ -754,6 +1495,15 @@ XSdPs_Config *SdConfig;
 	using plain int type. */
 
 
+	#if( sdREADAHEAD_BLOCKS != 0 )
+	{
+		/* The card is initialised with polled commands. The card may also have
+		been replaced. */
+		prvReadAheadWait();
+		prvReadAheadDiscard( 0, 0xFFFFFFFFUL );
+	}
+	#endif
+
 	/* Open a do {} while(0) loop to allow the use of break. */
 	do
 	{
@@ -884,6 +1634,10 @@ volatile unsigned sd_int_count = 0;
 		{
 			/* Could wake-up another task. */
 		}
+
+		/* End the queued read and start the next one */
+		prvReadInterrupt( ulStatusReg );
+
 		if( xSDSemaphores[ iIndex ] != NULL )
 		{
 		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
@@ -63,6 +63,36 @@ extern "C" {
 
 #include "ff_headers.h"
 
+/* Statistics of the SD-card transfers */
+struct xCACHE_STATS
+{
+	uint32_t xMemcpyReadCount;
+	uint32_t xMemcpyWriteCount;
+	uint32_t xPassReadCount;
+	uint32_t xPassWriteCount;
+	uint32_t xFailReadCount;
+	uint32_t xFailWriteCount;
+
+	/* Reads completed by the interrupt (ffconfigSDIO_DRIVER_USES_INTERRUPT) */
+	uint32_t ulReadCount;
+	uint32_t ulReadErrorCount;
+	uint32_t ulReadTimeoutCount;
+	uint32_t ulReadMaxQueued;			/* Most reads queued at the same time */
+	uint32_t ulReadTimeMinUs;			/* Time from the command to the end of the transfer */
+	uint32_t ulReadTimeMaxUs;
+	uint32_t ulReadQueuedTimeMaxUs;		/* Time a read waited for the previous ones */
+	uint64_t ullReadTimeTotalUs;
+	uint64_t ullReadBytes;
+
+	/* Read-ahead of sequential reads */
+	uint32_t ulReadAheadHitCount;		/* Reads copied from the prefetched blocks */
+	uint32_t ulReadAheadMissCount;		/* Reads of up to a block that went to the card */
+	uint32_t ulReadAheadWaitCount;		/* Hits that waited for the prefetch to end */
+	uint32_t ulReadAheadFillCount;		/* Blocks prefetched */
+};
+
+extern struct xCACHE_STATS xCacheStats;
+
 
 /* Return non-zero if the SD-card is present.
 The parameter 'pxDisk' may be null, unless device locking is necessary. */
@@ -91,6 +121,9 @@ void FF_SDDiskFlush( FF_Disk_t *pDisk );
 /* Format a given partition on an SD-card. */
 BaseType_t FF_SDDiskFormat( FF_Disk_t *pxDisk, BaseType_t aPart );
 
+/* Print the statistics of the SD-card transfers */
+void FF_SDDiskShowStats( void );
+
 /* Return non-zero if an SD-card is detected in a given slot. */
 BaseType_t FF_SDDiskInserted( BaseType_t xDriveNr );
 
@@ -142,6 +142,7 @@ void prv_vSystemInit( void ) {
     xil_printf("Done!\n\r");    
 
     vSamplerDMAInit();
+    vSamplerEngineInit();
 
     xil_printf("Done!\n\r");
     xil_printf("==========================\n\r");
@@ -0,0 +1,55 @@
+
+// C includes
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Xilinx includes
+#include "xil_printf.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS_CLI.h"
+
+// Sampler Includes
+#include "sampler_CLI_apps.h"
+#include "sampler_cfg.h"
+#include "patch_cache.h"
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static BaseType_t prv_xInstrumentCacheCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+
+///////////////////////////////////////
+// Command Definition Structure
+///////////////////////////////////////
+// >> instrument_cache
+static const CLI_Command_Definition_t prv_xInstrumentCacheCMD_definition =
+{
+    "instrument_cache", /* The command string to type. */
+    "\r\ninstrument_cache:\r\n Prints the resident instruments, the MIDI programs and the hit/miss/eviction counters\r\n",
+    prv_xInstrumentCacheCMD, /* The function to run. */
+    0 /* 0 parameters are expected. */
+};
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterInstrumentCacheCMD( void ) {
+  FreeRTOS_CLIRegisterCommand( &prv_xInstrumentCacheCMD_definition );
+}
+
+///////////////////////////////////////
+// Actual Command Implementation
+///////////////////////////////////////
+static BaseType_t prv_xInstrumentCacheCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+
+    // The report only reads the cache, so it doesn't need a task
+    vPrintPatchCacheReport();
+
+    return pdFALSE;
+
+}
@@ -139,11 +139,20 @@ static BaseType_t prv_xLoadInstrumentCMD( char *pcWriteBuffer, size_t xWriteBuff
                     (uint32_t) xFilenameQueueHandler,
                     eSetValueWithOverwrite );
 
-    if( ! xQueueReceive(xReturnQueueHandler, &return_value, 10000) ) {
-        SAMPLER_PRINTF_ERROR("Error receiving the Queue!");
-    }
-    else {
-        SAMPLER_PRINTF("Done! Return Value = %d\n\r", return_value);
+    // The loader reports its progress until it sends the return value
+    for ( ;; ) {
+        if( ! xQueueReceive(xReturnQueueHandler, &return_value, 10000) ) {
+            SAMPLER_PRINTF_ERROR("Error receiving the Queue!");
+            break;
+        }
+
+        if ( return_value & LOAD_PROGRESS_FLAG ) {
+            SAMPLER_PRINTF("\rLoaded %d/%d samples", LOAD_PROGRESS_DONE(return_value), LOAD_PROGRESS_TOTAL(return_value));
+            continue;
+        }
+
+        SAMPLER_PRINTF("\n\rDone! Return Value = %d\n\r", return_value);
+        break;
     }
 
     return pdFALSE;
@@ -19,6 +19,7 @@
 #include "sampler_CLI_apps.h"
 #include "sampler_FreeRTOS_tasks.h"
 #include "sampler_dma_voice_pb.h"
+#include "sampler_dma_cache.h"
 #include "sampler_engine.h"
 #include "nco.h"
 
@@ -127,7 +128,7 @@ static BaseType_t prv_xLoadSineWaveCMD( char *pcWriteBuffer, size_t xWriteBuffer
 			nco_load_sine_to_mem(&sine_nco);
 
 			// Step 4 - Flush the data to the DDR
-			Xil_DCacheFlushRange( (unsigned int) sine_nco.audio_data, (0x100000 * 2));
+			vSamplerCacheFlushSampleRange( sine_nco.audio_data, (0x100000 * 2) );
 
 			/* Return the parameter string. */
 			memset( pcWriteBuffer, 0x00, xWriteBufferLen ); // Initialize the buffer
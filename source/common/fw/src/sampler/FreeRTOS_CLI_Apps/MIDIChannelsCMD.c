@@ -0,0 +1,55 @@
+// C includes
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Xilinx includes
+#include "xil_printf.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "FreeRTOS_CLI.h"
+
+// Sampler Includes
+#include "sampler_CLI_apps.h"
+#include "sampler_FreeRTOS_tasks.h"
+#include "sampler_cfg.h"
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static BaseType_t prv_xMIDIChannelsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+
+///////////////////////////////////////
+// Command Definition Structure
+///////////////////////////////////////
+// >> midi_channels
+static const CLI_Command_Definition_t prv_xMIDIChannelsCMD_definition =
+{
+    "midi_channels", /* The command string to type. */
+    "\r\nmidi_channels:\r\n Prints the instruments (and key ranges) of each MIDI channel and its voices against its voice limit\r\n",
+    prv_xMIDIChannelsCMD, /* The function to run. */
+    0 /* 0 parameters are expected. */
+};
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterMIDIChannelsCMD( void ) {
+  FreeRTOS_CLIRegisterCommand( &prv_xMIDIChannelsCMD_definition );
+}
+
+///////////////////////////////////////
+// Actual Command Implementation
+///////////////////////////////////////
+static BaseType_t prv_xMIDIChannelsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+
+    // The report only reads the routes, so it doesn't need a task
+    vPrintChannelRoutesReport();
+
+    return pdFALSE;
+
+}
@@ -18,7 +18,9 @@
 // Sampler Includes
 #include "sampler_CLI_apps.h"
 #include "sampler_FreeRTOS_tasks.h"
+#include "sampler_dma_controller_regs.h"
 #include "sampler_dma_voice_pb.h"
+#include "sampler_dma_cache.h"
 #include "sampler_engine.h"
 #include "nco.h"
 
@@ -127,10 +129,11 @@ static BaseType_t prv_xPlaybackSineWaveCMD( char *pcWriteBuffer, size_t xWriteBu
 			nco_load_sine_to_mem(&sine_nco);
 
 			// Step 4 - Flush the data to the DDR
-			Xil_DCacheFlushRange( (unsigned int) sine_nco.audio_data, (0x100000 * 2));
+			vSamplerCacheFlushSampleRange( sine_nco.audio_data, (0x100000 * 2) );
 
 			// Step 5 - Start the playback
-			voice_slot    = ulStartVoicePlayback( (uint32_t) sine_nco.audio_data, sine_nco.target_memory_size );
+			voice_slot    = ulStartVoicePlayback( (uint32_t) sine_nco.audio_data, sine_nco.target_memory_size, NULL, SAMPLER_PHASE_INC_UNITY, NULL );
+			vSamplerDMACommit();
 			uint32_t addr = (uint32_t) sine_nco.audio_data;
 
 			/* Return the parameter string. */
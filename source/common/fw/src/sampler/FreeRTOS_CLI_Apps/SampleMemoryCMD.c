@@ -0,0 +1,55 @@
+
+// C includes
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Xilinx includes
+#include "xil_printf.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS_CLI.h"
+
+// Sampler Includes
+#include "sampler_CLI_apps.h"
+#include "sampler_cfg.h"
+#include "sample_memory.h"
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static BaseType_t prv_xSampleMemoryCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+
+///////////////////////////////////////
+// Command Definition Structure
+///////////////////////////////////////
+// >> sample_memory
+static const CLI_Command_Definition_t prv_xSampleMemoryCMD_definition =
+{
+    "sample_memory", /* The command string to type. */
+    "\r\nsample_memory:\r\n Prints the usage and the fragmentation of the sample memory\r\n",
+    prv_xSampleMemoryCMD, /* The function to run. */
+    0 /* 0 parameters are expected. */
+};
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterSampleMemoryCMD( void ) {
+  FreeRTOS_CLIRegisterCommand( &prv_xSampleMemoryCMD_definition );
+}
+
+///////////////////////////////////////
+// Actual Command Implementation
+///////////////////////////////////////
+static BaseType_t prv_xSampleMemoryCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+
+    // The report only reads the allocator, so it doesn't need a task
+    vPrintSampleMemoryReport();
+
+    return pdFALSE;
+
+}
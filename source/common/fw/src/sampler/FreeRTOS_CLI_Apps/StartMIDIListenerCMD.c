@@ -78,7 +78,9 @@ static BaseType_t prv_xStartMIDIListenerCMD( char *pcWriteBuffer, size_t xWriteB
                  eSetValueWithOverwrite );
 
 
-    if( ! xQueueReceive(xReturnQueueHandler, &return_value, 10000) ) {
+    // The listener reads the UART until it gets the stop SysEx. The serial stream buffer only allows one reader,
+    // so the console doesn't read again until the listener is done
+    if( ! xQueueReceive(xReturnQueueHandler, &return_value, portMAX_DELAY) ) {
         SAMPLER_PRINTF_ERROR("Timeout!");
     }
     else {
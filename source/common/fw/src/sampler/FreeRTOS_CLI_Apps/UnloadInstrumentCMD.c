@@ -0,0 +1,63 @@
+
+// C includes
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Xilinx includes
+#include "xil_printf.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "FreeRTOS_CLI.h"
+
+// Sampler Includes
+#include "sampler_CLI_apps.h"
+#include "sampler_FreeRTOS_tasks.h"
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static BaseType_t prv_xUnloadInstrumentCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+
+///////////////////////////////////////
+// Command Definition Structure
+///////////////////////////////////////
+// >> unload_instrument
+static const CLI_Command_Definition_t prv_xUnloadInstrumentCMD_definition =
+{
+    "unload_instrument", /* The command string to type. */
+    "\r\nunload_instrument:\r\n Stops the playback and releases the memory of the instruments of the MIDI channels and the cached ones\r\n",
+    prv_xUnloadInstrumentCMD, /* The function to run. */
+    0 /* 0 parameters are expected. */
+};
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterUnloadInstrumentCMD( void ) {
+  FreeRTOS_CLIRegisterCommand( &prv_xUnloadInstrumentCMD_definition );
+}
+
+///////////////////////////////////////
+// Actual Command Implementation
+///////////////////////////////////////
+static BaseType_t prv_xUnloadInstrumentCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+
+    // The instrument loader unloads the instrument, so it never happens in the middle of a load
+    TaskHandle_t     task_handle = xTaskGetHandle( LOAD_INSTRUMENT_TASK_NAME );
+
+    // A notification without a queue only unloads the instrument
+    xTaskNotify( task_handle,
+                 0,
+                 eSetValueWithOverwrite );
+
+    vTaskDelay( 100 );
+
+    // Don't wait for any feedback
+    return pdFALSE;
+
+}
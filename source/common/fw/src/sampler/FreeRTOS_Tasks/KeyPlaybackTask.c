@@ -42,12 +42,6 @@
 static void prv_vKeyPlaybackTask( void *pvParameters );
 
 
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
-
-
 ///////////////////////////////////////
 // Function to register the command
 ///////////////////////////////////////
@@ -58,7 +52,7 @@ void vRegisterKeyPlaybackTask( ) {
                     prv_vKeyPlaybackTask,              /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     tskIDLE_PRIORITY,                  /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 }
@@ -77,6 +71,7 @@ static void prv_vKeyPlaybackTask( void *pvParameters ) {
     uint32_t          ulNotifiedValue;
     key_parameters_t *key_parameters = malloc( sizeof( key_parameters_t ) );
     uint32_t          error = 0;
+    CHANNEL_ROUTE_t   channel_route;
 
     for ( ;; ) {
 
@@ -104,7 +99,10 @@ static void prv_vKeyPlaybackTask( void *pvParameters ) {
             }
 
             // Start the playback
-            error = ulPlayInstrumentKey( key_parameters->key, key_parameters->velocity, patch_descriptor );
+            ulAcquireChannelRoute( KEY_PLAYBACK_CHANNEL, &channel_route );
+            error = ulPlayChannelKey( KEY_PLAYBACK_CHANNEL, key_parameters->key, key_parameters->velocity, &channel_route );
+            vReleaseChannelRoute( &channel_route );
+            vSamplerEngineCommit();
 
             if( error ) {
                 SAMPLER_PRINTF_ERROR("Failed playing the key");
@@ -25,6 +25,7 @@
 #include "sampler_FreeRTOS_tasks.h"
 #include "sampler_cfg.h"
 #include "patch_loader.h"
+#include "patch_cache.h"
 #include "sampler_engine.h"
 
 ///////////////////////////////////////
@@ -37,15 +38,17 @@
 #endif
 
 ///////////////////////////////////////
-// Static Functions
+// Static Variables
 ///////////////////////////////////////
-static void prv_vLoadInstrumentTask( void *pvParameters );
-
+static TaskHandle_t     load_instrument_task_handle = NULL;
+// Program changes not run yet. Only the last program of each channel is kept
+static volatile uint8_t pending_programs[MIDI_NUM_OF_CHANNELS];
 
 ///////////////////////////////////////
-// Misc. Variables
+// Static Functions
 ///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
+static void prv_vLoadInstrumentTask( void *pvParameters );
+static void prv_vRunProgramChanges( void );
 
 
 ///////////////////////////////////////
@@ -53,14 +56,46 @@ extern PATCH_DESCRIPTOR_t *patch_descriptor;
 ///////////////////////////////////////
 void vRegisterLoadInstrumentTask( ) {
 
+    memset( (void *) pending_programs, PATCH_CACHE_PROGRAM_NONE, sizeof( pending_programs ) );
+
     // Create the task
     xTaskCreate(
                     prv_vLoadInstrumentTask,           /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     tskIDLE_PRIORITY,                  /* Priority at which the task is created. */
-                    NULL );                            /* Used to pass out the created task's handle. */
+                    &load_instrument_task_handle );    /* Used to pass out the created task's handle. */
+}
+
+// This function asks the instrument loader task to route the instrument of a MIDI program to a channel
+// It never blocks, so it can be called from the MIDI path
+void vRequestProgramChange( uint8_t channel, uint8_t program ) {
+
+    if ( channel >= MIDI_NUM_OF_CHANNELS || program > 127 || load_instrument_task_handle == NULL ) return;
+
+    pending_programs[channel] = program;
+
+    // A pending queue handle isn't overwritten. The program changes are run after every notification
+    xTaskNotify( load_instrument_task_handle, LOAD_PROGRAM_CHANGE_FLAG, eSetValueWithoutOverwrite );
+}
+
+// This function routes the instruments of the pending program changes. A resident instrument is only a route swap
+static void prv_vRunProgramChanges( void ) {
+    PATCH_DESCRIPTOR_t *new_patch;
+    uint8_t             program;
+
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        taskENTER_CRITICAL();
+        program                   = pending_programs[channel];
+        pending_programs[channel] = PATCH_CACHE_PROGRAM_NONE;
+        taskEXIT_CRITICAL();
+
+        if ( program == PATCH_CACHE_PROGRAM_NONE ) continue;
+
+        new_patch = xPatchCacheGetProgram( program );
+        if ( new_patch != NULL ) vPublishChannelPatch( channel, new_patch );
+    }
 }
 
 ///////////////////////////////////////
@@ -70,12 +105,31 @@ void vRegisterLoadInstrumentTask( ) {
 // This task loads the instrument using a .json file
 // The .json file contains all the information regarding
 // Key, velocity ranges, and associated sample
+// Precompiled bundles (.zsb) are loaded with a single read
+// The instruments go through the instrument cache, so selecting a resident instrument doesn't read the SD card
+// The instruments of the channels keep playing while the new one is loaded, then the new one replaces them
+// (see vPublishChannelRoutes()). The notification value selects the action:
+// - Queue handle:             the instrument of the file path received on the queue, played on all the channels
+// - LOAD_PROGRAM_CHANGE_FLAG: the program changes requested with vRequestProgramChange()
+// - 0:                        unloads the instruments of the channels and releases the cached ones
 static void prv_vLoadInstrumentTask( void *pvParameters ) {
     BaseType_t          notification_received;
     const TickType_t    xBlockTime = 500;
     uint32_t            ulNotifiedValue;
     file_path_handler_t *path_handler = malloc( sizeof( file_path_t ) );
     uint32_t            return_value = 1;
+    PATCH_DESCRIPTOR_t  *new_patch;
+    FF_Stat_t           setlist_stat;
+    CHANNEL_ROUTE_t     setlist_routes[MIDI_NUM_OF_CHANNELS];
+
+    // Preload the set list and route its instruments, if there's one
+    if ( ff_stat( SETLIST_FILE_PATH, &setlist_stat ) == 0 ) {
+        SAMPLER_PRINTF("Loading the set list \"%s\"\n\r", SETLIST_FILE_PATH);
+        if ( ulPatchCacheLoadSetList( SETLIST_FILE_PATH, setlist_routes ) ) {
+            SAMPLER_PRINTF_ERROR("Some instruments of the set list could not be loaded");
+        }
+        vPublishChannelRoutes( setlist_routes, MIDI_CHANNEL_MASK_ALL );
+    }
 
     for( ;; )
     {
@@ -88,6 +142,17 @@ static void prv_vLoadInstrumentTask( void *pvParameters ) {
 
         if ( notification_received == pdTRUE ) {
 
+            // The program changes can arrive while any other notification is pending
+            prv_vRunProgramChanges();
+
+            if ( ulNotifiedValue == 0 ) {
+                vUnloadRoutedPatches();
+                vPatchCacheFlush();
+                continue;
+            }
+
+            if ( ulNotifiedValue & LOAD_PROGRAM_CHANGE_FLAG ) continue;
+
             SAMPLER_PRINTF("Starting instrument loader...\n\n\r");
 
             if( ! xQueueReceive((QueueHandle_t) ulNotifiedValue, path_handler, xBlockTime) ) {
@@ -97,15 +162,19 @@ static void prv_vLoadInstrumentTask( void *pvParameters ) {
                 return_value = 0;
                 SAMPLER_PRINTF("Loading instrument \"%s\"\n\r", path_handler->file_path);
 
-                // Load the samples
-                patch_descriptor = ulLoadPatchFromJSON( path_handler->file_dir, path_handler->file_path );
+                // Load the samples (unless the instrument is resident)
+                new_patch = xPatchCacheGet( path_handler->file_dir, path_handler->file_path, path_handler->return_handle );
 
-                if (patch_descriptor == NULL) {
-                    SAMPLER_PRINTF_ERROR("Patch Loader returned patch_descriptor == NULL (0x%x)", patch_descriptor );
+                // The instruments of the channels are kept if the load failed
+                if (new_patch == NULL) {
+                    SAMPLER_PRINTF_ERROR("Patch Loader returned patch_descriptor == NULL (0x%x)", new_patch );
                     return_value = 1;
                 }
 
+                // Report the result before the old instruments are retired
                 xQueueSend(path_handler->return_handle, &return_value, 1000);
+
+                if (new_patch != NULL) vPublishChannelPatch( MIDI_CHANNEL_ALL, new_patch );
             }
 
         }
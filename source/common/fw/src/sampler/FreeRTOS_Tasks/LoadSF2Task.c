@@ -43,12 +43,6 @@
 static void prv_vLoadSF2Task( void *pvParameters );
 
 
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
-
-
 ///////////////////////////////////////
 // Function to register the command
 ///////////////////////////////////////
@@ -59,7 +53,7 @@ void vRegisterLoadSF2Task( ) {
                     prv_vLoadSF2Task,                  /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     tskIDLE_PRIORITY,                  /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 
@@ -78,6 +72,7 @@ static void prv_vLoadSF2Task( void *pvParameters ) {
     uint32_t            ulNotifiedValue;
     file_path_handler_t *path_handler = malloc( sizeof( file_path_t ) );
     uint32_t            return_value = 1;
+    PATCH_DESCRIPTOR_t  *new_patch;
 
     for( ;; )
     {
@@ -99,15 +94,18 @@ static void prv_vLoadSF2Task( void *pvParameters ) {
                 return_value = 0;
                 SAMPLER_PRINTF("Loading SF2 \"%s\"\n\r", path_handler->file_path);
 
-                // Load the samples
-                patch_descriptor = ulLoadPatchFromSF2( path_handler->file_path );
+                // Load the samples. The instruments of the channels keep playing in the meantime
+                new_patch = ulLoadPatchFromSF2( path_handler->file_path );
 
-                if (patch_descriptor == NULL) {
-                    SAMPLER_PRINTF_ERROR("Patch Loader returned patch_descriptor == NULL (0x%x)", patch_descriptor );
+                if (new_patch == NULL) {
+                    SAMPLER_PRINTF_ERROR("Patch Loader returned patch_descriptor == NULL (0x%x)", new_patch );
                     return_value = 1;
                 }
 
+                // Report the result before the old instruments are retired. The instrument plays on all the channels
                 xQueueSend(path_handler->return_handle, &return_value, 1000);
+
+                if (new_patch != NULL) vPublishChannelPatch( MIDI_CHANNEL_ALL, new_patch );
             }
 
         }
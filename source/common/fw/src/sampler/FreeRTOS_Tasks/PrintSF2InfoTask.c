@@ -42,12 +42,6 @@
 static void prv_vPrintSF2InfoTask( void *pvParameters );
 
 
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
-
-
 ///////////////////////////////////////
 // Function to register the command
 ///////////////////////////////////////
@@ -58,7 +52,7 @@ void vRegisterPrintSF2InfoTask( ) {
                     prv_vPrintSF2InfoTask,             /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     tskIDLE_PRIORITY,                  /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 
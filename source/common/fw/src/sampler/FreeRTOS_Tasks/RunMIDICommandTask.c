@@ -39,12 +39,6 @@
 static void prv_vRunMIDICommandTask( void *pvParameters );
 
 
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
-
-
 ///////////////////////////////////////
 // Function to register the command
 ///////////////////////////////////////
@@ -55,7 +49,7 @@ void vRegisterRunMIDICommandTask( ) {
                     prv_vRunMIDICommandTask,           /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     configMAX_PRIORITIES,              /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 }
@@ -65,12 +59,14 @@ void vRegisterRunMIDICommandTask( ) {
 ///////////////////////////////////////
 
 static void prv_vRunMIDICommandTask( void *pvParameters ) {
-    BaseType_t        notification_received;
-    uint32_t          ulNotifiedValue;
+    BaseType_t          notification_received;
+    uint32_t            ulNotifiedValue;
+    CHANNEL_ROUTE_t     channel_route;
 
     // MIDI Variables
     uint32_t full_command = 0;
     uint8_t  cmd          = 0;
+    uint8_t  channel      = 0;
     uint8_t  byte1        = 0;
     uint8_t  byte2        = 0;
 
@@ -92,24 +88,37 @@ static void prv_vRunMIDICommandTask( void *pvParameters ) {
         cmd   =   full_command         & 0xff;
         byte1 = ( full_command >> 8  ) & 0xff;
         byte2 = ( full_command >> 16 ) & 0xff;
+        channel = cmd & 0x0F;
+
+        // The instruments of the channel can't be released while the command is running
+        ulAcquireChannelRoute( channel, &channel_route );
 
         // Check which command is
         switch ( cmd & 0xF0 )
         {
             // Note OFF
             case 0x80:
-                ulPlayInstrumentKey( byte1, 0, patch_descriptor );
+                ulPlayChannelKey( channel, byte1, 0, &channel_route );
                 break;
 
             // Note ON
             case 0x90:
-                ulPlayInstrumentKey( byte1, byte2, patch_descriptor );
+                ulPlayChannelKey( channel, byte1, byte2, &channel_route );
+                break;
+
+            // Program Change
+            case 0xC0:
+                vRequestProgramChange( channel, byte1 );
                 break;
 
             default:
                 break;
         }
 
+        vReleaseChannelRoute( &channel_route );
+
+        vSamplerEngineCommit();
+
     }
 
     /* Tasks must not attempt to return from their implementing
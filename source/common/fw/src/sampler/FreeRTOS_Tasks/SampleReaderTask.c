@@ -0,0 +1,119 @@
+// C includes
+#include <string.h>
+
+// Xilinx Includes
+#include "xil_printf.h"
+#include "xparameters.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+// FreeRTOS+FAT includes
+#include "ff_stdio.h"
+#include "fat_CLI_apps.h"
+
+// Sampler Includes
+#include "sampler_FreeRTOS_tasks.h"
+#include "sampler_cfg.h"
+#include "patch_loader.h"
+
+///////////////////////////////////////
+// Defines
+///////////////////////////////////////
+#ifndef SAMPLE_READER_TASK_NAME
+    #define TASK_NAME "sample_reader"
+#else
+    #define TASK_NAME SAMPLE_READER_TASK_NAME
+#endif
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static void     prv_vSampleReaderTask( void *pvParameters );
+static uint32_t prv_ulReadSampleAudioData( SAMPLE_LOAD_PLAN_t *load_plan );
+
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterSampleReaderTask( ) {
+
+    // Create the task
+    // One priority above the loader so the next read starts as soon as the previous one is handed over
+    xTaskCreate(
+                    prv_vSampleReaderTask,             /* Function that implements the task. */
+                    TASK_NAME,                         /* Text name for the task. */
+                    0x800,                             /* Stack size in words, not bytes. */
+                    NULL,                              /* Parameter passed into the task. */
+                    tskIDLE_PRIORITY + 1,              /* Priority at which the task is created. */
+                    NULL );                            /* Used to pass out the created task's handle. */
+}
+
+///////////////////////////////////////
+// Actual Task Implementation
+///////////////////////////////////////
+
+// This task is the first stage of the sample loader
+// It reads the audio data of the samples of a load plan and hands them over to the patch loader,
+// which commits them while the next files are read. The result queue bounds the read-ahead
+// The memory of every sample was reserved by the patch loader, so this task doesn't allocate
+static void prv_vSampleReaderTask( void *pvParameters ) {
+    uint32_t              ulNotifiedValue;
+    SAMPLE_READ_REQUEST_t request;
+    SAMPLE_READ_RESULT_t  result;
+
+    for( ;; )
+    {
+        if ( xTaskNotifyWait( 0x00, 0xffffffff, &ulNotifiedValue, portMAX_DELAY ) != pdTRUE ) continue;
+
+        if( ! xQueueReceive((QueueHandle_t) ulNotifiedValue, &request, 500) ) {
+            SAMPLER_PRINTF_ERROR("Error receiving the Queue!");
+            continue;
+        }
+
+        // The patch loader expects one result per sample, even if the read is skipped
+        for ( uint32_t sample = 0; sample < request.number_of_samples; sample++ ) {
+            result.voice = request.load_plan[sample].voice;
+            result.error = 1;
+
+            if ( *request.abort == 0 ) {
+                result.error = prv_ulReadSampleAudioData( &request.load_plan[sample] );
+            }
+
+            // Blocks while the patch loader is SAMPLE_LOADER_READ_AHEAD files behind
+            xQueueSend( request.result_queue, &result, portMAX_DELAY );
+        }
+    }
+
+    vTaskDelete( NULL );
+}
+
+// This function reads the audio data of a sample into the memory reserved by the load plan
+// The file is opened from the directory entry found by the patch loader, so its path is not looked up again
+static uint32_t prv_ulReadSampleAudioData( SAMPLE_LOAD_PLAN_t *load_plan ) {
+    SAMPLE_FORMAT_t *sample_format = &load_plan->voice->sample_format;
+    const char      *file_name     = (const char *) load_plan->voice->sample_path;
+    FF_FILE         *pxFile        = NULL;
+    uint32_t         error         = 0;
+
+    pxFile = ff_fopenlocation( &load_plan->location, "r" );
+
+    if ( pxFile == NULL ) {
+        SAMPLER_PRINTF_ERROR("File %s could not be opened!", file_name);
+        return 1;
+    }
+
+    if ( ff_fseek( pxFile, load_plan->data_offset, FF_SEEK_SET ) != 0 ) {
+        SAMPLER_PRINTF_ERROR("Failed seeking to the audio data of %s", file_name);
+        error = 1;
+    } else if ( ff_fread( sample_format->data_start_ptr, sample_format->audio_data_size, 1, pxFile ) != 1 ) {
+        SAMPLER_PRINTF_ERROR("Failed reading the audio data of %s", file_name);
+        error = 1;
+    }
+
+    ff_fclose( pxFile );
+
+    return error;
+}
@@ -26,10 +26,19 @@
 #include "sampler_cfg.h"
 #include "patch_loader.h"
 #include "sampler_engine.h"
+#include "midi_parser.h"
 
 ///////////////////////////////////////
 // Defines
 ///////////////////////////////////////
+// Maximum number of bytes received at once
+#define MIDI_RX_BATCH_SIZE 64
+// Maximum SysEx message length (without 0xF0/0xF7)
+#define MIDI_SYSEX_BUFFER_SIZE 32
+// SysEx message that stops the listener: F0 7D 00 F7 (0x7D = non-commercial manufacturer ID)
+#define MIDI_LISTENER_STOP_SYSEX_ID  0x7D
+#define MIDI_LISTENER_STOP_SYSEX_CMD 0x00
+
 #ifndef SERIAL_MIDI_LISTENER_TASK_TASK_NAME
     #define TASK_NAME "serial_midi_listener_task"
 #else
@@ -40,12 +49,8 @@
 // Static Functions
 ///////////////////////////////////////
 static void prv_vSerialMIDIListenerTask( void *pvParameters );
-
-
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
+static void prv_vMIDIMessageCallback( const MIDI_MESSAGE_t *message, void *context );
+static void prv_vMIDISysExCallback( const uint8_t *data, size_t length, uint8_t truncated, void *context );
 
 
 ///////////////////////////////////////
@@ -58,7 +63,7 @@ void vRegisterSerialMIDIListenerTask( ) {
                     prv_vSerialMIDIListenerTask,       /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     configMAX_PRIORITIES,              /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 }
@@ -67,6 +72,58 @@ void vRegisterSerialMIDIListenerTask( ) {
 // Actual Task Implementation
 ///////////////////////////////////////
 
+// This function handles the channel messages received by the listener
+// Each message goes to the instruments routed to its channel
+static void prv_vMIDIMessageCallback( const MIDI_MESSAGE_t *message, void *context ) {
+    CHANNEL_ROUTE_t channel_route;
+
+    ( void ) context;
+
+    // The instruments of the channel can't be released while the message is handled
+    ulAcquireChannelRoute( message->channel, &channel_route );
+
+    switch ( message->status )
+    {
+        // Note OFF
+        case MIDI_STATUS_NOTE_OFF:
+            ulPlayChannelKey( message->channel, message->data1, 0, &channel_route );
+            break;
+
+        // Note ON (velocity 0 is a note OFF)
+        case MIDI_STATUS_NOTE_ON:
+            ulPlayChannelKey( message->channel, message->data1, message->data2, &channel_route );
+            break;
+
+        // Program Change. The instrument loader swaps the instrument of the channel, so the MIDI path doesn't wait
+        case MIDI_STATUS_PROGRAM_CHANGE:
+            vRequestProgramChange( message->channel, message->data1 );
+            break;
+
+        // All Sound Off/All Notes Off. Only the voices of the channel are stopped
+        case MIDI_STATUS_CONTROL_CHANGE:
+            if ( message->data1 == MIDI_CC_ALL_SOUND_OFF || message->data1 == MIDI_CC_ALL_NOTES_OFF ) {
+                ulStopChannelPlayback( message->channel, &channel_route );
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    vReleaseChannelRoute( &channel_route );
+}
+
+// This function handles the SysEx messages received by the listener
+static void prv_vMIDISysExCallback( const uint8_t *data, size_t length, uint8_t truncated, void *context ) {
+    BaseType_t *midi_listener_stop = (BaseType_t *) context;
+
+    if ( truncated || length != 2 ) return;
+
+    if ( data[0] == MIDI_LISTENER_STOP_SYSEX_ID && data[1] == MIDI_LISTENER_STOP_SYSEX_CMD ) {
+        *midi_listener_stop = pdTRUE;
+    }
+}
+
 static void prv_vSerialMIDIListenerTask( void *pvParameters ) {
     BaseType_t        notification_received;
     uint32_t          ulNotifiedValue;
@@ -75,11 +132,19 @@ static void prv_vSerialMIDIListenerTask( void *pvParameters ) {
 
     // Task Variables
     BaseType_t        midi_listener_stop;
-    signed char       cRxedChar;
-    uint32_t          index;
+    uint8_t           rx_batch[MIDI_RX_BATCH_SIZE];
+    size_t            rx_batch_size;
+    size_t            rx_batch_index;
 
     // MIDI Variables
-    uint8_t  bytes_rcvd[3];
+    MIDI_PARSER_t           midi_parser;
+    MIDI_PARSER_CALLBACKS_t midi_callbacks;
+    uint8_t                 sysex_buffer[MIDI_SYSEX_BUFFER_SIZE];
+
+    midi_callbacks.message_callback  = prv_vMIDIMessageCallback;
+    midi_callbacks.realtime_callback = NULL; // Clock/Active Sensing are not used (yet)
+    midi_callbacks.sysex_callback    = prv_vMIDISysExCallback;
+    midi_callbacks.context           = &midi_listener_stop;
 
     for( ;; )
     {
@@ -96,42 +161,21 @@ static void prv_vSerialMIDIListenerTask( void *pvParameters ) {
         // Initialize everything
         return_queue_handler = (QueueHandle_t) ulNotifiedValue;
         midi_listener_stop   = pdFALSE;
-        index                = 0;
         return_value         = 1;
 
-        memset( &bytes_rcvd, 0x00, 3 );
+        vMIDIParserInit( &midi_parser, &midi_callbacks, sysex_buffer, MIDI_SYSEX_BUFFER_SIZE );
+
         while( midi_listener_stop == pdFALSE ) {
+            // Wait for a batch of bytes. The whole batch is processed before blocking again
             // TODO: Find a way to get the xPort instead of hardcoding it
-            while( xSerialGetChar( ( xComPortHandle ) 0, &cRxedChar, portMAX_DELAY ) != pdPASS );
-
-            bytes_rcvd[index] = (uint8_t) cRxedChar;
-            index++;
-
-            if( index == 3 ){
-                // Check which command is
-                switch ( bytes_rcvd[0] & 0xF0 )
-                {
-                    // Note OFF
-                    case 0x80:
-                        ulPlayInstrumentKey( bytes_rcvd[1], 0, patch_descriptor );
-                        break;
-
-                    // Note ON
-                    case 0x90:
-                        ulPlayInstrumentKey( bytes_rcvd[1], bytes_rcvd[2], patch_descriptor );
-                        break;
-
-                    case 0xb0:
-                        midi_listener_stop = pdTRUE;
-                        break;
-
-                    default:
-                        break;
-                }
-
-                index = 0;
+            rx_batch_size = xSerialGetBytes( ( xComPortHandle ) 0, rx_batch, MIDI_RX_BATCH_SIZE, portMAX_DELAY );
+
+            for( rx_batch_index = 0; ( rx_batch_index < rx_batch_size ) && ( midi_listener_stop == pdFALSE ); rx_batch_index++ ) {
+                vMIDIParserProcessByte( &midi_parser, rx_batch[rx_batch_index] );
             }
 
+            // All the events of the batch are written to the HW at once
+            vSamplerEngineCommit();
         }
 
         xQueueSend(return_queue_handler, &return_value, 1000);
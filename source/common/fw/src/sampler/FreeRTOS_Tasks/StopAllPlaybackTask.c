@@ -42,12 +42,6 @@
 static void prv_vStopAllPlaybackTask( void *pvParameters );
 
 
-///////////////////////////////////////
-// Misc. Variables
-///////////////////////////////////////
-extern PATCH_DESCRIPTOR_t *patch_descriptor;
-
-
 ///////////////////////////////////////
 // Function to register the command
 ///////////////////////////////////////
@@ -58,7 +52,7 @@ void vRegisterStopAllPlaybackTask( ) {
                     prv_vStopAllPlaybackTask,          /* Function that implements the task. */
                     TASK_NAME,                         /* Text name for the task. */
                     0x2000,                            /* Stack size in words, not bytes. */
-                    ( void * ) patch_descriptor,       /* Parameter passed into the task. */
+                    NULL,                              /* Parameter passed into the task. */
                     tskIDLE_PRIORITY,                  /* Priority at which the task is created. */
                     NULL );                            /* Used to pass out the created task's handle. */
 }
@@ -72,6 +66,7 @@ static void prv_vStopAllPlaybackTask( void *pvParameters ) {
     BaseType_t        notification_received;
     uint32_t          ulNotifiedValue;
     uint32_t          error = 0;
+    CHANNEL_ROUTE_t   all_channel_routes[MIDI_NUM_OF_CHANNELS];
 
     for ( ;; ) {
 
@@ -86,8 +81,11 @@ static void prv_vStopAllPlaybackTask( void *pvParameters ) {
 
             SAMPLER_PRINTF("Stopping everything...\n\n\r");
 
-            // Start the playback
-            error = ulStopAllPlayback( patch_descriptor );
+            // Stop the playback
+            vAcquireAllChannelRoutes( all_channel_routes );
+            error = ulStopAllPlayback( all_channel_routes );
+            vReleaseAllChannelRoutes( all_channel_routes );
+            vSamplerEngineCommit();
 
             if( error ) {
                 SAMPLER_PRINTF_ERROR("Failed stopping everything");
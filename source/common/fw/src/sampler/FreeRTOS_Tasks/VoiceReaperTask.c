@@ -0,0 +1,64 @@
+// C includes
+#include <string.h>
+
+// Xilinx Includes
+#include "xil_printf.h"
+#include "xparameters.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Sampler Includes
+#include "sampler_FreeRTOS_tasks.h"
+#include "sampler_cfg.h"
+#include "sampler_engine.h"
+
+///////////////////////////////////////
+// Defines
+///////////////////////////////////////
+#ifndef VOICE_REAPER_TASK_NAME
+    #define TASK_NAME "voice_reaper"
+#else
+    #define TASK_NAME VOICE_REAPER_TASK_NAME
+#endif
+
+///////////////////////////////////////
+// Static Functions
+///////////////////////////////////////
+static void prv_vVoiceReaperTask( void *pvParameters );
+
+
+///////////////////////////////////////
+// Function to register the command
+///////////////////////////////////////
+void vRegisterVoiceReaperTask( ) {
+
+    // Create the task
+    xTaskCreate(
+                    prv_vVoiceReaperTask,              /* Function that implements the task. */
+                    TASK_NAME,                         /* Text name for the task. */
+                    0x400,                             /* Stack size in words, not bytes. */
+                    NULL,                              /* Parameter passed into the task. */
+                    tskIDLE_PRIORITY + 1,              /* Priority at which the task is created. */
+                    NULL );                            /* Used to pass out the created task's handle. */
+}
+
+///////////////////////////////////////
+// Actual Task Implementation
+///////////////////////////////////////
+
+// This task returns the voices that finished playing their sample to the voice allocator
+// It runs once per audio block so one-shot samples don't hold a voice until the key is released
+static void prv_vVoiceReaperTask( void *pvParameters ) {
+    TickType_t       xLastWakeTime = xTaskGetTickCount();
+    const TickType_t xPeriod       = pdMS_TO_TICKS( VOICE_REAPER_PERIOD_MS );
+
+    for ( ;; ) {
+
+        vTaskDelayUntil( &xLastWakeTime, ( xPeriod > 0 ) ? xPeriod : 1 );
+
+        ulReleaseFinishedVoices();
+
+    }
+}
@@ -0,0 +1,68 @@
+//////////////////////////////////////////
+// JSON Stream Parser
+//////////////////////////////////////////
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Maximum nesting of objects/arrays. The members of the root object are at depth 1
+#ifndef JSON_STREAM_MAX_DEPTH
+    #define JSON_STREAM_MAX_DEPTH   8
+#endif
+
+// Maximum length of a member name (including the terminator). Longer names are truncated
+#ifndef JSON_STREAM_MAX_KEY_LEN
+    #define JSON_STREAM_MAX_KEY_LEN 32
+#endif
+
+// Events
+typedef enum {
+    JSON_STREAM_STRING = 0,     // String value
+    JSON_STREAM_PRIMITIVE,      // Number, true, false or null. The text is passed as is
+    JSON_STREAM_OBJECT_START,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_START,
+    JSON_STREAM_ARRAY_END
+} JSON_STREAM_EVENT_e;
+
+// Event passed to the callback. The strings are only valid during the callback
+typedef struct {
+    JSON_STREAM_EVENT_e type;
+    uint8_t             depth;       // Depth of the container that holds the value (1 = root)
+    uint8_t             truncated;   // The value didn't fit in the value buffer
+    const char         *key;         // Member name of the value ("" for array elements and the root)
+    const char         *parent_key;  // Member name of the container that holds the value ("" for the root)
+    const char         *value;       // Text of the string/primitive. "" for the object/array events
+} JSON_STREAM_EVENT_t;
+
+typedef void (*JSON_STREAM_CALLBACK_t)( const JSON_STREAM_EVENT_t *event, void *context );
+
+// Parser state. All the memory is provided by the caller
+typedef struct {
+    JSON_STREAM_CALLBACK_t callback;
+    void                  *context;
+    uint8_t                state;                                                    // See json_stream.c
+    uint8_t                depth;                                                    // Number of open objects/arrays
+    uint8_t                done;                                                     // The root value is complete
+    uint8_t                escape;                                                   // Characters left of an escape sequence
+    uint8_t                in_key;                                                   // The string being received is a member name
+    uint8_t                truncated;                                                // The string/primitive didn't fit
+    uint8_t                container_is_array[JSON_STREAM_MAX_DEPTH + 1];
+    char                   container_key[JSON_STREAM_MAX_DEPTH + 1][JSON_STREAM_MAX_KEY_LEN]; // Member name of each open container
+    char                   key[JSON_STREAM_MAX_KEY_LEN];                             // Member name of the current value
+    size_t                 key_length;
+    char                  *value_buffer;
+    size_t                 value_buffer_size;
+    size_t                 value_length;
+    uint32_t               line;                                                     // Line being parsed (for the error messages)
+} JSON_STREAM_t;
+
+void     vJSONStreamInit( JSON_STREAM_t *parser, JSON_STREAM_CALLBACK_t callback, void *context, char *value_buffer, size_t value_buffer_size );
+uint32_t ulJSONStreamProcessByte( JSON_STREAM_t *parser, uint8_t json_byte );
+uint32_t ulJSONStreamProcessBuffer( JSON_STREAM_t *parser, const uint8_t *buffer, size_t length );
+uint32_t ulJSONStreamFinish( JSON_STREAM_t *parser );
+
+#endif
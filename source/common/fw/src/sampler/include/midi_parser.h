@@ -0,0 +1,69 @@
+//////////////////////////////////////////
+// MIDI Stream Parser
+//////////////////////////////////////////
+
+#ifndef MIDI_PARSER_H
+#define MIDI_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Status bytes
+#define MIDI_STATUS_NOTE_OFF          0x80
+#define MIDI_STATUS_NOTE_ON           0x90
+#define MIDI_STATUS_POLY_PRESSURE     0xA0
+#define MIDI_STATUS_CONTROL_CHANGE    0xB0
+#define MIDI_STATUS_PROGRAM_CHANGE    0xC0
+#define MIDI_STATUS_CHANNEL_PRESSURE  0xD0
+#define MIDI_STATUS_PITCH_BEND        0xE0
+#define MIDI_STATUS_SYSEX_START       0xF0
+#define MIDI_STATUS_SYSEX_END         0xF7
+#define MIDI_STATUS_REALTIME_FIRST    0xF8 // 0xF8 to 0xFF can appear anywhere, even inside other messages
+
+// Control change numbers
+#define MIDI_CC_ALL_SOUND_OFF         120
+#define MIDI_CC_ALL_NOTES_OFF         123
+
+#define MIDI_IS_STATUS(BYTE)          ( ( (BYTE) & 0x80 ) != 0 )
+#define MIDI_IS_REALTIME(BYTE)        ( (BYTE) >= MIDI_STATUS_REALTIME_FIRST )
+
+// Decoded channel or system common message
+typedef struct {
+    uint8_t status;  // Status byte without the channel (0x80..0xE0) or the system common status (0xF1..0xF6)
+    uint8_t channel; // 0..15. Only valid for channel messages
+    uint8_t data1;
+    uint8_t data2;   // 0 for messages with a single data byte
+} MIDI_MESSAGE_t;
+
+// Callbacks. Any of them can be NULL
+typedef void (*MIDI_MESSAGE_CALLBACK_t)  ( const MIDI_MESSAGE_t *message, void *context );
+typedef void (*MIDI_REALTIME_CALLBACK_t) ( uint8_t realtime_byte, void *context );
+typedef void (*MIDI_SYSEX_CALLBACK_t)    ( const uint8_t *data, size_t length, uint8_t truncated, void *context ); // data doesn't include 0xF0/0xF7
+
+typedef struct {
+    MIDI_MESSAGE_CALLBACK_t  message_callback;
+    MIDI_REALTIME_CALLBACK_t realtime_callback;
+    MIDI_SYSEX_CALLBACK_t    sysex_callback;
+    void                    *context;
+} MIDI_PARSER_CALLBACKS_t;
+
+// Parser state. All the memory is provided by the caller
+typedef struct {
+    MIDI_PARSER_CALLBACKS_t callbacks;
+    uint8_t                 running_status;  // Status of the message being received (0 = none)
+    uint8_t                 expected_bytes;  // Number of data bytes of the running status
+    uint8_t                 data_count;      // Number of data bytes received
+    uint8_t                 data[2];
+    uint8_t                 in_sysex;        // Receiving a SysEx message
+    uint8_t                 sysex_truncated; // The SysEx message didn't fit in the buffer
+    uint8_t                *sysex_buffer;
+    size_t                  sysex_buffer_size;
+    size_t                  sysex_length;
+} MIDI_PARSER_t;
+
+void vMIDIParserInit( MIDI_PARSER_t *parser, const MIDI_PARSER_CALLBACKS_t *callbacks, uint8_t *sysex_buffer, size_t sysex_buffer_size );
+void vMIDIParserReset( MIDI_PARSER_t *parser );
+void vMIDIParserProcessByte( MIDI_PARSER_t *parser, uint8_t midi_byte );
+void vMIDIParserProcessBuffer( MIDI_PARSER_t *parser, const uint8_t *buffer, size_t length );
+
+#endif
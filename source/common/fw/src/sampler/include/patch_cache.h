@@ -0,0 +1,90 @@
+//////////////////////////////////////////
+// Instrument Cache
+//////////////////////////////////////////
+
+#ifndef PATCH_CACHE_H
+#define PATCH_CACHE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "sampler_cfg.h"
+
+// Maximum number of resident instruments
+#ifndef PATCH_CACHE_MAX_ENTRIES
+    #define PATCH_CACHE_MAX_ENTRIES   8
+#endif
+
+// Sample memory the resident instruments can take. The least recently used ones are evicted above it
+// Some of the region is left free, so a new instrument can be loaded before an old one is evicted
+#ifndef PATCH_CACHE_BUDGET_BYTES
+    #define PATCH_CACHE_BUDGET_BYTES  ( ( SAMPLE_MEMORY_REGION_SIZE / 4 ) * 3 )
+#endif
+
+// MIDI programs that can be mapped to an instrument
+#define PATCH_CACHE_MAX_PROGRAMS      32
+#define PATCH_CACHE_PROGRAM_NONE      0xff
+
+// Set list. Maps MIDI programs to instruments and preloads them at boot (optional)
+// { "setlist": [ { "program": 0, "path": "/piano/piano.json" }, { "program": 1, "path": "organ.zsb" } ] }
+// Relative paths start at the directory of the set list
+// The programs can also be routed to the MIDI channels (1 to 16). The parts of a channel with overlapping
+// key ranges are layered, the others split the keyboard. Without channel entries, all the channels play the first program
+// "channels": [ { "channel": 1, "program": 0, "key_max": 59 }, { "channel": 1, "program": 1, "key_min": 60 },
+//               { "channel": 10, "program": 2, "voice_limit": 16 } ]
+#define SETLIST_FILE_PATH             "/setlist.json"
+#define MAX_SETLIST_FILE_SIZE         4096
+#define SETLIST_TOKEN_STR             "setlist"
+#define SETLIST_PROGRAM_TOKEN_STR     "program"
+#define SETLIST_PATH_TOKEN_STR        "path"
+#define SETLIST_CHANNELS_TOKEN_STR    "channels"
+#define SETLIST_CHANNEL_TOKEN_STR     "channel"
+#define SETLIST_KEY_MIN_TOKEN_STR     "key_min"
+#define SETLIST_KEY_MAX_TOKEN_STR     "key_max"
+#define SETLIST_VOICE_LIMIT_TOKEN_STR "voice_limit"
+#define SETLIST_VOICE_LIMIT_NONE      0xffffffff
+
+// Resident instrument
+typedef struct {
+    char                file_path[MAX_PATH_LEN];  // Patch file. Key of the cache
+    char                file_dir[MAX_PATH_LEN];   // Directory of the patch file
+    PATCH_DESCRIPTOR_t *patch;                    // NULL if the entry is free
+    uint32_t            last_used;                // Cache clock of the last time the instrument was requested
+} PATCH_CACHE_ENTRY_t;
+
+// MIDI program -> Patch file. The mapping is kept when the instrument is evicted
+typedef struct {
+    uint8_t             program;                  // PATCH_CACHE_PROGRAM_NONE if the entry is free
+    char                file_path[MAX_PATH_LEN];
+    char                file_dir[MAX_PATH_LEN];
+} PATCH_CACHE_PROGRAM_t;
+
+// Part of a channel read from the set list
+typedef struct {
+    uint8_t             channel;                  // 0..15
+    uint8_t             program;
+    uint8_t             key_min;
+    uint8_t             key_max;
+} SETLIST_PART_t;
+
+typedef struct {
+    uint32_t hits;                                // Requests served by a resident instrument
+    uint32_t misses;                              // Requests that loaded the instrument
+    uint32_t evictions;                           // Instruments released to make room
+    uint32_t load_errors;                         // Misses that failed to load
+    uint32_t entries;                             // Number of resident instruments
+    uint32_t resident_size;                       // Sample memory taken by the resident instruments
+    uint32_t budget;                              // PATCH_CACHE_BUDGET_BYTES
+} PATCH_CACHE_STATS_t;
+
+PATCH_DESCRIPTOR_t * xPatchCacheGet( const char *file_dir, const char *file_path, QueueHandle_t progress_queue );
+PATCH_DESCRIPTOR_t * xPatchCacheGetProgram( uint8_t program );
+uint32_t             ulPatchCacheMapProgram( uint8_t program, const char *file_dir, const char *file_path );
+uint32_t             ulPatchCacheLoadSetList( const char *setlist_file_path, CHANNEL_ROUTE_t *channel_routes );
+void                 vPatchCacheFlush( void );
+void                 vGetPatchCacheStats( PATCH_CACHE_STATS_t *stats );
+void                 vPrintPatchCacheReport( void );
+
+#endif
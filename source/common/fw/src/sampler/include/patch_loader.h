@@ -1,7 +1,8 @@
 #ifndef __PATCH_LOADER_H__
 #define __PATCH_LOADER_H__
 
-#include "jsmn.h"
+#include "FreeRTOS.h"
+#include "queue.h"
 #include "riff_utils.h"
 #include "sampler_cfg.h"
 
@@ -43,13 +44,58 @@
     #define PATCH_LOADER_PRINTF_DEBUG(fmt, args...)   /* Nothing */
 #endif
 
+// The instrument information file is read and parsed in chunks of this size (stack of the loader task)
+#ifndef JSON_READ_CHUNK_SIZE
+    #define JSON_READ_CHUNK_SIZE 512
+#endif
+
+// Number of sample files the reader can load ahead of the parser
+#define SAMPLE_LOADER_READ_AHEAD 2
+
 typedef struct {
     char file_path[MAX_PATH_LEN];
     char file_dir[MAX_PATH_LEN];
 } file_path_t;
 
-PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const char * json_file_fullpath);
+// State of the instrument information decoder. Passed to the JSON parser callback
+typedef struct {
+    PATCH_DESCRIPTOR_t       *patch_descriptor;
+    KEY_VOICE_INFORMATION_t  *current_voice;     // Sample being decoded. NULL outside of the samples
+    uint8_t                   midi_note;         // Note of the sample being decoded
+    uint8_t                   sample_depth;      // Depth of the settings of the sample being decoded
+    uint8_t                   in_note_array;     // The samples of the note are listed in an array
+    uint8_t                   loop_start_found;
+    uint8_t                   loop_end_found;
+    uint32_t                  number_of_samples;
+    uint32_t                  error;             // Set when the decoding has to stop (i.e. out of memory)
+} JSON_PATCH_DECODER_t;
+
+// Load plan of a sample. Built before any audio data is read
+// The sample format of the zone holds the size and the destination of the audio data
+typedef struct {
+    KEY_VOICE_INFORMATION_t  *voice;             // Zone of the sample
+    FF_FileLocation_t         location;          // Directory entry of the file. The reads are sorted by its first cluster
+    uint32_t                  data_offset;       // Offset of the audio data in the file
+} SAMPLE_LOAD_PLAN_t;
+
+// Sample loader pipeline
+// The reader task loads the sample files while the patch loader commits the previous ones
+typedef struct {
+    SAMPLE_LOAD_PLAN_t       *load_plan;         // Samples to load, in read order
+    uint32_t                  number_of_samples; // Number of samples in the plan
+    volatile uint32_t        *abort;             // Set by the patch loader to skip the remaining reads
+    QueueHandle_t             result_queue;      // SAMPLE_READ_RESULT_t. One result per sample of the plan
+} SAMPLE_READ_REQUEST_t;
+
+typedef struct {
+    KEY_VOICE_INFORMATION_t  *voice;             // Zone of the sample
+    uint32_t                  error;             // 0 if the audio data was read. 1 if the read failed or was skipped
+} SAMPLE_READ_RESULT_t;
+
+PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const char * json_file_fullpath, QueueHandle_t progress_queue );
 PATCH_DESCRIPTOR_t * ulLoadPatchFromSF2( const char * sf2_file_fullpath );
+PATCH_DESCRIPTOR_t * ulLoadPatchFromBundle( const char * bundle_file_fullpath );
 void                 vPrintSF2FileInfo( const char * sf2_file_fullpath );
+void                 vUnloadPatch( PATCH_DESCRIPTOR_t *patch_descriptor );
 
 #endif
@@ -2,6 +2,7 @@
 #define __RIFF_UTILS_H__
 
 #include "sampler_cfg.h"
+#include "ff_stdio.h"
 
 #ifndef RIFF_PRINTF
     #define RIFF_PRINTF xil_printf
@@ -81,6 +82,29 @@ typedef struct {
     uint16_t          BitsPerSample; // (little endian) | 8 bits = 8, 16 bits = 16, etc.
 } FORMAT_DESCRIPTOR_CHUNK_t;
 
+// Sampler chunk. Followed by NumSampleLoops loop descriptors
+typedef struct {
+    RIFF_BASE_CHUNK_t BaseChunk;         // ID ("smpl") and Size
+    uint32_t          Manufacturer;
+    uint32_t          Product;
+    uint32_t          SamplePeriod;      // Period of one sample in ns
+    uint32_t          MIDIUnityNote;
+    uint32_t          MIDIPitchFraction;
+    uint32_t          SMPTEFormat;
+    uint32_t          SMPTEOffset;
+    uint32_t          NumSampleLoops;
+    uint32_t          SamplerData;       // Number of bytes of vendor data after the loops
+} SAMPLER_CHUNK_t;
+
+typedef struct {
+    uint32_t          CuePointID;
+    uint32_t          Type;              // 0 = Forward, 1 = Ping-pong, 2 = Backward
+    uint32_t          Start;             // First frame of the loop
+    uint32_t          End;               // Last frame of the loop (included)
+    uint32_t          Fraction;
+    uint32_t          PlayCount;         // 0 = Infinite
+} SAMPLER_LOOP_t;
+
 // Canonical RIFF data structure
 typedef struct {
     // RIFF Descriptor
@@ -90,7 +114,8 @@ typedef struct {
 } WAVE_FORMAT_t;
 
 
-void vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMPLE_FORMAT_t *sample_information );
+void     vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMPLE_FORMAT_t *sample_information );
+uint32_t ulReadWAVEHeader( FF_FILE *wave_file, SAMPLE_FORMAT_t *sample_information );
 void vPrintSF2Info( uint8_t* sf2_buffer, size_t sf2_buffer_len );
 
 #endif
@@ -0,0 +1,73 @@
+#ifndef __SAMPLE_BUNDLE_H__
+#define __SAMPLE_BUNDLE_H__
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////
+// Instrument Bundle
+////////////////////////////////////////////////////////////
+// Precompiled instrument (see source/sw/sampler_bundle.py)
+// The whole file is loaded with one read into one buffer
+// and the samples are played from that buffer
+//
+// |--------------------------|
+// |     BUNDLE_HEADER_t      |
+// |--------------------------|
+// |  BUNDLE_ZONE_t [0]       |
+// |  ...                     |
+// |  BUNDLE_ZONE_t [n-1]     |
+// |==========================| <- data_offset
+// |  PCM [0] + loop guard    |
+// |  ...                     |
+// |  PCM [n-1] + loop guard  |
+// |--------------------------|
+//
+// All fields are little endian
+// The PCM data is 16-bit stereo, starts on a 4-byte boundary and is
+// followed by SAMPLER_DMA_BURST_BYTES of room for the loop guard
+////////////////////////////////////////////////////////////
+
+#define BUNDLE_FILE_EXTENSION   ".zsb"
+#define BUNDLE_MAGIC            0x3142535A // "ZSB1"
+#define BUNDLE_VERSION          1
+#define BUNDLE_NAME_LEN         64
+#define BUNDLE_DATA_ALIGN       4
+#define MAX_BUNDLE_FILE_SIZE    0x7F00000  // 133MB
+
+// Bundle header. Followed by number_of_zones zone records
+typedef struct {
+    uint32_t magic;                            // BUNDLE_MAGIC
+    uint16_t version;                          // BUNDLE_VERSION
+    uint16_t header_size;                      // sizeof(BUNDLE_HEADER_t)
+    uint16_t zone_size;                        // sizeof(BUNDLE_ZONE_t)
+    uint16_t number_of_zones;                  // Number of zone records
+    uint8_t  retrigger_mode;                   // RETRIGGER_MODE_*
+    uint8_t  max_instances;                    // Maximum number of instances of each zone
+    uint16_t rsvd;
+    uint32_t data_offset;                      // Offset of the PCM data from the start of the file
+    uint32_t data_size;                        // Size of the PCM data (including the loop guards)
+    char     instrument_name[BUNDLE_NAME_LEN]; // NULL terminated
+} BUNDLE_HEADER_t;
+
+// Zone record. One per key/velocity range
+typedef struct {
+    uint8_t  key;                              // MIDI note of the zone
+    uint8_t  velocity_min;                     // Lower end of the velocity range
+    uint8_t  velocity_max;                     // Higher end of the velocity range
+    uint8_t  root_key;                         // MIDI note of the sample at its original rate
+    uint8_t  key_min;                          // Lowest key played with this sample
+    uint8_t  key_max;                          // Highest key played with this sample
+    uint8_t  loop_enabled;                     // The sample is looped until the note is released
+    uint8_t  rsvd;
+    int16_t  fine_tune;                        // Tuning correction in cents
+    uint16_t number_of_channels;               // Always 2
+    uint32_t sample_rate;                      // 8000, 44100, etc.
+    uint16_t bits_per_sample;                  // Always 16
+    uint16_t block_align;                      // Bytes per frame
+    uint32_t audio_offset;                     // Offset of the PCM data of the zone from data_offset
+    uint32_t audio_size;                       // Size of the PCM data of the zone (without the loop guard)
+    uint32_t loop_start;                       // First frame of the loop
+    uint32_t loop_end;                         // First frame after the loop
+} BUNDLE_ZONE_t;
+
+#endif
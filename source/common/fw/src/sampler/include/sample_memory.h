@@ -0,0 +1,52 @@
+//////////////////////////////////////////
+// Sample Memory
+//////////////////////////////////////////
+
+#ifndef SAMPLE_MEMORY_H
+#define SAMPLE_MEMORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Small allocations of an arena (descriptor, keys, zones) share chunks of this size
+// Larger allocations (audio data) get a block of their own
+#define SAMPLE_ARENA_CHUNK_SIZE       0x10000
+#define SAMPLE_ARENA_SMALL_ALLOC_MAX  ( SAMPLE_ARENA_CHUNK_SIZE / 4 )
+
+// Block of the sample memory region. The payload starts SAMPLE_MEMORY_ALIGN bytes after the header
+typedef struct SAMPLE_MEMORY_BLOCK_s {
+    struct SAMPLE_MEMORY_BLOCK_s *next;        // Next free block (by address) or next block of the same arena
+    uint32_t                      size;        // Size of the block, including the header
+} SAMPLE_MEMORY_BLOCK_t;
+
+// Arena. Everything allocated from an arena is released at once
+typedef struct SAMPLE_ARENA_s {
+    struct SAMPLE_ARENA_s        *next;        // Next live arena (for the report)
+    SAMPLE_MEMORY_BLOCK_t        *blocks;      // Blocks owned by the arena
+    uint8_t                      *chunk_ptr;   // Next free byte of the current chunk
+    uint32_t                      chunk_free;  // Free bytes of the current chunk
+    uint32_t                      size;        // Bytes taken from the region (including the headers)
+    uint32_t                      used;        // Bytes handed out by the arena
+    uint32_t                      number_of_blocks;
+} SAMPLE_ARENA_t;
+
+// Region usage
+typedef struct {
+    uint32_t region_start;                     // Address of the region
+    uint32_t region_size;                      // Size of the region
+    uint32_t used;                             // Bytes taken by the arenas
+    uint32_t peak_used;                        // Maximum number of bytes taken at the same time
+    uint32_t free;                             // Bytes in the free blocks
+    uint32_t largest_free_block;               // Largest allocation that can succeed (including its header)
+    uint32_t free_blocks;                      // Number of free blocks. 1 means no fragmentation
+    uint32_t arenas;                           // Number of live arenas
+    uint32_t failed_allocations;               // Allocations that didn't fit
+} SAMPLE_MEMORY_STATS_t;
+
+SAMPLE_ARENA_t * xSampleArenaCreate( void );
+void           * pvSampleArenaAlloc( SAMPLE_ARENA_t *arena, size_t size );
+void             vSampleArenaDestroy( SAMPLE_ARENA_t *arena );
+void             vGetSampleMemoryStats( SAMPLE_MEMORY_STATS_t *stats );
+void             vPrintSampleMemoryReport( void );
+
+#endif
@@ -14,6 +14,14 @@
 #define PRINT_SF2_INFO_TASK_NAME            "print_sf2_info"
 #define RUN_MIDI_CMD_TASK_NAME              "run_midi_cmd"
 #define SERIAL_MIDI_LISTENER_TASK_TASK_NAME "serial_midi_listener_task"
+#define VOICE_REAPER_TASK_NAME              "voice_reaper"
+#define SAMPLE_READER_TASK_NAME             "sample_reader"
+
+// Period of the voice reaper (one audio block)
+#define VOICE_REAPER_PERIOD_MS              5
+
+// Time given to the voices of a replaced instrument to finish before they are stopped
+#define PATCH_RETIRE_TIMEOUT_MS             2000
 
 typedef struct {
     char file_path[MAX_PATH_LEN];
@@ -21,11 +29,35 @@ typedef struct {
     xQueueHandle return_handle;
 } file_path_handler_t;
 
+// Progress messages sent on the return_handle before the return value
+// [31] = 1 | [30:16] = Samples loaded | [15:0] = Number of samples
+#define LOAD_PROGRESS_FLAG                   0x80000000
+#define LOAD_PROGRESS(__DONE__, __TOTAL__)   ( LOAD_PROGRESS_FLAG | ( ( (__DONE__) & 0x7fff ) << 16 ) | ( (__TOTAL__) & 0xffff ) )
+#define LOAD_PROGRESS_DONE(__MSG__)          ( ( (__MSG__) >> 16 ) & 0x7fff )
+#define LOAD_PROGRESS_TOTAL(__MSG__)         ( (__MSG__) & 0xffff )
+
+// Notification of the instrument loader task that there are pending program changes (see vRequestProgramChange())
+// The other notifications are queue handles, which never have bit 31 set (DDR)
+#define LOAD_PROGRAM_CHANGE_FLAG             0x80000000
+
+// Channel played by the play_key command (MIDI channel 1)
+#define KEY_PLAYBACK_CHANNEL                 0
+
 typedef struct {
     uint8_t key;
     uint8_t velocity;
 } key_parameters_t;
 
 void vRegisterSamplerEngineTasks ( void );
+void vUnloadRoutedPatches ( void );
+void vPublishChannelRoutes ( const CHANNEL_ROUTE_t *new_routes, uint16_t channel_mask );
+void vPublishChannelPatch ( uint8_t channel, PATCH_DESCRIPTOR_t *new_patch );
+uint32_t ulEvictPatch ( PATCH_DESCRIPTOR_t *patch );
+uint32_t ulAcquireChannelRoute ( uint8_t channel, CHANNEL_ROUTE_t *channel_route );
+void vReleaseChannelRoute ( CHANNEL_ROUTE_t *channel_route );
+void vAcquireAllChannelRoutes ( CHANNEL_ROUTE_t *all_channel_routes );
+void vReleaseAllChannelRoutes ( CHANNEL_ROUTE_t *all_channel_routes );
+void vRequestProgramChange ( uint8_t channel, uint8_t program );
+void vPrintChannelRoutesReport ( void );
 
 #endif
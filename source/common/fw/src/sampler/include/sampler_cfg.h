@@ -3,8 +3,11 @@
 
 // Enable/Disable FreeRTOS malloc() implementation
 #define ENABLE_FREERTOS_MALLOC 1
-// Enable/disable data realignment
-#define ENABLE_SAMPLE_REALIGN 0
+// Alignment of the audio data in memory (Cortex-A9 cache line)
+#define SAMPLE_MEMORY_ALIGN    32
+#define SAMPLE_MEMORY_ALIGN_SIZE(size) ( ( (size) + SAMPLE_MEMORY_ALIGN - 1 ) & ~( SAMPLE_MEMORY_ALIGN - 1 ) )
+// Size of the sample memory region (at the top of the DDR, outside the FreeRTOS heap)
+#define SAMPLE_MEMORY_REGION_SIZE 0x10000000 // 256MB
 // Debug level
 #ifndef SAMPLER_DEBUG
   #define SAMPLER_DEBUG      0
@@ -57,6 +60,7 @@
 #endif
 
 #include "jsmn_utils.h"
+#include "sampler_dma_controller_regs.h"
 
 // Endinaness conversion
 // 12_34 -> 34_12
@@ -66,18 +70,40 @@
 #define TOGGLE_ENDIAN_32(__DATA__) (( ( __DATA__ & 0xff000000) >> 24 ) | ( ( __DATA__ & 0xff0000  ) >> 8  ) | ( ( __DATA__ & 0xff00    ) << 8  ) | ( ( __DATA__ & 0xff      ) << 24 ))                                    
 
 // Instrument information
-#define MAX_INST_FILE_SIZE  20000     // 20k Characters for the json file
 #define MAX_SF2_FILE_SIZE   0x7F00000 // 133MB
 #define MAX_SAMPLE_SIZE     0x1F00000 // 32MB
 #define MAX_NUM_OF_KEYS     128       // The MIDI spec allows for 128 keys
 #define MAX_NUM_OF_VELOCITY 128       // 7 bits of veolcity information according to the MIDI specification
+#define MAX_NUM_OF_ZONES    1024      // Maximum number of key/velocity zones with a sample
+#define MAX_ACTIVE_ZONES    64        // Same as the number of voices of the DMA engine
+#define ZONE_INDEX_NONE     0xffff    // No zone mapped to the key/velocity pair
+#define MAX_ZONE_INSTANCES  8         // Maximum number of DMA slots playing the same zone at the same time
+// Retrigger modes. What to do when a note-on hits a zone (or key) that is already playing
+#define RETRIGGER_MODE_RESTART       0 // Stop the instances of the zone and start a new one
+#define RETRIGGER_MODE_LAYER         1 // Start a new instance on top of the others. The oldest one is stopped when the zone is full
+#define RETRIGGER_MODE_CHOKE         2 // Stop the instances of all the zones of the key and start a new one
+// MIDI channel routing
+#define MIDI_NUM_OF_CHANNELS         16        // Each channel plays its own instruments. The channel is also the voice allocator instrument (polyphony cap)
+#define MAX_CHANNEL_PARTS            4         // Instruments a channel can play (keyboard splits and layers)
+#define MIDI_CHANNEL_ALL             0xff      // All the channels at once
+#define MIDI_CHANNEL_MASK_ALL        0xffff    // Bit N = Channel N
 // Tokens
-#define NUM_OF_SAMPLE_JSON_MEMBERS   3
 #define INSTRUMENT_NAME_TOKEN_STR    "instrument_name"
 #define INSTRUMENT_SAMPLES_TOKEN_STR "samples"
 #define SAMPLE_VEL_MIN_TOKEN_STR     "velocity_min"
 #define SAMPLE_VEL_MAX_TOKEN_STR     "velocity_max"
 #define SAMPLE_PATH_TOKEN_STR        "sample_file"
+#define SAMPLE_LOOP_START_TOKEN_STR  "loop_start"
+#define SAMPLE_LOOP_END_TOKEN_STR    "loop_end"
+#define SAMPLE_ROOT_KEY_TOKEN_STR    "root_key"
+#define SAMPLE_FINE_TUNE_TOKEN_STR   "fine_tune"
+#define SAMPLE_KEY_MIN_TOKEN_STR     "key_min"
+#define SAMPLE_KEY_MAX_TOKEN_STR     "key_max"
+#define RETRIGGER_MODE_TOKEN_STR     "retrigger_mode"
+#define MAX_INSTANCES_TOKEN_STR      "max_instances"
+#define RETRIGGER_RESTART_TOKEN_STR  "restart"
+#define RETRIGGER_LAYER_TOKEN_STR    "layer"
+#define RETRIGGER_CHOKE_TOKEN_STR    "choke"
 #define MAX_PATH_LEN                 100
 // Sample file format
 #define SAMPLE_FORMAT_RAW            0
@@ -101,6 +127,9 @@ typedef struct {
     uint16_t       bits_per_sample;    // 8 bits = 8, 16 bits = 16, etc.
     uint32_t       audio_data_size;    // Size of the actual audio data
     uint8_t       *data_start_ptr;     // Memory location where the audio data starts
+    uint8_t        loop_present;       // The file defines a loop (WAVE "smpl" chunk or SF2 sample header)
+    uint32_t       loop_start;         // First frame of the loop
+    uint32_t       loop_end;           // First frame after the loop
 } SAMPLE_FORMAT_t; // Note. Raw data is little endian
 
 ////////////////////////////////////////////////////////////
@@ -108,12 +137,18 @@ typedef struct {
 ////////////////////////////////////////////////////////////
 
 // This data structure holds the information of each particular sample and under what cirumstances it should be played
+// Only used while loading. The playback uses the zone table of the patch
 typedef struct {
-    uint8_t          current_status;                     // 1 = Currently in playback, 0 = Idle
-    uint8_t          current_slot;                       // Current slot
     uint8_t          velocity_min;                       // Lower end of the velocity curve
     uint8_t          velocity_max;                       // Higher end of the velocity curve
     uint8_t          sample_present;                     // A sample is present
+    uint8_t          root_key;                           // MIDI note of the sample at its original rate
+    int16_t          fine_tune;                          // Tuning correction in cents
+    uint8_t          key_min;                            // Lowest key played with this sample
+    uint8_t          key_max;                            // Highest key played with this sample. Not above the root key
+    uint8_t          loop_enabled;                       // The sample is looped until the note is released
+    uint32_t         loop_start;                         // First frame of the loop
+    uint32_t         loop_end;                           // First frame after the loop
     uint8_t          sample_path[MAX_CHAR_IN_TOKEN_STR]; // Path of the sample relative to the information file
     SAMPLE_FORMAT_t  sample_format;                      // The sample format
 } KEY_VOICE_INFORMATION_t;
@@ -124,16 +159,88 @@ typedef struct {
     KEY_VOICE_INFORMATION_t  *key_voice_information[MAX_NUM_OF_VELOCITY];     // Pointer to the first key voice information (the lowest velocity)
 } KEY_INFORMATION_t;
 
+// Load-time information of a patch
+// It lives in its own arena, which is released once the zone table is built
+typedef struct {
+    struct SAMPLE_ARENA_s *arena;                              // Memory of the load-time information
+    KEY_INFORMATION_t     *key_information[MAX_NUM_OF_KEYS];   // Pointer to the key information of key 0
+} PATCH_LOAD_INFO_t;
+
+////////////////////////////////////////////////////////////
+// Zone table data structures
+////////////////////////////////////////////////////////////
+// The zone table is a struct of arrays indexed by zone, allocated in the arena of the patch
+// A note-on reads the zone LUT, then one entry of each array of its zone
+
+// What the DMA needs to play a zone. Two zones per cache line
+typedef struct {
+    uint32_t sample_addr;                      // Address of the audio data
+    uint32_t sample_size;                      // Size of the audio data in bytes
+    uint32_t loop_start;                       // First byte of the loop
+    uint32_t loop_end;                         // First byte after the loop. 0 if the zone isn't looped
+} ZONE_PLAYBACK_t;
+
+// Pitch of a zone
+typedef struct {
+    uint8_t  root_key;                         // MIDI note of the sample at its original rate
+    uint8_t  rsvd;
+    int16_t  fine_tune;                        // Tuning correction in cents
+} ZONE_PITCH_t;
+
+// Playback state of a zone
+typedef struct {
+    uint8_t  number_of_instances;                   // Number of instances in playback. 0 = Idle
+    uint8_t  rsvd;
+    uint16_t active_index;                          // Position in the active zone list (only valid during playback)
+    uint8_t  instance_slots[MAX_ZONE_INSTANCES];    // DMA voice slot of each instance, from oldest to newest
+    uint8_t  instance_note[MAX_ZONE_INSTANCES];     // MIDI note that started each instance
+    uint8_t  instance_channel[MAX_ZONE_INSTANCES];  // MIDI channel that started each instance
+    uint32_t instance_sequence[MAX_ZONE_INSTANCES]; // Note-on sequence number of each instance
+} ZONE_STATE_t;
+
 // This is the main patch data structure. It contains all the information necessary to play it
-// Each patch should have at least 1 key that is defined in the KEY_INFORMATION_t data structure
 typedef struct {
     uint8_t            instrument_name[MAX_CHAR_IN_TOKEN_STR]; // 256 Characters
     uint8_t            instrument_loaded;                      // Indicates that the instrument has been loaded
+    uint8_t            retrigger_mode;                         // Retrigger mode of the zones
+    uint8_t            max_instances;                          // Maximum number of instances of each zone
+    uint32_t           instance_sequence;                      // Note-on counter. Used to release the instances in order
     uint32_t           total_size;                             // Indicates the memory consumption for the instrument
+    struct SAMPLE_ARENA_s *arena;                              // Memory of the patch (see sample_memory.h). Released at once
     uint32_t           total_keys;                             // Indicates the number of keys loaded
-    KEY_INFORMATION_t *key_information[MAX_NUM_OF_KEYS];       // Pointer to the key information of key 0
+    PATCH_LOAD_INFO_t *load_info;                              // Load-time information. NULL once the instrument is loaded
+    volatile uint32_t  readers;                                // Number of tasks holding the instrument (see ulAcquireChannelRoute())
+    uint8_t            cached;                                 // Owned by the instrument cache. Kept in memory when no channel plays it
+    // Zone table. Built by the patch loader once all the samples are loaded
+    uint16_t                 number_of_zones;                                 // Number of zones in the zone table
+    ZONE_PLAYBACK_t         *zone_playback;                                   // Audio data and loop of each zone
+    ZONE_PITCH_t            *zone_pitch;                                      // Pitch of each zone
+    ZONE_STATE_t            *zone_state;                                      // Instances of each zone
+    uint16_t                 zone_lut[MAX_NUM_OF_KEYS][MAX_NUM_OF_VELOCITY];  // Key/Velocity -> Zone index (ZONE_INDEX_NONE if not mapped)
+    // Active zone index. Zones that are currently being played back
+    uint16_t                 number_of_active_zones;                          // Number of zones in playback
+    uint16_t                 active_zones[MAX_ACTIVE_ZONES];                  // Zone indexes of the zones in playback
+    uint16_t                 slot_zone[MAX_VOICES];                           // DMA voice slot -> Zone index (ZONE_INDEX_NONE if not used)
 } PATCH_DESCRIPTOR_t;
 
+////////////////////////////////////////////////////////////
+// MIDI channel routing data structures
+////////////////////////////////////////////////////////////
+
+// Instrument played by a channel over a key range
+// The parts of a channel with overlapping key ranges are layered. The ones with disjoint ranges split the keyboard
+typedef struct {
+    PATCH_DESCRIPTOR_t *patch;                 // Instrument of the part
+    uint8_t             key_min;               // Lowest key played by the part
+    uint8_t             key_max;               // Highest key played by the part
+} CHANNEL_PART_t;
+
+// Instruments of a MIDI channel
+typedef struct {
+    uint8_t             number_of_parts;       // 0 = The channel doesn't play
+    CHANNEL_PART_t      parts[MAX_CHANNEL_PARTS];
+} CHANNEL_ROUTE_t;
+
 // This structure is used to create the lookup table to correlate the JSON note names with the MIDI note numbers
 typedef struct {
     uint8_t note_name[4]; // Example: "C3_S" (C3 Sharp)
@@ -16,8 +16,14 @@
     #endif
 #endif
 
-uint32_t ulStopAllPlayback( PATCH_DESCRIPTOR_t *instrument_information );
-uint32_t ulPlayInstrumentKey( uint8_t key, uint8_t velocity, PATCH_DESCRIPTOR_t *instrument_information );
+void     vSamplerEngineInit( void );
+uint32_t ulStopAllPlayback( const CHANNEL_ROUTE_t *channel_routes );
+uint32_t ulStopPatchPlayback( PATCH_DESCRIPTOR_t *instrument_information );
+uint32_t ulStopChannelPlayback( uint8_t channel, const CHANNEL_ROUTE_t *channel_route );
+uint32_t ulPlayChannelKey( uint8_t channel, uint8_t key, uint8_t velocity, const CHANNEL_ROUTE_t *channel_route );
+uint32_t ulSetChannelVoiceLimit( uint8_t channel, uint8_t voice_limit );
+uint32_t ulReleaseFinishedVoices( void );
+void     vSamplerEngineCommit( void );
 uint8_t  usGetMIDINoteNumber( const char *note_name );
 
 #endif
@@ -573,5 +573,7 @@ typedef struct {
   SF_PDATA_LIST_DESCRIPTOR_t sf_pdata_list_descriptor;
 } SF_DESCRIPTOR_t;
 
+// Functions
+void vDecodeSF2SampleLoop( const SF_SHDR_CHUNK_DATA_t *sample_header, SAMPLE_FORMAT_t *sample_information );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+////////////////////////////////////////////////////////
+// JSON Stream Parser
+////////////////////////////////////////////////////////
+// Byte-driven JSON state machine. The document is parsed in a single pass
+// while it is read, so it never has to be in memory as a whole
+// - An event is dispatched for each value with its member name and the member
+//   name of the object that holds it. Nothing is kept after the callback
+// - Only the member names of the open containers and the value being received
+//   are stored, so the memory doesn't depend on the size of the document
+// - Like jsmn in non-strict mode, trailing commas are accepted
+// The parser doesn't allocate memory nor call the OS, so it can be called from any context
+////////////////////////////////////////////////////////
+
+// C includes
+#include <string.h>
+
+// Sampler Includes
+#include "json_stream.h"
+
+// Parser states
+#define JSON_STATE_VALUE     0 // Expecting a value (or the end of an array)
+#define JSON_STATE_KEY       1 // Expecting a member name (or the end of an object)
+#define JSON_STATE_COLON     2 // Expecting the ':' after a member name
+#define JSON_STATE_NEXT      3 // Expecting a ',' or the end of the container after a value
+#define JSON_STATE_STRING    4 // Receiving a string (member name or value)
+#define JSON_STATE_PRIMITIVE 5 // Receiving a number, true, false or null
+
+// Escape sequences
+#define JSON_ESCAPE_NONE     0
+#define JSON_ESCAPE_START    1 // The next character is the escaped one
+#define JSON_ESCAPE_UNICODE  5 // \uXXXX. Counts down the 4 hex digits, which are skipped
+
+// This function returns the member name of the value being received ("" in arrays and at the root)
+static const char * prv_pcValueKey( const JSON_STREAM_t *parser ) {
+    if ( parser->depth == 0 || parser->container_is_array[parser->depth] ) return "";
+    return parser->key;
+}
+
+// This function dispatches an event for a value held by the current container
+static void prv_vDispatchEvent( JSON_STREAM_t *parser, JSON_STREAM_EVENT_e type, uint8_t depth, const char *key, const char *value ) {
+    JSON_STREAM_EVENT_t event;
+
+    if ( parser->callback == NULL ) return;
+
+    event.type       = type;
+    event.depth      = depth;
+    event.truncated  = parser->truncated;
+    event.key        = key;
+    event.parent_key = parser->container_key[depth];
+    event.value      = value;
+
+    parser->callback( &event, parser->context );
+}
+
+// This function ends a string/primitive value
+static void prv_vEndValue( JSON_STREAM_t *parser, JSON_STREAM_EVENT_e type ) {
+    parser->value_buffer[parser->value_length] = '\0';
+
+    prv_vDispatchEvent( parser, type, parser->depth, prv_pcValueKey( parser ), parser->value_buffer );
+
+    parser->value_length = 0;
+    parser->truncated    = 0;
+    parser->state        = JSON_STATE_NEXT;
+    if ( parser->depth == 0 ) parser->done = 1;
+}
+
+// This function opens an object/array
+static uint32_t prv_ulOpenContainer( JSON_STREAM_t *parser, uint8_t is_array ) {
+    const char *key = prv_pcValueKey( parser );
+
+    if ( parser->depth >= JSON_STREAM_MAX_DEPTH ) return 1;
+
+    prv_vDispatchEvent( parser, is_array ? JSON_STREAM_ARRAY_START : JSON_STREAM_OBJECT_START, parser->depth, key, "" );
+
+    parser->depth++;
+    parser->container_is_array[parser->depth] = is_array;
+    strncpy( parser->container_key[parser->depth], key, JSON_STREAM_MAX_KEY_LEN - 1 );
+    parser->container_key[parser->depth][JSON_STREAM_MAX_KEY_LEN - 1] = '\0';
+
+    parser->state = is_array ? JSON_STATE_VALUE : JSON_STATE_KEY;
+
+    return 0;
+}
+
+// This function closes an object/array. It must be the innermost open container
+static uint32_t prv_ulCloseContainer( JSON_STREAM_t *parser, uint8_t is_array ) {
+
+    if ( parser->depth == 0 || parser->container_is_array[parser->depth] != is_array ) return 1;
+
+    parser->depth--;
+
+    prv_vDispatchEvent( parser, is_array ? JSON_STREAM_ARRAY_END : JSON_STREAM_OBJECT_END, parser->depth, parser->container_key[parser->depth + 1], "" );
+
+    parser->state = JSON_STATE_NEXT;
+    if ( parser->depth == 0 ) parser->done = 1;
+
+    return 0;
+}
+
+// This function stores a character of a string/primitive. The characters that don't fit are dropped
+static void prv_vAppendChar( JSON_STREAM_t *parser, char character ) {
+    if ( parser->in_key ) {
+        if ( parser->key_length < JSON_STREAM_MAX_KEY_LEN - 1 ) parser->key[parser->key_length++] = character;
+        return;
+    }
+
+    if ( parser->value_length < parser->value_buffer_size - 1 ) {
+        parser->value_buffer[parser->value_length++] = character;
+    } else {
+        parser->truncated = 1;
+    }
+}
+
+// This function handles a character of a string
+static uint32_t prv_ulProcessStringByte( JSON_STREAM_t *parser, uint8_t json_byte ) {
+
+    // Escape sequences
+    if ( parser->escape == JSON_ESCAPE_START ) {
+        parser->escape = JSON_ESCAPE_NONE;
+        switch ( json_byte ) {
+            case 'n': prv_vAppendChar( parser, '\n' ); break;
+            case 't': prv_vAppendChar( parser, '\t' ); break;
+            case 'r': prv_vAppendChar( parser, '\r' ); break;
+            case 'b': prv_vAppendChar( parser, '\b' ); break;
+            case 'f': prv_vAppendChar( parser, '\f' ); break;
+            case 'u': prv_vAppendChar( parser, '?'  ); parser->escape = JSON_ESCAPE_UNICODE; break;
+            default:  prv_vAppendChar( parser, (char) json_byte ); break; // \" \\ \/
+        }
+        return 0;
+    }
+
+    if ( parser->escape > JSON_ESCAPE_START ) {
+        parser->escape--;
+        if ( parser->escape == JSON_ESCAPE_START ) parser->escape = JSON_ESCAPE_NONE;
+        return 0;
+    }
+
+    if ( json_byte == '\\' ) {
+        parser->escape = JSON_ESCAPE_START;
+        return 0;
+    }
+
+    if ( json_byte != '"' ) {
+        prv_vAppendChar( parser, (char) json_byte );
+        return 0;
+    }
+
+    // End of the string
+    if ( parser->in_key ) {
+        parser->key[parser->key_length] = '\0';
+        parser->in_key = 0;
+        parser->state  = JSON_STATE_COLON;
+    } else {
+        prv_vEndValue( parser, JSON_STREAM_STRING );
+    }
+
+    return 0;
+}
+
+// This function initializes the parser
+// value_buffer holds the string/primitive being received. Longer values are truncated (see JSON_STREAM_EVENT_t)
+void vJSONStreamInit( JSON_STREAM_t *parser, JSON_STREAM_CALLBACK_t callback, void *context, char *value_buffer, size_t value_buffer_size ) {
+    memset( parser, 0x00, sizeof( JSON_STREAM_t ) );
+
+    parser->callback          = callback;
+    parser->context           = context;
+    parser->value_buffer      = value_buffer;
+    parser->value_buffer_size = value_buffer_size;
+    parser->state             = JSON_STATE_VALUE;
+    parser->line              = 1;
+}
+
+// This function processes a byte of the document
+// Returns 1 if the document is not valid JSON. The parser must be initialized again after an error
+uint32_t ulJSONStreamProcessByte( JSON_STREAM_t *parser, uint8_t json_byte ) {
+
+    if ( json_byte == '\n' ) parser->line++;
+
+    if ( parser->state == JSON_STATE_STRING ) return prv_ulProcessStringByte( parser, json_byte );
+
+    // A primitive ends on the first delimiter, which is then processed
+    if ( parser->state == JSON_STATE_PRIMITIVE ) {
+        if ( json_byte != ',' && json_byte != '}' && json_byte != ']' &&
+             json_byte != ' ' && json_byte != '\t' && json_byte != '\r' && json_byte != '\n' ) {
+            prv_vAppendChar( parser, (char) json_byte );
+            return 0;
+        }
+        prv_vEndValue( parser, JSON_STREAM_PRIMITIVE );
+    }
+
+    if ( json_byte == ' ' || json_byte == '\t' || json_byte == '\r' || json_byte == '\n' ) return 0;
+
+    // Only whitespace can follow the root value
+    if ( parser->done ) return 1;
+
+    switch ( parser->state ) {
+
+        case JSON_STATE_VALUE:
+            if ( json_byte == '{' ) return prv_ulOpenContainer( parser, 0 );
+            if ( json_byte == '[' ) return prv_ulOpenContainer( parser, 1 );
+            if ( json_byte == ']' ) return prv_ulCloseContainer( parser, 1 ); // Empty array or trailing comma
+            if ( json_byte == '}' || json_byte == ',' || json_byte == ':' ) return 1;
+            if ( json_byte == '"' ) {
+                parser->in_key = 0;
+                parser->state  = JSON_STATE_STRING;
+                return 0;
+            }
+            parser->state = JSON_STATE_PRIMITIVE;
+            prv_vAppendChar( parser, (char) json_byte );
+            return 0;
+
+        case JSON_STATE_KEY:
+            if ( json_byte == '}' ) return prv_ulCloseContainer( parser, 0 ); // Empty object or trailing comma
+            if ( json_byte != '"' ) return 1;
+            parser->in_key     = 1;
+            parser->key_length = 0;
+            parser->state      = JSON_STATE_STRING;
+            return 0;
+
+        case JSON_STATE_COLON:
+            if ( json_byte != ':' ) return 1;
+            parser->state = JSON_STATE_VALUE;
+            return 0;
+
+        case JSON_STATE_NEXT:
+            if ( json_byte == '}' ) return prv_ulCloseContainer( parser, 0 );
+            if ( json_byte == ']' ) return prv_ulCloseContainer( parser, 1 );
+            if ( json_byte != ',' || parser->depth == 0 ) return 1;
+            parser->state = parser->container_is_array[parser->depth] ? JSON_STATE_VALUE : JSON_STATE_KEY;
+            return 0;
+
+        default:
+            return 1;
+    }
+}
+
+// This function processes a chunk of the document. Returns 1 on the first error
+uint32_t ulJSONStreamProcessBuffer( JSON_STREAM_t *parser, const uint8_t *buffer, size_t length ) {
+    for ( size_t index = 0; index < length; index++ ) {
+        if ( ulJSONStreamProcessByte( parser, buffer[index] ) ) return 1;
+    }
+    return 0;
+}
+
+// This function ends the document. Returns 1 if it is incomplete
+uint32_t ulJSONStreamFinish( JSON_STREAM_t *parser ) {
+    if ( parser->state == JSON_STATE_PRIMITIVE && parser->depth == 0 ) prv_vEndValue( parser, JSON_STREAM_PRIMITIVE );
+
+    return ( parser->done && parser->depth == 0 ) ? 0 : 1;
+}
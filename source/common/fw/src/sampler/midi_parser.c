@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////
+// MIDI Stream Parser
+////////////////////////////////////////////////////////
+// Byte-driven MIDI state machine
+// - Running status (data bytes without a status byte reuse the last channel status)
+// - Realtime bytes (0xF8..0xFF) are dispatched immediately, even in the middle of a message
+// - SysEx messages are collected in a buffer provided by the caller
+// The parser doesn't allocate memory nor call the OS, so it can be called from any context
+////////////////////////////////////////////////////////
+
+// C includes
+#include <string.h>
+
+// Sampler Includes
+#include "midi_parser.h"
+
+// Number of data bytes of the channel messages (indexed by the upper nibble of the status - 8)
+static const uint8_t MIDI_CHANNEL_DATA_BYTES[8] = {
+    2, // 0x8n Note Off
+    2, // 0x9n Note On
+    2, // 0xAn Polyphonic Pressure
+    2, // 0xBn Control Change
+    1, // 0xCn Program Change
+    1, // 0xDn Channel Pressure
+    2, // 0xEn Pitch Bend
+    0  // 0xFn System (see below)
+};
+
+// Number of data bytes of the system common messages (indexed by the lower nibble of the status)
+// 0xFF means that the status doesn't start a message
+static const uint8_t MIDI_SYSTEM_DATA_BYTES[8] = {
+    0xff, // 0xF0 SysEx Start (handled separately)
+    1,    // 0xF1 MIDI Time Code Quarter Frame
+    2,    // 0xF2 Song Position Pointer
+    1,    // 0xF3 Song Select
+    0xff, // 0xF4 Undefined
+    0xff, // 0xF5 Undefined
+    0,    // 0xF6 Tune Request
+    0xff  // 0xF7 SysEx End (handled separately)
+};
+
+// This function dispatches the message that has been received
+static void prv_vDispatchMessage( MIDI_PARSER_t *parser ) {
+    MIDI_MESSAGE_t message;
+
+    if ( parser->callbacks.message_callback == NULL ) return;
+
+    if ( parser->running_status < MIDI_STATUS_SYSEX_START ) {
+        message.status  = parser->running_status & 0xF0;
+        message.channel = parser->running_status & 0x0F;
+    } else {
+        message.status  = parser->running_status;
+        message.channel = 0;
+    }
+    message.data1 = ( parser->expected_bytes > 0 ) ? parser->data[0] : 0;
+    message.data2 = ( parser->expected_bytes > 1 ) ? parser->data[1] : 0;
+
+    parser->callbacks.message_callback( &message, parser->callbacks.context );
+}
+
+// This function ends the SysEx message being received
+static void prv_vEndSysEx( MIDI_PARSER_t *parser ) {
+    parser->in_sysex = 0;
+
+    if ( parser->callbacks.sysex_callback != NULL ) {
+        parser->callbacks.sysex_callback( parser->sysex_buffer, parser->sysex_length, parser->sysex_truncated, parser->callbacks.context );
+    }
+}
+
+// This function handles a status byte (other than realtime)
+static void prv_vProcessStatus( MIDI_PARSER_t *parser, uint8_t status ) {
+
+    // Any status byte terminates a SysEx message
+    if ( parser->in_sysex ) prv_vEndSysEx( parser );
+
+    parser->data_count = 0;
+
+    // Channel messages. They set the running status
+    if ( status < MIDI_STATUS_SYSEX_START ) {
+        parser->running_status = status;
+        parser->expected_bytes = MIDI_CHANNEL_DATA_BYTES[ ( status >> 4 ) & 0x7 ];
+        return;
+    }
+
+    // System common messages. They clear the running status
+    parser->running_status = 0;
+    parser->expected_bytes = 0;
+
+    if ( status == MIDI_STATUS_SYSEX_START ) {
+        parser->in_sysex        = 1;
+        parser->sysex_truncated = 0;
+        parser->sysex_length    = 0;
+        return;
+    }
+
+    if ( MIDI_SYSTEM_DATA_BYTES[ status & 0x7 ] == 0xff ) return; // SysEx End or undefined
+
+    parser->expected_bytes = MIDI_SYSTEM_DATA_BYTES[ status & 0x7 ];
+
+    // Messages without data are dispatched right away
+    if ( parser->expected_bytes == 0 ) {
+        parser->running_status = status;
+        prv_vDispatchMessage( parser );
+        parser->running_status = 0;
+        return;
+    }
+
+    // System common messages with data don't keep the running status after they're done
+    parser->running_status = status;
+}
+
+// This function initializes the parser
+void vMIDIParserInit( MIDI_PARSER_t *parser, const MIDI_PARSER_CALLBACKS_t *callbacks, uint8_t *sysex_buffer, size_t sysex_buffer_size ) {
+    memset( parser, 0x00, sizeof( MIDI_PARSER_t ) );
+
+    if ( callbacks != NULL ) parser->callbacks = *callbacks;
+
+    parser->sysex_buffer      = sysex_buffer;
+    parser->sysex_buffer_size = ( sysex_buffer != NULL ) ? sysex_buffer_size : 0;
+}
+
+// This function drops the message being received and the running status
+void vMIDIParserReset( MIDI_PARSER_t *parser ) {
+    parser->running_status  = 0;
+    parser->expected_bytes  = 0;
+    parser->data_count      = 0;
+    parser->in_sysex        = 0;
+    parser->sysex_truncated = 0;
+    parser->sysex_length    = 0;
+}
+
+// This function feeds one byte to the parser
+void vMIDIParserProcessByte( MIDI_PARSER_t *parser, uint8_t midi_byte ) {
+
+    // Realtime bytes don't change the state of the parser
+    if ( MIDI_IS_REALTIME( midi_byte ) ) {
+        if ( parser->callbacks.realtime_callback != NULL ) parser->callbacks.realtime_callback( midi_byte, parser->callbacks.context );
+        return;
+    }
+
+    if ( MIDI_IS_STATUS( midi_byte ) ) {
+        prv_vProcessStatus( parser, midi_byte );
+        return;
+    }
+
+    // Data bytes
+    if ( parser->in_sysex ) {
+        if ( parser->sysex_length < parser->sysex_buffer_size ) {
+            parser->sysex_buffer[ parser->sysex_length++ ] = midi_byte;
+        } else {
+            parser->sysex_truncated = 1;
+        }
+        return;
+    }
+
+    // Data without status. Drop it
+    if ( parser->running_status == 0 ) return;
+
+    parser->data[ parser->data_count++ ] = midi_byte;
+
+    if ( parser->data_count < parser->expected_bytes ) return;
+
+    prv_vDispatchMessage( parser );
+    parser->data_count = 0;
+
+    // Only channel messages keep the running status
+    if ( parser->running_status >= MIDI_STATUS_SYSEX_START ) parser->running_status = 0;
+}
+
+// This function feeds a buffer to the parser
+void vMIDIParserProcessBuffer( MIDI_PARSER_t *parser, const uint8_t *buffer, size_t length ) {
+    for ( size_t i = 0; i < length; i++ ) vMIDIParserProcessByte( parser, buffer[i] );
+}
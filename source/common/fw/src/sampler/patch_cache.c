@@ -0,0 +1,541 @@
+//////////////////////////////////////////
+// Instrument Cache
+//////////////////////////////////////////
+// Keeps several instruments resident in the sample memory
+// - The instruments are keyed by the path of their patch file. A request for a
+//   resident instrument (hit) only returns its descriptor. A miss loads it
+// - The resident instruments can take up to PATCH_CACHE_BUDGET_BYTES. Above it,
+//   or if a load runs out of sample memory, the least recently used instruments
+//   are evicted. The instruments routed to a MIDI channel are never evicted
+// - MIDI programs are mapped to patch files (i.e. by the set list), so a program
+//   change between resident instruments is a route swap (see vPublishChannelRoutes())
+// - The set list can also route the programs to the MIDI channels, with keyboard
+//   splits/layers and a voice limit per channel
+// Only the instrument loader task modifies the cache
+//////////////////////////////////////////
+
+// C includes
+#include <stdlib.h>
+#include <string.h>
+
+// Xilinx Includes
+#include "xil_printf.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+// FreeRTOS+FAT includes
+#include "ff_stdio.h"
+#include "fat_CLI_apps.h"
+
+// JSMN
+#include "jsmn.h"
+#include "jsmn_utils.h"
+
+// Sampler Includes
+#include "sampler_cfg.h"
+#include "sampler_FreeRTOS_tasks.h"
+#include "patch_loader.h"
+#include "patch_cache.h"
+#include "sample_bundle.h"
+#include "sample_memory.h"
+#include "sampler_engine.h"
+
+// Static variables
+static PATCH_CACHE_ENTRY_t   cache_entries[PATCH_CACHE_MAX_ENTRIES];
+static PATCH_CACHE_PROGRAM_t program_map[PATCH_CACHE_MAX_PROGRAMS];
+static PATCH_CACHE_STATS_t   cache_stats;
+static uint32_t              cache_clock        = 0;
+static uint32_t              program_map_ready  = 0;
+static uint8_t               setlist_buffer[MAX_SETLIST_FILE_SIZE];
+
+//////////////////////////////////////////////////
+// Static Functions
+//////////////////////////////////////////////////
+static PATCH_CACHE_ENTRY_t * prv_xFindEntry( const char *file_path );
+static PATCH_CACHE_ENTRY_t * prv_xFindFreeEntry( void );
+static uint32_t              prv_ulEvictLeastRecentlyUsed( PATCH_CACHE_ENTRY_t *keep_entry );
+static uint32_t              prv_ulEvictEntry( PATCH_CACHE_ENTRY_t *entry );
+static PATCH_DESCRIPTOR_t  * prv_xFindProgramPatch( uint8_t program );
+static void                  prv_vEnforceBudget( PATCH_CACHE_ENTRY_t *keep_entry );
+static PATCH_DESCRIPTOR_t  * prv_xLoadPatch( const char *file_dir, const char *file_path, QueueHandle_t progress_queue );
+static uint32_t              prv_ulIsBundleFile( const char *file_path );
+static void                  prv_vInitProgramMap( void );
+static void                  prv_vGetFileDir( const char *file_path, char *file_dir );
+
+// This function returns an instrument, loading it if it isn't resident
+// Returns NULL if the instrument could not be loaded
+PATCH_DESCRIPTOR_t * xPatchCacheGet( const char *file_dir, const char *file_path, QueueHandle_t progress_queue ) {
+    PATCH_CACHE_ENTRY_t   *entry;
+    PATCH_DESCRIPTOR_t    *patch;
+    SAMPLE_MEMORY_STATS_t  memory_stats;
+    uint32_t               failed_allocations;
+
+    // Step 1 - Hit
+    entry = prv_xFindEntry( file_path );
+    if ( entry != NULL ) {
+        entry->last_used = ++cache_clock;
+        cache_stats.hits++;
+        SAMPLER_PRINTF_INFO("Instrument cache hit: %s", file_path);
+        return entry->patch;
+    }
+
+    cache_stats.misses++;
+    SAMPLER_PRINTF_INFO("Instrument cache miss: %s", file_path);
+
+    // Step 2 - Load the instrument. Nothing is evicted unless the load ran out of sample memory,
+    // so a load that fails for another reason (i.e. a missing file) doesn't cost a resident instrument
+    for ( ;; ) {
+        vGetSampleMemoryStats( &memory_stats );
+        failed_allocations = memory_stats.failed_allocations;
+
+        patch = prv_xLoadPatch( file_dir, file_path, progress_queue );
+        if ( patch != NULL ) break;
+
+        vGetSampleMemoryStats( &memory_stats );
+        if ( memory_stats.failed_allocations == failed_allocations || prv_ulEvictLeastRecentlyUsed( NULL ) ) {
+            cache_stats.load_errors++;
+            return NULL;
+        }
+
+        SAMPLER_PRINTF_INFO("Out of sample memory. Retrying the load");
+    }
+
+    // Step 3 - Make room for the entry
+    entry = prv_xFindFreeEntry();
+    if ( entry == NULL ) {
+        if ( prv_ulEvictLeastRecentlyUsed( NULL ) ) {
+            SAMPLER_PRINTF_ERROR("The instrument cache is full and no instrument can be evicted");
+            vUnloadPatch( patch );
+            cache_stats.load_errors++;
+            return NULL;
+        }
+        entry = prv_xFindFreeEntry();
+    }
+
+    // Step 4 - Insert the instrument. The cache owns it from now on
+    patch->cached = 1;
+    strncpy( entry->file_path, file_path, MAX_PATH_LEN - 1 );
+    strncpy( entry->file_dir,  file_dir,  MAX_PATH_LEN - 1 );
+    entry->file_path[MAX_PATH_LEN - 1] = '\0';
+    entry->file_dir[MAX_PATH_LEN - 1]  = '\0';
+    entry->patch     = patch;
+    entry->last_used = ++cache_clock;
+
+    cache_stats.entries++;
+    cache_stats.resident_size += patch->arena->size;
+
+    // Step 5 - Evict the least recently used instruments above the budget
+    prv_vEnforceBudget( entry );
+
+    return patch;
+}
+
+// This function returns the instrument mapped to a MIDI program, loading it if it isn't resident
+// Returns NULL if the program is not mapped or the instrument could not be loaded
+PATCH_DESCRIPTOR_t * xPatchCacheGetProgram( uint8_t program ) {
+
+    prv_vInitProgramMap();
+
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_PROGRAMS; index++ ) {
+        if ( program_map[index].program == program ) {
+            return xPatchCacheGet( program_map[index].file_dir, program_map[index].file_path, NULL );
+        }
+    }
+
+    SAMPLER_PRINTF_WARNING("Program %d is not mapped to an instrument", program);
+
+    return NULL;
+}
+
+// This function maps a MIDI program to a patch file. A mapped program is remapped
+uint32_t ulPatchCacheMapProgram( uint8_t program, const char *file_dir, const char *file_path ) {
+    PATCH_CACHE_PROGRAM_t *free_program = NULL;
+    PATCH_CACHE_PROGRAM_t *map_entry    = NULL;
+
+    if ( program > 127 ) {
+        SAMPLER_PRINTF_ERROR("Invalid MIDI program %d", program);
+        return 1;
+    }
+
+    prv_vInitProgramMap();
+
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_PROGRAMS; index++ ) {
+        if ( program_map[index].program == program ) {
+            map_entry = &program_map[index];
+            break;
+        }
+        if ( free_program == NULL && program_map[index].program == PATCH_CACHE_PROGRAM_NONE ) free_program = &program_map[index];
+    }
+
+    if ( map_entry == NULL ) map_entry = free_program;
+
+    if ( map_entry == NULL ) {
+        SAMPLER_PRINTF_ERROR("Too many programs. Maximum number of programs = %d", PATCH_CACHE_MAX_PROGRAMS);
+        return 1;
+    }
+
+    memset( map_entry, 0x00, sizeof( PATCH_CACHE_PROGRAM_t ) );
+    strncpy( map_entry->file_path, file_path, MAX_PATH_LEN - 1 );
+    strncpy( map_entry->file_dir,  file_dir,  MAX_PATH_LEN - 1 );
+    map_entry->program = program;
+
+    return 0;
+}
+
+// This function loads a set list. The programs are mapped and their instruments preloaded
+// channel_routes returns the routes of the MIDI_NUM_OF_CHANNELS channels. If the set list doesn't route
+// any channel, all the channels play the first program of the list
+// Returns the number of entries that could not be applied
+uint32_t ulPatchCacheLoadSetList( const char *setlist_file_path, CHANNEL_ROUTE_t *channel_routes ) {
+    jsmn_parser        parser;
+    jsmntok_t          tokens[256];
+    int                parser_result;
+    int                token;
+    int                number_of_keys;
+    char               setlist_dir[MAX_PATH_LEN];
+    char               relative_path[MAX_PATH_LEN];
+    char               file_path[MAX_PATH_LEN];
+    char               file_dir[MAX_PATH_LEN];
+    uint32_t           program;
+    uint32_t           channel;
+    uint32_t           key_min;
+    uint32_t           key_max;
+    uint32_t           voice_limit;
+    uint32_t           errors = 0;
+    uint8_t            first_program = PATCH_CACHE_PROGRAM_NONE;
+    SETLIST_PART_t     setlist_parts[MIDI_NUM_OF_CHANNELS * MAX_CHANNEL_PARTS];
+    uint32_t           number_of_parts = 0;
+    CHANNEL_ROUTE_t   *channel_route;
+    PATCH_DESCRIPTOR_t *patch;
+
+    memset( channel_routes, 0x00, MIDI_NUM_OF_CHANNELS * sizeof( CHANNEL_ROUTE_t ) );
+
+    // Step 1 - Load and parse the set list
+    memset( setlist_buffer, 0x00, MAX_SETLIST_FILE_SIZE );
+    if ( xLoadFileToMemory( setlist_file_path, setlist_buffer, MAX_SETLIST_FILE_SIZE - 1 ) == 0 ) {
+        SAMPLER_PRINTF_ERROR("The set list %s could not be loaded", setlist_file_path);
+        return 1;
+    }
+
+    jsmn_init( &parser );
+    parser_result = jsmn_parse( &parser, (const char *) setlist_buffer, strlen( (const char *) setlist_buffer ), tokens, 256 );
+    if ( parser_result < 0 ) {
+        SAMPLER_PRINTF_ERROR("There was a problem decoding the set list. Error code = %d", parser_result);
+        return 1;
+    }
+
+    memset( setlist_dir, 0x00, MAX_PATH_LEN );
+    prv_vGetFileDir( setlist_file_path, setlist_dir );
+
+    // Step 2 - Walk the entries. The program entries are objects with a program and a path
+    // The channel entries are objects with a channel and, optionally, a program, a key range and a voice limit
+    for ( token = 0; token < parser_result; token++ ) {
+
+        if ( tokens[token].type != JSMN_OBJECT || token == 0 ) continue;
+
+        program     = PATCH_CACHE_PROGRAM_NONE;
+        channel     = 0;
+        key_min     = 0;
+        key_max     = MAX_NUM_OF_KEYS - 1;
+        voice_limit = SETLIST_VOICE_LIMIT_NONE;
+        memset( relative_path, 0x00, MAX_PATH_LEN );
+
+        number_of_keys = tokens[token].size;
+        for ( int key = 0; key < number_of_keys && token + 2 < parser_result; key++ ) {
+            token++;
+            if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_PROGRAM_TOKEN_STR ) ) {
+                program = strtoul( (const char *) setlist_buffer + tokens[token + 1].start, NULL, 10 );
+            } else if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_CHANNEL_TOKEN_STR ) ) {
+                channel = strtoul( (const char *) setlist_buffer + tokens[token + 1].start, NULL, 10 );
+            } else if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_KEY_MIN_TOKEN_STR ) ) {
+                key_min = strtoul( (const char *) setlist_buffer + tokens[token + 1].start, NULL, 10 );
+            } else if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_KEY_MAX_TOKEN_STR ) ) {
+                key_max = strtoul( (const char *) setlist_buffer + tokens[token + 1].start, NULL, 10 );
+            } else if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_VOICE_LIMIT_TOKEN_STR ) ) {
+                voice_limit = strtoul( (const char *) setlist_buffer + tokens[token + 1].start, NULL, 10 );
+            } else if ( l_json_equal( (const char *) setlist_buffer, &tokens[token], SETLIST_PATH_TOKEN_STR ) &&
+                        ( tokens[token + 1].end - tokens[token + 1].start ) < MAX_PATH_LEN ) {
+                l_json_get_string( (const char *) setlist_buffer, &tokens[token + 1], relative_path );
+            }
+            token++;
+        }
+
+        // Channel entry. The programs are routed once all of them are mapped
+        if ( channel != 0 ) {
+            if ( channel > MIDI_NUM_OF_CHANNELS ) {
+                SAMPLER_PRINTF_ERROR("Invalid MIDI channel %d. The channels go from 1 to %d", channel, MIDI_NUM_OF_CHANNELS);
+                errors++;
+                continue;
+            }
+            if ( voice_limit != SETLIST_VOICE_LIMIT_NONE && ulSetChannelVoiceLimit( channel - 1, (uint8_t) voice_limit ) ) errors++;
+            if ( program == PATCH_CACHE_PROGRAM_NONE ) continue;
+            if ( program > 127 || key_min > key_max || key_max >= MAX_NUM_OF_KEYS || number_of_parts == MIDI_NUM_OF_CHANNELS * MAX_CHANNEL_PARTS ) {
+                SAMPLER_PRINTF_ERROR("Invalid part of channel %d", channel);
+                errors++;
+                continue;
+            }
+            setlist_parts[number_of_parts].channel = channel - 1;
+            setlist_parts[number_of_parts].program = program;
+            setlist_parts[number_of_parts].key_min = key_min;
+            setlist_parts[number_of_parts].key_max = key_max;
+            number_of_parts++;
+            continue;
+        }
+
+        if ( program > 127 || relative_path[0] == '\0' ) {
+            SAMPLER_PRINTF_ERROR("Set list entries need a program (0 to 127) and a path");
+            errors++;
+            continue;
+        }
+
+        // Relative paths start at the directory of the set list
+        memset( file_path, 0x00, MAX_PATH_LEN );
+        memset( file_dir,  0x00, MAX_PATH_LEN );
+        if ( relative_path[0] == '/' || setlist_dir[0] == '\0' ) {
+            strncpy( file_path, relative_path, MAX_PATH_LEN - 1 );
+        } else if ( strlen( setlist_dir ) + strlen( relative_path ) + 1 < MAX_PATH_LEN ) {
+            strcat( file_path, setlist_dir );
+            strcat( file_path, "/" );
+            strcat( file_path, relative_path );
+        } else {
+            SAMPLER_PRINTF_ERROR("The path of program %d is too long", program);
+            errors++;
+            continue;
+        }
+        prv_vGetFileDir( file_path, file_dir );
+
+        if ( ulPatchCacheMapProgram( program, file_dir, file_path ) ) {
+            errors++;
+            continue;
+        }
+
+        if ( first_program == PATCH_CACHE_PROGRAM_NONE ) first_program = program;
+
+        // Step 3 - Preload the instrument
+        SAMPLER_PRINTF_INFO("Set list: program %d -> %s", program, file_path);
+        if ( xPatchCacheGet( file_dir, file_path, NULL ) == NULL ) errors++;
+    }
+
+    // Step 4 - Route the programs to the channels. Without channel entries, all the channels play the first program
+    if ( number_of_parts == 0 && first_program != PATCH_CACHE_PROGRAM_NONE ) {
+        for ( channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+            setlist_parts[number_of_parts].channel = channel;
+            setlist_parts[number_of_parts].program = first_program;
+            setlist_parts[number_of_parts].key_min = 0;
+            setlist_parts[number_of_parts].key_max = MAX_NUM_OF_KEYS - 1;
+            number_of_parts++;
+        }
+    }
+
+    // Only the resident instruments are routed. Loading a program now could evict an instrument already routed
+    for ( uint32_t part = 0; part < number_of_parts; part++ ) {
+        channel_route = &channel_routes[setlist_parts[part].channel];
+        patch         = prv_xFindProgramPatch( setlist_parts[part].program );
+
+        if ( patch == NULL ) {
+            SAMPLER_PRINTF_ERROR("Program %d of channel %d is not resident", setlist_parts[part].program, setlist_parts[part].channel + 1);
+            errors++;
+            continue;
+        }
+
+        if ( channel_route->number_of_parts == MAX_CHANNEL_PARTS ) {
+            SAMPLER_PRINTF_ERROR("Too many parts on channel %d. Maximum number of parts = %d", setlist_parts[part].channel + 1, MAX_CHANNEL_PARTS);
+            errors++;
+            continue;
+        }
+
+        channel_route->parts[channel_route->number_of_parts].patch   = patch;
+        channel_route->parts[channel_route->number_of_parts].key_min = setlist_parts[part].key_min;
+        channel_route->parts[channel_route->number_of_parts].key_max = setlist_parts[part].key_max;
+        channel_route->number_of_parts++;
+
+        SAMPLER_PRINTF_INFO("Set list: channel %d, keys %d-%d -> program %d", setlist_parts[part].channel + 1, setlist_parts[part].key_min, setlist_parts[part].key_max, setlist_parts[part].program);
+    }
+
+    return errors;
+}
+
+// This function evicts all the instruments but the ones routed to a channel
+void vPatchCacheFlush( void ) {
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+        if ( cache_entries[index].patch != NULL ) prv_ulEvictEntry( &cache_entries[index] );
+    }
+}
+
+void vGetPatchCacheStats( PATCH_CACHE_STATS_t *stats ) {
+    if ( stats == NULL ) return;
+
+    vTaskSuspendAll();
+    *stats        = cache_stats;
+    stats->budget = PATCH_CACHE_BUDGET_BYTES;
+    xTaskResumeAll();
+}
+
+// This function prints the counters, the resident instruments (most recently used first) and the programs
+void vPrintPatchCacheReport( void ) {
+    PATCH_CACHE_STATS_t stats;
+    PATCH_CACHE_ENTRY_t entries[PATCH_CACHE_MAX_ENTRIES];
+    uint32_t            entry_size[PATCH_CACHE_MAX_ENTRIES];
+    uint32_t            requests;
+    uint32_t            last_printed = 0xffffffff;
+    int32_t             next_entry;
+
+    vGetPatchCacheStats( &stats );
+
+    // Copy the entries, so they can be printed without holding the scheduler
+    vTaskSuspendAll();
+    memcpy( entries, cache_entries, sizeof( entries ) );
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+        entry_size[index] = ( entries[index].patch != NULL ) ? entries[index].patch->arena->size : 0;
+    }
+    xTaskResumeAll();
+
+    requests = stats.hits + stats.misses;
+
+    SAMPLER_PRINTF("Resident instruments   : %d of %d\n\r", stats.entries, PATCH_CACHE_MAX_ENTRIES);
+    SAMPLER_PRINTF("Sample memory          : %d KB of %d KB\n\r", stats.resident_size >> 10, stats.budget >> 10);
+    SAMPLER_PRINTF("Hits                   : %d (%d%%)\n\r", stats.hits, ( requests != 0 ) ? ( stats.hits * 100 ) / requests : 0);
+    SAMPLER_PRINTF("Misses                 : %d\n\r", stats.misses);
+    SAMPLER_PRINTF("Evictions              : %d\n\r", stats.evictions);
+    SAMPLER_PRINTF("Load errors            : %d\n\r", stats.load_errors);
+
+    // Most recently used first
+    for ( ;; ) {
+        next_entry = -1;
+        for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+            if ( entries[index].patch == NULL || entries[index].last_used >= last_printed ) continue;
+            if ( next_entry < 0 || entries[index].last_used > entries[next_entry].last_used ) next_entry = index;
+        }
+        if ( next_entry < 0 ) break;
+
+        last_printed = entries[next_entry].last_used;
+        SAMPLER_PRINTF("  %s (%d KB)\n\r", entries[next_entry].file_path, entry_size[next_entry] >> 10);
+    }
+
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_PROGRAMS && program_map_ready; index++ ) {
+        if ( program_map[index].program == PATCH_CACHE_PROGRAM_NONE ) continue;
+        SAMPLER_PRINTF("  Program %3d -> %s\n\r", program_map[index].program, program_map[index].file_path);
+    }
+}
+
+// This function returns the entry of a resident instrument (NULL if it isn't resident)
+PATCH_CACHE_ENTRY_t * prv_xFindEntry( const char *file_path ) {
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+        if ( cache_entries[index].patch != NULL && strncmp( cache_entries[index].file_path, file_path, MAX_PATH_LEN ) == 0 ) {
+            return &cache_entries[index];
+        }
+    }
+    return NULL;
+}
+
+PATCH_CACHE_ENTRY_t * prv_xFindFreeEntry( void ) {
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+        if ( cache_entries[index].patch == NULL ) return &cache_entries[index];
+    }
+    return NULL;
+}
+
+// This function evicts the least recently used instrument that can be evicted
+// The routed instruments and keep_entry are skipped. Returns 1 if nothing could be evicted
+uint32_t prv_ulEvictLeastRecentlyUsed( PATCH_CACHE_ENTRY_t *keep_entry ) {
+    PATCH_CACHE_ENTRY_t *lru_entry;
+    uint32_t             skipped[PATCH_CACHE_MAX_ENTRIES];
+
+    memset( skipped, 0x00, sizeof( skipped ) );
+
+    for ( ;; ) {
+        lru_entry = NULL;
+        for ( uint32_t index = 0; index < PATCH_CACHE_MAX_ENTRIES; index++ ) {
+            if ( cache_entries[index].patch == NULL || &cache_entries[index] == keep_entry || skipped[index] ) continue;
+            if ( lru_entry == NULL || cache_entries[index].last_used < lru_entry->last_used ) lru_entry = &cache_entries[index];
+        }
+
+        if ( lru_entry == NULL ) return 1;
+
+        if ( prv_ulEvictEntry( lru_entry ) == 0 ) return 0;
+
+        // A routed instrument can't be evicted. Try the next one
+        skipped[lru_entry - cache_entries] = 1;
+    }
+}
+
+// This function releases a resident instrument. Returns 1 if it is routed to a channel
+uint32_t prv_ulEvictEntry( PATCH_CACHE_ENTRY_t *entry ) {
+    uint32_t patch_size = entry->patch->arena->size;
+
+    if ( ulEvictPatch( entry->patch ) ) return 1;
+
+    SAMPLER_PRINTF_INFO("Evicted %s from the instrument cache (%d KB)", entry->file_path, patch_size >> 10);
+
+    cache_stats.entries--;
+    cache_stats.resident_size -= patch_size;
+    cache_stats.evictions++;
+
+    memset( entry, 0x00, sizeof( PATCH_CACHE_ENTRY_t ) );
+
+    return 0;
+}
+
+// This function evicts the least recently used instruments until the resident ones fit in the budget
+void prv_vEnforceBudget( PATCH_CACHE_ENTRY_t *keep_entry ) {
+    while ( cache_stats.resident_size > PATCH_CACHE_BUDGET_BYTES ) {
+        if ( prv_ulEvictLeastRecentlyUsed( keep_entry ) ) {
+            SAMPLER_PRINTF_WARNING("The resident instruments take %d KB. The budget is %d KB", cache_stats.resident_size >> 10, PATCH_CACHE_BUDGET_BYTES >> 10);
+            break;
+        }
+    }
+}
+
+// This function returns the resident instrument of a MIDI program without loading it (NULL if it isn't resident)
+PATCH_DESCRIPTOR_t * prv_xFindProgramPatch( uint8_t program ) {
+    PATCH_CACHE_ENTRY_t *entry;
+
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_PROGRAMS && program_map_ready; index++ ) {
+        if ( program_map[index].program != program ) continue;
+
+        entry = prv_xFindEntry( program_map[index].file_path );
+        return ( entry != NULL ) ? entry->patch : NULL;
+    }
+
+    return NULL;
+}
+
+// This function loads an instrument. Precompiled bundles (.zsb) are loaded with a single read
+PATCH_DESCRIPTOR_t * prv_xLoadPatch( const char *file_dir, const char *file_path, QueueHandle_t progress_queue ) {
+    if ( prv_ulIsBundleFile( file_path ) ) return ulLoadPatchFromBundle( file_path );
+
+    return ulLoadPatchFromJSON( file_dir, file_path, progress_queue );
+}
+
+// This function returns 1 if the file is an instrument bundle (by its extension)
+uint32_t prv_ulIsBundleFile( const char *file_path ) {
+    size_t path_len      = strlen( file_path );
+    size_t extension_len = strlen( BUNDLE_FILE_EXTENSION );
+
+    if ( path_len < extension_len ) return 0;
+
+    return ( strcmp( file_path + path_len - extension_len, BUNDLE_FILE_EXTENSION ) == 0 );
+}
+
+// This function clears the program map the first time it is used
+void prv_vInitProgramMap( void ) {
+    if ( program_map_ready ) return;
+
+    memset( program_map, 0x00, sizeof( program_map ) );
+    for ( uint32_t index = 0; index < PATCH_CACHE_MAX_PROGRAMS; index++ ) program_map[index].program = PATCH_CACHE_PROGRAM_NONE;
+
+    program_map_ready = 1;
+}
+
+// This function gets the directory of a given file
+void prv_vGetFileDir( const char *file_path, char *file_dir ) {
+    const char *last_slash = strrchr( file_path, '/' );
+
+    file_dir[0] = '\0';
+    if ( last_slash == NULL ) return;
+
+    strncat( file_dir, file_path, last_slash - file_path );
+}
@@ -13,25 +13,36 @@
 // C includes
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 
 // Xilinx Includes
 #include "xil_io.h"
 
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
 // FreeRTOS+FAT includes
 #include "ff_stdio.h"
 #include "ff_ramdisk.h"
 #include "ff_sddisk.h"
 #include "fat_CLI_apps.h"
 
-// JSMN
-#include "jsmn.h"
-#include "jsmn_utils.h"
-
 // Sampler includes
 #include "sampler_cfg.h"
 #include "riff_utils.h"
+#include "sample_bundle.h"
+#include "sample_memory.h"
 #include "patch_loader.h"
+#include "json_stream.h"
+#include "sampler_FreeRTOS_tasks.h"
+
+// Sampler DMA includes
+#include "sampler_dma_controller_regs.h"
+#include "sampler_dma_voice_pb.h"
+#include "sampler_dma_cache.h"
 
 // Lookup table to correlate note names with MIDI notes
 static const NOTE_LUT_STRUCT_t MIDI_NOTES_LUT[12] = {
@@ -50,38 +61,58 @@ static const NOTE_LUT_STRUCT_t MIDI_NOTES_LUT[12] = {
 };
 
 // Static variables
-static uint8_t   json_patch_information_buffer[MAX_INST_FILE_SIZE]; // JSON File buffer
 static uint8_t * sf2_patch_buffer = NULL; // SF2 Buffer
 
+// Sample loader pipeline
+static SAMPLE_LOAD_PLAN_t      *sample_load_plan = NULL;            // Zones with a sample file, in read order. In the load information of the patch
+static uint16_t                *sample_name_map  = NULL;            // Indexes of the load plan, sorted by directory and file name
+static FF_FindData_t            sample_find_data;                   // Listing of a sample directory
+static QueueHandle_t            xSampleReadRequestQueue = NULL;      // Patch loader -> Reader task
+static QueueHandle_t            xSampleReadResultQueue  = NULL;      // Reader task -> Patch loader
+
 //////////////////////////////////////////////////
 // Static Functions
 //////////////////////////////////////////////////
 static PATCH_DESCRIPTOR_t      * prv_xInitPatchDescriptor();
-static KEY_VOICE_INFORMATION_t * prv_xInitVoiceInformation();
-static KEY_INFORMATION_t       * prv_xInitKeyInformation();
-static uint32_t                  prv_ulDecodeJSON_SamplePaths( uint32_t sample_start_token_index, uint32_t number_of_samples, jsmntok_t *tokens, uint8_t *json_patch_information_buffer, PATCH_DESCRIPTOR_t *patch_descriptor );
-static uint8_t                   prv_usGetJSON_MIDINoteNumber( jsmntok_t *tok, uint8_t *instrument_info_buffer );
+static PATCH_LOAD_INFO_t       * prv_xInitLoadInfo();
+static void                      prv_vReleaseLoadInfo( PATCH_DESCRIPTOR_t *patch_descriptor );
+static KEY_VOICE_INFORMATION_t * prv_xInitVoiceInformation( PATCH_DESCRIPTOR_t *patch_descriptor );
+static KEY_INFORMATION_t       * prv_xInitKeyInformation( PATCH_DESCRIPTOR_t *patch_descriptor );
+static uint8_t                 * prv_pucLoadFileToArena( SAMPLE_ARENA_t *arena, const char *file_name, size_t max_file_size, size_t *file_size );
+static void                      prv_vDecodeJSON_Event( const JSON_STREAM_EVENT_t *event, void *context );
+static uint32_t                  prv_ulStartJSON_Sample( JSON_PATCH_DECODER_t *decoder, const char *note_name );
+static void                      prv_vDecodeJSON_SampleMember( JSON_PATCH_DECODER_t *decoder, const JSON_STREAM_EVENT_t *event );
+static void                      prv_vEndJSON_Sample( JSON_PATCH_DECODER_t *decoder );
+static uint8_t                   prv_usGetJSON_MIDINoteNumber( const char *note_name );
 static uint32_t                  prv_ulStr2Int( const char *input_string, uint32_t input_string_length );
-static uint32_t                  prv_ulDecodeJSON_PatchInfo( uint8_t *json_patch_information_buffer, PATCH_DESCRIPTOR_t *patch_descriptor );
-static uint32_t                  prv_ulLoadSamplesFromDescriptor( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir );
-#if ENABLE_SAMPLE_REALIGN == 1
-static uint32_t                  prv_ulRealignAudioData( KEY_VOICE_INFORMATION_t *voice_information );
-#endif
+static int32_t                   prv_lStr2Int( const char *input_string, uint32_t input_string_length );
+static uint32_t                  prv_ulDecodeJSON_PatchInfo( const char *json_file_fullpath, PATCH_DESCRIPTOR_t *patch_descriptor );
+static uint32_t                  prv_ulLoadSamplesFromDescriptor( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir, QueueHandle_t progress_queue );
+static uint32_t                  prv_ulPlanSampleLoad( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir, uint32_t *number_of_samples );
+static int                       prv_lCompareFirstCluster( const void *plan_a, const void *plan_b );
+static void                      prv_vFindSampleFiles( const char *json_file_root_dir, uint32_t number_of_samples );
+static int                       prv_lCompareSampleName( const void *index_a, const void *index_b );
+static size_t                    prv_xSampleDirLength( const char *sample_path );
+static uint32_t                  prv_ulCommitSampleFile( PATCH_DESCRIPTOR_t *patch_descriptor, SAMPLE_READ_RESULT_t *read_result );
+static uint32_t                  prv_ulBuildZoneTable( PATCH_DESCRIPTOR_t *patch_descriptor );
+static void                      prv_vFlushSampleMemory( PATCH_DESCRIPTOR_t *patch_descriptor );
+static void                      prv_vResolveSampleLoop( KEY_VOICE_INFORMATION_t *voice_information );
+static void                      prv_vWriteLoopGuard( KEY_VOICE_INFORMATION_t *voice_information );
+static void                      prv_vResolveKeyRange( KEY_VOICE_INFORMATION_t *voice_information, uint8_t midi_note );
+static uint32_t                  prv_ulCheckBundleHeader( const uint8_t *bundle_buffer, size_t bundle_buffer_len );
+static uint32_t                  prv_ulDecodeBundleZones( uint8_t *bundle_buffer, PATCH_DESCRIPTOR_t *patch_descriptor );
 
 // This function will load a patch given a JSON patch information file
-PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const char * json_file_fullpath) {
+// The progress of the sample loading is sent on the progress queue (optional)
+PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const char * json_file_fullpath, QueueHandle_t progress_queue ) {
 
     PATCH_DESCRIPTOR_t *patch_descriptor = NULL;
     uint32_t error = 0;
 
     PATCH_LOADER_PRINTF_DEBUG("This is a test");
 
-    // Step 1 - Open the json file containing the instrument information
-    PATCH_LOADER_PRINTF_INFO("Step 1 - Load the JSON File");
-    xLoadFileToMemory( json_file_fullpath, json_patch_information_buffer, (size_t) MAX_INST_FILE_SIZE );
-
-    // Step 2 - Initialize the instrument information
-    PATCH_LOADER_PRINTF_INFO("Step 2 - Initializing the instrument information");
+    // Step 1 - Initialize the instrument information
+    PATCH_LOADER_PRINTF_INFO("Step 1 - Initializing the instrument information");
 
     if ( patch_descriptor == NULL ){
         patch_descriptor = prv_xInitPatchDescriptor();
@@ -97,28 +128,51 @@ PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const
         patch_descriptor->instrument_loaded = 0; // Unset in case it was already loaded
     }
 
-    PATCH_LOADER_PRINTF_INFO("Step 2 - Done!");
+    PATCH_LOADER_PRINTF_INFO("Step 1 - Done!");
 
-    // Step 3 - Decode the JSON file using JSMN
-    PATCH_LOADER_PRINTF_INFO("Step 3 - Decoding the patch information...");
-    error = prv_ulDecodeJSON_PatchInfo( json_patch_information_buffer, patch_descriptor );
+    // Step 2 - Decode the JSON file while it is read
+    PATCH_LOADER_PRINTF_INFO("Step 2 - Decoding the patch information...");
+    error = prv_ulDecodeJSON_PatchInfo( json_file_fullpath, patch_descriptor );
     if ( error ) {
         PATCH_LOADER_PRINTF_ERROR("There was a problem when decoding the JSON Patch information!!");
+        vUnloadPatch( patch_descriptor );
         return NULL;
     }
-    PATCH_LOADER_PRINTF_INFO("Step 3 - Done!");
+    PATCH_LOADER_PRINTF_INFO("Step 2 - Done!");
 
-    // Step 4 - Load all the samples into memory
+    // Step 3 - Load all the samples into memory
     // Initialize the variables
-    PATCH_LOADER_PRINTF_INFO("Step 4 - Loading samples into memory...");
-    error = prv_ulLoadSamplesFromDescriptor( patch_descriptor, json_file_dirname );
+    PATCH_LOADER_PRINTF_INFO("Step 3 - Loading samples into memory...");
+    error = prv_ulLoadSamplesFromDescriptor( patch_descriptor, json_file_dirname, progress_queue );
     if ( error ) {
         PATCH_LOADER_PRINTF_ERROR("There was a problem when loading the samples into memory!!");
+        vUnloadPatch( patch_descriptor );
+        return NULL;
+    }
+    PATCH_LOADER_PRINTF_INFO("Step 3 - Done!");
+
+    // Step 4 - Build the key/velocity zone table used by the playback engine
+    PATCH_LOADER_PRINTF_INFO("Step 4 - Building the zone table...");
+    error = prv_ulBuildZoneTable( patch_descriptor );
+    if ( error ) {
+        PATCH_LOADER_PRINTF_ERROR("There was a problem when building the zone table!!");
+        vUnloadPatch( patch_descriptor );
         return NULL;
     }
-    patch_descriptor->instrument_loaded = 1;
     PATCH_LOADER_PRINTF_INFO("Step 4 - Done!");
 
+    // Step 5 - Make the audio data visible to the DMA
+    // This is the only cache maintenance of the samples. The playback doesn't flush the cache
+    PATCH_LOADER_PRINTF_INFO("Step 5 - Flushing the samples to memory...");
+    prv_vFlushSampleMemory( patch_descriptor );
+    PATCH_LOADER_PRINTF_INFO("Step 5 - Done!");
+
+    // Step 6 - Release the load-time information. Only the zone table is kept
+    PATCH_LOADER_PRINTF_INFO("Step 6 - Releasing the load information...");
+    prv_vReleaseLoadInfo( patch_descriptor );
+    patch_descriptor->instrument_loaded = 1;
+    PATCH_LOADER_PRINTF_INFO("Step 6 - Done!");
+
     if(patch_descriptor == NULL) {
         PATCH_LOADER_PRINTF_ERROR("Somehow the patch descriptor lost its information. patch_descriptor == NULL");
         return NULL;
@@ -133,6 +187,80 @@ PATCH_DESCRIPTOR_t * ulLoadPatchFromJSON( const char * json_file_dirname, const
     return patch_descriptor;
 }
 
+// This function will load a precompiled instrument bundle
+// The bundle is read with a single read into a single buffer and the samples are played from it
+PATCH_DESCRIPTOR_t * ulLoadPatchFromBundle( const char * bundle_file_fullpath ) {
+
+    PATCH_DESCRIPTOR_t *patch_descriptor   = NULL;
+    uint8_t            *bundle_buffer      = NULL;
+    size_t              bundle_buffer_len  = 0;
+    uint32_t            error = 0;
+
+    // Step 1 - Initialize the instrument information
+    PATCH_LOADER_PRINTF_INFO("Step 1 - Initializing the instrument information");
+    patch_descriptor = prv_xInitPatchDescriptor();
+    if ( patch_descriptor == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("Instrument information could not be initialized!!");
+        return NULL;
+    }
+    PATCH_LOADER_PRINTF_INFO("Step 1 - Done!");
+
+    // Step 2 - Load the whole bundle into the memory of the patch
+    PATCH_LOADER_PRINTF_INFO("Step 2 - Load the bundle");
+    bundle_buffer = prv_pucLoadFileToArena( patch_descriptor->arena, bundle_file_fullpath, (size_t) MAX_BUNDLE_FILE_SIZE, &bundle_buffer_len );
+
+    if ( bundle_buffer == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("Error while loading the bundle!");
+        vUnloadPatch( patch_descriptor );
+        return NULL;
+    }
+
+    error = prv_ulCheckBundleHeader( bundle_buffer, bundle_buffer_len );
+    if ( error ) {
+        vUnloadPatch( patch_descriptor );
+        return NULL;
+    }
+    PATCH_LOADER_PRINTF_INFO("Step 2 - Done!");
+
+    // Step 3 - Decode the zones. The audio data stays in the bundle buffer
+    PATCH_LOADER_PRINTF_INFO("Step 3 - Decoding the zones...");
+    error = prv_ulDecodeBundleZones( bundle_buffer, patch_descriptor );
+    if ( error ) {
+        PATCH_LOADER_PRINTF_ERROR("There was a problem when decoding the bundle zones!!");
+        vUnloadPatch( patch_descriptor );
+        return NULL;
+    }
+    patch_descriptor->total_size = patch_descriptor->arena->size;
+    PATCH_LOADER_PRINTF_INFO("Step 3 - Done!");
+
+    // Step 4 - Build the key/velocity zone table used by the playback engine
+    PATCH_LOADER_PRINTF_INFO("Step 4 - Building the zone table...");
+    error = prv_ulBuildZoneTable( patch_descriptor );
+    if ( error ) {
+        PATCH_LOADER_PRINTF_ERROR("There was a problem when building the zone table!!");
+        vUnloadPatch( patch_descriptor );
+        return NULL;
+    }
+    PATCH_LOADER_PRINTF_INFO("Step 4 - Done!");
+
+    // Step 5 - Make the audio data visible to the DMA
+    PATCH_LOADER_PRINTF_INFO("Step 5 - Flushing the samples to memory...");
+    prv_vFlushSampleMemory( patch_descriptor );
+    PATCH_LOADER_PRINTF_INFO("Step 5 - Done!");
+
+    // Step 6 - Release the load-time information. Only the zone table is kept
+    PATCH_LOADER_PRINTF_INFO("Step 6 - Releasing the load information...");
+    prv_vReleaseLoadInfo( patch_descriptor );
+    patch_descriptor->instrument_loaded = 1;
+    PATCH_LOADER_PRINTF_INFO("Step 6 - Done!");
+
+    PATCH_LOADER_PRINTF("------------\n\r");
+    PATCH_LOADER_PRINTF("Instrument Succesfully Loaded!\n\r");
+    PATCH_LOADER_PRINTF("------------\n\r\n\r");
+
+    return patch_descriptor;
+}
+
 // This function will load a SoundFont3 file
 PATCH_DESCRIPTOR_t * ulLoadPatchFromSF2( const char * sf2_file_fullpath ) {
     PATCH_DESCRIPTOR_t *patch_descriptor = NULL;
@@ -190,27 +318,71 @@ static uint32_t prv_ulStr2Int( const char *input_string, uint32_t input_string_l
     return output_int;
 }
 
+// This function converts a signed decimal string to an int32_t
+static int32_t prv_lStr2Int( const char *input_string, uint32_t input_string_length ) {
+    char *end_char;
+    return (int32_t)strtol(input_string, &end_char, 10);
+}
+
 // This function will initialize the data structure of a patch
+// The patch owns an arena. Everything it needs is allocated from it and released with vUnloadPatch()
 PATCH_DESCRIPTOR_t * prv_xInitPatchDescriptor() {
 
-    PATCH_DESCRIPTOR_t * patch_descriptor = sampler_malloc( sizeof(PATCH_DESCRIPTOR_t) );
+    SAMPLE_ARENA_t     *arena            = xSampleArenaCreate();
+    PATCH_DESCRIPTOR_t *patch_descriptor = pvSampleArenaAlloc( arena, sizeof(PATCH_DESCRIPTOR_t) );
     if ( patch_descriptor == NULL ) {
         PATCH_LOADER_PRINTF_ERROR("Memory allocation for the instrument info failed. Requested size = %d bytes", sizeof(PATCH_DESCRIPTOR_t));
+        vSampleArenaDestroy( arena );
         return NULL;
     } else {
         PATCH_LOADER_PRINTF_INFO("Memory allocation for the instrument info succeeded. Memory location: 0x%x", patch_descriptor );
 
         // Initialize the structure
         memset( patch_descriptor, 0x00 , sizeof(PATCH_DESCRIPTOR_t) );
+        patch_descriptor->arena = arena;
+    }
+
+    // The load-time information goes to a second arena, so it can be released once the instrument is loaded
+    patch_descriptor->load_info = prv_xInitLoadInfo();
+    if ( patch_descriptor->load_info == NULL ) {
+        vSampleArenaDestroy( arena );
+        return NULL;
     }
 
     return patch_descriptor;
 }
 
+// This function will initialize the load-time information of a patch (keys, voices and sample paths)
+PATCH_LOAD_INFO_t * prv_xInitLoadInfo() {
+
+    SAMPLE_ARENA_t    *arena     = xSampleArenaCreate();
+    PATCH_LOAD_INFO_t *load_info = pvSampleArenaAlloc( arena, sizeof(PATCH_LOAD_INFO_t) );
+    if ( load_info == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("Memory allocation for the load information failed. Requested size = %d bytes", sizeof(PATCH_LOAD_INFO_t));
+        vSampleArenaDestroy( arena );
+        return NULL;
+    }
+
+    memset( load_info, 0x00 , sizeof(PATCH_LOAD_INFO_t) );
+    load_info->arena = arena;
+
+    return load_info;
+}
+
+// This function releases the load-time information of a patch
+// Only the zone table is needed for playback
+void prv_vReleaseLoadInfo( PATCH_DESCRIPTOR_t *patch_descriptor ) {
+
+    if ( patch_descriptor->load_info == NULL ) return;
+
+    vSampleArenaDestroy( patch_descriptor->load_info->arena );
+    patch_descriptor->load_info = NULL;
+}
+
 // Initialize key voice information
-KEY_VOICE_INFORMATION_t *prv_xInitVoiceInformation() {
+KEY_VOICE_INFORMATION_t *prv_xInitVoiceInformation( PATCH_DESCRIPTOR_t *patch_descriptor ) {
 
-    KEY_VOICE_INFORMATION_t *voice_information = sampler_malloc( sizeof( KEY_VOICE_INFORMATION_t ) );
+    KEY_VOICE_INFORMATION_t *voice_information = pvSampleArenaAlloc( patch_descriptor->load_info->arena, sizeof( KEY_VOICE_INFORMATION_t ) );
 
     // Sanity check
     if( voice_information == NULL ){
@@ -220,13 +392,17 @@ KEY_VOICE_INFORMATION_t *prv_xInitVoiceInformation() {
 
     memset( voice_information, 0x00, sizeof( KEY_VOICE_INFORMATION_t ) );
 
+    // By default the voice covers the full velocity range
+    voice_information->velocity_min = 0;
+    voice_information->velocity_max = MAX_NUM_OF_VELOCITY - 1;
+
     return voice_information;
 }
 
 // Initialize key information
-KEY_INFORMATION_t * prv_xInitKeyInformation( ) {
+KEY_INFORMATION_t * prv_xInitKeyInformation( PATCH_DESCRIPTOR_t *patch_descriptor ) {
 
-    KEY_INFORMATION_t *key_information = sampler_malloc( sizeof( KEY_INFORMATION_t ) );
+    KEY_INFORMATION_t *key_information = pvSampleArenaAlloc( patch_descriptor->load_info->arena, sizeof( KEY_INFORMATION_t ) );
 
     // Sanity check
     if( key_information == NULL ){
@@ -239,17 +415,61 @@ KEY_INFORMATION_t * prv_xInitKeyInformation( ) {
     return key_information;
 }
 
+// This function releases a patch and everything it owns in one operation
+// The patch must not be in playback. It can be partially initialized (i.e. on the error paths of the loaders)
+void vUnloadPatch( PATCH_DESCRIPTOR_t *patch_descriptor ) {
+
+    if ( patch_descriptor == NULL ) return;
+
+    prv_vReleaseLoadInfo( patch_descriptor );
+
+    // The descriptor lives in its own arena
+    vSampleArenaDestroy( patch_descriptor->arena );
+}
+
+// This function loads a file into the memory of a patch
+// Returns NULL on error
+uint8_t * prv_pucLoadFileToArena( SAMPLE_ARENA_t *arena, const char *file_name, size_t max_file_size, size_t *file_size ) {
+    FF_FILE *pxFile;
+    uint8_t *file_buffer = NULL;
+
+    pxFile = ff_fopen( file_name, "r" );
+    if ( pxFile == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("File %s could not be opened!", file_name);
+        return NULL;
+    }
+
+    *file_size = ff_filelength( pxFile );
+
+    if ( *file_size == 0 || *file_size > max_file_size ) {
+        PATCH_LOADER_PRINTF_ERROR("Invalid file size. File = %d bytes | Max File Size = %d bytes", *file_size, max_file_size);
+    } else {
+        file_buffer = pvSampleArenaAlloc( arena, *file_size );
+        if ( file_buffer == NULL ) {
+            PATCH_LOADER_PRINTF_ERROR("The file doesn't fit in the sample memory. Requested %d bytes", *file_size);
+        } else if ( ff_fread( file_buffer, *file_size, 1, pxFile ) != 1 ) {
+            PATCH_LOADER_PRINTF_ERROR("Failed reading %s", file_name);
+            file_buffer = NULL; // Released with the arena
+        }
+    }
+
+    ff_fclose( pxFile );
+
+    return file_buffer;
+}
+
 // This function will decode the JSON file containing the
 // instrument information and will populate the instrument data structures
-uint32_t prv_ulDecodeJSON_PatchInfo( uint8_t *json_patch_information_buffer, PATCH_DESCRIPTOR_t *patch_descriptor ) {
-    // JSMN Variables
-    jsmn_parser parser;
-    jsmntok_t   tokens[1000];
-    int         parser_result;
-
-    // Patch Variables
-    uint32_t number_of_samples;
-    uint32_t sample_start_token_index;
+// The file is parsed while it is read in chunks of JSON_READ_CHUNK_SIZE bytes, so its size is not limited
+uint32_t prv_ulDecodeJSON_PatchInfo( const char *json_file_fullpath, PATCH_DESCRIPTOR_t *patch_descriptor ) {
+    // JSON Stream Variables
+    JSON_STREAM_t        json_stream;
+    JSON_PATCH_DECODER_t decoder;
+    uint8_t              json_chunk[JSON_READ_CHUNK_SIZE];
+    char                 json_value[MAX_CHAR_IN_TOKEN_STR];
+    size_t               json_chunk_len;
+    uint32_t             error = 0;
+    FF_FILE             *pxFile;
 
     // Sanity check
     if( patch_descriptor == NULL ) {
@@ -257,140 +477,248 @@ uint32_t prv_ulDecodeJSON_PatchInfo( uint8_t *json_patch_information_buffer, PAT
         return 1;
     }
 
-    // Step 1 - Initialize the parser
-    jsmn_init(&parser);
+    // Step 1 - Initialize the parser and the defaults of the optional settings
+    memset( &decoder, 0x00, sizeof( JSON_PATCH_DECODER_t ) );
+    decoder.patch_descriptor = patch_descriptor;
 
+    patch_descriptor->retrigger_mode = RETRIGGER_MODE_RESTART;
+    patch_descriptor->max_instances  = MAX_ZONE_INSTANCES;
 
-    // Step 2 - Parse the buffer
-    // js - pointer to JSON string
-    // tokens - an array of tokens available
-    // 1000 - number of tokens available
-    parser_result = jsmn_parse(&parser, (const char *) json_patch_information_buffer, strlen((const char *) json_patch_information_buffer), tokens, 1000);
+    vJSONStreamInit( &json_stream, prv_vDecodeJSON_Event, &decoder, json_value, MAX_CHAR_IN_TOKEN_STR );
 
-    // Step 3 - Check for errors
-    if ( parser_result < 0 ) {
-        PATCH_LOADER_PRINTF_ERROR("There was a problem decoding the instrument information. Error code = %d", parser_result);
+    pxFile = ff_fopen( json_file_fullpath, "r" );
+    if ( pxFile == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("File %s could not be opened!", json_file_fullpath);
         return 1;
     }
-    else {
-        PATCH_LOADER_PRINTF_INFO("Instrument information parsing was succesful!");
-    }
 
-    // Step 4 - Extract the information
-    // Step 4.1 - Get the instrument name
-    for ( int i = 0; i < parser_result ; i++ ) {
-        if ( l_json_equal( (const char *) json_patch_information_buffer, &tokens[i], INSTRUMENT_NAME_TOKEN_STR ) ) {
-            l_json_get_string((const char *) json_patch_information_buffer, &tokens[i + 1], (char *) patch_descriptor->instrument_name );
-            PATCH_LOADER_PRINTF_INFO("Instrument Name: %s", patch_descriptor->instrument_name );
+    // Step 2 - Parse the file while it is read. The samples go straight into the load information
+    for ( ;; ) {
+        json_chunk_len = ff_fread( json_chunk, 1, JSON_READ_CHUNK_SIZE, pxFile );
+        if ( json_chunk_len == 0 ) break;
+
+        if ( ulJSONStreamProcessBuffer( &json_stream, json_chunk, json_chunk_len ) ) {
+            PATCH_LOADER_PRINTF_ERROR("There was a problem decoding the instrument information. Syntax error on line %d", json_stream.line);
+            error = 1;
             break;
         }
-    }
 
-    // Step 4.2 - Extract the sample paths
-    for ( int i = 0; i < parser_result ; i++ ) {
-        if ( l_json_equal( (const char *) json_patch_information_buffer, &tokens[i], INSTRUMENT_SAMPLES_TOKEN_STR ) ) {
-            number_of_samples        = (uint32_t) tokens[i + 1].size;
-            sample_start_token_index = i + 2;
-            PATCH_LOADER_PRINTF_INFO("Number of samples: %d", number_of_samples );
-            prv_ulDecodeJSON_SamplePaths( sample_start_token_index, number_of_samples, tokens, json_patch_information_buffer, patch_descriptor );
+        if ( decoder.error ) {
+            error = 1;
             break;
         }
     }
+
+    ff_fclose( pxFile );
+
+    // Step 3 - Check for errors
+    if ( error == 0 && ulJSONStreamFinish( &json_stream ) ) {
+        PATCH_LOADER_PRINTF_ERROR("There was a problem decoding the instrument information. The file ends on line %d", json_stream.line);
+        error = 1;
+    }
+
+    if ( error ) return 1;
+
+    PATCH_LOADER_PRINTF_INFO("Instrument information parsing was succesful!");
+    PATCH_LOADER_PRINTF_INFO("Instrument Name: %s", patch_descriptor->instrument_name );
+    PATCH_LOADER_PRINTF_INFO("Retrigger mode: %d, Max instances: %d", patch_descriptor->retrigger_mode, patch_descriptor->max_instances );
+    PATCH_LOADER_PRINTF_INFO("Number of samples: %d", decoder.number_of_samples );
+
     return 0;
 
 }
 
-// This function will extract the sample paths from the information file
-// This will also allocate and initialize the information when it hasn't been allocated yet
-uint32_t prv_ulDecodeJSON_SamplePaths( uint32_t sample_start_token_index, uint32_t number_of_samples, jsmntok_t *tokens, uint8_t *json_patch_information_buffer, PATCH_DESCRIPTOR_t *patch_descriptor ) {
-    uint8_t midi_note;
-    uint32_t note_name_index;
-    uint32_t key_info_index;
+// This function is called by the JSON parser for each value of the instrument information
+// The members of the root object are the instrument settings. Each member of "samples" is a sample
+// named after its note, and its members are the settings of the sample. A note can hold an array of
+// samples (i.e. velocity layers), and each of them is a zone of its own
+void prv_vDecodeJSON_Event( const JSON_STREAM_EVENT_t *event, void *context ) {
+    JSON_PATCH_DECODER_t *decoder          = (JSON_PATCH_DECODER_t *) context;
+    PATCH_DESCRIPTOR_t   *patch_descriptor = decoder->patch_descriptor;
+
+    if ( decoder->error ) return;
+
+    // Instrument settings
+    if ( event->depth == 1 ) {
+        if ( strcmp( event->key, INSTRUMENT_NAME_TOKEN_STR ) == 0 && event->type == JSON_STREAM_STRING ) {
+            strncpy( (char *) patch_descriptor->instrument_name, event->value, MAX_CHAR_IN_TOKEN_STR - 1 );
+        } else if ( strcmp( event->key, RETRIGGER_MODE_TOKEN_STR ) == 0 ) {
+            if ( strcmp( event->value, RETRIGGER_LAYER_TOKEN_STR ) == 0 ) {
+                patch_descriptor->retrigger_mode = RETRIGGER_MODE_LAYER;
+            } else if ( strcmp( event->value, RETRIGGER_CHOKE_TOKEN_STR ) == 0 ) {
+                patch_descriptor->retrigger_mode = RETRIGGER_MODE_CHOKE;
+            } else if ( strcmp( event->value, RETRIGGER_RESTART_TOKEN_STR ) != 0 ) {
+                PATCH_LOADER_PRINTF_ERROR("Unknown retrigger mode. Using \"%s\"", RETRIGGER_RESTART_TOKEN_STR);
+            }
+        } else if ( strcmp( event->key, MAX_INSTANCES_TOKEN_STR ) == 0 ) {
+            patch_descriptor->max_instances = prv_ulStr2Int( event->value, strlen( event->value ) );
+            if ( patch_descriptor->max_instances == 0 || patch_descriptor->max_instances > MAX_ZONE_INSTANCES ) {
+                PATCH_LOADER_PRINTF_ERROR("max_instances must be between 1 and %d", MAX_ZONE_INSTANCES);
+                patch_descriptor->max_instances = MAX_ZONE_INSTANCES;
+            }
+        }
+        return;
+    }
+
+    // Start/end of a sample, or of the array of samples of a note
+    if ( event->depth == 2 && strcmp( event->parent_key, INSTRUMENT_SAMPLES_TOKEN_STR ) == 0 ) {
+        if ( event->type == JSON_STREAM_OBJECT_START ) {
+            decoder->error = prv_ulStartJSON_Sample( decoder, event->key );
+            decoder->sample_depth = 3;
+        } else if ( event->type == JSON_STREAM_OBJECT_END && decoder->current_voice != NULL ) {
+            prv_vEndJSON_Sample( decoder );
+        } else if ( event->type == JSON_STREAM_ARRAY_START || event->type == JSON_STREAM_ARRAY_END ) {
+            decoder->in_note_array = ( event->type == JSON_STREAM_ARRAY_START );
+        }
+        return;
+    }
 
-    KEY_INFORMATION_t       *current_key   = NULL;
-    KEY_VOICE_INFORMATION_t *current_voice = NULL;
+    // Start/end of a sample of an array. The array is named after the note
+    if ( event->depth == 3 && decoder->in_note_array ) {
+        if ( event->type == JSON_STREAM_OBJECT_START ) {
+            decoder->error = prv_ulStartJSON_Sample( decoder, event->parent_key );
+            decoder->sample_depth = 4;
+        } else if ( event->type == JSON_STREAM_OBJECT_END && decoder->current_voice != NULL ) {
+            prv_vEndJSON_Sample( decoder );
+        }
+        return;
+    }
 
-    for( int i = 0; i < number_of_samples ; i++) {
-        note_name_index = sample_start_token_index + (i * (NUM_OF_SAMPLE_JSON_MEMBERS + 1) * 2);
-        key_info_index  = note_name_index + 2;
-        // Get the MIDI note
-        midi_note = prv_usGetJSON_MIDINoteNumber(&tokens[note_name_index], json_patch_information_buffer);
+    // Settings of the sample
+    if ( event->depth == decoder->sample_depth && decoder->current_voice != NULL ) {
+        prv_vDecodeJSON_SampleMember( decoder, event );
+    }
+}
 
-        if ( midi_note < MAX_NUM_OF_KEYS ) {
+// This function starts a sample of the instrument information
+// Each sample is a new velocity range of its key. The key information is allocated with its first sample
+uint32_t prv_ulStartJSON_Sample( JSON_PATCH_DECODER_t *decoder, const char *note_name ) {
+    PATCH_DESCRIPTOR_t *patch_descriptor = decoder->patch_descriptor;
+    KEY_INFORMATION_t  *current_key;
+    uint8_t             midi_note;
 
-            // Allocate the memory if the key information doesn't exist
-            if( patch_descriptor->key_information[midi_note] == NULL ) {
-                patch_descriptor->key_information[midi_note] = prv_xInitKeyInformation();
-                if( patch_descriptor->key_information[midi_note] == NULL ) return 0;
-            }
+    decoder->current_voice = NULL;
 
-            current_key = patch_descriptor->key_information[midi_note];
+    // Get the MIDI note
+    midi_note = prv_usGetJSON_MIDINoteNumber( note_name );
+    if ( midi_note >= MAX_NUM_OF_KEYS ) {
+        PATCH_LOADER_PRINTF_ERROR("Invalid note name \"%s\". Sample ignored", note_name);
+        return 0;
+    }
 
-            // TODO: Add multiple velocity switches
-            if( current_key->key_voice_information[0] == NULL ) {
-                current_key->key_voice_information[0] = prv_xInitVoiceInformation();
-                if( current_key->key_voice_information[0] == NULL ) return 0;
-            }
+    // Allocate the memory if the key information doesn't exist
+    if( patch_descriptor->load_info->key_information[midi_note] == NULL ) {
+        patch_descriptor->load_info->key_information[midi_note] = prv_xInitKeyInformation( patch_descriptor );
+        if( patch_descriptor->load_info->key_information[midi_note] == NULL ) return 1;
+    }
 
-            current_voice = current_key->key_voice_information[0];
-
-            // Get the rest of the information
-            for( int j = key_info_index; j < ( key_info_index + (NUM_OF_SAMPLE_JSON_MEMBERS * 2) ); j += 2 ) {
-                if( l_json_equal( (const char *)json_patch_information_buffer, &tokens[j], SAMPLE_VEL_MIN_TOKEN_STR ) ) {
-                    current_voice->velocity_min = prv_ulStr2Int( (char *)(json_patch_information_buffer + tokens[j + 1].start), ( tokens[j + 1].end - tokens[j + 1].start ) );
-                    //PATCH_LOADER_PRINTF_DEBUG("KEY[%d]: velocity_min = %d", midi_note, patch_descriptor->key_information[midi_note].key_voice_information[0].velocity_min);
-                } else if( l_json_equal( (const char *)json_patch_information_buffer, &tokens[j], SAMPLE_VEL_MAX_TOKEN_STR ) ) {
-                    current_voice->velocity_max = prv_ulStr2Int( (char *)(json_patch_information_buffer + tokens[j + 1].start), ( tokens[j + 1].end - tokens[j + 1].start ) );
-                    //PATCH_LOADER_PRINTF_DEBUG("KEY[%d]: velocity_max = %d", midi_note, patch_descriptor->key_information[midi_note].key_voice_information[0].velocity_max);
-                } else if( l_json_equal( (const char *)json_patch_information_buffer, &tokens[j], SAMPLE_PATH_TOKEN_STR ) ) {
-                    current_voice->sample_present = 1;
-                    l_json_get_string( (const char *)json_patch_information_buffer, &tokens[j + 1], (char *) current_voice->sample_path );
-                    PATCH_LOADER_PRINTF_DEBUG("KEY[%d]: sample_path = %s", midi_note, current_voice->sample_path);
-                }
-            }
-        }
+    current_key = patch_descriptor->load_info->key_information[midi_note];
+    if ( current_key->number_of_velocity_ranges >= MAX_NUM_OF_VELOCITY ) {
+        PATCH_LOADER_PRINTF_ERROR("KEY[%d]: Too many velocity ranges", midi_note);
+        return 1;
     }
 
+    decoder->current_voice = prv_xInitVoiceInformation( patch_descriptor );
+    if( decoder->current_voice == NULL ) return 1;
+    current_key->key_voice_information[current_key->number_of_velocity_ranges++] = decoder->current_voice;
+
+    decoder->midi_note        = midi_note;
+    decoder->loop_start_found = 0;
+    decoder->loop_end_found   = 0;
+    decoder->number_of_samples++;
+
+    // By default the sample is only played on its own key at its original rate
+    decoder->current_voice->root_key  = midi_note;
+    decoder->current_voice->key_min   = midi_note;
+    decoder->current_voice->key_max   = midi_note;
+    decoder->current_voice->fine_tune = 0;
+
     return 0;
+}
 
+// This function decodes a setting of the current sample
+void prv_vDecodeJSON_SampleMember( JSON_PATCH_DECODER_t *decoder, const JSON_STREAM_EVENT_t *event ) {
+    KEY_VOICE_INFORMATION_t *current_voice = decoder->current_voice;
+    uint32_t                 value_len     = strlen( event->value );
+
+    if( strcmp( event->key, SAMPLE_VEL_MIN_TOKEN_STR ) == 0 ) {
+        current_voice->velocity_min = prv_ulStr2Int( event->value, value_len );
+    } else if( strcmp( event->key, SAMPLE_VEL_MAX_TOKEN_STR ) == 0 ) {
+        current_voice->velocity_max = prv_ulStr2Int( event->value, value_len );
+    } else if( strcmp( event->key, SAMPLE_PATH_TOKEN_STR ) == 0 ) {
+        if ( event->truncated ) {
+            PATCH_LOADER_PRINTF_ERROR("KEY[%d]: The sample path is longer than %d characters", decoder->midi_note, MAX_CHAR_IN_TOKEN_STR - 1);
+            decoder->error = 1;
+            return;
+        }
+        current_voice->sample_present = 1;
+        strcpy( (char *) current_voice->sample_path, event->value );
+        PATCH_LOADER_PRINTF_DEBUG("KEY[%d]: sample_path = %s", decoder->midi_note, current_voice->sample_path);
+    } else if( strcmp( event->key, SAMPLE_LOOP_START_TOKEN_STR ) == 0 ) {
+        current_voice->loop_start = prv_ulStr2Int( event->value, value_len );
+        decoder->loop_start_found = 1;
+    } else if( strcmp( event->key, SAMPLE_LOOP_END_TOKEN_STR ) == 0 ) {
+        current_voice->loop_end = prv_ulStr2Int( event->value, value_len );
+        decoder->loop_end_found = 1;
+    } else if( strcmp( event->key, SAMPLE_ROOT_KEY_TOKEN_STR ) == 0 ) {
+        current_voice->root_key = (uint8_t) prv_ulStr2Int( event->value, value_len );
+    } else if( strcmp( event->key, SAMPLE_FINE_TUNE_TOKEN_STR ) == 0 ) {
+        current_voice->fine_tune = (int16_t) prv_lStr2Int( event->value, value_len );
+    } else if( strcmp( event->key, SAMPLE_KEY_MIN_TOKEN_STR ) == 0 ) {
+        current_voice->key_min = (uint8_t) prv_ulStr2Int( event->value, value_len );
+    } else if( strcmp( event->key, SAMPLE_KEY_MAX_TOKEN_STR ) == 0 ) {
+        current_voice->key_max = (uint8_t) prv_ulStr2Int( event->value, value_len );
+    }
 }
 
-// This function will return the hex MIDI note number of a given JSON patch information field
-uint8_t prv_usGetJSON_MIDINoteNumber( jsmntok_t *tok, uint8_t *json_patch_information_buffer ) {
-    uint8_t midi_note = 0;
+// This function ends the current sample once all its settings are known
+void prv_vEndJSON_Sample( JSON_PATCH_DECODER_t *decoder ) {
+    KEY_VOICE_INFORMATION_t *current_voice = decoder->current_voice;
 
-    uint8_t *note_letter_addr = json_patch_information_buffer + tok->start;
-    uint8_t *note_number_addr = note_letter_addr + 1;
-    uint8_t *sharp_flag_addr  = note_letter_addr + 3;
+    prv_vResolveKeyRange( current_voice, decoder->midi_note );
 
-    char note_letter = (char) *note_letter_addr;
-    char note_number = (char) *note_number_addr;
-    char sharp_flag  = (char) *sharp_flag_addr;
+    // The JSON loop points override the ones of the sample file
+    if( decoder->loop_start_found && decoder->loop_end_found ) {
+        current_voice->loop_enabled = ( current_voice->loop_end > current_voice->loop_start );
+        if( current_voice->loop_enabled == 0 ) PATCH_LOADER_PRINTF_ERROR("KEY[%d]: loop_end must be greater than loop_start. Loop ignored", decoder->midi_note);
+    } else if( decoder->loop_start_found || decoder->loop_end_found ) {
+        PATCH_LOADER_PRINTF_ERROR("KEY[%d]: loop_start and loop_end must be defined together. Loop ignored", decoder->midi_note);
+    }
+
+    decoder->current_voice = NULL;
+}
 
-    uint32_t note_number_int = prv_ulStr2Int( &note_number, 1 );
+// This function will return the MIDI note number of a JSON note name (i.e. "C3" or "A4_S")
+// Returns 0xff if the name is not a note
+uint8_t prv_usGetJSON_MIDINoteNumber( const char *note_name ) {
+    char note_letter = note_name[0];
+    char note_number = ( note_letter != '\0' ) ? note_name[1] : '\0';
+
+    if ( note_number < '0' || note_number > '9' ) return 0xff;
 
     for( int i = 0; i < 12; i++ ) {
         if( MIDI_NOTES_LUT[i].note_name[0] == note_letter ) {
-            midi_note = MIDI_NOTES_LUT[i].note_number + (12 * note_number_int);
-            if ( sharp_flag == 'S' ) {
-                midi_note++;
-            }
-            return midi_note;
+            // The first entry of the letter is the natural note. The sharp one follows it
+            return MIDI_NOTES_LUT[i].note_number + ( 12 * ( note_number - '0' ) ) + ( ( strlen( note_name ) >= 4 && note_name[3] == 'S' ) ? 1 : 0 );
         }
     }
-    return 0;
+    return 0xff;
 }
 
 // This function will load the samples of a descriptor into memory
-uint32_t prv_ulLoadSamplesFromDescriptor( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir ) {
+// The load is planned first, so nothing is read unless all the samples fit in memory
+// The loading is pipelined: the reader task loads the audio data while this function commits
+// the samples already in memory, so the SD card and the CPU work at the same time
+uint32_t prv_ulLoadSamplesFromDescriptor( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir, QueueHandle_t progress_queue ) {
 
     // Initialize the variables
-    uint32_t  key              = 0;
-    uint32_t  vel_range        = 0;    
-    uint32_t  error            = 0;
-    uint8_t * riff_buffer      = NULL;
-    size_t    riff_buffer_size = 0;
-    char      full_path[MAX_PATH_LEN]; // Path to the sample
+    uint32_t              error             = 0;
+    uint32_t              number_of_samples = 0;
+    uint32_t              progress;
+    volatile uint32_t     abort_read        = 0;
+    TaskHandle_t          reader_handle     = xTaskGetHandle( SAMPLE_READER_TASK_NAME );
+    SAMPLE_READ_REQUEST_t read_request;
+    SAMPLE_READ_RESULT_t  read_result;
 
     // Sanity check
     if (patch_descriptor == NULL) {
@@ -398,120 +726,653 @@ uint32_t prv_ulLoadSamplesFromDescriptor( PATCH_DESCRIPTOR_t *patch_descriptor,
         return 1;
     }
 
+    if (reader_handle == NULL) {
+        PATCH_LOADER_PRINTF_ERROR("Sample loader failed. The %s task is not running", SAMPLE_READER_TASK_NAME);
+        return 1;
+    }
+
     patch_descriptor->total_size = 0;
     patch_descriptor->total_keys = 0;
 
+    // Step 1 - Plan the load and reserve the sample memory
+    error = prv_ulPlanSampleLoad( patch_descriptor, json_file_root_dir, &number_of_samples );
+    if ( error ) return error;
+
+    if ( number_of_samples == 0 ) return 0;
+
+    // Step 2 - Start the reader
+    if ( xSampleReadRequestQueue == NULL ) {
+        xSampleReadRequestQueue = xQueueCreate( 1, sizeof( SAMPLE_READ_REQUEST_t ) );
+        xSampleReadResultQueue  = xQueueCreate( SAMPLE_LOADER_READ_AHEAD, sizeof( SAMPLE_READ_RESULT_t ) );
+        if ( xSampleReadRequestQueue == NULL || xSampleReadResultQueue == NULL ) {
+            PATCH_LOADER_PRINTF_ERROR("Sample loader failed. The pipeline queues could not be created");
+            return 1;
+        }
+    }
+
+    read_request.load_plan         = sample_load_plan;
+    read_request.number_of_samples = number_of_samples;
+    read_request.abort             = &abort_read;
+    read_request.result_queue      = xSampleReadResultQueue;
+
+    xQueueSend( xSampleReadRequestQueue, &read_request, portMAX_DELAY );
+    xTaskNotify( reader_handle, (uint32_t) xSampleReadRequestQueue, eSetValueWithOverwrite );
+
+    // Step 3 - Commit the samples as they are read
+    // All the results are received, even after an error, so the reader is idle when this function returns
+    for ( uint32_t sample = 0; sample < number_of_samples; sample++ ) {
+
+        xQueueReceive( xSampleReadResultQueue, &read_result, portMAX_DELAY );
+
+        if ( error ) continue;
+
+        #if PATCH_LOADER_DEBUG < 1
+            PATCH_LOADER_PRINTF(".");
+        #else
+            PATCH_LOADER_PRINTF_DEBUG("[%d/%d] Loading Sample \"%s\"", sample + 1, number_of_samples, read_result.voice->sample_path );
+        #endif
+
+        error = prv_ulCommitSampleFile( patch_descriptor, &read_result );
+        if ( error ) {
+            abort_read = 1;
+            continue;
+        }
+
+        if ( progress_queue != NULL ) {
+            progress = LOAD_PROGRESS( sample + 1, number_of_samples );
+            xQueueSend( progress_queue, &progress, 0 ); // Progress messages are dropped if the queue is full
+        }
+    }
+
+    if ( error ) return error;
+
+    PATCH_LOADER_PRINTF("\n\r---\n\r");
+    PATCH_LOADER_PRINTF_INFO("Loaded %d keys", patch_descriptor->total_keys);
+    PATCH_LOADER_PRINTF_INFO("Total Memory Used = %d bytes", patch_descriptor->total_size);
+
+    return 0;
+}
+
+// This function plans the load of the samples of a descriptor
+// Every sample file is opened once to read its WAVE header and its first cluster, then the memory
+// of all the samples is reserved with a single allocation. The plan is sorted by first cluster,
+// so the reads follow the layout of the SD card instead of the order of the keys
+// The files are opened from their directory entry, found by listing each sample directory once
+// The plan is sized by the number of samples and released with the load information
+uint32_t prv_ulPlanSampleLoad( PATCH_DESCRIPTOR_t *patch_descriptor, const char *json_file_root_dir, uint32_t *number_of_samples ) {
+    uint32_t                 key;
+    uint32_t                 vel_range;
+    uint32_t                 sample;
+    uint32_t                 sample_memory_size = 0;
+    uint8_t                 *sample_memory;
+    SAMPLE_MEMORY_STATS_t    memory_stats;
+    FF_FILE                 *pxFile;
+    char                     full_path[MAX_PATH_LEN];
     KEY_INFORMATION_t       *current_key;
     KEY_VOICE_INFORMATION_t *current_voice;
+    SAMPLE_LOAD_PLAN_t      *current_plan;
 
-    // DMA Data Structure
-    SAMPLE_FORMAT_t         *current_sample_format;
+    *number_of_samples = 0;
 
+    // Step 1 - Count the samples and allocate the plan
     for (key = 0; key < MAX_NUM_OF_KEYS; key++) {
 
-        current_key = patch_descriptor->key_information[key];
+        current_key = patch_descriptor->load_info->key_information[key];
         if ( current_key == NULL ) continue;
 
-        for (vel_range = 0; vel_range < 1; vel_range++) {
+        for (vel_range = 0; vel_range < current_key->number_of_velocity_ranges; vel_range++) {
+            current_voice = current_key->key_voice_information[vel_range];
+            if ( (current_voice != NULL) && (current_voice->sample_present != 0) ) (*number_of_samples)++;
+        }
+    }
 
-            current_voice                 = current_key->key_voice_information[vel_range];
+    if ( *number_of_samples == 0 ) return 0;
+
+    if ( *number_of_samples > MAX_NUM_OF_ZONES ) {
+        PATCH_LOADER_PRINTF_ERROR("Too many samples (%d). Maximum number of zones = %d", *number_of_samples, MAX_NUM_OF_ZONES);
+        return 1;
+    }
+
+    sample_load_plan = pvSampleArenaAlloc( patch_descriptor->load_info->arena, *number_of_samples * sizeof( SAMPLE_LOAD_PLAN_t ) );
+    sample_name_map  = pvSampleArenaAlloc( patch_descriptor->load_info->arena, *number_of_samples * sizeof( uint16_t ) );
+    if ( sample_load_plan == NULL || sample_name_map == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("Memory allocation for the load plan of %d samples failed", *number_of_samples);
+        return 1;
+    }
+
+    // Step 2 - List the samples
+    *number_of_samples = 0;
+    for (key = 0; key < MAX_NUM_OF_KEYS; key++) {
+
+        current_key = patch_descriptor->load_info->key_information[key];
+        if ( current_key == NULL ) continue;
+
+        for (vel_range = 0; vel_range < current_key->number_of_velocity_ranges; vel_range++) {
+
+            current_voice = current_key->key_voice_information[vel_range];
             if ( (current_voice == NULL) || (current_voice->sample_present == 0) ) continue;
 
-            // Initialize status
-            current_voice->current_status = 0;
-            current_voice->current_slot   = 0;
-            current_sample_format         = &current_voice->sample_format;
+            current_plan = &sample_load_plan[*number_of_samples];
+            memset( current_plan, 0x00, sizeof( SAMPLE_LOAD_PLAN_t ) );
+            current_plan->voice = current_voice;
+            sample_name_map[*number_of_samples] = (uint16_t) *number_of_samples;
+            (*number_of_samples)++;
+        }
+    }
+
+    // Step 3 - Find the directory entries of the sample files
+    prv_vFindSampleFiles( json_file_root_dir, *number_of_samples );
+
+    // Step 4 - Stat the samples
+    for ( sample = 0; sample < *number_of_samples; sample++ ) {
 
-            // Copy the full path
+        current_plan  = &sample_load_plan[sample];
+        current_voice = current_plan->voice;
+
+        if ( current_plan->location.pxIOManager != NULL ) {
+            pxFile = ff_fopenlocation( &current_plan->location, "r" );
+        } else {
+            // Not found in the listing of its directory (i.e. a short name). Look up its path
             memset( full_path, 0x00, MAX_PATH_LEN );
-            strcat( full_path, json_file_root_dir);
-            strcat( full_path, "/");
-            strcat( full_path, (const char *) current_voice->sample_path);
-            #if PATCH_LOADER_DEBUG < 1
-                PATCH_LOADER_PRINTF(".");
-            #else
-                PATCH_LOADER_PRINTF_DEBUG("[%d][%d] Loading Sample \"%s\"", key, vel_range, current_voice->sample_path );
-            #endif
-
-            // Load the RIFF File into memory
-            riff_buffer      = NULL;
-            riff_buffer_size = xLoadFileToMemory_malloc( 
-                                                            full_path,
-                                                            &riff_buffer,
-                                                            (size_t) MAX_SAMPLE_SIZE,
-                                                            sizeof(uint32_t) // Overhead to allow realignment
-                                                        );
-            if ( riff_buffer == NULL || riff_buffer_size == 0 ) {
-                PATCH_LOADER_PRINTF_ERROR("Failed loading the RIFF file into memory");
-                return 1;                          
+            strcat( full_path, json_file_root_dir );
+            strcat( full_path, "/" );
+            strcat( full_path, (const char *) current_voice->sample_path );
+
+            pxFile = ff_fopen( full_path, "r" );
+            if ( pxFile != NULL ) {
+                current_plan->location.pxIOManager     = pxFile->pxIOManager;
+                current_plan->location.ulDirCluster    = pxFile->ulDirCluster;
+                current_plan->location.ulObjectCluster = pxFile->ulObjectCluster;
+                current_plan->location.ulFileSize      = pxFile->ulFileSize;
+                current_plan->location.usDirEntry      = pxFile->usDirEntry;
             }
-            
-            patch_descriptor->total_size += riff_buffer_size;
-            patch_descriptor->total_keys++;
+        }
 
-            // Extract the RIFF information and configure the DMA data structures for the PL DMA functionality
-            vDecodeWAVEInformation( riff_buffer, riff_buffer_size, current_sample_format );
+        if ( pxFile == NULL ) {
+            PATCH_LOADER_PRINTF_ERROR("File %s could not be opened!", current_voice->sample_path);
+            return 1;
+        }
 
-            // Check for errors
-            if ( (current_sample_format->audio_data_size == 0) || (current_sample_format->data_start_ptr == NULL)) {
-                PATCH_LOADER_PRINTF_ERROR("Failed decoding the RIFF audio data");
-                return error;
-            }
+        current_plan->data_offset = ulReadWAVEHeader( pxFile, &current_voice->sample_format );
+        ff_fclose( pxFile );
+
+        if ( current_plan->data_offset == 0 || current_voice->sample_format.audio_data_size == 0 ) {
+            PATCH_LOADER_PRINTF_ERROR("Failed decoding the RIFF information of %s", current_voice->sample_path);
+            return 1;
+        }
 
-            // Data realignment mechanism
-            #if ENABLE_SAMPLE_REALIGN == 1
-                error = prv_ulRealignAudioData( current_voice );
+        if ( current_voice->sample_format.audio_data_size > MAX_SAMPLE_SIZE ) {
+            PATCH_LOADER_PRINTF_ERROR("The audio data of %s is too large. Audio Data = %d bytes | Max Sample Size = %d bytes", current_voice->sample_path, current_voice->sample_format.audio_data_size, MAX_SAMPLE_SIZE);
+            return 1;
+        }
+
+        // Audio data + loop guard. Every sample starts on a cache line
+        sample_memory_size += SAMPLE_MEMORY_ALIGN_SIZE( current_voice->sample_format.audio_data_size + SAMPLER_DMA_BURST_BYTES );
+    }
+
+    // Step 5 - Reserve the sample memory in the arena of the patch. Fails before any audio data is read
+    sample_memory = pvSampleArenaAlloc( patch_descriptor->arena, sample_memory_size );
+    if ( sample_memory == NULL ) {
+        vGetSampleMemoryStats( &memory_stats );
+        PATCH_LOADER_PRINTF_ERROR("The samples don't fit in memory. Requested %d bytes for %d samples | Largest free block = %d bytes", sample_memory_size, *number_of_samples, memory_stats.largest_free_block);
+        return 1;
+    }
+
+    patch_descriptor->total_size = sample_memory_size;
+
+    // Step 6 - Place the samples in key order
+    for ( sample = 0; sample < *number_of_samples; sample++ ) {
+        current_voice = sample_load_plan[sample].voice;
+        current_voice->sample_format.sample_file_buffer = sample_memory;
+        current_voice->sample_format.data_start_ptr     = sample_memory;
+        sample_memory += SAMPLE_MEMORY_ALIGN_SIZE( current_voice->sample_format.audio_data_size + SAMPLER_DMA_BURST_BYTES );
+    }
+
+    // Step 7 - Read in the order of the SD card
+    qsort( sample_load_plan, *number_of_samples, sizeof( SAMPLE_LOAD_PLAN_t ), prv_lCompareFirstCluster );
+
+    PATCH_LOADER_PRINTF_INFO("Reserved %d bytes for %d samples", patch_descriptor->total_size, *number_of_samples);
 
-                if ( error != 0 ) {
-                    PATCH_LOADER_PRINTF_ERROR("Failed realigning the RIFF audio data");
-                    return error;
+    return 0;
+}
+
+// This function finds the directory entries of the samples of the load plan
+// Opening every sample by its path walks the directory and compares all the names before it for each file.
+// Instead, each directory that holds samples is listed once and every entry is looked up in the sample names,
+// sorted by directory and file name. The location of the entry is stored in the plan, so the file can be
+// opened without looking up its path. The samples that are not found keep an empty location
+void prv_vFindSampleFiles( const char *json_file_root_dir, uint32_t number_of_samples ) {
+    uint32_t    group_start = 0;
+    uint32_t    group_end;
+    uint32_t    lower, upper, middle;
+    size_t      dir_length;
+    const char *sample_path;
+    const char *file_name;
+    char        dir_path[MAX_PATH_LEN];
+
+    qsort( sample_name_map, number_of_samples, sizeof( uint16_t ), prv_lCompareSampleName );
+
+    while ( group_start < number_of_samples ) {
+
+        // The samples of a directory are next to each other in the map
+        sample_path = (const char *) sample_load_plan[sample_name_map[group_start]].voice->sample_path;
+        dir_length  = prv_xSampleDirLength( sample_path );
+
+        for ( group_end = group_start + 1; group_end < number_of_samples; group_end++ ) {
+            file_name = (const char *) sample_load_plan[sample_name_map[group_end]].voice->sample_path;
+            if ( prv_xSampleDirLength( file_name ) != dir_length || strncasecmp( file_name, sample_path, dir_length ) != 0 ) break;
+        }
+
+        // Directory of the group
+        if ( dir_length == 0 ) {
+            snprintf( dir_path, MAX_PATH_LEN, "%s", json_file_root_dir );
+        } else {
+            snprintf( dir_path, MAX_PATH_LEN, "%s/%.*s", json_file_root_dir, (int) dir_length, sample_path );
+        }
+
+        if ( ff_findfirst( dir_path, &sample_find_data ) == 0 ) {
+            do {
+                if ( ( sample_find_data.ucAttributes & FF_FAT_ATTR_DIR ) != 0 ) continue;
+
+                // First sample of the group with this file name
+                lower = group_start;
+                upper = group_end;
+                while ( lower < upper ) {
+                    middle    = ( lower + upper ) / 2;
+                    file_name = (const char *) sample_load_plan[sample_name_map[middle]].voice->sample_path + dir_length + ( dir_length ? 1 : 0 );
+                    if ( strcasecmp( file_name, sample_find_data.pcFileName ) < 0 ) {
+                        lower = middle + 1;
+                    } else {
+                        upper = middle;
+                    }
                 }
 
-                // Release the memory for the next file
-                vClearMemoryBuffer( riff_buffer );
-                riff_buffer = NULL;
-            #endif
+                // Zones can share a sample file
+                for ( ; lower < group_end; lower++ ) {
+                    file_name = (const char *) sample_load_plan[sample_name_map[lower]].voice->sample_path + dir_length + ( dir_length ? 1 : 0 );
+                    if ( strcasecmp( file_name, sample_find_data.pcFileName ) != 0 ) break;
+                    ff_getlocation( &sample_find_data, &sample_load_plan[sample_name_map[lower]].location );
+                }
+            } while ( ff_findnext( &sample_find_data ) == 0 );
+        } else {
+            PATCH_LOADER_PRINTF_WARNING("The directory %s could not be listed", dir_path);
         }
+
+        group_start = group_end;
     }
+}
 
-    PATCH_LOADER_PRINTF("\n\r---\n\r");
-    PATCH_LOADER_PRINTF_INFO("Loaded %d keys", patch_descriptor->total_keys);
-    PATCH_LOADER_PRINTF_INFO("Total Memory Used = %d bytes", patch_descriptor->total_size);
+// This function sorts the sample name map by directory, then by file name
+// Names are compared without case, as FAT does
+int prv_lCompareSampleName( const void *index_a, const void *index_b ) {
+    const char *path_a       = (const char *) sample_load_plan[*(const uint16_t *) index_a].voice->sample_path;
+    const char *path_b       = (const char *) sample_load_plan[*(const uint16_t *) index_b].voice->sample_path;
+    size_t      dir_length_a = prv_xSampleDirLength( path_a );
+    size_t      dir_length_b = prv_xSampleDirLength( path_b );
+    int         result;
+
+    if ( dir_length_a != dir_length_b ) return ( dir_length_a > dir_length_b ) - ( dir_length_a < dir_length_b );
+
+    result = strncasecmp( path_a, path_b, dir_length_a );
+    if ( result != 0 ) return result;
+
+    return strcasecmp( path_a + dir_length_a + ( dir_length_a ? 1 : 0 ), path_b + dir_length_b + ( dir_length_b ? 1 : 0 ) );
+}
+
+// This function returns the length of the directory part of a sample path (0 if the sample is next to the JSON file)
+size_t prv_xSampleDirLength( const char *sample_path ) {
+    const char *separator = strrchr( sample_path, '/' );
+
+    return ( separator == NULL ) ? 0 : (size_t) ( separator - sample_path );
+}
+
+// This function sorts the load plan by first cluster
+int prv_lCompareFirstCluster( const void *plan_a, const void *plan_b ) {
+    uint32_t first_cluster_a = ( (const SAMPLE_LOAD_PLAN_t *) plan_a )->location.ulObjectCluster;
+    uint32_t first_cluster_b = ( (const SAMPLE_LOAD_PLAN_t *) plan_b )->location.ulObjectCluster;
+
+    return ( first_cluster_a > first_cluster_b ) - ( first_cluster_a < first_cluster_b );
+}
+
+// This function commits a sample loaded by the reader task to its zone
+// The audio data is already in its final (aligned) location
+uint32_t prv_ulCommitSampleFile( PATCH_DESCRIPTOR_t *patch_descriptor, SAMPLE_READ_RESULT_t *read_result ) {
+    KEY_VOICE_INFORMATION_t *current_voice = read_result->voice;
+
+    if ( read_result->error ) {
+        PATCH_LOADER_PRINTF_ERROR("Failed loading \"%s\" into memory", current_voice->sample_path);
+        return 1;
+    }
+
+    patch_descriptor->total_keys++;
+
+    // Use the loop of the sample file unless the JSON file defines one
+    prv_vResolveSampleLoop( current_voice );
+
+    // Pitched loops read past the loop end
+    prv_vWriteLoopGuard( current_voice );
 
     return 0;
 }
 
-#if ENABLE_SAMPLE_REALIGN == 1
-// This function realigns the 16-bit audio data so that it can be properly accessed through DMA without complex HW implementations
-// To do this, the data needs to start in an address that is multiple of 4 (ej. 0xffff0000, 0xffff0004, 0xffff0008, 0xffff000c, etc.)
-uint32_t prv_ulRealignAudioData( KEY_VOICE_INFORMATION_t *voice_information ) {
+// This function builds the flat zone table of the patch
+// Every key/velocity pair is mapped to the index of the zone that should be played back,
+// so the playback engine only needs one table read per MIDI event
+// The zone table is allocated in the arena of the patch and only holds what the playback needs.
+// The load-time information can be released once it is built
+uint32_t prv_ulBuildZoneTable( PATCH_DESCRIPTOR_t *patch_descriptor ) {
+    uint32_t                  key;
+    uint32_t                  vel_range;
+    uint32_t                  velocity;
+    uint32_t                  velocity_max;
+    uint16_t                  zone_index = 0;
+    uint16_t                  number_of_zones = 0;
+    uint8_t                   key_zone_count[MAX_NUM_OF_KEYS];
+    KEY_INFORMATION_t        *current_key;
+    KEY_VOICE_INFORMATION_t  *current_voice;
+    KEY_VOICE_INFORMATION_t **zone_voice;
+    ZONE_PLAYBACK_t          *zone_playback;
 
-    uint8_t *aligned_buffer_ptr = NULL;
-    
     // Sanity check
-    if ( voice_information == NULL ) return 1;
-    if ( voice_information->sample_format.data_start_ptr == NULL ) return 1;
-    if ( voice_information->sample_format.audio_data_size == 0 ) return 1;
+    if ( (patch_descriptor == NULL) || (patch_descriptor->load_info == NULL) ) {
+        PATCH_LOADER_PRINTF_ERROR("Zone table builder failed. No load information");
+        return 1;
+    }
+
+    // Step 1 - Count the zones
+    for (key = 0; key < MAX_NUM_OF_KEYS; key++) {
+        current_key = patch_descriptor->load_info->key_information[key];
+        if ( current_key == NULL ) continue;
 
-    // If data needs realignment, copy the unaligned data to a temp memory location
-    // and then copy back the data on the appropriate offset.
+        for (vel_range = 0; vel_range < MAX_NUM_OF_VELOCITY; vel_range++) {
+            current_voice = current_key->key_voice_information[vel_range];
+            if ( (current_voice != NULL) && (current_voice->sample_present != 0) ) number_of_zones++;
+        }
+    }
+
+    if ( number_of_zones > MAX_NUM_OF_ZONES ) {
+        PATCH_LOADER_PRINTF_ERROR("Too many zones (%d). Maximum number of zones = %d", number_of_zones, MAX_NUM_OF_ZONES);
+        return 1;
+    }
 
-    // Step 1 - Malloc the required temoporary space
-    aligned_buffer_ptr = sampler_malloc( (size_t) voice_information->sample_format.audio_data_size );
+    // Step 2 - Allocate the zone table (one spare entry, so an empty patch still gets one)
+    // The zone -> voice table is only needed while building it
+    patch_descriptor->zone_playback = pvSampleArenaAlloc( patch_descriptor->arena, ( number_of_zones + 1 ) * sizeof( ZONE_PLAYBACK_t ) );
+    patch_descriptor->zone_pitch    = pvSampleArenaAlloc( patch_descriptor->arena, ( number_of_zones + 1 ) * sizeof( ZONE_PITCH_t ) );
+    patch_descriptor->zone_state    = pvSampleArenaAlloc( patch_descriptor->arena, ( number_of_zones + 1 ) * sizeof( ZONE_STATE_t ) );
+    zone_voice                      = pvSampleArenaAlloc( patch_descriptor->load_info->arena, ( number_of_zones + 1 ) * sizeof( KEY_VOICE_INFORMATION_t * ) );
 
-    // Fail if there's not enugh space for malloc
-    if ( aligned_buffer_ptr == NULL ) {
-        PATCH_LOADER_PRINTF_ERROR("Malloc for the temporary realignment buffer failed! Requested size = %d bytes", voice_information->sample_format.audio_data_size);
+    if ( patch_descriptor->zone_playback == NULL || patch_descriptor->zone_pitch == NULL || patch_descriptor->zone_state == NULL || zone_voice == NULL ) {
+        PATCH_LOADER_PRINTF_ERROR("Memory allocation for the zone table failed!");
         return 1;
     }
 
-    // Step 2 - Copy the contents
-    //memcpy( temp_data_buffer, voice_information->sample_format.data_start_ptr, (size_t) voice_information->sample_format.audio_data_size );
-    memcpy( aligned_buffer_ptr, voice_information->sample_format.data_start_ptr, (size_t) voice_information->sample_format.audio_data_size );
+    // Initialize the table. Nothing is mapped and nothing is active
+    memset( patch_descriptor->zone_state, 0x00, ( number_of_zones + 1 ) * sizeof( ZONE_STATE_t ) );
+    memset( patch_descriptor->zone_lut,   0xff, sizeof( patch_descriptor->zone_lut ) );
+    memset( patch_descriptor->slot_zone,  0xff, sizeof( patch_descriptor->slot_zone ) );
+    memset( key_zone_count,               0x00, sizeof( key_zone_count ) );
+    patch_descriptor->number_of_active_zones = 0;
+    patch_descriptor->instance_sequence      = 0;
+
+    // Step 3 - Add the zones, sorted by key
+    for (key = 0; key < MAX_NUM_OF_KEYS; key++) {
+
+        current_key = patch_descriptor->load_info->key_information[key];
+        if ( current_key == NULL ) continue;
+
+        for (vel_range = 0; vel_range < MAX_NUM_OF_VELOCITY; vel_range++) {
+
+            current_voice = current_key->key_voice_information[vel_range];
+            if ( (current_voice == NULL) || (current_voice->sample_present == 0) ) continue;
+
+            // Add the zone. The loop is stored in bytes, as the DMA uses it
+            zone_playback              = &patch_descriptor->zone_playback[zone_index];
+            zone_playback->sample_addr = (uint32_t) current_voice->sample_format.data_start_ptr;
+            zone_playback->sample_size = current_voice->sample_format.audio_data_size;
+            zone_playback->loop_start  = 0;
+            zone_playback->loop_end    = 0;
+            if ( current_voice->loop_enabled ) {
+                zone_playback->loop_start = current_voice->loop_start * current_voice->sample_format.block_align;
+                zone_playback->loop_end   = current_voice->loop_end   * current_voice->sample_format.block_align;
+            }
+
+            patch_descriptor->zone_pitch[zone_index].root_key  = current_voice->root_key;
+            patch_descriptor->zone_pitch[zone_index].fine_tune = current_voice->fine_tune;
+
+            zone_voice[zone_index] = current_voice;
+            key_zone_count[key]++;
+
+            // Map the velocity range. If two ranges overlap, the first zone wins
+            velocity_max = current_voice->velocity_max;
+            if ( velocity_max >= MAX_NUM_OF_VELOCITY ) velocity_max = MAX_NUM_OF_VELOCITY - 1;
+
+            for (velocity = current_voice->velocity_min; velocity <= velocity_max; velocity++) {
+                if ( patch_descriptor->zone_lut[key][velocity] == ZONE_INDEX_NONE ) {
+                    patch_descriptor->zone_lut[key][velocity] = zone_index;
+                }
+            }
+
+            zone_index++;
+        }
+    }
+
+    patch_descriptor->number_of_zones = zone_index;
+
+    // Step 4 - Map the key ranges. The keys with their own sample keep it
+    // Zones are sorted by key, so the zone with the closest root key above a key wins
+    for (zone_index = 0; zone_index < patch_descriptor->number_of_zones; zone_index++) {
+
+        current_voice = zone_voice[zone_index];
+
+        velocity_max = current_voice->velocity_max;
+        if ( velocity_max >= MAX_NUM_OF_VELOCITY ) velocity_max = MAX_NUM_OF_VELOCITY - 1;
+
+        for (key = current_voice->key_min; key <= current_voice->key_max; key++) {
+            if ( key_zone_count[key] != 0 ) continue;
+
+            for (velocity = current_voice->velocity_min; velocity <= velocity_max; velocity++) {
+                if ( patch_descriptor->zone_lut[key][velocity] == ZONE_INDEX_NONE ) {
+                    patch_descriptor->zone_lut[key][velocity] = zone_index;
+                }
+            }
+        }
+    }
+
+    PATCH_LOADER_PRINTF_INFO("Zone table built with %d zones", patch_descriptor->number_of_zones);
+
+    return 0;
+}
+
+// This function selects the loop points of a sample. The JSON loop points have priority over the sample file ones
+// The loop is disabled if it doesn't fit in the audio data
+void prv_vResolveSampleLoop( KEY_VOICE_INFORMATION_t *voice_information ) {
+    SAMPLE_FORMAT_t *sample_format = &voice_information->sample_format;
+    uint32_t         number_of_frames;
+
+    if ( voice_information->loop_enabled == 0 && sample_format->loop_present ) {
+        voice_information->loop_enabled = 1;
+        voice_information->loop_start   = sample_format->loop_start;
+        voice_information->loop_end     = sample_format->loop_end;
+    }
+
+    if ( voice_information->loop_enabled == 0 ) return;
+
+    number_of_frames = ( sample_format->block_align != 0 ) ? ( sample_format->audio_data_size / sample_format->block_align ) : 0;
+    if ( voice_information->loop_end > number_of_frames ) {
+        PATCH_LOADER_PRINTF_ERROR("Loop end (%d) is past the end of the sample (%d frames). Loop ignored", voice_information->loop_end, number_of_frames);
+        voice_information->loop_enabled = 0;
+        return;
+    }
+
+    PATCH_LOADER_PRINTF_DEBUG("Loop from frame %d to %d", voice_information->loop_start, voice_information->loop_end);
+}
+
+// This function copies the start of the loop right after the loop end (as aligned by the DMA)
+// The DMA always reads full bursts, and the last burst of a pitched loop goes past the loop end
+// The copy overwrites audio data that is never played (the sample isn't read past the loop end)
+// or the overhead allocated with the sample
+void prv_vWriteLoopGuard( KEY_VOICE_INFORMATION_t *voice_information ) {
+    SAMPLE_FORMAT_t   *sample_format = &voice_information->sample_format;
+    VOICE_LOOP_INFO_t  loop_info;
+
+    if ( voice_information->loop_enabled == 0 ) return;
+
+    loop_info.loop_start = voice_information->loop_start * sample_format->block_align;
+    loop_info.loop_end   = voice_information->loop_end   * sample_format->block_align;
+    if ( ulAlignVoiceLoop( sample_format->audio_data_size, &loop_info ) ) return;
+
+    memmove( sample_format->data_start_ptr + loop_info.loop_end, sample_format->data_start_ptr + loop_info.loop_start, SAMPLER_DMA_BURST_BYTES );
+}
+
+// This function checks the keys covered by a sample
+// The resampler can only lower the pitch, so the keys above the root key are not covered
+void prv_vResolveKeyRange( KEY_VOICE_INFORMATION_t *voice_information, uint8_t midi_note ) {
+
+    if ( voice_information->root_key >= MAX_NUM_OF_KEYS ) {
+        PATCH_LOADER_PRINTF_ERROR("KEY[%d]: root_key (%d) out of range. Using the key of the sample", midi_note, voice_information->root_key);
+        voice_information->root_key = midi_note;
+    }
+
+    if ( voice_information->key_min > voice_information->key_max || voice_information->key_max >= MAX_NUM_OF_KEYS ) {
+        PATCH_LOADER_PRINTF_ERROR("KEY[%d]: Invalid key range (%d to %d). The sample is only played on its own key", midi_note, voice_information->key_min, voice_information->key_max);
+        voice_information->key_min = midi_note;
+        voice_information->key_max = midi_note;
+    }
+
+    if ( voice_information->key_max > voice_information->root_key ) {
+        PATCH_LOADER_PRINTF_WARNING("KEY[%d]: Samples can't be pitched up. key_max lowered from %d to the root key (%d)", midi_note, voice_information->key_max, voice_information->root_key);
+        voice_information->key_max = voice_information->root_key;
+        if ( voice_information->key_min > voice_information->key_max ) voice_information->key_min = voice_information->key_max;
+    }
+
+    if ( midi_note > voice_information->root_key ) {
+        PATCH_LOADER_PRINTF_WARNING("KEY[%d]: The key is above the root key (%d). The sample is played at its original rate", midi_note, voice_information->root_key);
+    }
+}
+
+// This function flushes the audio data of all the zones from the cache to the DDR
+void prv_vFlushSampleMemory( PATCH_DESCRIPTOR_t *patch_descriptor ) {
+    ZONE_PLAYBACK_t *zone_playback;
+    uint32_t         flush_size;
+
+    for ( uint32_t zone = 0; zone < patch_descriptor->number_of_zones; zone++ ) {
+        zone_playback = &patch_descriptor->zone_playback[zone];
+        flush_size    = zone_playback->sample_size;
+        if ( zone_playback->loop_end != 0 ) flush_size += SAMPLER_DMA_BURST_BYTES; // Loop guard
+        vSamplerCacheFlushSampleRange( (uint8_t *) zone_playback->sample_addr, flush_size );
+    }
+}
+
+// This function checks that the bundle header matches the firmware and the file
+uint32_t prv_ulCheckBundleHeader( const uint8_t *bundle_buffer, size_t bundle_buffer_len ) {
+    const BUNDLE_HEADER_t *bundle_header = (const BUNDLE_HEADER_t *) bundle_buffer;
+
+    if ( bundle_buffer_len < sizeof( BUNDLE_HEADER_t ) || bundle_header->magic != BUNDLE_MAGIC ) {
+        PATCH_LOADER_PRINTF_ERROR("The file is not an instrument bundle");
+        return 1;
+    }
+
+    if ( bundle_header->version != BUNDLE_VERSION || bundle_header->header_size != sizeof( BUNDLE_HEADER_t ) || bundle_header->zone_size != sizeof( BUNDLE_ZONE_t ) ) {
+        PATCH_LOADER_PRINTF_ERROR("Unsupported bundle version %d (expected %d). The bundle needs to be rebuilt", bundle_header->version, BUNDLE_VERSION);
+        return 1;
+    }
+
+    if ( bundle_header->number_of_zones > MAX_NUM_OF_ZONES ) {
+        PATCH_LOADER_PRINTF_ERROR("Too many zones in the bundle (%d). Maximum number of zones = %d", bundle_header->number_of_zones, MAX_NUM_OF_ZONES);
+        return 1;
+    }
+
+    // The sizes are compared with what is left after the offsets, so a corrupted size can't wrap the sums
+    if ( ( bundle_header->data_offset % BUNDLE_DATA_ALIGN ) != 0 ||
+         bundle_header->data_offset < sizeof( BUNDLE_HEADER_t ) + bundle_header->number_of_zones * sizeof( BUNDLE_ZONE_t ) ||
+         bundle_header->data_offset > bundle_buffer_len ||
+         bundle_header->data_size > bundle_buffer_len - bundle_header->data_offset ) {
+        PATCH_LOADER_PRINTF_ERROR("The bundle is truncated or corrupted");
+        return 1;
+    }
+
+    return 0;
+}
+
+// This function populates the patch descriptor with the zones of a bundle
+// The zones of the same key are added as velocity ranges
+uint32_t prv_ulDecodeBundleZones( uint8_t *bundle_buffer, PATCH_DESCRIPTOR_t *patch_descriptor ) {
+    BUNDLE_HEADER_t         *bundle_header = (BUNDLE_HEADER_t *) bundle_buffer;
+    BUNDLE_ZONE_t           *bundle_zone   = (BUNDLE_ZONE_t *) ( bundle_buffer + sizeof( BUNDLE_HEADER_t ) );
+    uint8_t                 *audio_data    = bundle_buffer + bundle_header->data_offset;
+    KEY_INFORMATION_t       *current_key;
+    KEY_VOICE_INFORMATION_t *current_voice;
+    SAMPLE_FORMAT_t         *current_sample_format;
+
+    memcpy( patch_descriptor->instrument_name, bundle_header->instrument_name, BUNDLE_NAME_LEN );
+    patch_descriptor->instrument_name[BUNDLE_NAME_LEN - 1] = '\0';
+    PATCH_LOADER_PRINTF_INFO("Instrument Name: %s", patch_descriptor->instrument_name );
+
+    patch_descriptor->retrigger_mode = bundle_header->retrigger_mode;
+    patch_descriptor->max_instances  = bundle_header->max_instances;
+    if ( patch_descriptor->retrigger_mode > RETRIGGER_MODE_CHOKE ) patch_descriptor->retrigger_mode = RETRIGGER_MODE_RESTART;
+    if ( patch_descriptor->max_instances == 0 || patch_descriptor->max_instances > MAX_ZONE_INSTANCES ) patch_descriptor->max_instances = MAX_ZONE_INSTANCES;
+
+    for ( uint32_t zone = 0; zone < bundle_header->number_of_zones; zone++, bundle_zone++ ) {
+
+        if ( bundle_zone->key >= MAX_NUM_OF_KEYS || bundle_zone->block_align == 0 ||
+             ( bundle_zone->audio_offset % BUNDLE_DATA_ALIGN ) != 0 ||
+             bundle_header->data_size < SAMPLER_DMA_BURST_BYTES ||
+             bundle_zone->audio_offset > bundle_header->data_size - SAMPLER_DMA_BURST_BYTES ||
+             bundle_zone->audio_size > bundle_header->data_size - SAMPLER_DMA_BURST_BYTES - bundle_zone->audio_offset ) {
+            PATCH_LOADER_PRINTF_ERROR("Zone %d of the bundle is corrupted", zone);
+            return 1;
+        }
+
+        // Allocate the memory if the key information doesn't exist
+        if( patch_descriptor->load_info->key_information[bundle_zone->key] == NULL ) {
+            patch_descriptor->load_info->key_information[bundle_zone->key] = prv_xInitKeyInformation( patch_descriptor );
+            if( patch_descriptor->load_info->key_information[bundle_zone->key] == NULL ) return 1;
+        }
+
+        current_key = patch_descriptor->load_info->key_information[bundle_zone->key];
+        if ( current_key->number_of_velocity_ranges >= MAX_NUM_OF_VELOCITY ) {
+            PATCH_LOADER_PRINTF_ERROR("KEY[%d]: Too many velocity ranges", bundle_zone->key);
+            return 1;
+        }
+
+        current_voice = prv_xInitVoiceInformation( patch_descriptor );
+        if( current_voice == NULL ) return 1;
+        current_key->key_voice_information[current_key->number_of_velocity_ranges++] = current_voice;
+
+        current_voice->sample_present = 1;
+        current_voice->velocity_min   = bundle_zone->velocity_min;
+        current_voice->velocity_max   = bundle_zone->velocity_max;
+        current_voice->root_key       = bundle_zone->root_key;
+        current_voice->fine_tune      = bundle_zone->fine_tune;
+        current_voice->key_min        = bundle_zone->key_min;
+        current_voice->key_max        = bundle_zone->key_max;
+        current_voice->loop_enabled   = bundle_zone->loop_enabled;
+        current_voice->loop_start     = bundle_zone->loop_start;
+        current_voice->loop_end       = bundle_zone->loop_end;
+
+        // The audio data is ready for the DMA
+        current_sample_format                     = &current_voice->sample_format;
+        current_sample_format->sample_file_format = SAMPLE_FORMAT_RAW;
+        current_sample_format->sample_file_buffer = bundle_buffer;
+        current_sample_format->audio_format       = 1; // PCM
+        current_sample_format->number_of_channels = bundle_zone->number_of_channels;
+        current_sample_format->sample_rate        = bundle_zone->sample_rate;
+        current_sample_format->block_align        = bundle_zone->block_align;
+        current_sample_format->bits_per_sample    = bundle_zone->bits_per_sample;
+        current_sample_format->byte_rate          = bundle_zone->sample_rate * bundle_zone->block_align;
+        current_sample_format->audio_data_size    = bundle_zone->audio_size;
+        current_sample_format->data_start_ptr     = audio_data + bundle_zone->audio_offset;
+
+        prv_vResolveKeyRange( current_voice, bundle_zone->key );
+        prv_vResolveSampleLoop( current_voice );
+        prv_vWriteLoopGuard( current_voice );
+
+        patch_descriptor->total_keys++;
+    }
 
-    // Step 3 - Assign the new pointer
-    voice_information->sample_format.data_start_ptr = aligned_buffer_ptr;
+    PATCH_LOADER_PRINTF_INFO("Loaded %d zones", patch_descriptor->total_keys);
 
     return 0;
 }
-#endif
@@ -23,6 +23,9 @@ static void prv_vPrintSHDR( SF_DESCRIPTOR_t * sf_descriptor );
 static void prv_vSF2DecodeINFO( uint8_t * info_chunk_buffer, size_t info_chunk_buffer_len, SF_DESCRIPTOR_t * sf_descriptor );
 static void prv_vSF2DecodeSDTA( uint8_t * sdta_chunk_buffer, size_t sdta_chunk_buffer_len, SF_DESCRIPTOR_t * sf_descriptor  );
 static void prv_vSF2DecodePDTA( uint8_t * pdta_chunk_buffer, size_t pdta_chunk_buffer_len, SF_DESCRIPTOR_t * sf_descriptor  );
+static void prv_vFindWAVELoop( uint8_t * buffer, uint8_t * buffer_end, SAMPLE_FORMAT_t *sample_information );
+static void prv_vSetWAVELoop( SAMPLER_CHUNK_t *sampler_chunk, SAMPLER_LOOP_t *sampler_loop, SAMPLE_FORMAT_t *sample_information );
+static void prv_vSetWAVEFormat( FORMAT_DESCRIPTOR_CHUNK_t *format_chunk, SAMPLE_FORMAT_t *sample_information );
 // Find the audio data of a WAVE chunk
 static void prv_vFindWAVEData( uint8_t * buffer, uint8_t * buffer_end, SAMPLE_FORMAT_t *sample_information ) {
 
@@ -55,6 +58,138 @@ static void prv_vFindWAVEData( uint8_t * buffer, uint8_t * buffer_end, SAMPLE_FO
     }
 }
 
+// Find the first forward loop of the "smpl" chunk of a WAVE file
+// The chunk can be anywhere in the file (usually after the audio data)
+static void prv_vFindWAVELoop( uint8_t * buffer, uint8_t * buffer_end, SAMPLE_FORMAT_t *sample_information ) {
+
+    RIFF_BASE_CHUNK_t * current_chunk;
+    SAMPLER_CHUNK_t   * sampler_chunk;
+    SAMPLER_LOOP_t    * sampler_loop;
+    uint8_t           * current_buffer_idx = buffer;
+
+    // Initialize
+    sample_information->loop_present = 0;
+    sample_information->loop_start   = 0;
+    sample_information->loop_end     = 0;
+
+    while( ( current_buffer_idx + sizeof( RIFF_BASE_CHUNK_t ) ) <= buffer_end ) {
+        current_chunk = cmdGET_RIFF_BASE_CHUNK(current_buffer_idx);
+
+        if( current_chunk->ChunkID == SMPL_ASCII_TOKEN ) {
+            sampler_chunk = (SAMPLER_CHUNK_t *) current_buffer_idx;
+            sampler_loop  = (SAMPLER_LOOP_t *) ( current_buffer_idx + sizeof( SAMPLER_CHUNK_t ) );
+
+            if( (uint8_t *) ( sampler_loop + 1 ) > buffer_end ) return;
+
+            prv_vSetWAVELoop( sampler_chunk, sampler_loop, sample_information );
+            return;
+        }
+
+        // Chunks are padded to an even size
+        current_buffer_idx += sizeof( RIFF_BASE_CHUNK_t ) + current_chunk->ChunkSize + ( current_chunk->ChunkSize & 0x1 );
+    }
+}
+
+// Copy the first loop of a "smpl" chunk to the sample information
+static void prv_vSetWAVELoop( SAMPLER_CHUNK_t *sampler_chunk, SAMPLER_LOOP_t *sampler_loop, SAMPLE_FORMAT_t *sample_information ) {
+
+    if( sampler_chunk->NumSampleLoops == 0 ) return;
+
+    // Only forward loops are supported
+    if( sampler_loop->Type != 0 ) {
+        RIFF_PRINTF_WARNING("Only forward loops are supported. Loop type = %d", sampler_loop->Type);
+        return;
+    }
+
+    if( sampler_loop->End < sampler_loop->Start ) return;
+
+    sample_information->loop_present = 1;
+    sample_information->loop_start   = sampler_loop->Start;
+    sample_information->loop_end     = sampler_loop->End + 1; // The WAVE loop end is included
+    RIFF_PRINTF_DEBUG("Found loop from frame %d to %d", sample_information->loop_start, sample_information->loop_end);
+}
+
+// Copy the "fmt " chunk to the sample information
+static void prv_vSetWAVEFormat( FORMAT_DESCRIPTOR_CHUNK_t *format_chunk, SAMPLE_FORMAT_t *sample_information ) {
+    sample_information->sample_file_format = SAMPLE_FORMAT_WAVE;
+    sample_information->audio_format       = format_chunk->AudioFormat;
+    sample_information->number_of_channels = format_chunk->NumChannels;
+    sample_information->sample_rate        = format_chunk->SampleRate;
+    sample_information->byte_rate          = format_chunk->ByteRate;
+    sample_information->block_align        = format_chunk->BlockAlign;
+    sample_information->bits_per_sample    = format_chunk->BitsPerSample;
+}
+
+// This function reads the information of a WAVE file without reading its audio data
+// The chunks are walked with seeks, so only the chunk headers, "fmt " and "smpl" are read
+// Returns the offset of the audio data in the file (0 if the file is not a valid WAVE file)
+uint32_t ulReadWAVEHeader( FF_FILE *wave_file, SAMPLE_FORMAT_t *sample_information ) {
+
+    RIFF_DESCRIPTOR_CHUNK_t   riff_chunk;
+    RIFF_BASE_CHUNK_t         current_chunk;
+    FORMAT_DESCRIPTOR_CHUNK_t format_chunk;
+    SAMPLER_CHUNK_t           sampler_chunk;
+    SAMPLER_LOOP_t            sampler_loop;
+    uint32_t                  file_size    = ff_filelength( wave_file );
+    uint32_t                  chunk_offset = sizeof( RIFF_DESCRIPTOR_CHUNK_t );
+    uint32_t                  data_offset  = 0;
+    uint8_t                   format_found = 0;
+
+    sample_information->data_start_ptr  = NULL; // Initialize to 0
+    sample_information->audio_data_size = 0;    // Initialize to 0
+    sample_information->loop_present    = 0;    // No loop by default
+
+    // Step 1 - Check that this is a WAVE file
+    ff_fseek( wave_file, 0, FF_SEEK_SET );
+    if( ff_fread( &riff_chunk, sizeof( RIFF_DESCRIPTOR_CHUNK_t ), 1, wave_file ) != 1 ||
+        riff_chunk.BaseChunk.ChunkID != RIFF_ASCII_TOKEN || riff_chunk.FormType != WAVE_ASCII_TOKEN ) {
+        RIFF_PRINTF_ERROR("Error while parsing the RIFF information. File is not WAVE.");
+        return 0;
+    }
+
+    // Step 2 - Walk the chunks
+    while( chunk_offset + sizeof( RIFF_BASE_CHUNK_t ) <= file_size ) {
+
+        ff_fseek( wave_file, chunk_offset, FF_SEEK_SET );
+        if( ff_fread( &current_chunk, sizeof( RIFF_BASE_CHUNK_t ), 1, wave_file ) != 1 ) break;
+
+        if( current_chunk.ChunkID == FMT_ASCII_TOKEN ) {
+            if( ff_fread( &format_chunk.AudioFormat, sizeof( FORMAT_DESCRIPTOR_CHUNK_t ) - sizeof( RIFF_BASE_CHUNK_t ), 1, wave_file ) == 1 ) {
+                prv_vSetWAVEFormat( &format_chunk, sample_information );
+                format_found = 1;
+            }
+        } else if( current_chunk.ChunkID == DATA_ASCII_TOKEN ) {
+            data_offset                         = chunk_offset + sizeof( RIFF_BASE_CHUNK_t );
+            sample_information->audio_data_size = current_chunk.ChunkSize;
+            // Truncated files play what is there
+            if( current_chunk.ChunkSize > file_size - data_offset ) sample_information->audio_data_size = file_size - data_offset;
+        } else if( current_chunk.ChunkID == SMPL_ASCII_TOKEN ) {
+            if( ff_fread( &sampler_chunk.Manufacturer, sizeof( SAMPLER_CHUNK_t ) - sizeof( RIFF_BASE_CHUNK_t ), 1, wave_file ) == 1 &&
+                ff_fread( &sampler_loop, sizeof( SAMPLER_LOOP_t ), 1, wave_file ) == 1 ) {
+                prv_vSetWAVELoop( &sampler_chunk, &sampler_loop, sample_information );
+            }
+        }
+
+        // Nothing can follow a chunk that reaches the end of the file. This also keeps a bogus size from wrapping the offset
+        if( current_chunk.ChunkSize >= file_size - chunk_offset - sizeof( RIFF_BASE_CHUNK_t ) ) break;
+
+        // Chunks are padded to an even size
+        chunk_offset += sizeof( RIFF_BASE_CHUNK_t ) + current_chunk.ChunkSize + ( current_chunk.ChunkSize & 0x1 );
+    }
+
+    if( format_found == 0 ) {
+        RIFF_PRINTF_ERROR("Couldn't find the \"fmt \" chunk!");
+        return 0;
+    }
+
+    if( data_offset == 0 || sample_information->audio_data_size == 0 ) {
+        RIFF_PRINTF_ERROR("Couldn't find the DATA chunk!");
+        return 0;
+    }
+
+    return data_offset;
+}
+
 // This function will extract the information based on the canonical wave format
 void vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMPLE_FORMAT_t *sample_information ) {
 
@@ -80,6 +215,7 @@ void vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMP
 
     sample_information->data_start_ptr  = NULL; // Initialize to 0
     sample_information->audio_data_size = 0;    // Initialize to 0
+    sample_information->loop_present    = 0;    // No loop by default
 
     // Step 1 - Read the first chunk. Must contain "RIFF"
     main_riff_chunk = cmdGET_RIFF_DESCRIPTOR_CHUNK(riff_buffer);
@@ -100,14 +236,8 @@ void vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMP
         }
 
         // Step 3.1 - Extract the base information
-        sample_information->sample_file_format = SAMPLE_FORMAT_WAVE;
         sample_information->sample_file_buffer = riff_buffer;
-        sample_information->audio_format       = wave_format_data.FormatDescriptor.AudioFormat;
-        sample_information->number_of_channels = wave_format_data.FormatDescriptor.NumChannels;
-        sample_information->sample_rate        = wave_format_data.FormatDescriptor.SampleRate;
-        sample_information->byte_rate          = wave_format_data.FormatDescriptor.ByteRate;
-        sample_information->block_align        = wave_format_data.FormatDescriptor.BlockAlign;
-        sample_information->bits_per_sample    = wave_format_data.FormatDescriptor.BitsPerSample;
+        prv_vSetWAVEFormat( &wave_format_data.FormatDescriptor, sample_information );
 
         // Step 3.2 - Find the "DATA" chunk and get the pointer
         // Current index is where the Format chunk finished
@@ -122,6 +252,9 @@ void vDecodeWAVEInformation( uint8_t *riff_buffer, size_t riff_buffer_size, SAMP
             return;
         }
 
+        // Step 3.3 - Find the loop points (optional)
+        prv_vFindWAVELoop( riff_buffer_idx, (riff_buffer + riff_buffer_size), sample_information );
+
     } else {
         RIFF_PRINTF_ERROR("Error while parsing the RIFF information. Buffer format is not WAVE.");
         return;
@@ -224,6 +357,24 @@ void vPrintSF2Info( uint8_t* sf2_buffer, size_t sf2_buffer_len ) {
 
 }
 
+// This function extracts the loop points of an SF2 sample header
+// The SF2 loop points are absolute indexes in the "smpl" sub-chunk. They are converted to frames relative to the sample start
+void vDecodeSF2SampleLoop( const SF_SHDR_CHUNK_DATA_t *sample_header, SAMPLE_FORMAT_t *sample_information ) {
+
+    sample_information->loop_present = 0;
+    sample_information->loop_start   = 0;
+    sample_information->loop_end     = 0;
+
+    // The loop must be inside the sample. dwEndloop is the first point after the loop
+    if( sample_header->dwStartloop < sample_header->dwStart   ) return;
+    if( sample_header->dwEndloop   <= sample_header->dwStartloop ) return;
+    if( sample_header->dwEndloop   > sample_header->dwEnd     ) return;
+
+    sample_information->loop_present = 1;
+    sample_information->loop_start   = sample_header->dwStartloop - sample_header->dwStart;
+    sample_information->loop_end     = sample_header->dwEndloop   - sample_header->dwStart;
+}
+
 // Print the PHDR of all the presets
 void prv_vPrintPHDR( SF_DESCRIPTOR_t * sf_descriptor ) {
     size_t                   phdr_len        = 0;
@@ -255,6 +406,7 @@ void prv_vPrintSHDR( SF_DESCRIPTOR_t * sf_descriptor ) {
     size_t                   shdr_len        = 0;
     uint32_t                 num_of_samples  = 0;
     SF_SHDR_CHUNK_DATA_t   * curr_shdr_chunk = NULL;
+    SAMPLE_FORMAT_t          sample_loop;
 
     // Get the length
     shdr_len       = sf_descriptor->sf_pdata_list_descriptor.SHDR_CHUNK->BaseChunk.ChunkSize;
@@ -273,6 +425,12 @@ void prv_vPrintSHDR( SF_DESCRIPTOR_t * sf_descriptor ) {
         RIFF_PRINTF_INFO("  End              = 0x%x", curr_shdr_chunk->dwEnd);
         RIFF_PRINTF_INFO("  Start Loop       = 0x%x", curr_shdr_chunk->dwStartloop);
         RIFF_PRINTF_INFO("  End Loop         = 0x%x", curr_shdr_chunk->dwEndloop);
+        vDecodeSF2SampleLoop( curr_shdr_chunk, &sample_loop );
+        if ( sample_loop.loop_present ) {
+            RIFF_PRINTF_INFO("  Loop (frames)    = %d to %d", sample_loop.loop_start, sample_loop.loop_end);
+        } else {
+            RIFF_PRINTF_INFO("  Loop (frames)    = None");
+        }
         RIFF_PRINTF_INFO("  Sample Link      = 0x%x", curr_shdr_chunk->wSampleLink);
         RIFF_PRINTF_INFO("  Sample Type      = 0x%x", curr_shdr_chunk->sfSampleType);
         curr_shdr_chunk += 1;
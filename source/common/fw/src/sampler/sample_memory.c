@@ -0,0 +1,315 @@
+//////////////////////////////////////////
+// Sample Memory
+//////////////////////////////////////////
+// Region allocator for the instruments
+// - The region is a dedicated area at the top of the DDR, outside the FreeRTOS heap,
+//   so the large sample buffers never fragment the heap used by the tasks and queues
+// - Each instrument owns an arena. The descriptor, the keys, the zones and the audio
+//   data are allocated from it and released at once when the instrument is unloaded
+// - The region is handed out in blocks aligned to SAMPLE_MEMORY_ALIGN (cache line).
+//   The free blocks are kept sorted by address and merged when released
+//////////////////////////////////////////
+
+// C includes
+#include <string.h>
+
+// Xilinx Includes
+#include "xil_printf.h"
+#include "xparameters.h"
+
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Sampler Includes
+#include "sampler_cfg.h"
+#include "sample_memory.h"
+
+// End of the DDR
+#define DDR_MEMORY_END              ( XPAR_PS7_DDR_0_S_AXI_HIGHADDR + 1 )
+
+// The SD driver takes the first MB after the program as uncached memory (see uncached_memory.c)
+#define UNCACHED_MEMORY_SIZE        0x100000ul
+
+// The header takes a full alignment unit, so the payload is aligned too
+#define SAMPLE_MEMORY_HEADER_SIZE   SAMPLE_MEMORY_ALIGN
+#define SAMPLE_MEMORY_MIN_BLOCK     ( SAMPLE_MEMORY_HEADER_SIZE * 2 )
+
+// Number of arenas listed by the report
+#define SAMPLE_MEMORY_REPORT_ARENAS 8
+
+// Static variables
+static uint8_t                *region_start       = NULL;
+static uint32_t                region_size        = 0;
+static SAMPLE_MEMORY_BLOCK_t  *free_list          = NULL; // Sorted by address
+static SAMPLE_ARENA_t         *arena_list         = NULL; // Live arenas
+static uint32_t                used_size          = 0;
+static uint32_t                peak_used_size     = 0;
+static uint32_t                failed_allocations = 0;
+
+//////////////////////////////////////////////////
+// Static Functions
+//////////////////////////////////////////////////
+static uint32_t                prv_ulInitSampleMemory( void );
+static SAMPLE_MEMORY_BLOCK_t * prv_xAllocBlock( uint32_t size );
+static void                    prv_vFreeBlock( SAMPLE_MEMORY_BLOCK_t *block );
+
+// This function creates the region the first time it is needed
+// Must be called with the scheduler suspended (so it doesn't print)
+uint32_t prv_ulInitSampleMemory( void ) {
+    extern uint8_t _end;
+    uint32_t       program_end;
+
+    if ( region_start != NULL ) return 0;
+
+    // The uncached memory is aligned to 1MB after the end of the program
+    program_end = ( ( (uint32_t) &_end + UNCACHED_MEMORY_SIZE ) & ~( UNCACHED_MEMORY_SIZE - 1 ) ) + UNCACHED_MEMORY_SIZE;
+
+    // The region would overlap the program
+    if ( DDR_MEMORY_END - SAMPLE_MEMORY_REGION_SIZE < program_end ) return 1;
+
+    region_start = (uint8_t *) ( DDR_MEMORY_END - SAMPLE_MEMORY_REGION_SIZE );
+    region_size  = SAMPLE_MEMORY_REGION_SIZE;
+
+    // The whole region is a single free block
+    free_list       = (SAMPLE_MEMORY_BLOCK_t *) region_start;
+    free_list->next = NULL;
+    free_list->size = region_size;
+
+    return 0;
+}
+
+// This function takes a block from the region (first fit)
+// The size includes the header. Must be called with the scheduler suspended
+SAMPLE_MEMORY_BLOCK_t * prv_xAllocBlock( uint32_t size ) {
+    SAMPLE_MEMORY_BLOCK_t **previous_next = &free_list;
+    SAMPLE_MEMORY_BLOCK_t  *block         = free_list;
+    SAMPLE_MEMORY_BLOCK_t  *remainder;
+
+    size = SAMPLE_MEMORY_ALIGN_SIZE( size );
+
+    while ( block != NULL && block->size < size ) {
+        previous_next = &block->next;
+        block         = block->next;
+    }
+
+    if ( block == NULL ) {
+        failed_allocations++;
+        return NULL;
+    }
+
+    // Split the block if the rest is worth keeping
+    if ( block->size - size >= SAMPLE_MEMORY_MIN_BLOCK ) {
+        remainder       = (SAMPLE_MEMORY_BLOCK_t *) ( (uint8_t *) block + size );
+        remainder->next = block->next;
+        remainder->size = block->size - size;
+        block->size     = size;
+        *previous_next  = remainder;
+    } else {
+        *previous_next  = block->next;
+    }
+
+    block->next = NULL;
+
+    used_size += block->size;
+    if ( used_size > peak_used_size ) peak_used_size = used_size;
+
+    return block;
+}
+
+// This function returns a block to the region, merging it with its free neighbours
+// Must be called with the scheduler suspended
+void prv_vFreeBlock( SAMPLE_MEMORY_BLOCK_t *block ) {
+    SAMPLE_MEMORY_BLOCK_t *previous = NULL;
+    SAMPLE_MEMORY_BLOCK_t *next     = free_list;
+
+    used_size -= block->size;
+
+    while ( next != NULL && next < block ) {
+        previous = next;
+        next     = next->next;
+    }
+
+    // Merge with the next block
+    if ( next != NULL && (uint8_t *) block + block->size == (uint8_t *) next ) {
+        block->size += next->size;
+        block->next  = next->next;
+    } else {
+        block->next  = next;
+    }
+
+    // Merge with the previous block
+    if ( previous != NULL && (uint8_t *) previous + previous->size == (uint8_t *) block ) {
+        previous->size += block->size;
+        previous->next  = block->next;
+    } else if ( previous != NULL ) {
+        previous->next  = block;
+    } else {
+        free_list       = block;
+    }
+}
+
+// This function creates an empty arena
+// The arena lives in its first chunk
+SAMPLE_ARENA_t * xSampleArenaCreate( void ) {
+    SAMPLE_MEMORY_BLOCK_t *chunk = NULL;
+    SAMPLE_ARENA_t        *arena = NULL;
+
+    vTaskSuspendAll();
+
+    if ( prv_ulInitSampleMemory() == 0 ) chunk = prv_xAllocBlock( SAMPLE_ARENA_CHUNK_SIZE );
+
+    if ( chunk != NULL ) {
+        arena = (SAMPLE_ARENA_t *) ( (uint8_t *) chunk + SAMPLE_MEMORY_HEADER_SIZE );
+        memset( arena, 0x00, sizeof( SAMPLE_ARENA_t ) );
+
+        arena->blocks           = chunk;
+        arena->number_of_blocks = 1;
+        arena->size             = chunk->size;
+        arena->used             = SAMPLE_MEMORY_ALIGN_SIZE( sizeof( SAMPLE_ARENA_t ) );
+        arena->chunk_ptr        = (uint8_t *) arena + arena->used;
+        arena->chunk_free       = chunk->size - SAMPLE_MEMORY_HEADER_SIZE - arena->used;
+
+        arena->next = arena_list;
+        arena_list  = arena;
+    }
+
+    xTaskResumeAll();
+
+    if ( arena == NULL ) SAMPLER_PRINTF_ERROR("The sample memory arena could not be created. Region = %d bytes at the top of the DDR", SAMPLE_MEMORY_REGION_SIZE);
+
+    return arena;
+}
+
+// This function allocates memory from an arena. The memory is aligned to SAMPLE_MEMORY_ALIGN
+// There is no way to release a single allocation. The arena is released at once
+void * pvSampleArenaAlloc( SAMPLE_ARENA_t *arena, size_t size ) {
+    SAMPLE_MEMORY_BLOCK_t *block  = NULL;
+    void                  *memory = NULL;
+
+    if ( arena == NULL || size == 0 ) return NULL;
+
+    size = SAMPLE_MEMORY_ALIGN_SIZE( size );
+
+    vTaskSuspendAll();
+
+    if ( size > SAMPLE_ARENA_SMALL_ALLOC_MAX ) {
+        // Large allocations get a block of their own
+        block = prv_xAllocBlock( size + SAMPLE_MEMORY_HEADER_SIZE );
+        if ( block != NULL ) memory = (uint8_t *) block + SAMPLE_MEMORY_HEADER_SIZE;
+    } else {
+        // Small allocations are taken from the current chunk. The rest of a full chunk is not reused
+        if ( arena->chunk_free < size ) {
+            block = prv_xAllocBlock( SAMPLE_ARENA_CHUNK_SIZE );
+            if ( block != NULL ) {
+                arena->chunk_ptr  = (uint8_t *) block + SAMPLE_MEMORY_HEADER_SIZE;
+                arena->chunk_free = block->size - SAMPLE_MEMORY_HEADER_SIZE;
+            }
+        }
+
+        if ( arena->chunk_free >= size ) {
+            memory             = arena->chunk_ptr;
+            arena->chunk_ptr  += size;
+            arena->chunk_free -= size;
+        }
+    }
+
+    if ( block != NULL ) {
+        block->next   = arena->blocks;
+        arena->blocks = block;
+        arena->size  += block->size;
+        arena->number_of_blocks++;
+    }
+
+    if ( memory != NULL ) arena->used += size;
+
+    xTaskResumeAll();
+
+    return memory;
+}
+
+// This function releases an arena and everything allocated from it
+void vSampleArenaDestroy( SAMPLE_ARENA_t *arena ) {
+    SAMPLE_ARENA_t        **previous_next = &arena_list;
+    SAMPLE_MEMORY_BLOCK_t  *block;
+    SAMPLE_MEMORY_BLOCK_t  *next_block;
+
+    if ( arena == NULL ) return;
+
+    vTaskSuspendAll();
+
+    while ( *previous_next != NULL && *previous_next != arena ) previous_next = &(*previous_next)->next;
+    if ( *previous_next != NULL ) *previous_next = arena->next;
+
+    // The arena itself lives in one of the blocks. Don't touch it after the first release
+    block = arena->blocks;
+    while ( block != NULL ) {
+        next_block = block->next;
+        prv_vFreeBlock( block );
+        block      = next_block;
+    }
+
+    xTaskResumeAll();
+}
+
+// This function returns the usage of the region
+void vGetSampleMemoryStats( SAMPLE_MEMORY_STATS_t *stats ) {
+    SAMPLE_MEMORY_BLOCK_t *block;
+    SAMPLE_ARENA_t        *arena;
+
+    memset( stats, 0x00, sizeof( SAMPLE_MEMORY_STATS_t ) );
+
+    vTaskSuspendAll();
+
+    prv_ulInitSampleMemory();
+
+    stats->region_start       = (uint32_t) region_start;
+    stats->region_size        = region_size;
+    stats->used               = used_size;
+    stats->peak_used          = peak_used_size;
+    stats->failed_allocations = failed_allocations;
+
+    for ( block = free_list; block != NULL; block = block->next ) {
+        stats->free += block->size;
+        stats->free_blocks++;
+        if ( block->size > stats->largest_free_block ) stats->largest_free_block = block->size;
+    }
+
+    for ( arena = arena_list; arena != NULL; arena = arena->next ) stats->arenas++;
+
+    xTaskResumeAll();
+}
+
+// This function prints the usage of the region and its arenas
+void vPrintSampleMemoryReport( void ) {
+    SAMPLE_MEMORY_STATS_t stats;
+    SAMPLE_ARENA_t        arena_info[SAMPLE_MEMORY_REPORT_ARENAS];
+    SAMPLE_ARENA_t       *arena;
+    uint32_t              number_of_arenas = 0;
+    uint32_t              fragmentation    = 0;
+
+    vGetSampleMemoryStats( &stats );
+
+    // Share of the free memory that can't be used by the largest allocation
+    if ( stats.free != 0 ) fragmentation = 100 - (uint32_t) ( ( (uint64_t) stats.largest_free_block * 100 ) / stats.free );
+
+    // Copy the arenas, so they can be printed without holding the scheduler
+    vTaskSuspendAll();
+    for ( arena = arena_list; arena != NULL && number_of_arenas < SAMPLE_MEMORY_REPORT_ARENAS; arena = arena->next ) {
+        memcpy( &arena_info[number_of_arenas], arena, sizeof( SAMPLE_ARENA_t ) );
+        arena_info[number_of_arenas++].next = arena; // Keep the address for the report
+    }
+    xTaskResumeAll();
+
+    SAMPLER_PRINTF("Sample memory region   : 0x%08x - 0x%08x (%d KB)\n\r", stats.region_start, stats.region_start + stats.region_size, stats.region_size >> 10);
+    SAMPLER_PRINTF("Used                   : %d KB (peak %d KB)\n\r", stats.used >> 10, stats.peak_used >> 10);
+    SAMPLER_PRINTF("Free                   : %d KB in %d block(s)\n\r", stats.free >> 10, stats.free_blocks);
+    SAMPLER_PRINTF("Largest free block     : %d KB\n\r", stats.largest_free_block >> 10);
+    SAMPLER_PRINTF("Fragmentation          : %d%%\n\r", fragmentation);
+    SAMPLER_PRINTF("Failed allocations     : %d\n\r", stats.failed_allocations);
+    SAMPLER_PRINTF("Arenas                 : %d\n\r", stats.arenas);
+
+    for ( uint32_t index = 0; index < number_of_arenas; index++ ) {
+        SAMPLER_PRINTF("  [%d] 0x%08x: %d KB used of %d KB in %d block(s)\n\r", index, (uint32_t) arena_info[index].next, arena_info[index].used >> 10, arena_info[index].size >> 10, arena_info[index].number_of_blocks);
+    }
+}
@@ -36,6 +36,10 @@ extern void vRegisterMIDIKeyPlayASCIICMD( void );
 extern void vRegisterMIDIKeyPlayCMD( void );
 extern void vRegisterLoadSF2CMD( void );
 extern void vRegisterLoadInstrumentCMD( void );
+extern void vRegisterUnloadInstrumentCMD( void );
+extern void vRegisterSampleMemoryCMD( void );
+extern void vRegisterInstrumentCacheCMD( void );
+extern void vRegisterMIDIChannelsCMD( void );
 
 // This function registers all the CLI applications
 void vRegisterSamplerCLICommands( void ) {
@@ -50,6 +54,10 @@ void vRegisterSamplerCLICommands( void ) {
     vRegisterMIDIKeyPlayCMD();
     vRegisterLoadSF2CMD();
     vRegisterLoadInstrumentCMD();
+    vRegisterUnloadInstrumentCMD();
+    vRegisterSampleMemoryCMD();
+    vRegisterInstrumentCacheCMD();
+    vRegisterMIDIChannelsCMD();
 }
 
 
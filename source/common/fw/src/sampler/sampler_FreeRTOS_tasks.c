@@ -30,8 +30,15 @@
 #include "sampler_cfg.h"
 #include "patch_loader.h"
 #include "sampler_engine.h"
+#include "sampler_dma_voice_pb.h"
 
-PATCH_DESCRIPTOR_t *patch_descriptor = NULL;
+// Instruments of each MIDI channel. A MIDI message is dispatched with its channel number
+// The playback tasks hold the route of a channel with ulAcquireChannelRoute() and the loader tasks replace
+// the routes with vPublishChannelRoutes()
+static CHANNEL_ROUTE_t channel_routes[MIDI_NUM_OF_CHANNELS];
+
+// Serializes the swaps and the evictions, so an instrument is never released while it is being retired
+static SemaphoreHandle_t patch_swap_mutex = NULL;
 
 // Tasks (each implemented on its own file)
 extern void vRegisterKeyPlaybackTask();
@@ -41,9 +48,203 @@ extern void vRegisterLoadSF2Task();
 extern void vRegisterPrintSF2InfoTask();
 extern void vRegisterRunMIDICommandTask();
 extern void vRegisterSerialMIDIListenerTask();
+extern void vRegisterVoiceReaperTask();
+extern void vRegisterSampleReaderTask();
+
+// This function copies the route of a channel and holds its instruments until vReleaseChannelRoute() is called
+// It never blocks, so the MIDI path can't be delayed by a load. Returns the number of parts of the route
+uint32_t ulAcquireChannelRoute( uint8_t channel, CHANNEL_ROUTE_t *channel_route ) {
+
+    if ( channel >= MIDI_NUM_OF_CHANNELS ) {
+        channel_route->number_of_parts = 0;
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    *channel_route = channel_routes[channel];
+    for ( uint8_t part = 0; part < channel_route->number_of_parts; part++ ) channel_route->parts[part].patch->readers++;
+    taskEXIT_CRITICAL();
+
+    return channel_route->number_of_parts;
+}
+
+// This function releases the instruments of a route returned by ulAcquireChannelRoute()
+void vReleaseChannelRoute( CHANNEL_ROUTE_t *channel_route ) {
+
+    taskENTER_CRITICAL();
+    for ( uint8_t part = 0; part < channel_route->number_of_parts; part++ ) channel_route->parts[part].patch->readers--;
+    taskEXIT_CRITICAL();
+
+    channel_route->number_of_parts = 0;
+}
+
+// This function copies the routes of all the channels (MIDI_NUM_OF_CHANNELS entries) and holds their instruments
+void vAcquireAllChannelRoutes( CHANNEL_ROUTE_t *all_channel_routes ) {
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) ulAcquireChannelRoute( channel, &all_channel_routes[channel] );
+}
+
+void vReleaseAllChannelRoutes( CHANNEL_ROUTE_t *all_channel_routes ) {
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) vReleaseChannelRoute( &all_channel_routes[channel] );
+}
+
+// This function returns 1 if a channel plays the instrument
+static uint32_t prv_ulIsPatchRouted( const PATCH_DESCRIPTOR_t *patch ) {
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        for ( uint8_t part = 0; part < channel_routes[channel].number_of_parts; part++ ) {
+            if ( channel_routes[channel].parts[part].patch == patch ) return 1;
+        }
+    }
+    return 0;
+}
+
+// This function waits until an instrument that no channel plays anymore can be released:
+//   1. No task holds it anymore (grace period)
+//   2. Its voices finished, or PATCH_RETIRE_TIMEOUT_MS elapsed and the remaining ones were stopped
+static void prv_vRetirePatch( PATCH_DESCRIPTOR_t *old_patch ) {
+    TickType_t retire_start;
+
+    // Step 1 - Wait for the tasks that got the instrument before the swap
+    while ( old_patch->readers != 0 ) vTaskDelay( 1 );
+
+    // Step 2 - Let the voices finish. The one-shot ones are released by the voice reaper
+    retire_start = xTaskGetTickCount();
+    while ( ( old_patch->number_of_active_zones != 0 ) && ( ( xTaskGetTickCount() - retire_start ) < pdMS_TO_TICKS( PATCH_RETIRE_TIMEOUT_MS ) ) ) {
+        vTaskDelay( pdMS_TO_TICKS( VOICE_REAPER_PERIOD_MS ) );
+    }
+
+    // Step 3 - Stop the voices that are still playing (held or looped notes)
+    if ( old_patch->number_of_active_zones != 0 ) {
+        SAMPLER_PRINTF_INFO("Stopping %d zone(s) of the replaced instrument", old_patch->number_of_active_zones);
+    }
+    ulStopPatchPlayback( old_patch );
+}
+
+// This function replaces the routes of the channels set in channel_mask (bit N = channel N) (read-copy-update)
+// new_routes holds MIDI_NUM_OF_CHANNELS routes. Only the ones of the selected channels are used
+// The instruments must be fully loaded. The route of a channel is copied in a critical section, so the playback
+// tasks see either the old or the new route. The old instruments keep playing their voices while the new ones
+// play the new notes. An instrument that no channel plays anymore is retired, then released unless the
+// instrument cache owns it
+// Only the loader tasks should call this function. It blocks until the old instruments are retired
+void vPublishChannelRoutes( const CHANNEL_ROUTE_t *new_routes, uint16_t channel_mask ) {
+    PATCH_DESCRIPTOR_t *old_patches[MIDI_NUM_OF_CHANNELS * MAX_CHANNEL_PARTS];
+    uint32_t            number_of_old_patches = 0;
+    uint32_t            old_patch;
+    uint8_t             channel;
+    uint8_t             part;
+
+    xSemaphoreTake( patch_swap_mutex, portMAX_DELAY );
+
+    // Step 1 - Collect the instruments of the replaced routes (once each)
+    // Only this function modifies the routes, so they can be read without a critical section
+    for ( channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        if ( ( channel_mask & ( 1 << channel ) ) == 0 ) continue;
+        for ( part = 0; part < channel_routes[channel].number_of_parts; part++ ) {
+            for ( old_patch = 0; old_patch < number_of_old_patches; old_patch++ ) {
+                if ( old_patches[old_patch] == channel_routes[channel].parts[part].patch ) break;
+            }
+            if ( old_patch == number_of_old_patches ) old_patches[number_of_old_patches++] = channel_routes[channel].parts[part].patch;
+        }
+    }
+
+    // Step 2 - Swap the routes
+    taskENTER_CRITICAL();
+    for ( channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        if ( channel_mask & ( 1 << channel ) ) channel_routes[channel] = new_routes[channel];
+    }
+    taskEXIT_CRITICAL();
+
+    // Step 3 - Retire the instruments that no channel plays anymore
+    for ( old_patch = 0; old_patch < number_of_old_patches; old_patch++ ) {
+        if ( prv_ulIsPatchRouted( old_patches[old_patch] ) ) continue;
+
+        prv_vRetirePatch( old_patches[old_patch] );
+
+        if ( old_patches[old_patch]->cached == 0 ) {
+            vUnloadPatch( old_patches[old_patch] );
+            SAMPLER_PRINTF_INFO("Instrument unloaded");
+        }
+    }
+
+    xSemaphoreGive( patch_swap_mutex );
+}
+
+// This function routes an instrument to the whole keyboard of a channel (MIDI_CHANNEL_ALL for all the channels)
+// The other parts of the channel are removed. A NULL instrument mutes the channel
+void vPublishChannelPatch( uint8_t channel, PATCH_DESCRIPTOR_t *new_patch ) {
+    CHANNEL_ROUTE_t new_routes[MIDI_NUM_OF_CHANNELS];
+    uint16_t        channel_mask;
+
+    if ( channel != MIDI_CHANNEL_ALL && channel >= MIDI_NUM_OF_CHANNELS ) return;
+
+    channel_mask = ( channel == MIDI_CHANNEL_ALL ) ? MIDI_CHANNEL_MASK_ALL : ( 1 << channel );
+
+    memset( new_routes, 0x00, sizeof( new_routes ) );
+    for ( uint8_t route = 0; route < MIDI_NUM_OF_CHANNELS && new_patch != NULL; route++ ) {
+        new_routes[route].number_of_parts  = 1;
+        new_routes[route].parts[0].patch   = new_patch;
+        new_routes[route].parts[0].key_min = 0;
+        new_routes[route].parts[0].key_max = MAX_NUM_OF_KEYS - 1;
+    }
+
+    vPublishChannelRoutes( new_routes, channel_mask );
+}
+
+// This function releases an instrument of the instrument cache
+// Returns 1 if a channel plays it (it can't be released)
+uint32_t ulEvictPatch( PATCH_DESCRIPTOR_t *patch ) {
+
+    xSemaphoreTake( patch_swap_mutex, portMAX_DELAY );
+
+    if ( prv_ulIsPatchRouted( patch ) ) {
+        xSemaphoreGive( patch_swap_mutex );
+        return 1;
+    }
+
+    // It was retired when it was replaced, so this doesn't wait
+    prv_vRetirePatch( patch );
+    vUnloadPatch( patch );
+
+    xSemaphoreGive( patch_swap_mutex );
+
+    return 0;
+}
+
+// This function unloads the instruments of all the channels
+void vUnloadRoutedPatches( void ) {
+    vPublishChannelPatch( MIDI_CHANNEL_ALL, NULL );
+}
+
+// This function prints the instruments of each channel and the voices it plays against its voice limit
+void vPrintChannelRoutesReport( void ) {
+    CHANNEL_ROUTE_t all_channel_routes[MIDI_NUM_OF_CHANNELS];
+    CHANNEL_PART_t *part;
+    uint8_t         active_voices;
+    uint8_t         voice_limit;
+
+    // The instruments can't be released while they are printed
+    vAcquireAllChannelRoutes( all_channel_routes );
+
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        ulGetInstrumentVoiceUsage( channel, &active_voices, &voice_limit );
+
+        if ( all_channel_routes[channel].number_of_parts == 0 && active_voices == 0 ) continue;
+
+        SAMPLER_PRINTF("Channel %2d             : %d of %d voice(s)\n\r", channel + 1, active_voices, voice_limit);
+        for ( uint8_t part_index = 0; part_index < all_channel_routes[channel].number_of_parts; part_index++ ) {
+            part = &all_channel_routes[channel].parts[part_index];
+            SAMPLER_PRINTF("  Keys %3d-%3d -> %s\n\r", part->key_min, part->key_max, part->patch->instrument_name);
+        }
+    }
+
+    vReleaseAllChannelRoutes( all_channel_routes );
+}
 
 // Register task definitions
 void vRegisterSamplerEngineTasks ( void ) {
+    patch_swap_mutex = xSemaphoreCreateMutex();
+    configASSERT( patch_swap_mutex );
+
     vRegisterKeyPlaybackTask();
     vRegisterStopAllPlaybackTask();
     vRegisterLoadInstrumentTask();
@@ -51,4 +252,6 @@ void vRegisterSamplerEngineTasks ( void ) {
     vRegisterPrintSF2InfoTask();
     vRegisterRunMIDICommandTask();
     vRegisterSerialMIDIListenerTask();
+    vRegisterVoiceReaperTask();
+    vRegisterSampleReaderTask();
 }
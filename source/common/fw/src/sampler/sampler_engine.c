@@ -12,6 +12,10 @@
 //information about AXI peripherals
 #include "xparameters.h"
 
+// FreeRTOS Includes
+#include "FreeRTOS.h"
+#include "semphr.h"
+
 // Sampler Includes
 #include "sampler_dma_controller_regs.h"
 #include "sampler_dma_controller_reg_utils.h"
@@ -20,6 +24,9 @@
 #include "patch_loader.h"
 #include "sampler_engine.h"
 
+// Serializes the access to the voices and the zone state between the tasks
+static SemaphoreHandle_t engine_mutex = NULL;
+
 // Lookup table to correlate note names with MIDI notes
 static const NOTE_LUT_STRUCT_t MIDI_NOTES_LUT[12] = {
     {"Ax",   21}, // Starts from A0
@@ -36,6 +43,12 @@ static const NOTE_LUT_STRUCT_t MIDI_NOTES_LUT[12] = {
     {"Gx_S", 20}	
 };
 
+// Pitch ratios used to build the phase increment of the resampler (Q16)
+// 2^(-n/12) for n semitones, 2^(-n/120) for n tens of cents and 2^(-n/1200) for n cents
+static const uint32_t SEMITONE_DOWN_LUT[12] = { 65536, 61858, 58386, 55109, 52016, 49097, 46341, 43740, 41285, 38968, 36781, 34716 };
+static const uint32_t CENTS10_DOWN_LUT[10]  = { 65536, 65159, 64783, 64410, 64039, 63670, 63304, 62939, 62576, 62216 };
+static const uint32_t CENTS1_DOWN_LUT[10]   = { 65536, 65498, 65460, 65423, 65385, 65347, 65309, 65272, 65234, 65196 };
+
 // This function converts an string in int or hex to a uint32_t
 static uint32_t prv_ulStrToInt( const char *input_string ) {
 
@@ -55,38 +68,154 @@ static uint32_t prv_ulStrToInt( const char *input_string ) {
 
 }
 
-// This function stops the playback for everything
-uint32_t ulStopAllPlayback( PATCH_DESCRIPTOR_t *instrument_information ) {
-    KEY_INFORMATION_t       *current_key    = NULL;
-    KEY_VOICE_INFORMATION_t *current_voice  = NULL;
-    uint32_t                 key            = 0;
-    uint32_t                 velocity_range = 0;
-    uint32_t                 voice_slot     = 0;
+// This function returns the phase increment of the resampler to play a zone on a key
+// The resampler can only lower the pitch, so the keys above the root key are played at the original rate
+static uint32_t prv_ulGetPhaseIncrement( uint8_t key, const ZONE_PITCH_t *zone_pitch ) {
+    int32_t  cents;
+    uint32_t ratio;
 
-    // Stop the engine
-    SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_STOP;
+    cents = ( (int32_t) key - (int32_t) zone_pitch->root_key ) * 100 + zone_pitch->fine_tune;
+    if ( cents >= 0 ) return SAMPLER_PHASE_INC_UNITY;
 
-    // Stop the playback
-    for ( voice_slot = 0; voice_slot < MAX_VOICES; voice_slot++ ) ulStopVoicePlayback( voice_slot );
+    cents = -cents;
+    ratio = SEMITONE_DOWN_LUT[ ( cents / 100 ) % 12 ];
+    ratio = (uint32_t)( ( (uint64_t) ratio * CENTS10_DOWN_LUT[ ( cents / 10 ) % 10 ] ) >> 16 );
+    ratio = (uint32_t)( ( (uint64_t) ratio * CENTS1_DOWN_LUT[ cents % 10 ] ) >> 16 );
+    ratio >>= ( cents / 1200 ); // Octaves
 
-    if( instrument_information == NULL ) return 0;
+    // Q16 -> phase increment
+    ratio = ( ratio + ( 1 << ( 15 - SAMPLER_PHASE_FRACTION_BITS ) ) ) >> ( 16 - SAMPLER_PHASE_FRACTION_BITS );
+
+    return ( ratio == 0 ) ? 1 : ratio;
+}
+
+// This function returns the oldest instance of a zone started by a key of a channel
+// Returns MAX_ZONE_INSTANCES if the key isn't playing the zone
+static uint8_t prv_ucFindNoteInstance( const ZONE_STATE_t *zone_state, uint8_t channel, uint8_t key ) {
+    for ( uint8_t instance = 0; instance < zone_state->number_of_instances; instance++ ) {
+        if ( zone_state->instance_note[instance] == key && zone_state->instance_channel[instance] == channel ) return instance;
+    }
+    return MAX_ZONE_INSTANCES;
+}
+
+// This function adds a new instance to a zone
+// The zone goes into the list of active zones with its first instance
+// Returns 1 if the instance can't be tracked, so the caller can stop its voice
+static uint32_t prv_ulAddZoneInstance( PATCH_DESCRIPTOR_t *instrument_information, uint16_t zone_index, uint32_t voice_slot, uint8_t channel, uint8_t key ) {
+    ZONE_STATE_t *zone_state = &instrument_information->zone_state[zone_index];
+    uint8_t       instance;
+
+    if ( zone_state->number_of_instances >= MAX_ZONE_INSTANCES ) return 1;
+
+    if ( zone_state->number_of_instances == 0 ) {
+        if ( instrument_information->number_of_active_zones >= MAX_ACTIVE_ZONES ) return 1;
+
+        zone_state->active_index = instrument_information->number_of_active_zones;
+
+        instrument_information->active_zones[instrument_information->number_of_active_zones] = zone_index;
+        instrument_information->number_of_active_zones++;
+    }
+
+    instance = zone_state->number_of_instances;
+    zone_state->instance_slots[instance]    = voice_slot;
+    zone_state->instance_sequence[instance] = instrument_information->instance_sequence++;
+    zone_state->instance_note[instance]     = key;
+    zone_state->instance_channel[instance]  = channel;
+    zone_state->number_of_instances++;
+
+    instrument_information->slot_zone[voice_slot] = zone_index;
+
+    return 0;
+}
+
+// This function removes an instance from a zone. The instances stay ordered from oldest to newest
+// The last active zone takes the place of the removed zone so the list stays packed
+static void prv_vRemoveZoneInstance( PATCH_DESCRIPTOR_t *instrument_information, uint16_t zone_index, uint8_t instance ) {
+    ZONE_STATE_t *zone_state = &instrument_information->zone_state[zone_index];
+    uint16_t      last_zone;
+
+    if ( instance >= zone_state->number_of_instances ) return;
+
+    instrument_information->slot_zone[zone_state->instance_slots[instance]] = ZONE_INDEX_NONE;
+
+    zone_state->number_of_instances--;
+    for ( ; instance < zone_state->number_of_instances; instance++ ) {
+        zone_state->instance_slots[instance]    = zone_state->instance_slots[instance + 1];
+        zone_state->instance_sequence[instance] = zone_state->instance_sequence[instance + 1];
+        zone_state->instance_note[instance]     = zone_state->instance_note[instance + 1];
+        zone_state->instance_channel[instance]  = zone_state->instance_channel[instance + 1];
+    }
+
+    // If this was the last instance, the zone is not active anymore
+    if ( zone_state->number_of_instances != 0 ) return;
+
+    if ( instrument_information->number_of_active_zones == 0 ) return;
+
+    instrument_information->number_of_active_zones--;
+    last_zone = instrument_information->active_zones[instrument_information->number_of_active_zones];
+
+    instrument_information->active_zones[zone_state->active_index] = last_zone;
+    instrument_information->zone_state[last_zone].active_index     = zone_state->active_index;
+}
+
+// This function stops the playback of an instance of a zone
+static void prv_vStopZoneInstance( PATCH_DESCRIPTOR_t *instrument_information, uint16_t zone_index, uint8_t instance ) {
+    uint8_t voice_slot = instrument_information->zone_state[zone_index].instance_slots[instance];
+
+    SAMPLER_PRINTF_INFO("[INFO] - Stopping voice playback of slot %d", voice_slot);
+    ulStopVoicePlayback( voice_slot );
+    prv_vRemoveZoneInstance( instrument_information, zone_index, instance );
+}
 
-    // Reset the flags
-    for (key = 0; key < MAX_NUM_OF_KEYS; key++) {
-        if( instrument_information->key_information[key] == NULL ) continue;
+// This function is called by the voice allocator when a slot is stolen from a zone
+static void prv_vVoiceReleasedCallback( uint32_t voice_slot, void *owner ) {
+    PATCH_DESCRIPTOR_t *instrument_information = (PATCH_DESCRIPTOR_t *) owner;
+    ZONE_STATE_t       *zone_state;
+    uint16_t            zone_index;
 
-        current_key = instrument_information->key_information[key];
+    if ( instrument_information == NULL || voice_slot >= MAX_VOICES ) return;
 
-        for ( velocity_range = 0; velocity_range < MAX_NUM_OF_VELOCITY; velocity_range++ ) {
+    zone_index = instrument_information->slot_zone[voice_slot];
+    if ( zone_index == ZONE_INDEX_NONE ) return;
 
-            if( current_key->key_voice_information[velocity_range] == NULL ) continue;
+    SAMPLER_PRINTF_DEBUG("Voice slot %d stolen from zone %d", voice_slot, zone_index);
 
-            current_voice = current_key->key_voice_information[velocity_range];
+    zone_state = &instrument_information->zone_state[zone_index];
+    for ( uint8_t instance = 0; instance < zone_state->number_of_instances; instance++ ) {
+        if ( zone_state->instance_slots[instance] == voice_slot ) {
+            prv_vRemoveZoneInstance( instrument_information, zone_index, instance );
+            break;
+        }
+    }
+}
 
-            if ( current_voice->current_status != 0 ) {
-                SAMPLER_PRINTF_INFO("[%d][%d] Stopping voice playback of slot %d", key, velocity_range, current_voice->current_slot);
-                current_voice->current_status = 0;
-                current_voice->current_slot   = 0;
+// This function initializes the sampler engine
+void vSamplerEngineInit( void ) {
+    engine_mutex = xSemaphoreCreateMutex();
+    configASSERT( engine_mutex );
+
+    vSetVoiceReleaseCallback( prv_vVoiceReleasedCallback );
+}
+
+// This function stops the playback for everything
+// channel_routes holds the routes of the MIDI_NUM_OF_CHANNELS channels. The zone state of their instruments is reset
+static uint32_t prv_ulStopAllPlayback( const CHANNEL_ROUTE_t *channel_routes ) {
+    PATCH_DESCRIPTOR_t *instrument_information;
+    uint16_t            zone_index;
+
+    // Stop the engine and the playback
+    vStopAllVoicePlayback();
+
+    if( channel_routes == NULL ) return 0;
+
+    // Reset the zone state. Only the active zones need to be visited
+    for ( uint8_t channel = 0; channel < MIDI_NUM_OF_CHANNELS; channel++ ) {
+        for ( uint8_t part = 0; part < channel_routes[channel].number_of_parts; part++ ) {
+            instrument_information = channel_routes[channel].parts[part].patch;
+            while ( instrument_information->number_of_active_zones != 0 ) {
+                zone_index = instrument_information->active_zones[0];
+                SAMPLER_PRINTF_INFO("[%d] Stopping %d instance(s)", zone_index, instrument_information->zone_state[zone_index].number_of_instances);
+                while ( instrument_information->zone_state[zone_index].number_of_instances != 0 ) prv_vRemoveZoneInstance( instrument_information, zone_index, 0 );
             }
         }
     }
@@ -95,13 +224,58 @@ uint32_t ulStopAllPlayback( PATCH_DESCRIPTOR_t *instrument_information ) {
 
 }
 
-// This function starts the playback of a sample given the key/velocity parameters and the instrument information
-uint32_t ulPlayInstrumentKey( uint8_t key, uint8_t velocity, PATCH_DESCRIPTOR_t *instrument_information ) {
+// This function stops the voices of an instrument started by a channel (MIDI_CHANNEL_ALL for all the channels)
+// The voices of the other instruments and channels keep playing
+// The zone state can be stale if all the voices were stopped at once (vStopAllVoicePlayback()),
+// so a slot is only stopped if the instrument still owns it
+static uint32_t prv_ulStopPatchPlayback( PATCH_DESCRIPTOR_t *instrument_information, uint8_t channel ) {
+    uint16_t      zone_index;
+    uint16_t      active_index = 0;
+    uint8_t       instance;
+    ZONE_STATE_t *zone_state;
+
+    if( instrument_information == NULL ) return 0;
+
+    while ( active_index < instrument_information->number_of_active_zones ) {
+        zone_index = instrument_information->active_zones[active_index];
+        zone_state = &instrument_information->zone_state[zone_index];
+        instance   = 0;
+        while ( instance < zone_state->number_of_instances ) {
+            if ( channel != MIDI_CHANNEL_ALL && zone_state->instance_channel[instance] != channel ) {
+                instance++;
+                continue;
+            }
+            if ( pvGetVoiceOwner( zone_state->instance_slots[instance] ) == instrument_information ) {
+                ulStopVoicePlayback( zone_state->instance_slots[instance] );
+            }
+            prv_vRemoveZoneInstance( instrument_information, zone_index, instance );
+        }
+        // An idle zone is replaced by the last active zone, which is visited next
+        if ( zone_state->number_of_instances != 0 ) active_index++;
+    }
+
+    vSamplerDMACommit();
 
-    int                      velocity_range = 0;
-    KEY_INFORMATION_t       *current_key = NULL;
-    KEY_VOICE_INFORMATION_t *current_voice = NULL;
+    return 0;
+}
+
+// This function starts the playback of a sample given the channel/key/velocity parameters and the instrument information
+// Only the zone LUT entry and the zone table entries of the played zone are read
+static uint32_t prv_ulPlayInstrumentKey( uint8_t channel, uint8_t key, uint8_t velocity, PATCH_DESCRIPTOR_t *instrument_information ) {
+
+    uint16_t                 zone_index;
+    uint16_t                 active_zone;
+    uint16_t                 oldest_zone = ZONE_INDEX_NONE;
+    uint32_t                 active_index;
+    uint32_t                 oldest_sequence;
+    uint8_t                  instance;
+    uint8_t                  oldest_instance = 0;
+    uint8_t                  note_instances;
+    ZONE_STATE_t            *zone_state    = NULL;
+    ZONE_PLAYBACK_t         *zone_playback = NULL;
     uint32_t                 voice_slot = 0;
+    VOICE_ALLOC_INFO_t       alloc_info;
+    VOICE_LOOP_INFO_t        loop_info;
 
     // Sanity check
 
@@ -115,82 +289,228 @@ uint32_t ulPlayInstrumentKey( uint8_t key, uint8_t velocity, PATCH_DESCRIPTOR_t
         return 1;		
     }
 
-    if ( instrument_information->key_information[key] == NULL ) {
-        SAMPLER_PRINTF_ERROR("[ERROR] - There is no information related to this key: %d", key);
+    if ( (key >= MAX_NUM_OF_KEYS) || (velocity >= MAX_NUM_OF_VELOCITY) ) {
+        SAMPLER_PRINTF_ERROR("[ERROR] - Key or velocity out of range: %d/%d", key, velocity);
         return 1;
     }
 
-    current_key = instrument_information->key_information[key];
-
-
-
     // If velocity is 0, it means to stop
+    // Each note-off releases the oldest instance started by a note-on of the same key and channel
+    // Zones can be shared by several keys (key ranges), so the active zones are searched by note
     if ( velocity == 0 ) {
-        for ( velocity_range = 0; velocity_range < MAX_NUM_OF_VELOCITY; velocity_range++ ) {
+        oldest_sequence = 0xffffffff;
 
-            if( current_key->key_voice_information[velocity_range] == NULL ) {
-                continue;
-            }
+        for ( active_index = 0; active_index < instrument_information->number_of_active_zones; active_index++ ) {
 
-            current_voice = current_key->key_voice_information[velocity_range];
+            active_zone = instrument_information->active_zones[active_index];
+            zone_state  = &instrument_information->zone_state[active_zone];
 
-            if ( current_voice->current_status != 0 ) {
-                SAMPLER_PRINTF_INFO("[INFO] - Stopping voice playback of slot %d", current_voice->current_slot);
-                ulStopVoicePlayback( current_voice->current_slot );
-                current_voice->current_status = 0;
-                current_voice->current_slot   = 0;
+            // Instances are ordered, so the first one of the key is the oldest of the zone
+            instance = prv_ucFindNoteInstance( zone_state, channel, key );
+            if ( instance < MAX_ZONE_INSTANCES && zone_state->instance_sequence[instance] < oldest_sequence ) {
+                oldest_sequence = zone_state->instance_sequence[instance];
+                oldest_zone     = active_zone;
+                oldest_instance = instance;
             }
         }
 
+        if ( oldest_zone != ZONE_INDEX_NONE ) prv_vStopZoneInstance( instrument_information, oldest_zone, oldest_instance );
+
         return 0;
     }
 
-    for ( velocity_range = 0; velocity_range < MAX_NUM_OF_VELOCITY; velocity_range++ ) {
+    // Find the zone mapped to the key/velocity pair
+    zone_index = instrument_information->zone_lut[key][velocity];
 
-        // Check if the velocity information exists
-        if( current_key->key_voice_information[velocity_range] == NULL ) {
-            continue;
-        }
+    if ( zone_index == ZONE_INDEX_NONE ) {
+        SAMPLER_PRINTF_ERROR("There's no sample for key %d and velocity %d", key, velocity);
+        return 2;
+    }
 
-        current_voice = current_key->key_voice_information[velocity_range];
+    zone_state = &instrument_information->zone_state[zone_index];
+
+    // Apply the retrigger mode if the zone (or key) is already being played back
+    // Only the instances started by the same key of the same channel are affected
+    switch ( instrument_information->retrigger_mode ) {
+        case RETRIGGER_MODE_CHOKE:
+            // Stopping the last instance of a zone moves another zone to its place in the active list
+            active_index = 0;
+            while ( active_index < instrument_information->number_of_active_zones ) {
+                active_zone = instrument_information->active_zones[active_index];
+                instance    = prv_ucFindNoteInstance( &instrument_information->zone_state[active_zone], channel, key );
+                if ( instance < MAX_ZONE_INSTANCES ) {
+                    prv_vStopZoneInstance( instrument_information, active_zone, instance );
+                } else {
+                    active_index++;
+                }
+            }
+            break;
+        case RETRIGGER_MODE_LAYER:
+            note_instances = 0;
+            for ( instance = 0; instance < zone_state->number_of_instances; instance++ ) {
+                if ( zone_state->instance_note[instance] == key && zone_state->instance_channel[instance] == channel ) note_instances++;
+            }
+            if ( note_instances >= instrument_information->max_instances ) {
+                prv_vStopZoneInstance( instrument_information, zone_index, prv_ucFindNoteInstance( zone_state, channel, key ) );
+            }
+            break;
+        default: // RETRIGGER_MODE_RESTART
+            while ( ( instance = prv_ucFindNoteInstance( zone_state, channel, key ) ) < MAX_ZONE_INSTANCES ) {
+                prv_vStopZoneInstance( instrument_information, zone_index, instance );
+            }
+            break;
+    }
 
-        // Check if requested velocity falls within the range
-        if ( (velocity <= current_voice->velocity_min) && (velocity >= current_voice->velocity_max) ) {
-            continue;
-        }
+    // The zone can still be full because of the instances of other keys or channels
+    // The oldest instance is stopped, so the new voice can be tracked
+    if ( zone_state->number_of_instances >= MAX_ZONE_INSTANCES ) {
+        prv_vStopZoneInstance( instrument_information, zone_index, 0 );
+    }
 
-        // Check if the sample is not already being played back
-        if ( current_voice->current_status != 0 ) {
-            SAMPLER_PRINTF_ERROR("Current sample is being played on slot %d", current_voice->current_slot);
-            return 3;
-        }
+    // Start playback. The allocator may steal a voice if all slots are busy
+    // The voices are accounted to the channel, so each channel can have its own voice limit
+    alloc_info.note       = key;
+    alloc_info.velocity   = velocity;
+    alloc_info.instrument = channel;
+    alloc_info.owner      = instrument_information;
+
+    // Looped samples play from the loop start to the loop end until the note is released
+    zone_playback        = &instrument_information->zone_playback[zone_index];
+    loop_info.loop_start = zone_playback->loop_start;
+    loop_info.loop_end   = zone_playback->loop_end;
+
+    voice_slot = ulStartVoicePlayback( zone_playback->sample_addr, // Audio data pointer
+                                       zone_playback->sample_size, // Audio data size
+                                       ( zone_playback->loop_end != 0 ) ? &loop_info : NULL,
+                                       prv_ulGetPhaseIncrement( key, &instrument_information->zone_pitch[zone_index] ), // Pitch
+                                       &alloc_info
+                                     );
+
+    // If there are no available slots, don't update the status
+    if ( voice_slot == VOICE_SLOT_NONE ) {
+        SAMPLER_PRINTF_ERROR("No available slots found! %d", voice_slot);
+        return 0;
+    }
 
-        // Check if sample is present
-        if ( current_voice->sample_present == 0 ) {
-            SAMPLER_PRINTF_ERROR("There's no sample for the specified velocity! %d", current_voice->current_slot);
-            return 2;
-        }
+    SAMPLER_PRINTF_INFO("Started playback on slot %d (instance %d)", voice_slot, zone_state->number_of_instances);
 
-        // Start playback
-        voice_slot = ulStartVoicePlayback( (uint32_t) current_voice->sample_format.data_start_ptr, // Audio data pointer
-                                                      current_voice->sample_format.audio_data_size // Audio data size
-                                            );
-        
-        // If there are no available slots, don't update the status
-        if ( voice_slot == 0xffff ) {
-            SAMPLER_PRINTF_ERROR("No available slots found! %d", voice_slot);
-            break;
-        }
+    // An untracked voice would keep reading the patch memory after the instrument is released
+    if ( prv_ulAddZoneInstance( instrument_information, zone_index, voice_slot, channel, key ) != 0 ) {
+        SAMPLER_PRINTF_ERROR("[ERROR] - Zone %d can't track slot %d, stopping it", zone_index, voice_slot);
+        ulStopVoicePlayback( voice_slot );
+        return 1;
+    }
+
+    return 0;
 
-        SAMPLER_PRINTF_INFO("Started playback on slot %d", voice_slot);
+}
 
-        current_voice->current_slot   = voice_slot;
-        current_voice->current_status = 1;
-        break;
+// This function plays a key on the instruments routed to a channel
+// Every part whose key range holds the key plays it, so overlapping parts are layered
+static uint32_t prv_ulPlayChannelKey( uint8_t channel, uint8_t key, uint8_t velocity, const CHANNEL_ROUTE_t *channel_route ) {
+    const CHANNEL_PART_t *part;
+    uint32_t              error = 0;
+
+    if ( channel >= MIDI_NUM_OF_CHANNELS || channel_route == NULL ) {
+        SAMPLER_PRINTF_ERROR("[ERROR] - Invalid channel %d", channel);
+        return 1;
     }
 
-    return 0;
+    if ( channel_route->number_of_parts == 0 ) {
+        SAMPLER_PRINTF_DEBUG("No instrument is routed to channel %d", channel + 1);
+        return 1;
+    }
+
+    for ( uint8_t part_index = 0; part_index < channel_route->number_of_parts; part_index++ ) {
+        part = &channel_route->parts[part_index];
+        if ( key < part->key_min || key > part->key_max ) continue;
+        error |= prv_ulPlayInstrumentKey( channel, key, velocity, part->patch );
+    }
+
+    return error;
+}
+
+// Thread-safe wrappers of the engine functions
+uint32_t ulStopAllPlayback( const CHANNEL_ROUTE_t *channel_routes ) {
+    uint32_t error;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    error = prv_ulStopAllPlayback( channel_routes );
+    xSemaphoreGive( engine_mutex );
+
+    return error;
+}
+
+uint32_t ulStopPatchPlayback( PATCH_DESCRIPTOR_t *instrument_information ) {
+    uint32_t error;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    error = prv_ulStopPatchPlayback( instrument_information, MIDI_CHANNEL_ALL );
+    xSemaphoreGive( engine_mutex );
+
+    return error;
+}
+
+// This function stops the voices started by a channel (i.e. All Notes Off). The other channels keep playing
+uint32_t ulStopChannelPlayback( uint8_t channel, const CHANNEL_ROUTE_t *channel_route ) {
+    uint32_t error = 0;
+
+    if ( channel_route == NULL ) return 1;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    for ( uint8_t part = 0; part < channel_route->number_of_parts; part++ ) {
+        error |= prv_ulStopPatchPlayback( channel_route->parts[part].patch, channel );
+    }
+    xSemaphoreGive( engine_mutex );
+
+    return error;
+}
+
+uint32_t ulPlayChannelKey( uint8_t channel, uint8_t key, uint8_t velocity, const CHANNEL_ROUTE_t *channel_route ) {
+    uint32_t error;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    error = prv_ulPlayChannelKey( channel, key, velocity, channel_route );
+    xSemaphoreGive( engine_mutex );
+
+    return error;
+}
+
+// This function limits the number of DMA voices a channel can play at the same time (0 = no limit)
+// The channels share the voice pool, so a busy channel can't take the voices of the others
+uint32_t ulSetChannelVoiceLimit( uint8_t channel, uint8_t voice_limit ) {
+    uint32_t error;
+
+    if ( channel >= MIDI_NUM_OF_CHANNELS ) return 1;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    error = ulSetInstrumentPolyphonyCap( channel, voice_limit );
+    xSemaphoreGive( engine_mutex );
+
+    return error;
+}
+
+// This function writes the voice changes of the engine to the HW
+// The engine functions only update the shadow registers, so this must be called after a batch of events
+void vSamplerEngineCommit( void ) {
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    vSamplerDMACommit();
+    xSemaphoreGive( engine_mutex );
+}
+
+// This function releases the voices that finished playing their sample (i.e. one-shot samples)
+// The zones of the released voices are updated through the release callback
+uint32_t ulReleaseFinishedVoices( void ) {
+    uint32_t reaped;
+
+    xSemaphoreTake( engine_mutex, portMAX_DELAY );
+    reaped = ulReapFinishedVoices();
+    if ( reaped ) vSamplerDMACommit();
+    xSemaphoreGive( engine_mutex );
+
+    if ( reaped ) SAMPLER_PRINTF_DEBUG("Released %d finished voice(s)", reaped);
 
+    return reaped;
 }
 
 // This function will return the hex value of a MIDI note
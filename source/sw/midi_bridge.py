@@ -16,6 +16,9 @@ PARITY_BITS = 0
 
 MIDI_CMD    = b'midi'
 
+## SysEx message that stops the MIDI listener of the sampler
+MIDI_LISTENER_STOP_SYSEX = [ 0xF0, 0x7D, 0x00, 0xF7 ]
+
 def list_serial_ports():
     """ Lists serial port names
 
@@ -123,13 +126,18 @@ def main():
 
     ser.open()
 
-    for msg in inport:
-        msg_bytes = msg.bytes()
-        values    = bytearray( msg_bytes )
-
-        #print "{}".format( " ".join( hex(x) for x in values) )
-        #print "--"
-        ser.write( values )
+    try:
+        for msg in inport:
+            msg_bytes = msg.bytes()
+            values    = bytearray( msg_bytes )
+
+            #print "{}".format( " ".join( hex(x) for x in values) )
+            #print "--"
+            ser.write( values )
+    except KeyboardInterrupt:
+        ## Stop the MIDI listener of the sampler
+        ser.write( bytearray( MIDI_LISTENER_STOP_SYSEX ) )
+        ser.close()
 
 
     return 0
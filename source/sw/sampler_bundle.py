@@ -0,0 +1,511 @@
+##########################################
+## Instrument bundle compiler
+##########################################
+## Compiles a JSON instrument (and its WAVE files) or an SF2 preset
+## into a bundle (.zsb) that the sampler loads with a single read.
+## The layout is defined in sampler/include/sample_bundle.h
+##
+## Usage:
+##   python3 sampler_bundle.py json <instrument.json> -o <bundle.zsb>
+##   python3 sampler_bundle.py sf2  <soundfont.sf2>   -o <bundle.zsb> [--preset <bank:program>]
+##   python3 sampler_bundle.py sf2  <soundfont.sf2>   --list
+
+import sys
+import os
+import json
+import struct
+import argparse
+
+## Bundle format (sample_bundle.h)
+BUNDLE_MAGIC        = 0x3142535A  # "ZSB1"
+BUNDLE_VERSION      = 1
+BUNDLE_NAME_LEN     = 64
+BUNDLE_DATA_ALIGN   = 4
+BUNDLE_HEADER_FMT   = "<IHHHHBBHII{}s".format(BUNDLE_NAME_LEN)
+BUNDLE_ZONE_FMT     = "<BBBBBBBBhHIHHIIII"
+
+## Firmware limits (sampler_cfg.h and sampler_dma_controller_regs.h)
+SAMPLER_DMA_BURST_BYTES = 0x100
+MAX_NUM_OF_KEYS         = 128
+MAX_NUM_OF_VELOCITY     = 128
+MAX_NUM_OF_ZONES        = 1024
+MAX_ZONE_INSTANCES      = 8
+MAX_BUNDLE_FILE_SIZE    = 0x7F00000
+
+RETRIGGER_MODES = { "restart": 0, "layer": 1, "choke": 2 }
+
+## The DMA plays 16-bit stereo frames
+OUTPUT_CHANNELS    = 2
+OUTPUT_BYTES       = 2
+OUTPUT_BLOCK_ALIGN = OUTPUT_CHANNELS * OUTPUT_BYTES
+
+## Same note table as the firmware ("C4", "A4_S", etc.)
+MIDI_NOTES_LUT = { "A": 21, "B": 23, "C": 12, "D": 14, "E": 16, "F": 17, "G": 19 }
+
+
+class Zone(object):
+    """ One key/velocity zone of the bundle """
+    def __init__(self, key):
+        self.key          = key
+        self.velocity_min = 0
+        self.velocity_max = MAX_NUM_OF_VELOCITY - 1
+        self.root_key     = key
+        self.key_min      = key
+        self.key_max      = key
+        self.fine_tune    = 0
+        self.sample_rate  = 44100
+        self.loop_enabled = 0
+        self.loop_start   = 0
+        self.loop_end     = 0
+        self.audio        = b""   # 16-bit stereo PCM
+        self.audio_id     = None  # Zones with the same id share the audio data
+
+
+def warning(msg):
+    print("[WARNING] - {}".format(msg))
+
+
+def error(msg):
+    print("[ERROR] - {}".format(msg))
+    sys.exit(1)
+
+
+def note_name_to_midi(note_name):
+    """ Converts a JSON note name ("C4", "A4_S") to a MIDI note """
+    note_letter = note_name[0].upper()
+    if note_letter not in MIDI_NOTES_LUT or len(note_name) < 2 or not note_name[1].isdigit():
+        return None
+
+    midi_note = MIDI_NOTES_LUT[note_letter] + 12 * int(note_name[1])
+    if len(note_name) > 3 and note_name[3].upper() == "S":
+        midi_note += 1
+
+    return midi_note
+
+
+def to_stereo16(data, channels, bits):
+    """ Converts interleaved PCM to 16-bit stereo """
+    bytes_per_sample = bits // 8
+    frame_len        = channels * bytes_per_sample
+    frames           = len(data) // frame_len
+
+    if bits == 16 and channels == 2:
+        return bytes(data[:frames * frame_len])
+
+    out = bytearray(frames * OUTPUT_BLOCK_ALIGN)
+    for frame in range(frames):
+        values = []
+        for channel in range(min(channels, 2)):
+            offset = frame * frame_len + channel * bytes_per_sample
+            if bits == 8:
+                value = (data[offset] - 128) << 8
+            else:
+                ## Keep the 16 most significant bits
+                value = struct.unpack_from("<h", data, offset + bytes_per_sample - 2)[0]
+            values.append(value)
+        if len(values) == 1:
+            values.append(values[0])
+        struct.pack_into("<hh", out, frame * OUTPUT_BLOCK_ALIGN, values[0], values[1])
+
+    return bytes(out)
+
+
+def iterate_chunks(data, start, end):
+    """ Yields the (id, offset, size) of the RIFF chunks in data[start:end] """
+    offset = start
+    while offset + 8 <= end:
+        chunk_id, chunk_size = struct.unpack_from("<4sI", data, offset)
+        yield chunk_id, offset + 8, min(chunk_size, end - offset - 8)
+        offset += 8 + chunk_size + (chunk_size & 1)
+
+
+##########################################
+## WAVE files
+##########################################
+def read_wave(path):
+    """ Returns (sample_rate, 16-bit stereo PCM, loop or None) """
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if len(data) < 12 or data[0:4] != b"RIFF" or data[8:12] != b"WAVE":
+        error("\"{}\" is not a WAVE file".format(path))
+
+    fmt   = None
+    audio = None
+    loop  = None
+
+    for chunk_id, offset, size in iterate_chunks(data, 12, len(data)):
+        if chunk_id == b"fmt ":
+            fmt = struct.unpack_from("<HHIIHH", data, offset)
+        elif chunk_id == b"data":
+            audio = data[offset:offset + size]
+        elif chunk_id == b"smpl" and size >= 36 + 24:
+            number_of_loops = struct.unpack_from("<I", data, offset + 28)[0]
+            if number_of_loops:
+                ## Only forward loops. The WAVE loop end is included
+                loop_type, loop_start, loop_end = struct.unpack_from("<III", data, offset + 36 + 4)
+                if loop_type == 0 and loop_end >= loop_start:
+                    loop = (loop_start, loop_end + 1)
+
+    if fmt is None or audio is None:
+        error("\"{}\" has no format or data chunk".format(path))
+
+    audio_format, channels, sample_rate, _, _, bits = fmt
+    if audio_format not in (1, 0xFFFE) or bits not in (8, 16, 24, 32):
+        error("\"{}\" is not linear PCM".format(path))
+
+    return sample_rate, to_stereo16(audio, channels, bits), loop
+
+
+def compile_json(json_path):
+    """ Returns (name, retrigger_mode, max_instances, zones) of a JSON instrument """
+    with open(json_path, "r") as f:
+        instrument = json.load(f)
+
+    root_dir       = os.path.dirname(os.path.abspath(json_path))
+    name           = instrument.get("instrument_name", os.path.basename(json_path))
+    retrigger_mode = RETRIGGER_MODES.get(instrument.get("retrigger_mode", "restart"), 0)
+    max_instances  = int(instrument.get("max_instances", MAX_ZONE_INSTANCES))
+    zones          = []
+
+    ## A note holds a sample or an array of samples (i.e. velocity layers)
+    note_samples = []
+    for note_name, samples in instrument.get("samples", {}).items():
+        for sample in (samples if isinstance(samples, list) else [samples]):
+            note_samples.append((note_name, sample))
+
+    for note_name, sample in note_samples:
+        key = note_name_to_midi(note_name)
+        if key is None or key >= MAX_NUM_OF_KEYS or not isinstance(sample, dict) or "sample_file" not in sample:
+            warning("Skipping \"{}\"".format(note_name))
+            continue
+
+        zone = Zone(key)
+        zone.velocity_min = min(int(sample.get("velocity_min", 0)), MAX_NUM_OF_VELOCITY - 1)
+        zone.velocity_max = min(int(sample.get("velocity_max", MAX_NUM_OF_VELOCITY - 1)), MAX_NUM_OF_VELOCITY - 1)
+        zone.root_key     = int(sample.get("root_key", key))
+        zone.fine_tune    = int(sample.get("fine_tune", 0))
+        zone.key_min      = int(sample.get("key_min", key))
+        zone.key_max      = int(sample.get("key_max", key))
+
+        sample_path = os.path.join(root_dir, sample["sample_file"])
+        zone.sample_rate, zone.audio, loop = read_wave(sample_path)
+        zone.audio_id = os.path.normpath(sample_path)
+
+        ## The JSON loop points override the ones of the WAVE file
+        if "loop_start" in sample and "loop_end" in sample:
+            loop = (int(sample["loop_start"]), int(sample["loop_end"]))
+        elif "loop_start" in sample or "loop_end" in sample:
+            warning("{}: loop_start and loop_end must be defined together. Loop ignored".format(note_name))
+
+        if loop is not None:
+            zone.loop_enabled, zone.loop_start, zone.loop_end = 1, loop[0], loop[1]
+            ## Shared audio data must have the same loop guard
+            zone.audio_id = (zone.audio_id, loop)
+
+        zones.append(zone)
+
+    return name, retrigger_mode, max_instances, zones
+
+
+##########################################
+## SF2 files
+##########################################
+SF2_GEN_START_OFFSET        = 0
+SF2_GEN_END_OFFSET          = 1
+SF2_GEN_STARTLOOP_OFFSET    = 2
+SF2_GEN_ENDLOOP_OFFSET      = 3
+SF2_GEN_START_COARSE        = 4
+SF2_GEN_END_COARSE          = 12
+SF2_GEN_INSTRUMENT          = 41
+SF2_GEN_KEY_RANGE           = 43
+SF2_GEN_VEL_RANGE           = 44
+SF2_GEN_STARTLOOP_COARSE    = 45
+SF2_GEN_ENDLOOP_COARSE      = 50
+SF2_GEN_COARSE_TUNE         = 51
+SF2_GEN_FINE_TUNE           = 52
+SF2_GEN_SAMPLE_ID           = 53
+SF2_GEN_SAMPLE_MODES        = 54
+SF2_GEN_OVERRIDING_ROOT_KEY = 58
+
+SF2_SAMPLE_RIGHT = 2
+SF2_SAMPLE_LEFT  = 4
+SF2_SAMPLE_ROM   = 0x8000
+
+
+class SoundFont(object):
+    """ Minimal SF2 reader. Only what is needed to build the zones """
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+
+        if len(self.data) < 12 or self.data[0:4] != b"RIFF" or self.data[8:12] != b"sfbk":
+            error("\"{}\" is not an SF2 file".format(path))
+
+        self.smpl   = None
+        self.chunks = {}
+
+        for chunk_id, offset, size in iterate_chunks(self.data, 12, len(self.data)):
+            if chunk_id != b"LIST":
+                continue
+            for sub_id, sub_offset, sub_size in iterate_chunks(self.data, offset + 4, offset + size):
+                if sub_id == b"smpl":
+                    self.smpl = (sub_offset, sub_size)
+                else:
+                    self.chunks[sub_id] = (sub_offset, sub_size)
+
+        if self.smpl is None:
+            error("\"{}\" has no sample data".format(path))
+
+        self.presets     = self.records(b"phdr", "<20sHHHIII")
+        self.preset_bags = self.records(b"pbag", "<HH")
+        self.preset_gens = self.records(b"pgen", "<HH")
+        self.instruments = self.records(b"inst", "<20sH")
+        self.inst_bags   = self.records(b"ibag", "<HH")
+        self.inst_gens   = self.records(b"igen", "<HH")
+        self.samples     = self.records(b"shdr", "<20sIIIIIBbHH")
+
+    def records(self, chunk_id, fmt):
+        if chunk_id not in self.chunks:
+            error("SF2 chunk {} is missing".format(chunk_id))
+        offset, size = self.chunks[chunk_id]
+        record_size  = struct.calcsize(fmt)
+        return [ struct.unpack_from(fmt, self.data, offset + i * record_size) for i in range(size // record_size) ]
+
+    def zones(self, bags, gens, first_bag, last_bag):
+        """ Returns the generator dictionaries of the zones in [first_bag, last_bag) """
+        zones = []
+        for bag in range(first_bag, last_bag):
+            generators = {}
+            for gen in range(bags[bag][0], bags[bag + 1][0]):
+                generators[gens[gen][0]] = gens[gen][1]
+            zones.append(generators)
+        return zones
+
+    def sample_points(self, sample_id):
+        """ Returns the 16-bit mono points of a sample """
+        offset = self.smpl[0]
+        start, end = self.samples[sample_id][1], self.samples[sample_id][2]
+        return self.data[offset + start * 2:offset + end * 2]
+
+
+def signed16(value):
+    return value - 0x10000 if value >= 0x8000 else value
+
+
+def gen_range(generators, gen, default):
+    if gen not in generators:
+        return default
+    return generators[gen] & 0xff, generators[gen] >> 8
+
+
+def list_presets(sf2):
+    for name, program, bank, _, _, _, _ in sf2.presets[:-1]:
+        print("{:3d}:{:3d} {}".format(bank, program, name.split(b"\0")[0].decode("ascii", "replace")))
+
+
+def compile_sf2(sf2_path, preset_id):
+    """ Returns (name, retrigger_mode, max_instances, zones) of an SF2 preset """
+    sf2 = SoundFont(sf2_path)
+
+    ## The last record of each list is the terminator
+    preset_index = 0
+    if preset_id is not None:
+        bank, program = [ int(x) for x in preset_id.split(":") ]
+        matches = [ i for i, p in enumerate(sf2.presets[:-1]) if p[2] == bank and p[1] == program ]
+        if not matches:
+            error("Preset {} not found".format(preset_id))
+        preset_index = matches[0]
+
+    preset = sf2.presets[preset_index]
+    name   = preset[0].split(b"\0")[0].decode("ascii", "replace")
+    zones  = []
+
+    preset_zones  = sf2.zones(sf2.preset_bags, sf2.preset_gens, preset[3], sf2.presets[preset_index + 1][3])
+    preset_global = {}
+    if preset_zones and SF2_GEN_INSTRUMENT not in preset_zones[0]:
+        preset_global = preset_zones.pop(0)
+
+    for preset_zone in preset_zones:
+        pgen = dict(preset_global)
+        pgen.update(preset_zone)
+        if SF2_GEN_INSTRUMENT not in pgen:
+            continue
+
+        instrument_index = pgen[SF2_GEN_INSTRUMENT]
+        instrument       = sf2.instruments[instrument_index]
+        inst_zones       = sf2.zones(sf2.inst_bags, sf2.inst_gens, instrument[1], sf2.instruments[instrument_index + 1][1])
+        inst_global      = {}
+        if inst_zones and SF2_GEN_SAMPLE_ID not in inst_zones[0]:
+            inst_global = inst_zones.pop(0)
+
+        ## The right channel of a stereo pair is added to its left zone
+        left_links = set()
+        for inst_zone in inst_zones:
+            if SF2_GEN_SAMPLE_ID in inst_zone and sf2.samples[inst_zone[SF2_GEN_SAMPLE_ID]][9] & SF2_SAMPLE_LEFT:
+                left_links.add(sf2.samples[inst_zone[SF2_GEN_SAMPLE_ID]][8])
+
+        for inst_zone in inst_zones:
+            igen = dict(inst_global)
+            igen.update(inst_zone)
+            if SF2_GEN_SAMPLE_ID not in igen:
+                continue
+
+            sample_id = igen[SF2_GEN_SAMPLE_ID]
+            sample    = sf2.samples[sample_id]
+            sample_type = sample[9]
+            if sample_type & SF2_SAMPLE_ROM:
+                continue
+            if sample_type & SF2_SAMPLE_RIGHT and sample_id in left_links:
+                continue
+
+            ## The preset ranges narrow the instrument ranges
+            key_lo, key_hi = gen_range(igen, SF2_GEN_KEY_RANGE, (0, 127))
+            vel_lo, vel_hi = gen_range(igen, SF2_GEN_VEL_RANGE, (0, 127))
+            pkey_lo, pkey_hi = gen_range(pgen, SF2_GEN_KEY_RANGE, (0, 127))
+            pvel_lo, pvel_hi = gen_range(pgen, SF2_GEN_VEL_RANGE, (0, 127))
+            key_lo, key_hi = max(key_lo, pkey_lo), min(key_hi, pkey_hi)
+            vel_lo, vel_hi = max(vel_lo, pvel_lo), min(vel_hi, pvel_hi)
+            if key_lo > key_hi or vel_lo > vel_hi:
+                continue
+
+            root_key = igen.get(SF2_GEN_OVERRIDING_ROOT_KEY, 0xffff)
+            if root_key > 127:
+                root_key = sample[6] if sample[6] <= 127 else 60
+
+            ## The sampler can only pitch down, so the sample is played from its root key downwards
+            if root_key < key_lo:
+                warning("{}: Keys {} to {} are above the root key ({}). Only key {} is played".format(name, key_lo, key_hi, root_key, key_lo))
+                key = key_min = key_max = key_lo
+            else:
+                key_max = min(key_hi, root_key)
+                key     = key_max
+                key_min = key_lo
+                if key_hi > root_key:
+                    warning("{}: Keys {} to {} are above the root key ({}) and are not mapped".format(name, root_key + 1, key_hi, root_key))
+
+            zone = Zone(key)
+            zone.velocity_min = vel_lo
+            zone.velocity_max = vel_hi
+            zone.root_key     = root_key
+            zone.key_min      = key_min
+            zone.key_max      = key_max
+            zone.fine_tune    = ( signed16(igen.get(SF2_GEN_COARSE_TUNE, 0)) + signed16(pgen.get(SF2_GEN_COARSE_TUNE, 0)) ) * 100 + \
+                                signed16(igen.get(SF2_GEN_FINE_TUNE, 0)) + signed16(pgen.get(SF2_GEN_FINE_TUNE, 0)) + sample[7]
+            zone.sample_rate  = sample[5]
+
+            ## Address offsets of the zone (in points)
+            start_offset     = signed16(igen.get(SF2_GEN_START_OFFSET, 0))     + 32768 * signed16(igen.get(SF2_GEN_START_COARSE, 0))
+            end_offset       = signed16(igen.get(SF2_GEN_END_OFFSET, 0))       + 32768 * signed16(igen.get(SF2_GEN_END_COARSE, 0))
+            startloop_offset = signed16(igen.get(SF2_GEN_STARTLOOP_OFFSET, 0)) + 32768 * signed16(igen.get(SF2_GEN_STARTLOOP_COARSE, 0))
+            endloop_offset   = signed16(igen.get(SF2_GEN_ENDLOOP_OFFSET, 0))   + 32768 * signed16(igen.get(SF2_GEN_ENDLOOP_COARSE, 0))
+
+            left  = sf2.sample_points(sample_id)
+            right = left
+            if sample_type & SF2_SAMPLE_LEFT and sample[8] < len(sf2.samples) - 1:
+                right = sf2.sample_points(sample[8])
+
+            frames = min(len(left), len(right)) // 2
+            first  = max(0, min(frames, start_offset))
+            last   = max(first, min(frames, frames + end_offset))
+
+            audio = bytearray((last - first) * OUTPUT_BLOCK_ALIGN)
+            audio[0::4] = left[first * 2 + 0:last * 2:2]
+            audio[1::4] = left[first * 2 + 1:last * 2:2]
+            audio[2::4] = right[first * 2 + 0:last * 2:2]
+            audio[3::4] = right[first * 2 + 1:last * 2:2]
+            zone.audio = bytes(audio)
+
+            loop_start = sample[3] - sample[1] + startloop_offset - first
+            loop_end   = sample[4] - sample[1] + endloop_offset   - first
+            if igen.get(SF2_GEN_SAMPLE_MODES, 0) & 1 and 0 <= loop_start < loop_end <= last - first:
+                zone.loop_enabled, zone.loop_start, zone.loop_end = 1, loop_start, loop_end
+
+            zone.audio_id = (sample_id, first, last, zone.loop_enabled, zone.loop_start, zone.loop_end)
+            zones.append(zone)
+
+    return name, 0, MAX_ZONE_INSTANCES, zones
+
+
+##########################################
+## Bundle writer
+##########################################
+def write_bundle(path, name, retrigger_mode, max_instances, zones):
+    if not zones:
+        error("The instrument has no zones")
+    if len(zones) > MAX_NUM_OF_ZONES:
+        error("Too many zones ({}). Maximum number of zones = {}".format(len(zones), MAX_NUM_OF_ZONES))
+
+    ## Zones sorted by key, like the firmware zone table
+    zones = sorted(zones, key=lambda z: (z.key, z.velocity_min))
+
+    header_size = struct.calcsize(BUNDLE_HEADER_FMT)
+    zone_size   = struct.calcsize(BUNDLE_ZONE_FMT)
+    data_offset = header_size + len(zones) * zone_size
+    data_offset = (data_offset + BUNDLE_DATA_ALIGN - 1) & ~(BUNDLE_DATA_ALIGN - 1)
+
+    ## Each PCM blob is followed by room for the loop guard (written by the firmware)
+    data    = bytearray()
+    offsets = {}
+    records = []
+    for zone in zones:
+        if zone.audio_id not in offsets:
+            offsets[zone.audio_id] = len(data)
+            data += zone.audio
+            data += bytes(SAMPLER_DMA_BURST_BYTES + (-len(data) % BUNDLE_DATA_ALIGN))
+
+        records.append(struct.pack(BUNDLE_ZONE_FMT,
+                                   zone.key, zone.velocity_min, zone.velocity_max, zone.root_key,
+                                   zone.key_min, zone.key_max, zone.loop_enabled, 0,
+                                   max(-32768, min(32767, zone.fine_tune)), OUTPUT_CHANNELS,
+                                   zone.sample_rate, OUTPUT_BYTES * 8, OUTPUT_BLOCK_ALIGN,
+                                   offsets[zone.audio_id], len(zone.audio),
+                                   zone.loop_start, zone.loop_end))
+
+    header = struct.pack(BUNDLE_HEADER_FMT, BUNDLE_MAGIC, BUNDLE_VERSION, header_size, zone_size, len(zones),
+                         retrigger_mode, max_instances, 0, data_offset, len(data),
+                         name.encode("ascii", "replace")[:BUNDLE_NAME_LEN - 1])
+
+    bundle = bytearray(header) + b"".join(records)
+    bundle += bytes(data_offset - len(bundle))
+    bundle += data
+
+    if len(bundle) > MAX_BUNDLE_FILE_SIZE:
+        error("The bundle is too large ({} bytes). Maximum size = {} bytes".format(len(bundle), MAX_BUNDLE_FILE_SIZE))
+
+    with open(path, "wb") as f:
+        f.write(bundle)
+
+    print("\"{}\": {} zones, {} bytes".format(path, len(zones), len(bundle)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compiles an instrument into a sampler bundle (.zsb)")
+    parser.add_argument("format", choices=["json", "sf2"], help="Input format")
+    parser.add_argument("input", help="JSON instrument file or SF2 file")
+    parser.add_argument("-o", "--output", help="Output bundle")
+    parser.add_argument("--preset", help="SF2 preset as <bank:program> (default is the first preset)")
+    parser.add_argument("--list", action="store_true", help="List the SF2 presets")
+    args = parser.parse_args()
+
+    if args.list:
+        if args.format != "sf2":
+            error("--list is only supported for SF2 files")
+        list_presets(SoundFont(args.input))
+        return 0
+
+    if args.output is None:
+        args.output = os.path.splitext(args.input)[0] + ".zsb"
+
+    if args.format == "json":
+        name, retrigger_mode, max_instances, zones = compile_json(args.input)
+    else:
+        name, retrigger_mode, max_instances, zones = compile_sf2(args.input, args.preset)
+
+    write_bundle(args.output, name, retrigger_mode, max_instances, zones)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,5 +8,6 @@ set synthesis_file_list {
     ${core_root}/rtl/sample_info_fetcher.sv
     ${core_root}/rtl/sample_dma_requester.sv
     ${core_root}/rtl/sample_dma_receiver.sv
+    ${core_root}/rtl/sample_resampler.sv
     ${core_root}/rtl/axi_dma_bridge.sv
 }
\ No newline at end of file
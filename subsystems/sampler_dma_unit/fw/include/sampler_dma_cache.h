@@ -0,0 +1,34 @@
+/////////////////////////////////////
+// Sampler DMA Cache Maintenance
+/////////////////////////////////////
+
+#ifndef _SAMPLER_DMA_CACHE_H_
+#define _SAMPLER_DMA_CACHE_H_
+
+#include <stdint.h>
+#include "xtime_l.h"
+
+// Cache maintenance operations
+typedef enum {
+    SAMPLER_CACHE_OP_SAMPLE_FLUSH = 0, // Clean of the sample memory read by the DMA
+    SAMPLER_CACHE_OP_REG_BARRIER,      // Barrier after the register writes
+    SAMPLER_CACHE_NUM_OF_OPS
+} SAMPLER_CACHE_OP_e;
+
+// Timing statistics of a cache maintenance operation
+typedef struct {
+    uint32_t count;       // Number of operations
+    uint32_t bytes;       // Number of bytes cleaned (flushes only)
+    XTime    total_time;  // Global timer counts
+    XTime    max_time;    // Global timer counts
+} SAMPLER_CACHE_STATS_t;
+
+#define SAMPLER_CACHE_COUNTS_TO_US(COUNTS) ( (uint32_t) ( ( (COUNTS) * 1000000ULL ) / COUNTS_PER_SECOND ) )
+
+void vSamplerCacheInit( void );
+void vSamplerCacheFlushSampleRange( const void *sample_addr, uint32_t sample_size );
+void vSamplerCacheRegisterBarrier( void );
+void vGetSamplerCacheStats( SAMPLER_CACHE_OP_e op, SAMPLER_CACHE_STATS_t *stats );
+void vClearSamplerCacheStats( void );
+
+#endif
@@ -12,6 +12,18 @@
 #define SAMPLER_DMA_REGISTER_ACCESS     ((volatile SAMPLER_DMA_REGISTERS_t *)(SAMPLER_DMA_BASE_ADDR))
 #define GET_SAMPLER_FULL_ADDR(ADDR)     ( SAMPLER_BASE_ADDR + (ADDR * 4) )
 #define MAX_VOICES            64
+// First HW version with the Voices Done registers
+#define SAMPLER_VOICES_DONE_MIN_VERSION 0x00010002
+// First HW version with looped samples
+#define SAMPLER_LOOP_MIN_VERSION        0x00010003
+// Number of bytes read by the DMA on each access. The loop points are aligned to this
+#define SAMPLER_DMA_BURST_BYTES         0x100
+// First HW version with pitched playback (resampler)
+#define SAMPLER_PITCH_MIN_VERSION       0x00010004
+// Phase increment of the resampler. Source frames per output frame in 1/4096 units
+// The resampler can only slow down the playback, so the maximum is the original rate
+#define SAMPLER_PHASE_FRACTION_BITS     12
+#define SAMPLER_PHASE_INC_UNITY         ( 1 << SAMPLER_PHASE_FRACTION_BITS )
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 //  _   _               _                          ____            _     _                 //
@@ -54,6 +66,10 @@
 // |  0x3     |  RO         |  BRAM END ADDRESS          |
 // :----------+-------------+----------------------------:
 // |  0x4     |  RD/WR      |  RSVD[31:2] | STOP | START |
+// :----------+-------------+----------------------------:
+// |  0x5     |  RD/W1C     |  VOICES DONE [31:0]        |
+// :----------+-------------+----------------------------:
+// |  0x6     |  RD/W1C     |  VOICES DONE [63:32]       |
 // '----------'-------------'----------------------------'
 
 // Sample DMA Register (BAR = SAMPLER_BASE_ADDR + BRAM START ADDRESS)
@@ -64,10 +80,14 @@
 // :-------------+-------------+-----------------------------------------------------------:
 // |     0x1     |    RD/WR    |                   Sample End Address [31:0]               |
 // :-------------+-------------+-----------------------------------------------------------:
-// |     0x2     |    RD/WR    |  Control[7:0] |   Sample Length [23:0]                    |
+// |     0x2     |    RD/WR    |  Control[7:0] | Phase Fraction[11:0] | Phase Inc[11:0]    |
 // :-------------+-------------+-----------------------------------------------------------:
-// |     0x3     |    RD/WR    |          RSVD[15:0]         |     Next Sample[15:0]       |
+// |     0x3     |    RD/WR    |      Loop Length[15:0]      |     Next Sample[15:0]       |
 // '-------------'-------------'-----------------------------------------------------------'
+// Loop Length is in DMA bursts (SAMPLER_DMA_BURST_BYTES). Only used when the loop bit is set
+// The loop ends at the Sample End Address and starts Loop Length bursts before it
+// Phase Inc is the number of source frames per output frame in 1/4096 units (0 = original rate)
+// Phase Fraction is the position of the resampler between two frames. Written back by the HW
 
 
 
@@ -140,12 +160,28 @@ typedef union {
     uint32_t value;
 } SAMPLER_CONTROL_REG_t;
 
+/////////////////////////////////
+// Sampler Voices Done Register
+// One bit per voice. Set by the HW when all the
+// samples of the voice have been read (overflow)
+// Write 1 to clear
+/////////////////////////////////
+typedef union {
+    // Individual Fields
+    struct {
+        uint32_t voices_done : 32 ; // Bit 31:0
+    } field;
+    // Complete Value
+    uint32_t value;
+} SAMPLER_VOICES_DONE_REG_t;
+
 typedef struct {
     SAMPLER_VER_REG_t                 SAMPLER_VER_REG;                 // Address 0
     SAMPLER_MAX_VOICES_REG_t          SAMPLER_MAX_VOICES_REG;          // Address 1
     SAMPLER_DMA_CTRL_START_ADDR_REG_t SAMPLER_DMA_CTRL_START_ADDR_REG; // Address 2
     SAMPLER_DMA_CTRL_END_ADDR_REG_t   SAMPLER_DMA_CTRL_END_ADDR_REG;   // Address 3
     SAMPLER_CONTROL_REG_t             SAMPLER_CONTROL_REG;             // Address 4
+    SAMPLER_VOICES_DONE_REG_t         SAMPLER_VOICES_DONE_REG[2];      // Address 5 and 6
 } SAMPLER_REGISTERS_t;
 
 ////////////////////////////////////////////////////////////////////
@@ -186,11 +222,14 @@ typedef union {
 typedef union {
     // Individual Fields
     struct {
-        uint32_t dma_len  : 24 ; // Bit [23:0]   // Length in number of samples
-        uint32_t valid    : 1  ; // Bit 24       // Sample is valid
-        uint32_t last     : 1  ; // Bit 25       // Sample is the last of the loop
-        uint32_t rsvd     : 5  ; // Bits [30:26] // Reserved
-        uint32_t overflow : 1  ; // Bit 31       // Sampler read all the samples
+        uint32_t phase_inc  : 12 ; // Bit [11:0]   // Resampler phase increment (1/4096 frames). 0 = Original rate
+        uint32_t phase_frac : 12 ; // Bit [23:12]  // Resampler phase fraction. Updated by the HW
+        uint32_t valid      : 1  ; // Bit 24       // Sample is valid
+        uint32_t last       : 1  ; // Bit 25       // Sample is the last of the loop
+        uint32_t loop       : 1  ; // Bit 26       // Sample loops between the loop start and the end address
+        uint32_t hist_valid : 1  ; // Bit 27       // The resampler has the previous frame of the slot. Set by the HW
+        uint32_t rsvd       : 3  ; // Bits [30:28] // Reserved
+        uint32_t overflow   : 1  ; // Bit 31       // Sampler read all the samples
     } field;
     // Complete Value
     uint32_t value;
@@ -204,7 +243,7 @@ typedef union {
     // TODO: Put individual bits
     struct {
         uint32_t dma_next_sample : 16 ; // Bit [15:0]
-        uint32_t rsvd            : 16 ; // Bit [31:16]
+        uint32_t loop_len        : 16 ; // Bit [31:16]  // Loop length in DMA bursts
     } field;
     // Complete Value
     uint32_t value;
@@ -11,6 +11,20 @@
 #define SAMPLER_CONTROL_START     ( 1 << SAMPLER_CONTROL_START_BIT )
 #define SAMPLER_CONTROL_STOP      ( 1 << SAMPLER_CONTROL_STOP_BIT  )
 
+// Voice allocation
+#define VOICE_SLOT_NONE           0xffff           // Returned when no slot could be allocated
+#define VOICE_INSTRUMENT_NONE     0xff             // The voice doesn't belong to any instrument
+#define MAX_VOICE_INSTRUMENTS     16               // Number of instruments with their own polyphony cap
+#define VOICE_FREE_BITMAP_WORDS   ( MAX_VOICES / 32 )
+
+// Policy used when there are no free slots (or the instrument reached its polyphony cap)
+typedef enum {
+    VOICE_STEAL_NONE = 0,       // Drop the new note
+    VOICE_STEAL_OLDEST,         // Steal the voice that started first
+    VOICE_STEAL_SAME_NOTE,      // Steal the oldest voice playing the same note. Fall back to the oldest voice
+    VOICE_STEAL_LOWEST_VELOCITY // Steal the voice with the lowest velocity. The oldest one wins on ties
+} VOICE_STEAL_POLICY_e;
+
 
 // Voice tracking
 typedef struct {
@@ -18,8 +32,40 @@ typedef struct {
     uint16_t previous_voice_slot;
     uint16_t next_voice_slot;
     uint16_t slot_is_last;
+    uint8_t  note;                // MIDI note that requested the voice
+    uint8_t  velocity;            // MIDI velocity that requested the voice
+    uint8_t  instrument;          // Instrument that owns the voice
+    void    *owner;               // Cookie passed back to the release callback
 } VOICE_TRK_t;
 
+// Information of the note requesting a voice
+typedef struct {
+    uint8_t  note;
+    uint8_t  velocity;
+    uint8_t  instrument;          // VOICE_INSTRUMENT_NONE if the voice doesn't belong to an instrument
+    void    *owner;
+} VOICE_ALLOC_INFO_t;
+
+// Loop points of a sample. Byte offsets from the sample address
+// The HW loops on DMA bursts, so the points are rounded to SAMPLER_DMA_BURST_BYTES
+typedef struct {
+    uint32_t loop_start;          // First byte of the loop
+    uint32_t loop_end;            // First byte after the loop. The sample is not read past this point
+} VOICE_LOOP_INFO_t;
+
+// Allocator statistics
+typedef struct {
+    uint32_t allocations;         // Voices started
+    uint32_t steals;              // Voices taken away from a playing note
+    uint32_t cap_steals;          // Steals caused by the instrument polyphony cap
+    uint32_t drops;               // Notes that could not get a voice
+    uint32_t reaped;              // Voices released because the sample was fully played
+    uint32_t peak_active;         // Maximum number of voices played at the same time
+} VOICE_ALLOC_STATS_t;
+
+// Called when a voice slot is taken away from its owner (i.e. stolen or fully played)
+typedef void (*VOICE_RELEASE_CALLBACK_t)( uint32_t voice_slot, void *owner );
+
 //////////////////////////////////////////
 // Voice Information Data Structure
 // This data structure will be accessed by
@@ -40,6 +86,21 @@ typedef struct {
 
 void     vSamplerDMAInit ( void );
 uint32_t ulStopVoicePlayback( uint32_t voice_slot_number );
-uint32_t ulStartVoicePlayback( uint32_t sample_addr, uint32_t sample_size );
+uint32_t ulStartVoicePlayback( uint32_t sample_addr, uint32_t sample_size, const VOICE_LOOP_INFO_t *loop_info, uint32_t phase_inc, const VOICE_ALLOC_INFO_t *alloc_info );
+uint32_t ulAlignVoiceLoop( uint32_t sample_size, VOICE_LOOP_INFO_t *loop_info );
+void     vStopAllVoicePlayback( void );
+void     vSamplerDMACommit( void );
+uint32_t ulReapFinishedVoices( void );
+
+// Voice allocator configuration
+void                 vSetVoiceStealPolicy( VOICE_STEAL_POLICY_e policy );
+VOICE_STEAL_POLICY_e xGetVoiceStealPolicy( void );
+uint32_t             ulSetInstrumentPolyphonyCap( uint8_t instrument, uint8_t cap );
+uint32_t             ulGetInstrumentVoiceUsage( uint8_t instrument, uint8_t *active_voices, uint8_t *cap );
+void                 vSetVoiceReleaseCallback( VOICE_RELEASE_CALLBACK_t callback );
+uint32_t             ulGetNumberOfActiveVoices( void );
+void               * pvGetVoiceOwner( uint32_t voice_slot );
+void                 vGetVoiceAllocStats( VOICE_ALLOC_STATS_t *stats );
+void                 vClearVoiceAllocStats( void );
 
 #endif
\ No newline at end of file
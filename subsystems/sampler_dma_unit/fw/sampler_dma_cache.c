@@ -0,0 +1,93 @@
+////////////////////////////////////////////////
+// Sampler DMA Cache Maintenance
+////////////
+// This file contains the cache policy of the
+// memory shared with the Sampler DMA:
+// - The sample memory is cleaned by range, once,
+//   when it's loaded. The DMA only reads it
+// - The DMA registers are device memory, so they
+//   are never cached. They only need barriers
+// Every operation is timed with the global timer
+///////////////////////////////////////////////
+
+// C includes
+#include <stddef.h>
+
+// Xilinx Includes
+#include "xparameters.h"
+#include "xil_cache.h"
+#include "xil_mmu.h"
+#include "xpseudo_asm.h"
+#include "xtime_l.h"
+
+// Sampler DMA Includes
+#include "sampler_dma_controller_regs.h"
+#include "sampler_dma_cache.h"
+
+// Private functions
+static void prv_vUpdateStats( SAMPLER_CACHE_OP_e op, XTime start_time, uint32_t bytes );
+
+// Statistics
+static SAMPLER_CACHE_STATS_t cache_stats[SAMPLER_CACHE_NUM_OF_OPS];
+
+// This function initializes the cache policy
+void vSamplerCacheInit( void ) {
+
+    // Make sure that the registers are mapped as device memory (1MB section)
+    // The control and the DMA registers are both in the same section
+    Xil_SetTlbAttributes( (INTPTR) SAMPLER_BASE_ADDR, DEVICE_MEMORY );
+
+    vClearSamplerCacheStats();
+}
+
+// This function cleans the sample memory so that the DMA reads the data written by the CPU
+// Call it once after the sample is in its final location, not on every playback
+void vSamplerCacheFlushSampleRange( const void *sample_addr, uint32_t sample_size ) {
+    XTime start_time;
+
+    if( sample_addr == NULL || sample_size == 0 ) return;
+
+    XTime_GetTime( &start_time );
+    Xil_DCacheFlushRange( (INTPTR) sample_addr, sample_size );
+    prv_vUpdateStats( SAMPLER_CACHE_OP_SAMPLE_FLUSH, start_time, sample_size );
+}
+
+// This function waits for the register writes to complete
+// Use it before the writes that make the previous ones visible to the DMA (i.e. START)
+void vSamplerCacheRegisterBarrier( void ) {
+    XTime start_time;
+
+    XTime_GetTime( &start_time );
+    dsb();
+    prv_vUpdateStats( SAMPLER_CACHE_OP_REG_BARRIER, start_time, 0 );
+}
+
+// This function updates the statistics of an operation
+static void prv_vUpdateStats( SAMPLER_CACHE_OP_e op, XTime start_time, uint32_t bytes ) {
+    XTime end_time;
+    XTime elapsed_time;
+
+    XTime_GetTime( &end_time );
+    elapsed_time = end_time - start_time;
+
+    cache_stats[op].count++;
+    cache_stats[op].bytes      += bytes;
+    cache_stats[op].total_time += elapsed_time;
+    if( elapsed_time > cache_stats[op].max_time ) cache_stats[op].max_time = elapsed_time;
+}
+
+// This function returns the statistics of an operation
+void vGetSamplerCacheStats( SAMPLER_CACHE_OP_e op, SAMPLER_CACHE_STATS_t *stats ) {
+    if( stats == NULL || op >= SAMPLER_CACHE_NUM_OF_OPS ) return;
+    *stats = cache_stats[op];
+}
+
+// This function clears the statistics
+void vClearSamplerCacheStats( void ) {
+    for( int i = 0; i < SAMPLER_CACHE_NUM_OF_OPS; i++ ) {
+        cache_stats[ i ].count      = 0;
+        cache_stats[ i ].bytes      = 0;
+        cache_stats[ i ].total_time = 0;
+        cache_stats[ i ].max_time   = 0;
+    }
+}
@@ -16,6 +16,8 @@
 // Sampler Register Utils
 #include "sampler_dma_controller_regs.h"
 #include "sampler_dma_controller_reg_utils.h"
+#include "sampler_dma_voice_pb.h"
+#include "sampler_dma_cache.h"
 
 // Sampler DMA Controller CLI Apps
 #include "sampler_dma_controller_CLI_apps.h"
@@ -26,6 +28,13 @@
 
 static BaseType_t prv_xSamplerRegCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 static BaseType_t prv_xGetSamplerHWVersionCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prv_xVoiceStatsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prv_xVoicePolicyCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prv_xCacheStatsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+
+// Names of the voice steal policies (same order as VOICE_STEAL_POLICY_e)
+static const char *voice_steal_policy_names[] = { "none", "oldest", "same_note", "lowest_velocity" };
+#define NUM_OF_VOICE_STEAL_POLICIES ( sizeof( voice_steal_policy_names ) / sizeof( voice_steal_policy_names[0] ) )
 
 // This function converts an string in int or hex to a uint32_t
 static uint32_t prv_ulStr2Int( const char *input_string, BaseType_t input_string_length ) {
@@ -64,10 +73,40 @@ static const CLI_Command_Definition_t prv_xGetSamplerHWVersionCMD_definition =
     0 /* The user can enter any number of commands. */
 };
 
+// Command to print the voice allocator statistics
+static const CLI_Command_Definition_t prv_xVoiceStatsCMD_definition =
+{
+    "voice_stats",
+    "\r\nvoice_stats\r\n Prints the voice allocation/steal/drop statistics\r\n",
+    prv_xVoiceStatsCMD, /* The function to run. */
+    0 /* No parameters are expected. */
+};
+
+// Command to configure the voice allocator
+static const CLI_Command_Definition_t prv_xVoicePolicyCMD_definition =
+{
+    "voice_policy",
+    "\r\nvoice_policy <none|oldest|same_note|lowest_velocity> <INSTRUMENT> <CAP>\r\n Sets the voice steal policy and the polyphony cap of an instrument (0 = no cap)\r\n",
+    prv_xVoicePolicyCMD, /* The function to run. */
+    3 /* 3 parameters are expected. */
+};
+
+// Command to print the cache maintenance statistics
+static const CLI_Command_Definition_t prv_xCacheStatsCMD_definition =
+{
+    "cache_stats",
+    "\r\ncache_stats\r\n Prints the count and time of the sample flushes and register barriers. The statistics are cleared after printing\r\n",
+    prv_xCacheStatsCMD, /* The function to run. */
+    0 /* No parameters are expected. */
+};
+
 // Register all the CLI commands
 void vRegisterSamplerDMAControllerCLICommands( void ) {
     FreeRTOS_CLIRegisterCommand( &prv_xSamplerRegCMD_definition );         // Sampler Read/Write Command
    	FreeRTOS_CLIRegisterCommand( &prv_xGetSamplerHWVersionCMD_definition ); // Get sampler version
+    FreeRTOS_CLIRegisterCommand( &prv_xVoiceStatsCMD_definition );          // Voice allocator statistics
+    FreeRTOS_CLIRegisterCommand( &prv_xVoicePolicyCMD_definition );         // Voice allocator configuration
+    FreeRTOS_CLIRegisterCommand( &prv_xCacheStatsCMD_definition );          // Cache maintenance statistics
 
 }
 
@@ -221,3 +260,116 @@ static BaseType_t prv_xGetSamplerHWVersionCMD( char *pcWriteBuffer, size_t xWrit
 
     return xReturn;
 }
+
+// This command prints the statistics of the voice allocator
+static BaseType_t prv_xVoiceStatsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+    BaseType_t          xReturn;
+    VOICE_ALLOC_STATS_t stats;
+    uint32_t            policy;
+    static BaseType_t   command_done = pdFALSE;
+
+    ( void ) pcCommandString;
+    configASSERT( pcWriteBuffer );
+
+    if ( command_done != pdTRUE ) {
+        vGetVoiceAllocStats( &stats );
+        policy = (uint32_t) xGetVoiceStealPolicy();
+
+        memset( pcWriteBuffer, 0x00, xWriteBufferLen ); // Initialize the buffer
+        snprintf( pcWriteBuffer, xWriteBufferLen,
+                  "Policy      = %s\n\rActive      = %lu\n\rPeak        = %lu\n\rAllocations = %lu\n\rSteals      = %lu (cap = %lu)\n\rDrops       = %lu\n\rReaped      = %lu",
+                  ( policy < NUM_OF_VOICE_STEAL_POLICIES ) ? voice_steal_policy_names[policy] : "unknown",
+                  ulGetNumberOfActiveVoices(), stats.peak_active, stats.allocations, stats.steals, stats.cap_steals, stats.drops, stats.reaped );
+        APPEND_NEWLINE(pcWriteBuffer);
+
+        command_done = pdTRUE;
+        xReturn      = pdTRUE; // Come back to re-initialize the variables
+    } else {
+        pcWriteBuffer[ 0 ] = 0x00;
+        xReturn      = pdFALSE;
+        command_done = pdFALSE;
+    }
+
+    return xReturn;
+}
+
+// This command sets the voice steal policy and the polyphony cap of an instrument
+static BaseType_t prv_xVoicePolicyCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+    const char *policy_name;
+    const char *instrument;
+    const char *cap;
+    BaseType_t  xPolicyStringLength;
+    BaseType_t  xInstrumentStringLength;
+    BaseType_t  xCapStringLength;
+    uint32_t    policy;
+    uint32_t    instrument_int;
+    uint32_t    cap_int;
+
+    configASSERT( pcWriteBuffer );
+
+    policy_name = FreeRTOS_CLIGetParameter( pcCommandString, 1, &xPolicyStringLength );
+    instrument  = FreeRTOS_CLIGetParameter( pcCommandString, 2, &xInstrumentStringLength );
+    cap         = FreeRTOS_CLIGetParameter( pcCommandString, 3, &xCapStringLength );
+
+    memset( pcWriteBuffer, 0x00, xWriteBufferLen ); // Initialize the buffer
+
+    for ( policy = 0; policy < NUM_OF_VOICE_STEAL_POLICIES; policy++ ) {
+        if ( ( strlen( voice_steal_policy_names[policy] ) == (size_t) xPolicyStringLength ) &&
+             ( strncmp( policy_name, voice_steal_policy_names[policy], xPolicyStringLength ) == 0 ) ) break;
+    }
+
+    if ( policy == NUM_OF_VOICE_STEAL_POLICIES ) {
+        sprintf( pcWriteBuffer, "[ERROR] - Unknown policy" );
+        APPEND_NEWLINE(pcWriteBuffer);
+        return pdFALSE;
+    }
+
+    instrument_int = prv_ulStr2Int( instrument, xInstrumentStringLength );
+    cap_int        = prv_ulStr2Int( cap, xCapStringLength );
+
+    if ( ulSetInstrumentPolyphonyCap( (uint8_t) instrument_int, (uint8_t) cap_int ) ) {
+        sprintf( pcWriteBuffer, "[ERROR] - Instrument must be lower than %d", MAX_VOICE_INSTRUMENTS );
+        APPEND_NEWLINE(pcWriteBuffer);
+        return pdFALSE;
+    }
+
+    vSetVoiceStealPolicy( (VOICE_STEAL_POLICY_e) policy );
+
+    sprintf( pcWriteBuffer, "Voice steal policy = %s. Instrument %lu cap = %lu", voice_steal_policy_names[policy], instrument_int, cap_int );
+    APPEND_NEWLINE(pcWriteBuffer);
+
+    return pdFALSE;
+}
+
+// This command prints the statistics of the cache maintenance operations
+static BaseType_t prv_xCacheStatsCMD( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString ) {
+    BaseType_t            xReturn;
+    SAMPLER_CACHE_STATS_t flush_stats;
+    SAMPLER_CACHE_STATS_t barrier_stats;
+    static BaseType_t     command_done = pdFALSE;
+
+    ( void ) pcCommandString;
+    configASSERT( pcWriteBuffer );
+
+    if ( command_done != pdTRUE ) {
+        vGetSamplerCacheStats( SAMPLER_CACHE_OP_SAMPLE_FLUSH, &flush_stats );
+        vGetSamplerCacheStats( SAMPLER_CACHE_OP_REG_BARRIER,  &barrier_stats );
+        vClearSamplerCacheStats();
+
+        memset( pcWriteBuffer, 0x00, xWriteBufferLen ); // Initialize the buffer
+        snprintf( pcWriteBuffer, xWriteBufferLen,
+                  "Sample flushes   = %lu (%lu bytes) | Total = %lu us | Max = %lu us\n\rRegister barriers = %lu | Total = %lu us | Max = %lu us",
+                  flush_stats.count, flush_stats.bytes, SAMPLER_CACHE_COUNTS_TO_US( flush_stats.total_time ), SAMPLER_CACHE_COUNTS_TO_US( flush_stats.max_time ),
+                  barrier_stats.count, SAMPLER_CACHE_COUNTS_TO_US( barrier_stats.total_time ), SAMPLER_CACHE_COUNTS_TO_US( barrier_stats.max_time ) );
+        APPEND_NEWLINE(pcWriteBuffer);
+
+        command_done = pdTRUE;
+        xReturn      = pdTRUE; // Come back to re-initialize the variables
+    } else {
+        pcWriteBuffer[ 0 ] = 0x00;
+        xReturn      = pdFALSE;
+        command_done = pdFALSE;
+    }
+
+    return xReturn;
+}
@@ -5,19 +5,26 @@
 // that control the polyphonic voice playback
 ///////////////////////////////////////////////
 
+// C includes
+#include <stddef.h>
+
 // Xilinx Includes
 #include "xparameters.h"
 #include "xil_io.h"
-#include "xil_cache.h"
 
 // Sampler DMA Includes
 #include "sampler_dma_controller_regs.h"
 #include "sampler_dma_controller_reg_utils.h"
 #include "sampler_dma_voice_pb.h"
+#include "sampler_dma_cache.h"
 
 // Private functions
-uint16_t prv_usGetAvailableVoiceSlot( void );
+uint16_t prv_usGetAvailableVoiceSlot( const VOICE_ALLOC_INFO_t *alloc_info );
+uint16_t prv_usFindVictimSlot( const VOICE_ALLOC_INFO_t *alloc_info, uint8_t instrument );
+void     prv_vStealSlot( uint16_t slot );
 void     prv_vReleaseSlot( uint16_t slot );
+void     prv_vClearShadowRegisters( void );
+void     prv_vWriteSlotRegisters( uint16_t slot );
 
 // Tracking variables
 static VOICE_TRK_t     sampler_voices[MAX_VOICES];
@@ -25,6 +32,39 @@ static uint8_t         last_voice_slot;
 static uint8_t         number_of_active_slots;
 static SAMPLER_VOICE_t sampler_voices_information[MAX_VOICES];
 
+// Allocator variables
+// Free slot bitmap. Slot N is bit (31 - N%32) of word N/32, so the
+// count of leading zeros of a word is directly the lowest free slot
+static uint32_t                 free_slot_bitmap[VOICE_FREE_BITMAP_WORDS];
+static VOICE_STEAL_POLICY_e     steal_policy = VOICE_STEAL_OLDEST;
+static uint8_t                  instrument_cap[MAX_VOICE_INSTRUMENTS];
+static uint8_t                  instrument_active_slots[MAX_VOICE_INSTRUMENTS];
+static VOICE_RELEASE_CALLBACK_t release_callback = NULL;
+static VOICE_ALLOC_STATS_t      alloc_stats;
+static uint8_t                  hw_has_voices_done;
+static uint8_t                  hw_has_loops;
+static uint8_t                  hw_has_pitch;
+
+// Shadow copy of the DMA slot registers
+// ulStartVoicePlayback()/ulStopVoicePlayback() only update the shadow copy
+// vSamplerDMACommit() writes all the changes to the HW in one burst
+static SAMPLER_DMA_t shadow_dma[MAX_VOICES];
+static uint8_t       shadow_dirty[MAX_VOICES];                  // Words of each slot to write (SHADOW_DIRTY_*)
+static uint32_t      shadow_started[VOICE_FREE_BITMAP_WORDS];   // Slots started since the last commit
+static uint8_t       commit_start_pending;                      // A voice was started since the last commit
+static uint8_t       commit_chain_emptied;                      // All the voices were stopped since the last commit
+
+#define SHADOW_DIRTY_START_ADDR  0x1
+#define SHADOW_DIRTY_END_ADDR    0x2
+#define SHADOW_DIRTY_CONTROL     0x4
+#define SHADOW_DIRTY_NEXT        0x8
+#define SHADOW_DIRTY_ALL         0xf
+
+#define SLOT_BIT(SLOT)       ( 0x80000000 >> ( (SLOT) & 0x1f ) )
+#define SLOT_WORD(SLOT)      ( (SLOT) >> 5 )
+#define SET_SLOT_FREE(SLOT)  ( free_slot_bitmap[SLOT_WORD(SLOT)] |=  SLOT_BIT(SLOT) )
+#define SET_SLOT_USED(SLOT)  ( free_slot_bitmap[SLOT_WORD(SLOT)] &= ~SLOT_BIT(SLOT) )
+
 // Initialize the sampler registers
 void vSamplerDMAInit ( void ) {
 
@@ -36,58 +76,225 @@ void vSamplerDMAInit ( void ) {
         sampler_voices[ i ].previous_voice_slot = 0;
         sampler_voices[ i ].next_voice_slot     = 0;
         sampler_voices[ i ].slot_is_last        = 0;
+        sampler_voices[ i ].instrument          = VOICE_INSTRUMENT_NONE;
+        sampler_voices[ i ].owner               = NULL;
+    }
+
+    // Initialize the allocator. All slots are free and there are no caps
+    for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) free_slot_bitmap[ i ] = 0xffffffff;
+    for( int i = 0; i < MAX_VOICE_INSTRUMENTS; i++ ) {
+        instrument_cap[ i ]          = MAX_VOICES;
+        instrument_active_slots[ i ] = 0;
+    }
+
+    vClearVoiceAllocStats();
+
+    // Initialize the shadow registers and the cache policy
+    prv_vClearShadowRegisters();
+    vSamplerCacheInit();
+
+    // Check if the HW reports the finished voices. If not, the overflow bit of each slot has to be polled
+    hw_has_voices_done = ( ulGetDMAEngineHWVersion() >= SAMPLER_VOICES_DONE_MIN_VERSION );
+    hw_has_loops       = ( ulGetDMAEngineHWVersion() >= SAMPLER_LOOP_MIN_VERSION );
+    hw_has_pitch       = ( ulGetDMAEngineHWVersion() >= SAMPLER_PITCH_MIN_VERSION );
+    if( hw_has_voices_done ) {
+        SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_VOICES_DONE_REG[0].value = 0xffffffff;
+        SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_VOICES_DONE_REG[1].value = 0xffffffff;
     }
 
 }
 
+// This function selects the policy used to steal voices
+void vSetVoiceStealPolicy( VOICE_STEAL_POLICY_e policy ) {
+    steal_policy = policy;
+}
+
+VOICE_STEAL_POLICY_e xGetVoiceStealPolicy( void ) {
+    return steal_policy;
+}
+
+// This function limits the number of voices an instrument can play at the same time
+// A cap of 0 removes the limit
+uint32_t ulSetInstrumentPolyphonyCap( uint8_t instrument, uint8_t cap ) {
+    if( instrument >= MAX_VOICE_INSTRUMENTS ) return 1;
+    if( cap == 0 || cap > MAX_VOICES ) cap = MAX_VOICES;
+
+    instrument_cap[ instrument ] = cap;
+    return 0;
+}
+
+// This function returns the number of voices an instrument is playing and its polyphony cap
+uint32_t ulGetInstrumentVoiceUsage( uint8_t instrument, uint8_t *active_voices, uint8_t *cap ) {
+    if( instrument >= MAX_VOICE_INSTRUMENTS ) return 1;
+
+    if( active_voices != NULL ) *active_voices = instrument_active_slots[ instrument ];
+    if( cap           != NULL ) *cap           = instrument_cap[ instrument ];
+    return 0;
+}
+
+// This function registers the function to call when a voice is stolen from its owner
+void vSetVoiceReleaseCallback( VOICE_RELEASE_CALLBACK_t callback ) {
+    release_callback = callback;
+}
+
+uint32_t ulGetNumberOfActiveVoices( void ) {
+    return number_of_active_slots;
+}
+
+// This function returns the owner of an active voice slot (NULL if the slot is free)
+void * pvGetVoiceOwner( uint32_t voice_slot ) {
+    if( voice_slot >= MAX_VOICES || sampler_voices[ voice_slot ].voice_is_active == 0 ) return NULL;
+    return sampler_voices[ voice_slot ].owner;
+}
+
+void vGetVoiceAllocStats( VOICE_ALLOC_STATS_t *stats ) {
+    if( stats == NULL ) return;
+    *stats = alloc_stats;
+}
+
+void vClearVoiceAllocStats( void ) {
+    alloc_stats.allocations = 0;
+    alloc_stats.steals      = 0;
+    alloc_stats.cap_steals  = 0;
+    alloc_stats.drops       = 0;
+    alloc_stats.peak_active = 0;
+    alloc_stats.reaped      = 0;
+}
+
+// This function finds the voice to steal based on the steal policy
+// The chain is kept in playback order, so walking it from the first link visits the voices from oldest to newest
+// If instrument != VOICE_INSTRUMENT_NONE, only the voices of that instrument are considered
+uint16_t prv_usFindVictimSlot( const VOICE_ALLOC_INFO_t *alloc_info, uint8_t instrument ) {
+    uint16_t current_slot;
+    uint16_t oldest_slot   = VOICE_SLOT_NONE;
+    uint16_t victim_slot   = VOICE_SLOT_NONE;
+    uint16_t min_velocity  = 0xffff;
+
+    if( steal_policy == VOICE_STEAL_NONE || number_of_active_slots == 0 ) return VOICE_SLOT_NONE;
+
+    // The first link of the chain is the one after the last link
+    current_slot = sampler_voices[ last_voice_slot ].next_voice_slot;
+
+    for( int i = 0; i < number_of_active_slots; i++ ) {
+
+        if( instrument == VOICE_INSTRUMENT_NONE || sampler_voices[ current_slot ].instrument == instrument ) {
+
+            if( oldest_slot == VOICE_SLOT_NONE ) oldest_slot = current_slot;
+
+            if( steal_policy == VOICE_STEAL_OLDEST ) break;
+
+            if( steal_policy == VOICE_STEAL_SAME_NOTE && alloc_info != NULL ) {
+                if( sampler_voices[ current_slot ].note       == alloc_info->note &&
+                    sampler_voices[ current_slot ].instrument == alloc_info->instrument ) {
+                    victim_slot = current_slot;
+                    break;
+                }
+            }
+
+            if( steal_policy == VOICE_STEAL_LOWEST_VELOCITY ) {
+                if( sampler_voices[ current_slot ].velocity < min_velocity ) {
+                    min_velocity = sampler_voices[ current_slot ].velocity;
+                    victim_slot  = current_slot;
+                }
+            }
+        }
+
+        current_slot = sampler_voices[ current_slot ].next_voice_slot;
+    }
+
+    if( victim_slot == VOICE_SLOT_NONE ) victim_slot = oldest_slot;
+
+    return victim_slot;
+}
+
+// This function stops a voice and notifies the owner that it has been taken away
+void prv_vStealSlot( uint16_t slot ) {
+    void *owner = sampler_voices[ slot ].owner;
+
+    ulStopVoicePlayback( slot );
+
+    if( release_callback != NULL ) release_callback( slot, owner );
+
+    alloc_stats.steals++;
+}
+
 // This function will return the number of the voice slot available to start the playback
-uint16_t prv_usGetAvailableVoiceSlot( void ) {
-    uint16_t current_slot     = 0xffff;
+uint16_t prv_usGetAvailableVoiceSlot( const VOICE_ALLOC_INFO_t *alloc_info ) {
+    uint16_t current_slot     = VOICE_SLOT_NONE;
+    uint16_t victim_slot      = VOICE_SLOT_NONE;
     uint16_t previous_slot    = 0;
     uint16_t next_slot        = 0;
+    uint8_t  instrument       = ( alloc_info != NULL ) ? alloc_info->instrument : VOICE_INSTRUMENT_NONE;
 
-    // Step 1 - Get the last link of the chain
-    previous_slot = last_voice_slot;
+    if( instrument >= MAX_VOICE_INSTRUMENTS ) instrument = VOICE_INSTRUMENT_NONE;
 
-    // If there are no voices playing
-    // Step 2 - Check if there are voices playing. If not, take slot 0
-    if( number_of_active_slots == 0 ){
-        current_slot = 0;
-        sampler_voices[ current_slot ].voice_is_active     = 1;
-        sampler_voices[ current_slot ].previous_voice_slot = 0;
-        sampler_voices[ current_slot ].next_voice_slot     = 0;
-        sampler_voices[ current_slot ].slot_is_last        = 1;
-        last_voice_slot                                    = 0;
-        previous_slot                                      = 0;
-        number_of_active_slots                             = number_of_active_slots + 1;
-        return current_slot;
+    // Step 1 - Check the polyphony cap of the instrument
+    if( instrument != VOICE_INSTRUMENT_NONE && instrument_active_slots[ instrument ] >= instrument_cap[ instrument ] ) {
+        victim_slot = prv_usFindVictimSlot( alloc_info, instrument );
+        if( victim_slot == VOICE_SLOT_NONE ) {
+            alloc_stats.drops++;
+            return VOICE_SLOT_NONE;
+        }
+        prv_vStealSlot( victim_slot );
+        alloc_stats.cap_steals++;
+    }
+
+    // Step 2 - If all the slots are busy, steal one
+    if( number_of_active_slots >= MAX_VOICES ) {
+        victim_slot = prv_usFindVictimSlot( alloc_info, VOICE_INSTRUMENT_NONE );
+        if( victim_slot == VOICE_SLOT_NONE ) {
+            alloc_stats.drops++;
+            return VOICE_SLOT_NONE;
+        }
+        prv_vStealSlot( victim_slot );
     }
 
-    // If there are voices playing
     // Step 3 - Get a free slot
-    for( current_slot = 0; current_slot < MAX_VOICES; current_slot ++ ){
-        if( sampler_voices[ current_slot ].voice_is_active == 0 ){
+    for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) {
+        if( free_slot_bitmap[ i ] != 0 ) {
+            current_slot = ( i << 5 ) + __builtin_clz( free_slot_bitmap[ i ] );
             break;
         }
     }
 
-    if( current_slot == 0xffff ) return current_slot;
-
-    next_slot = sampler_voices[ previous_slot ].next_voice_slot;
+    if( current_slot == VOICE_SLOT_NONE ) {
+        alloc_stats.drops++;
+        return current_slot;
+    }
 
     // Step 4 - Insert the voice slot into the link
-    sampler_voices[ current_slot ].previous_voice_slot = previous_slot;
-    sampler_voices[ current_slot ].next_voice_slot     = next_slot;
-    sampler_voices[ previous_slot ].next_voice_slot    = current_slot;
-    sampler_voices[ previous_slot ].slot_is_last       = 0;
-    sampler_voices[ next_slot ].previous_voice_slot    = current_slot; // The previous slot of the first item is the last item
+    if( number_of_active_slots == 0 ){
+        // If there are no voices playing, the slot is the only link of the chain
+        sampler_voices[ current_slot ].previous_voice_slot = current_slot;
+        sampler_voices[ current_slot ].next_voice_slot     = current_slot;
+    } else {
+        // If there are voices playing, the slot goes after the last link
+        previous_slot = last_voice_slot;
+        next_slot     = sampler_voices[ previous_slot ].next_voice_slot;
+
+        sampler_voices[ current_slot ].previous_voice_slot = previous_slot;
+        sampler_voices[ current_slot ].next_voice_slot     = next_slot;
+        sampler_voices[ previous_slot ].next_voice_slot    = current_slot;
+        sampler_voices[ previous_slot ].slot_is_last       = 0;
+        sampler_voices[ next_slot ].previous_voice_slot    = current_slot; // The previous slot of the first item is the last item
+    }
 
     // Step 5 - Enable the slot
     sampler_voices[ current_slot ].slot_is_last    = 1;
     sampler_voices[ current_slot ].voice_is_active = 1;
+    sampler_voices[ current_slot ].note            = ( alloc_info != NULL ) ? alloc_info->note     : 0;
+    sampler_voices[ current_slot ].velocity        = ( alloc_info != NULL ) ? alloc_info->velocity : 0;
+    sampler_voices[ current_slot ].owner           = ( alloc_info != NULL ) ? alloc_info->owner    : NULL;
+    sampler_voices[ current_slot ].instrument      = instrument;
     last_voice_slot                                = current_slot;
     number_of_active_slots                         = number_of_active_slots + 1;
+    SET_SLOT_USED( current_slot );
 
+    if( instrument != VOICE_INSTRUMENT_NONE ) instrument_active_slots[ instrument ]++;
+
+    // Step 6 - Update the statistics
+    alloc_stats.allocations++;
+    if( number_of_active_slots > alloc_stats.peak_active ) alloc_stats.peak_active = number_of_active_slots;
 
     return current_slot;
 }
@@ -99,21 +306,10 @@ void prv_vReleaseSlot( uint16_t slot ) {
     // Sanity check. Check if there are any voices playing
     if( number_of_active_slots == 0 || number_of_active_slots > MAX_VOICES ) return;
     // Sanity check. Check if slot is valid
-    if( slot > MAX_VOICES ) return;
-
-    // If this is the last voice remaining
-    if( number_of_active_slots == 1 ){
-        // Clean all slots
-        for ( int i = 0; i < MAX_VOICES; i++){
-            sampler_voices[ i ].previous_voice_slot = 0;
-            sampler_voices[ i ].next_voice_slot     = 0;
-            sampler_voices[ i ].slot_is_last        = 0;
-            sampler_voices[ i ].voice_is_active     = 0;
-        }
-        last_voice_slot        = 0;
-        number_of_active_slots = 0;
-    } else {
-        // If there are more voices playing
+    if( slot >= MAX_VOICES || sampler_voices[ slot ].voice_is_active == 0 ) return;
+
+    // If there are more voices playing, remove the slot from the chain
+    if( number_of_active_slots > 1 ){
         // Get the previous slot
         previous_slot = sampler_voices[ slot ].previous_voice_slot;
         next_slot     = sampler_voices[ slot ].next_voice_slot;
@@ -127,102 +323,309 @@ void prv_vReleaseSlot( uint16_t slot ) {
             sampler_voices[ previous_slot ].slot_is_last = 1;
             last_voice_slot = previous_slot;
         }
-
-        // Clear the slot
-        sampler_voices[ slot ].previous_voice_slot = 0;
-        sampler_voices[ slot ].next_voice_slot     = 0;
-        sampler_voices[ slot ].slot_is_last        = 0;
-        sampler_voices[ slot ].voice_is_active     = 0;
-        number_of_active_slots                     = number_of_active_slots - 1;
+    } else {
+        last_voice_slot      = 0;
+        commit_chain_emptied = 1;
     }
 
+    if( sampler_voices[ slot ].instrument < MAX_VOICE_INSTRUMENTS ) instrument_active_slots[ sampler_voices[ slot ].instrument ]--;
+
+    // Clear the slot
+    sampler_voices[ slot ].previous_voice_slot = 0;
+    sampler_voices[ slot ].next_voice_slot     = 0;
+    sampler_voices[ slot ].slot_is_last        = 0;
+    sampler_voices[ slot ].voice_is_active     = 0;
+    sampler_voices[ slot ].instrument          = VOICE_INSTRUMENT_NONE;
+    sampler_voices[ slot ].owner               = NULL;
+    number_of_active_slots                     = number_of_active_slots - 1;
+    SET_SLOT_FREE( slot );
+
+}
+
+// This function rounds the loop points to the ones used by the HW
+// Loops are aligned to the DMA bursts. The loop end is rounded down (the sample can't be read past it)
+// and the loop length is rounded to the nearest burst
+// Returns 1 if the loop can't be played (the sample is played as a one-shot)
+uint32_t ulAlignVoiceLoop( uint32_t sample_size, VOICE_LOOP_INFO_t *loop_info ) {
+    uint32_t loop_bursts;
+    uint32_t loop_end;
+
+    if( loop_info == NULL || loop_info->loop_end <= loop_info->loop_start ) return 1;
+    if( loop_info->loop_end > sample_size || loop_info->loop_end < SAMPLER_DMA_BURST_BYTES ) return 1;
+
+    loop_end    = loop_info->loop_end & ~( SAMPLER_DMA_BURST_BYTES - 1 );
+    loop_bursts = ( loop_info->loop_end - loop_info->loop_start + ( SAMPLER_DMA_BURST_BYTES / 2 ) ) / SAMPLER_DMA_BURST_BYTES;
+    if( loop_bursts == 0 ) loop_bursts = 1;
+    if( loop_bursts > ( loop_end / SAMPLER_DMA_BURST_BYTES ) ) loop_bursts = loop_end / SAMPLER_DMA_BURST_BYTES;
+    if( loop_bursts > 0xffff ) loop_bursts = 0xffff;
+
+    loop_info->loop_end   = loop_end;
+    loop_info->loop_start = loop_end - ( loop_bursts * SAMPLER_DMA_BURST_BYTES );
+
+    return 0;
 }
 
 // This function will trigger the playback of a voice based on the voice information
-uint32_t ulStartVoicePlayback( uint32_t sample_addr, uint32_t sample_size ) {
+// loop_info can be NULL for one-shot samples. It's ignored if the HW doesn't support loops
+// phase_inc is the playback rate in 1/SAMPLER_PHASE_INC_UNITY units. 0 or SAMPLER_PHASE_INC_UNITY play the
+// sample at its original rate. It's ignored if the HW doesn't support pitched playback
+// alloc_info can be NULL if the voice doesn't belong to any note (i.e. test tones)
+// The HW is only updated on the next vSamplerDMACommit()
+uint32_t ulStartVoicePlayback( uint32_t sample_addr, uint32_t sample_size, const VOICE_LOOP_INFO_t *loop_info, uint32_t phase_inc, const VOICE_ALLOC_INFO_t *alloc_info ) {
     uint32_t voice_slot          = 0;
     uint32_t previous_voice_slot = 0;
-    uint32_t number_of_samples   = 0;
+    uint32_t loop_bursts         = 0;
+    VOICE_LOOP_INFO_t         hw_loop_info;
     SAMPLER_DMA_CONTROL_REG_t temp_ctrl_reg;
-    SAMPLER_DMA_CONTROL_REG_t temp_ctrl_reg2;
 
+    if( loop_info != NULL && hw_has_loops ) {
+        hw_loop_info = *loop_info;
+        if( ulAlignVoiceLoop( sample_size, &hw_loop_info ) == 0 ) {
+            sample_size = hw_loop_info.loop_end;
+            loop_bursts = ( hw_loop_info.loop_end - hw_loop_info.loop_start ) / SAMPLER_DMA_BURST_BYTES;
+        }
+    }
+
+    // The resampler can only slow down the playback
+    if( hw_has_pitch == 0 || phase_inc >= SAMPLER_PHASE_INC_UNITY ) phase_inc = 0;
 
     // Step 1 - Get a voice slot
-    voice_slot = prv_usGetAvailableVoiceSlot();
-    if( voice_slot == 0xffff ) return voice_slot;
-
-    // Step 2 - Calculate Number of sampler
-    number_of_samples = sample_size / 4; // 2x16-bit samples
+    voice_slot = prv_usGetAvailableVoiceSlot( alloc_info );
+    if( voice_slot == VOICE_SLOT_NONE ) return voice_slot;
 
-    // Step 3 - Load the voice information data structure
+    // Step 2 - Load the voice information data structure
     sampler_voices_information[voice_slot].voice_start_addr = sample_addr;
     sampler_voices_information[voice_slot].voice_size       = sample_size;
 
-    // Step 4 - Write the voice information address to the register with the slot number
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_start_addr.value = sample_addr;
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_end_addr.value   = sample_addr + sample_size;
+    // Step 3 - Write the voice information address to the register with the slot number
+    shadow_dma[voice_slot].dma_start_addr.value = sample_addr;
+    shadow_dma[voice_slot].dma_end_addr.value   = sample_addr + sample_size;
 
     // Set the control register
-    temp_ctrl_reg.value         = 0; // Initialize
-    temp_ctrl_reg.field.dma_len = number_of_samples;
-    temp_ctrl_reg.field.valid   = 1;
-    temp_ctrl_reg.field.last    = (uint32_t) sampler_voices[voice_slot].slot_is_last;
-
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_control.value    = 0;
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_control.value    = temp_ctrl_reg.value;
-
-    // Step 6 - Add the voice to the chain
+    // The phase fraction and the resampler history start from scratch
+    temp_ctrl_reg.value           = 0; // Initialize
+    temp_ctrl_reg.field.phase_inc = phase_inc;
+    temp_ctrl_reg.field.valid     = 1;
+    temp_ctrl_reg.field.last      = (uint32_t) sampler_voices[voice_slot].slot_is_last;
+    temp_ctrl_reg.field.loop      = ( loop_bursts != 0 );
+
+    shadow_dma[voice_slot].dma_control.value              = temp_ctrl_reg.value;
+    shadow_dma[voice_slot].dma_next_sample.value          = 0;
+    shadow_dma[voice_slot].dma_next_sample.field.loop_len = loop_bursts;
+
+    // Step 4 - Add the voice to the chain
     if ( number_of_active_slots > 1 ) {
-        previous_voice_slot       = sampler_voices[voice_slot].previous_voice_slot;
-        temp_ctrl_reg2.value      = SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_control.value;
-        temp_ctrl_reg2.field.last = sampler_voices[previous_voice_slot].slot_is_last & 0x1;
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_next_sample.value          = ( sampler_voices[voice_slot].next_voice_slot & 0xffff );
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_control.value     = temp_ctrl_reg2.value;
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_next_sample.value = ( voice_slot & 0xffff );
+        previous_voice_slot = sampler_voices[voice_slot].previous_voice_slot;
+        shadow_dma[voice_slot].dma_next_sample.field.dma_next_sample = sampler_voices[voice_slot].next_voice_slot;
+        shadow_dma[previous_voice_slot].dma_control.field.last                = sampler_voices[previous_voice_slot].slot_is_last & 0x1;
+        shadow_dma[previous_voice_slot].dma_next_sample.field.dma_next_sample = voice_slot;
+        shadow_dirty[previous_voice_slot]                                    |= SHADOW_DIRTY_CONTROL | SHADOW_DIRTY_NEXT;
     } else {
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_next_sample.value = voice_slot;
+        shadow_dma[voice_slot].dma_next_sample.field.dma_next_sample = voice_slot;
     }
 
-    // Step 6 - Start the DMA
-    SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_START;
-
-    Xil_DCacheFlush();
+    // Step 5 - Mark the slot to be written and the DMA to be started
+    shadow_dirty[voice_slot]                |= SHADOW_DIRTY_ALL;
+    shadow_started[SLOT_WORD(voice_slot)]   |= ( 1U << ( voice_slot & 0x1f ) );
+    commit_start_pending                     = 1;
 
     return voice_slot;
 }
 
 // This function will stop the playback of the voice
+// The HW is only updated on the next vSamplerDMACommit()
 uint32_t ulStopVoicePlayback( uint32_t voice_slot ) {
-    uint32_t                  previous_voice_slot = 0;
-    SAMPLER_DMA_CONTROL_REG_t temp_ctrl_reg;
+    uint32_t previous_voice_slot = 0;
 
     // Sanity check
     if( voice_slot >= MAX_VOICES ) return 1;
+    if( sampler_voices[voice_slot].voice_is_active == 0 ) return 1;
 
     // Step 1 - Remove the sample from the chain
     if ( number_of_active_slots > 1 ) {
         previous_voice_slot = sampler_voices[voice_slot].previous_voice_slot;
-        temp_ctrl_reg.value = SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_control.value;
 
-        if ( sampler_voices[voice_slot].slot_is_last ) temp_ctrl_reg.field.last = 1;
+        if ( sampler_voices[voice_slot].slot_is_last ) shadow_dma[previous_voice_slot].dma_control.field.last = 1;
 
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_control.value     = temp_ctrl_reg.value;
-        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[previous_voice_slot].dma_next_sample.value = sampler_voices[voice_slot].next_voice_slot;
-    } else {
-        // Fully stop the DMA
-        SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_STOP;
+        shadow_dma[previous_voice_slot].dma_next_sample.field.dma_next_sample = sampler_voices[voice_slot].next_voice_slot;
+        shadow_dirty[previous_voice_slot]                                    |= SHADOW_DIRTY_CONTROL | SHADOW_DIRTY_NEXT;
     }
 
     // Step 2 - Clear the DMA
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_start_addr.value  = 0;
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_end_addr.value    = 0;
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_control.value     = 0;
-    SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_next_sample.value = 0;
+    shadow_dma[voice_slot].dma_start_addr.value  = 0;
+    shadow_dma[voice_slot].dma_end_addr.value    = 0;
+    shadow_dma[voice_slot].dma_control.value     = 0;
+    shadow_dma[voice_slot].dma_next_sample.value = 0;
+    shadow_dirty[voice_slot]                    |= SHADOW_DIRTY_ALL;
 
-    Xil_DCacheFlush();
-
-    // Release the voice slot
+    // Release the voice slot. If this was the last voice, the DMA is stopped on commit
     prv_vReleaseSlot( voice_slot );
 
     return 0;
 }
+
+// This function writes the dirty words of a slot to the HW
+void prv_vWriteSlotRegisters( uint16_t slot ) {
+    uint8_t dirty = shadow_dirty[slot];
+
+    if( dirty & SHADOW_DIRTY_START_ADDR ) SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[slot].dma_start_addr.value  = shadow_dma[slot].dma_start_addr.value;
+    if( dirty & SHADOW_DIRTY_END_ADDR   ) SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[slot].dma_end_addr.value    = shadow_dma[slot].dma_end_addr.value;
+    if( dirty & SHADOW_DIRTY_CONTROL    ) SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[slot].dma_control.value     = shadow_dma[slot].dma_control.value;
+    if( dirty & SHADOW_DIRTY_NEXT       ) SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[slot].dma_next_sample.value = shadow_dma[slot].dma_next_sample.value;
+
+    shadow_dirty[slot] = 0;
+}
+
+// This function writes all the pending slot changes to the HW
+// The order keeps the HW chain consistent while the DMA is running:
+//   1) The new slots are fully written. Nothing points to them yet
+//   2) The slots in playback are re-linked (this makes the new slots visible and skips the released ones)
+//   3) The released slots are cleared. Nothing points to them anymore
+void vSamplerDMACommit( void ) {
+    uint32_t slot_mask;
+
+    // If all the voices were stopped, the chain is restarted from scratch
+    if( commit_chain_emptied ) SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_STOP;
+
+    // Step 1 - New slots
+    for( uint16_t slot = 0; slot < MAX_VOICES; slot++ ) {
+        slot_mask = ( 1U << ( slot & 0x1f ) );
+        if( ( shadow_started[SLOT_WORD(slot)] & slot_mask ) == 0 || sampler_voices[slot].voice_is_active == 0 ) continue;
+
+        // Clear any stale done flag of the previous voice of this slot
+        if( hw_has_voices_done ) SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_VOICES_DONE_REG[SLOT_WORD(slot)].value = slot_mask;
+
+        shadow_dirty[slot] = SHADOW_DIRTY_ALL;
+        prv_vWriteSlotRegisters( slot );
+
+        // The control word is written again when the slot is re-linked. From now on the HW owns the
+        // resampler history, so don't clear it (the phase fraction restarts, which is less than one frame)
+        shadow_dma[slot].dma_control.field.hist_valid = 1;
+    }
+
+    // Step 2 - Slots in playback
+    for( uint16_t slot = 0; slot < MAX_VOICES; slot++ ) {
+        if( shadow_dirty[slot] && sampler_voices[slot].voice_is_active ) prv_vWriteSlotRegisters( slot );
+    }
+
+    // Step 3 - Released slots
+    for( uint16_t slot = 0; slot < MAX_VOICES; slot++ ) {
+        if( shadow_dirty[slot] ) prv_vWriteSlotRegisters( slot );
+    }
+
+    // Step 4 - Start the DMA once all the slot writes are done
+    // The sample data was already cleaned when it was loaded
+    if( number_of_active_slots != 0 && ( commit_start_pending || commit_chain_emptied ) ) {
+        vSamplerCacheRegisterBarrier();
+        SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_START;
+    }
+
+    for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) shadow_started[ i ] = 0;
+    commit_start_pending = 0;
+    commit_chain_emptied = 0;
+}
+
+// This function clears the shadow registers and the pending changes
+void prv_vClearShadowRegisters( void ) {
+    for( int i = 0; i < MAX_VOICES; i++ ) {
+        shadow_dma[ i ].dma_start_addr.value  = 0;
+        shadow_dma[ i ].dma_end_addr.value    = 0;
+        shadow_dma[ i ].dma_control.value     = 0;
+        shadow_dma[ i ].dma_next_sample.value = 0;
+        shadow_dirty[ i ]                     = 0;
+    }
+    for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) shadow_started[ i ] = 0;
+    commit_start_pending = 0;
+    commit_chain_emptied = 0;
+}
+
+// This function will stop the playback of all the voices
+void vStopAllVoicePlayback( void ) {
+
+    // Stop the engine
+    SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_CONTROL_REG.value = SAMPLER_CONTROL_STOP;
+
+    // Clear the DMA of the active slots and the ones with pending changes
+    // This is done right away. Any pending change is dropped
+    for( uint32_t voice_slot = 0; voice_slot < MAX_VOICES; voice_slot++ ) {
+        if( sampler_voices[voice_slot].voice_is_active == 0 && shadow_dirty[voice_slot] == 0 ) continue;
+
+        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_start_addr.value  = 0;
+        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_end_addr.value    = 0;
+        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_control.value     = 0;
+        SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[voice_slot].dma_next_sample.value = 0;
+    }
+
+    vSamplerCacheRegisterBarrier();
+
+    prv_vClearShadowRegisters();
+
+    // Release all the slots. The policy, caps and statistics are kept
+    last_voice_slot        = 0;
+    number_of_active_slots = 0;
+    for( int i = 0; i < MAX_VOICES; i++ ){
+        sampler_voices[ i ].voice_is_active     = 0;
+        sampler_voices[ i ].previous_voice_slot = 0;
+        sampler_voices[ i ].next_voice_slot     = 0;
+        sampler_voices[ i ].slot_is_last        = 0;
+        sampler_voices[ i ].instrument          = VOICE_INSTRUMENT_NONE;
+        sampler_voices[ i ].owner               = NULL;
+    }
+    for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) free_slot_bitmap[ i ] = 0xffffffff;
+    for( int i = 0; i < MAX_VOICE_INSTRUMENTS;   i++ ) instrument_active_slots[ i ] = 0;
+}
+
+// This function releases the voices that have played all their samples
+// Returns the number of voices released
+uint32_t ulReapFinishedVoices( void ) {
+    uint32_t                  voices_done[VOICE_FREE_BITMAP_WORDS];
+    uint32_t                  reaped = 0;
+    uint16_t                  current_slot;
+    uint16_t                  next_slot;
+    uint16_t                  active_slots;
+    void                     *owner;
+    SAMPLER_DMA_CONTROL_REG_t temp_ctrl_reg;
+
+    if( number_of_active_slots == 0 ) return 0;
+
+    // Step 1 - Get the finished voices
+    if( hw_has_voices_done ) {
+        // The HW keeps a bitmap of the finished voices (bit N = slot N)
+        for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) {
+            voices_done[ i ] = SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_VOICES_DONE_REG[ i ].value;
+            if( voices_done[ i ] ) SAMPLER_CONTROL_REGISTER_ACCESS->SAMPLER_VOICES_DONE_REG[ i ].value = voices_done[ i ];
+        }
+    } else {
+        // Older HW. Check the overflow bit of the active slots
+        for( int i = 0; i < VOICE_FREE_BITMAP_WORDS; i++ ) voices_done[ i ] = 0;
+
+        current_slot = sampler_voices[ last_voice_slot ].next_voice_slot;
+        for( int i = 0; i < number_of_active_slots; i++ ) {
+            temp_ctrl_reg.value = SAMPLER_DMA_REGISTER_ACCESS->sampler_dma[current_slot].dma_control.value;
+            if( temp_ctrl_reg.field.overflow ) voices_done[ SLOT_WORD(current_slot) ] |= ( 1U << ( current_slot & 0x1f ) );
+            current_slot = sampler_voices[ current_slot ].next_voice_slot;
+        }
+    }
+
+    // Step 2 - Release the active slots that are done
+    current_slot = sampler_voices[ last_voice_slot ].next_voice_slot;
+    active_slots = number_of_active_slots;
+    for( int i = 0; i < active_slots; i++ ) {
+        next_slot = sampler_voices[ current_slot ].next_voice_slot;
+
+        if( voices_done[ SLOT_WORD(current_slot) ] & ( 1U << ( current_slot & 0x1f ) ) ) {
+            owner = sampler_voices[ current_slot ].owner;
+
+            ulStopVoicePlayback( current_slot );
+            if( release_callback != NULL ) release_callback( current_slot, owner );
+
+            reaped++;
+        }
+
+        current_slot = next_slot;
+    }
+
+    alloc_stats.reaped += reaped;
+
+    return reaped;
+}
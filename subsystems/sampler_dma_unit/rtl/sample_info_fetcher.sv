@@ -11,6 +11,14 @@
 // | cycle through all samples until it reaches the last one of the loop,   |
 // | indicated by the sample information fetched.                           |
 // | At that moment it will indicate the DMA engine that the loop is done   |
+// |                                                                        |
+// | Looped samples (Control[2]) never overflow. When the next address      |
+// | reaches the end address, the current address goes back to the loop     |
+// | start (End Address - Loop Length * 256 bytes)                          |
+// |                                                                        |
+// | Pitched samples (Phase Increment != 0) advance less than one burst per |
+// | request. The address moves by the number of frames consumed by the     |
+// | resampler and the fractional part is kept in the Phase Fraction field  |
 // +------------------------------------------------------------------------+
 
 ////////////////////
@@ -24,11 +32,25 @@
 // :---------------------------------------------------------+---------:
 // |                  Sample End Address [31:0]              |    1    |
 // :---------------------------------------------------------+---------:
-// | Control[7:0] |   Sample Length [23:0]                   |    2    |
+// | Control[7:0] | Phase Fraction[11:0] | Phase Inc[11:0]   |    2    |
 // :---------------------------------------------------------+---------:
-// |         RSVD[15:0]         |     Next Sample[15:0]      |    3    |
+// |      Loop Length[15:0]     |     Next Sample[15:0]      |    3    |
 // '---------------------------------------------------------'---------'
 
+// Control[7:0]
+// [0]   Valid
+// [1]   Last slot
+// [2]   Loop enable
+// [3]   Resampler history valid (Set by the HW after the first request)
+// [6:4] RSVD
+// [7]   Overflow
+
+// Loop Length is in DMA bursts (256 bytes)
+
+// Phase Increment is the number of source frames per output frame in 1/4096 units
+// 0 plays the sample at its original rate. Only rates below 1 are supported (1 burst = 64 frames per request)
+// Phase Fraction is the fractional source position of the next request (1/4096 frames)
+
 module sample_info_fetcher #(
     parameter NUMBER_OF_SAMPLE_REG_PER_READ = 4,   // This controls the number of registers to be fetched on a single read
     parameter BRAM_DATA_WIDTH               = 128, // This controls the data width of the BRAM data
@@ -57,6 +79,9 @@ module sample_info_fetcher #(
     output wire            sample_valid,
     output wire            sample_overflow,
     output wire            sample_last,
+    output wire [ 11 : 0 ] sample_phase_inc,
+    output wire [ 11 : 0 ] sample_phase_frac,
+    output wire            sample_hist_valid,
     input  wire            load_next_sample,
     input  wire            all_samples_invalid
 );
@@ -99,11 +124,16 @@ wire [ BRAM_ADDR_WIDTH - 1 : 0 ] next_bram_addr;
 
 // DMA Address
 wire [ 31 : 0 ] next_sample_addr;
+wire [ 31 : 0 ] burst_end_addr;
 wire [ 31 : 0 ] sample_end_addr;
 wire            sample_addr_overflow;
 
-// Sample Length
-wire [ 23 : 0 ] sample_len;
+// Phase accumulator
+wire [ 11 : 0 ] phase_inc;
+wire [ 11 : 0 ] phase_frac;
+wire [ 18 : 0 ] phase_next;     // Source position after 64 output frames (1/4096 frames)
+wire [ 6 : 0 ]  frames_consumed; // 0 to 64 frames
+wire [ 11 : 0 ] next_phase_frac;
 
 // Control and status register
 wire [ 7 : 0 ] control_and_status;
@@ -111,6 +141,12 @@ wire [ 7 : 0 ] next_control_and_status;
 wire           curr_sample_valid;
 wire           curr_sample_overflow;
 wire           curr_sample_last;
+wire           curr_sample_loop;
+
+// Loop
+wire [ 15 : 0 ] loop_len;        // Number of DMA bursts (256 bytes) of the loop
+wire [ 31 : 0 ] loop_start_addr;
+wire            loop_wrap;
 
 //////////////////////////////////
 
@@ -244,7 +280,8 @@ end
 
 assign sample_addr        = sample_registers[0];
 assign sample_end_addr    = sample_registers[1];
-assign sample_len         = sample_registers[2][23:0];
+assign phase_inc          = sample_registers[2][11:0];
+assign phase_frac         = sample_registers[2][23:12];
 assign control_and_status = sample_registers[2][31:24];
 assign sample_id          = current_bram_addr;
 assign next_bram_addr     = sample_registers_pre[3][BRAM_ADDR_WIDTH - 1 : 0]; // Take the next BRAM address directly in case the FW changed it while waiting
@@ -253,21 +290,43 @@ assign next_bram_addr     = sample_registers_pre[3][BRAM_ADDR_WIDTH - 1 : 0]; //
 assign curr_sample_valid       = control_and_status[0];
 assign curr_sample_last        = control_and_status[1]; // Last slot
 assign curr_sample_overflow    = control_and_status[7];
+assign curr_sample_loop        = control_and_status[2] & ( |loop_len ); // A loop of length 0 plays as a one-shot
 
 
 assign sample_valid    = fsm_curr_st_FSM_ST_WAIT & curr_sample_valid;
 assign sample_last     = fsm_curr_st_FSM_ST_WAIT & curr_sample_valid & curr_sample_last;
 assign sample_overflow = sample_addr_overflow | curr_sample_overflow;
 
+// Resampler information of the current request
+assign sample_phase_inc  = phase_inc;
+assign sample_phase_frac = phase_frac;
+assign sample_hist_valid = control_and_status[3];
+
+// Calculate the number of frames consumed by the resampler
+// Each request produces 64 output frames. At the original rate that's the whole burst
+assign phase_next      = { 7'h00, phase_frac } + { 1'b0, phase_inc, 6'h00 };
+assign frames_consumed = ( phase_inc == 12'h000 ) ? 7'd64 : phase_next[18:12];
+assign next_phase_frac = ( phase_inc == 12'h000 ) ? 12'h000 : phase_next[11:0];
+
 // Calculate the next sample address
 // 1 DMA access = 64x32bit transfer = 256 bytes
-assign next_sample_addr = sample_addr + 32'h100;
+assign next_sample_addr = sample_addr + { 23'h000000, frames_consumed, 2'b00 };
+assign burst_end_addr   = sample_addr + 32'h100;
+
+// Check if the current burst is still within range
+// Looped samples never overflow
+assign sample_addr_overflow = ~curr_sample_loop & ( burst_end_addr > sample_end_addr );
 
-// Check if the next address is still within range
-assign sample_addr_overflow = ( next_sample_addr > sample_end_addr );
+// Go back to the loop start once the loop end has been read
+// The loop length is subtracted from the next address so the fraction of the burst past the loop end isn't lost
+assign loop_len        = sample_registers[3][31:16];
+assign loop_start_addr = next_sample_addr - { 8'h00, loop_len, 8'h00 };
+assign loop_wrap       = curr_sample_loop & ( next_sample_addr >= sample_end_addr );
 
 // Control and status register for writeback
-assign next_control_and_status[6:0] = control_and_status[6:0];
+assign next_control_and_status[2:0] = control_and_status[2:0];
+assign next_control_and_status[3]   = 1'b1; // The resampler has the history of this slot after the first request
+assign next_control_and_status[6:4] = control_and_status[6:4];
 assign next_control_and_status[7]   = sample_addr_overflow;
 
 ///////////////////////////////////////
@@ -295,9 +354,11 @@ end
 // Sample Data Writeback FF
 ///////////////////////////////////////
 
-assign sample_registers_wb[0]        = curr_sample_overflow ? sample_addr : next_sample_addr;
+assign sample_registers_wb[0]        = curr_sample_overflow ? sample_addr :
+                                       loop_wrap            ? loop_start_addr : next_sample_addr;
 assign sample_registers_wb[1]        = sample_registers[1];
-assign sample_registers_wb[2][23:0]  = sample_len;
+assign sample_registers_wb[2][11:0]  = phase_inc;
+assign sample_registers_wb[2][23:12] = next_phase_frac;
 assign sample_registers_wb[2][31:24] = next_control_and_status;
 assign sample_registers_wb[3]        = sample_registers[3];
 
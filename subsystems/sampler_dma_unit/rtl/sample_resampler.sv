@@ -0,0 +1,340 @@
+// +-------------------------------------------------------------------------+
+// | sample_resampler.sv                                                     |
+// +-------------------------------------------------------------------------+
+// | This module will change the playback rate of the sample streams         |
+// |                                                                         |
+// | This module sits between the DMA receiver and the mixer. Each stream    |
+// | (64 stereo frames of one slot) is stored in a buffer and then 64 output |
+// | frames are produced with linear interpolation at the phase increment of |
+// | the slot. The phase increment and the starting fraction are captured    |
+// | from the DMA requests, since the fetcher is the one that advances the   |
+// | slot address by the number of frames consumed here.                    |
+// |                                                                         |
+// | Interpolating the last output frame of a stream can need one frame past |
+// | the burst, so the source of each stream is shifted by one frame: frame  |
+// | 0 is the last frame consumed by the previous stream of the same slot    |
+// | (kept in the history memory) and frames 1 to 64 are the burst.          |
+// |                                                                         |
+// | Slots with a phase increment of 0 are passed through untouched          |
+// +-------------------------------------------------------------------------+
+
+`default_nettype none
+
+module sample_resampler #(
+    parameter         ENABLE_DEBUG             = 0,
+    parameter integer C_AXI_STREAM_TDATA_WIDTH = 32,
+    parameter integer C_AXI_STREAM_TUSER_WIDTH = 32
+)(
+    input wire clk,
+    input wire reset_n,
+
+    input wire stop,
+
+    // Phase information of the DMA requests //
+    input  wire           phase_info_wr,
+    input  wire [ 5 : 0 ] phase_info_id,
+    input  wire [ 11 : 0] phase_info_inc,        // Source frames per output frame (1/4096 units). 0 = Original rate
+    input  wire [ 11 : 0] phase_info_frac,       // Fractional source position of the first output frame (1/4096 frames)
+    input  wire           phase_info_hist_valid, // The history memory has the previous frame of the slot
+
+    // Input AXI Stream interface from the DMA receiver
+    input  wire [C_AXI_STREAM_TDATA_WIDTH-1 : 0] axi_stream_slave_tdata,
+    input  wire                                  axi_stream_slave_tvalid,
+    input  wire                                  axi_stream_slave_tlast,
+    input  wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0] axi_stream_slave_tuser,
+    output wire                                  axi_stream_slave_tready,
+
+    // Output AXI Stream interface
+    output wire [C_AXI_STREAM_TDATA_WIDTH-1 : 0] axi_stream_master_tdata,
+    output wire                                  axi_stream_master_tvalid,
+    output wire                                  axi_stream_master_tlast,
+    output wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0] axi_stream_master_tuser,
+    input  wire                                  axi_stream_master_tready
+);
+
+// States
+localparam FSM_ST_FILL = 0;
+localparam FSM_ST_PLAY = 1;
+
+// Number of frames per stream
+localparam STREAM_LEN = 64;
+
+// State Machine
+reg   [ 0 : 0 ] fsm_curr_st;
+logic [ 0 : 0 ] fsm_next_st;
+
+wire fsm_curr_st_FSM_ST_FILL;
+wire fsm_curr_st_FSM_ST_PLAY;
+
+// Phase information of each slot
+reg [ 11 : 0 ] phase_inc_mem  [ 0 : 63 ];
+reg [ 11 : 0 ] phase_frac_mem [ 0 : 63 ];
+reg [ 63 : 0 ] hist_valid_mem;
+
+// Last frame consumed by each slot
+reg [ 31 : 0 ] hist_mem [ 0 : 63 ];
+
+// Stream buffer
+reg  [ 31 : 0 ]                         frame_buffer [ 0 : STREAM_LEN - 1 ];
+reg  [ C_AXI_STREAM_TUSER_WIDTH-1 : 0 ] tuser_buffer [ 0 : STREAM_LEN - 1 ];
+reg  [ 5 : 0 ]                          fill_count;
+wire                                    fill_data;
+wire                                    fill_done;
+
+// Current stream
+reg  [ 5 : 0 ]  stream_slot;
+reg  [ 31 : 0 ] stream_hist;  // Frame 0 of the source
+reg  [ 12 : 0 ] stream_inc;   // 13 bits so the original rate is 4096
+wire            stream_start;
+
+// Playback
+reg  [ 18 : 0 ] play_pos;     // Source position of the next output frame (1/4096 frames)
+reg  [ 6 : 0 ]  play_count;   // Output frames produced
+wire            play_data;
+wire            play_done;
+wire [ 6 : 0 ]  play_idx_a;
+wire [ 6 : 0 ]  play_idx_b;
+wire [ 6 : 0 ]  buffer_idx_a;
+wire [ 6 : 0 ]  buffer_idx_b;
+wire [ 6 : 0 ]  hist_idx;
+wire [ 6 : 0 ]  hist_buffer_idx;
+wire [ 11 : 0 ] play_frac;
+wire [ 31 : 0 ] frame_a;
+wire [ 31 : 0 ] frame_b;
+
+// Interpolation
+wire signed [ 15 : 0 ] frame_a_left;
+wire signed [ 15 : 0 ] frame_a_right;
+wire signed [ 16 : 0 ] frame_diff_left;
+wire signed [ 16 : 0 ] frame_diff_right;
+wire signed [ 29 : 0 ] frame_prod_left;
+wire signed [ 29 : 0 ] frame_prod_right;
+wire signed [ 15 : 0 ] frame_out_left;
+wire signed [ 15 : 0 ] frame_out_right;
+
+// Output register
+reg  [ C_AXI_STREAM_TDATA_WIDTH-1 : 0 ] out_tdata;
+reg                                     out_tvalid;
+reg                                     out_tlast;
+reg  [ C_AXI_STREAM_TUSER_WIDTH-1 : 0 ] out_tuser;
+wire                                    out_accepted;
+
+/////////////////////////////////////
+// Assignments
+/////////////////////////////////////
+
+assign fsm_curr_st_FSM_ST_FILL = ( fsm_curr_st == FSM_ST_FILL );
+assign fsm_curr_st_FSM_ST_PLAY = ( fsm_curr_st == FSM_ST_PLAY );
+
+// The stream is only accepted while filling the buffer
+assign axi_stream_slave_tready = fsm_curr_st_FSM_ST_FILL & ~stop;
+assign fill_data               = axi_stream_slave_tvalid & axi_stream_slave_tready;
+assign fill_done               = fill_data & axi_stream_slave_tlast;
+assign stream_start            = fill_data & ( fill_count == 'h0 );
+
+// The receiver signals the stop with TUSER = '1 while there's no stream. Pass it through to the mixer
+assign axi_stream_master_tdata  = out_tdata;
+assign axi_stream_master_tvalid = out_tvalid;
+assign axi_stream_master_tlast  = out_tlast;
+assign axi_stream_master_tuser  = fsm_curr_st_FSM_ST_PLAY ? out_tuser : axi_stream_slave_tuser;
+
+assign out_accepted = out_tvalid & axi_stream_master_tready;
+assign play_data    = fsm_curr_st_FSM_ST_PLAY & ( play_count < STREAM_LEN ) & ( ~out_tvalid | axi_stream_master_tready );
+assign play_done    = out_accepted & out_tlast;
+
+// Source frames. Frame 0 is the history, frames 1 to 64 are the buffer
+// The second frame is clamped to the end of the buffer. Its weight is 0 in that case
+assign play_idx_a   = play_pos[18:12];
+assign play_idx_b   = ( play_idx_a == STREAM_LEN ) ? STREAM_LEN : play_idx_a + 1'b1;
+assign play_frac    = play_pos[11:0];
+assign buffer_idx_a = play_idx_a - 1'b1;
+assign buffer_idx_b = play_idx_b - 1'b1;
+assign frame_a      = ( play_idx_a == 'h0 ) ? stream_hist : frame_buffer[ buffer_idx_a[5:0] ];
+assign frame_b      = frame_buffer[ buffer_idx_b[5:0] ];
+
+// Linear interpolation. out = a + ( b - a ) * frac
+assign frame_a_left     = frame_a[15:0];
+assign frame_a_right    = frame_a[31:16];
+assign frame_diff_left  = $signed( { frame_b[15],    frame_b[15:0]  } ) - $signed( { frame_a[15],    frame_a[15:0]  } );
+assign frame_diff_right = $signed( { frame_b[31],    frame_b[31:16] } ) - $signed( { frame_a[31],    frame_a[31:16] } );
+assign frame_prod_left  = frame_diff_left  * $signed( { 1'b0, play_frac } );
+assign frame_prod_right = frame_diff_right * $signed( { 1'b0, play_frac } );
+assign frame_out_left   = frame_a_left  + frame_prod_left[27:12];
+assign frame_out_right  = frame_a_right + frame_prod_right[27:12];
+
+// Frame to keep for the next stream of the slot (the last one consumed)
+// The position after the last output frame is the source position of the next stream plus one
+assign hist_idx        = ( play_pos[18:12] > STREAM_LEN ) ? STREAM_LEN : play_pos[18:12];
+assign hist_buffer_idx = hist_idx - 1'b1;
+
+/////////////////////////////////////
+// State Machine
+/////////////////////////////////////
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if (~reset_n) begin
+        fsm_curr_st <= FSM_ST_FILL;
+    end
+    else begin
+        fsm_curr_st <= fsm_next_st;
+    end
+end
+
+always_comb begin
+    case (fsm_curr_st)
+        FSM_ST_FILL: begin
+            if ( fill_done ) fsm_next_st = FSM_ST_PLAY;
+            else             fsm_next_st = FSM_ST_FILL;
+        end
+
+        FSM_ST_PLAY: begin
+            if ( stop )           fsm_next_st = FSM_ST_FILL;
+            else if ( play_done ) fsm_next_st = FSM_ST_FILL;
+            else                  fsm_next_st = FSM_ST_PLAY;
+        end
+
+        default: begin
+            fsm_next_st = FSM_ST_FILL;
+        end
+    endcase
+end
+
+/////////////////////////////////////
+// Phase Information
+/////////////////////////////////////
+
+always_ff @(posedge clk) begin
+    if ( phase_info_wr ) begin
+        phase_inc_mem [ phase_info_id ] <= phase_info_inc;
+        phase_frac_mem[ phase_info_id ] <= phase_info_frac;
+    end
+end
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if (~reset_n) begin
+        hist_valid_mem <= 'h0;
+    end
+    else begin
+        hist_valid_mem <= hist_valid_mem;
+
+        if ( phase_info_wr ) begin
+            hist_valid_mem[ phase_info_id ] <= phase_info_hist_valid;
+        end
+    end
+end
+
+/////////////////////////////////////
+// Stream Buffer
+/////////////////////////////////////
+
+always_ff @(posedge clk) begin
+    if ( fill_data ) begin
+        frame_buffer[ fill_count ] <= axi_stream_slave_tdata;
+        tuser_buffer[ fill_count ] <= axi_stream_slave_tuser;
+    end
+end
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if (~reset_n) begin
+        fill_count  <= 'h0;
+        stream_slot <= 'h0;
+    end
+    else begin
+        fill_count  <= fill_count;
+        stream_slot <= stream_slot;
+
+        if ( stop | fill_done ) begin
+            fill_count <= 'h0;
+        end
+        else if ( fill_data ) begin
+            fill_count <= fill_count + 1'b1;
+        end
+
+        if ( stream_start ) begin
+            stream_slot <= axi_stream_slave_tuser[5:0];
+        end
+    end
+end
+
+/////////////////////////////////////
+// Playback
+/////////////////////////////////////
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if (~reset_n) begin
+        play_pos    <= 'h0;
+        play_count  <= 'h0;
+        stream_inc  <= 'h0;
+        stream_hist <= 'h0;
+    end
+    else begin
+        play_pos    <= play_pos;
+        play_count  <= play_count;
+        stream_inc  <= stream_inc;
+        stream_hist <= stream_hist;
+
+        if ( fill_done ) begin
+            play_count <= 'h0;
+
+            // Original rate. Output frame N is buffer frame N
+            if ( phase_inc_mem[ stream_slot ] == 12'h000 ) begin
+                play_pos   <= 19'h01000;
+                stream_inc <= 13'h1000;
+            end
+            else begin
+                play_pos   <= { 7'h00, phase_frac_mem[ stream_slot ] };
+                stream_inc <= { 1'b0, phase_inc_mem[ stream_slot ] };
+            end
+
+            // A new voice has no history. Repeat its first frame
+            stream_hist <= hist_valid_mem[ stream_slot ] ? hist_mem[ stream_slot ] : frame_buffer[0];
+        end
+        else if ( play_data ) begin
+            play_pos   <= play_pos + { 6'h00, stream_inc };
+            play_count <= play_count + 1'b1;
+        end
+    end
+end
+
+// Keep the last frame consumed by the stream
+always_ff @(posedge clk) begin
+    if ( play_done ) begin
+        hist_mem[ stream_slot ] <= ( hist_idx == 'h0 ) ? stream_hist : frame_buffer[ hist_buffer_idx[5:0] ];
+    end
+end
+
+/////////////////////////////////////
+// Output Register
+/////////////////////////////////////
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if (~reset_n) begin
+        out_tdata  <= 'h0;
+        out_tvalid <= 1'b0;
+        out_tlast  <= 1'b0;
+        out_tuser  <= 'h0;
+    end
+    else begin
+        out_tdata  <= out_tdata;
+        out_tvalid <= out_tvalid;
+        out_tlast  <= out_tlast;
+        out_tuser  <= out_tuser;
+
+        if ( stop ) begin
+            out_tvalid <= 1'b0;
+            out_tlast  <= 1'b0;
+        end
+        else if ( play_data ) begin
+            out_tdata  <= { frame_out_right, frame_out_left };
+            out_tvalid <= 1'b1;
+            out_tlast  <= ( play_count == STREAM_LEN - 1 );
+            out_tuser  <= tuser_buffer[ play_count[5:0] ];
+        end
+        else if ( out_accepted ) begin
+            out_tvalid <= 1'b0;
+            out_tlast  <= 1'b0;
+        end
+    end
+end
+
+endmodule
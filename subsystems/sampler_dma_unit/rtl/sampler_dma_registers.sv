@@ -26,7 +26,7 @@
 // |--------------------------|
 ///////////////////////////////////////////////////////////////
 
-`define SAMPLER_VERSION 32'h0001_0001
+`define SAMPLER_VERSION 32'h0001_0004
 
 module sampler_dma_registers #(
     parameter         MAX_VOICES        = 64,
@@ -81,6 +81,8 @@ localparam BRAM_ADDR_LSB           = 0;
 localparam BRAM_ADDR_MSB           = NUM_OF_BRAM_REG_BITS + BRAM_ADDR_LSB;
 localparam BRAM_START_ADDR         = 12'b0100_0000_0000; // 0x400
 localparam BRAM_END_ADDR           = BRAM_START_ADDR + BRAM_DEPTH - 1;
+// Writeback data bit with the overflow flag of the sample (Control[7] of word 2)
+localparam BRAM_B_OVERFLOW_BIT     = ( 2 * 32 ) + 31;
 // DMA Register Address
 localparam DMA_BASE_ADDR_REG = 1'b0;
 localparam DMA_CONTROL_REG   = 1'b1;
@@ -99,6 +101,11 @@ wire  [ 31 : 0 ] dma_bram_data_out;
 logic [ 31 : 0 ] control_reg_data_out;
 reg   [ 1 : 0 ]  control_reg;
 
+// Voices done. One bit per voice, set when the sample of the voice has been fully read
+reg   [ MAX_VOICES - 1 : 0 ] voices_done;
+wire  [ MAX_VOICES - 1 : 0 ] voices_done_set;
+logic [ MAX_VOICES - 1 : 0 ] voices_done_clr;
+
 // Address Arbiter signals
 wire wr_addr_is_control_reg;
 wire rd_addr_is_control_reg;
@@ -167,6 +174,8 @@ always_comb begin
         2: control_reg_data_out = BRAM_START_ADDR;
         3: control_reg_data_out = BRAM_END_ADDR;
         4: control_reg_data_out = control_reg;
+        5: control_reg_data_out = voices_done[ 31 : 0 ];
+        6: control_reg_data_out = voices_done[ MAX_VOICES - 1 : 32 ];
         default: control_reg_data_out = 32'hbeefdead;
     endcase
 end
@@ -189,6 +198,31 @@ always_ff @(posedge clk, negedge reset_n) begin
     end
 end
 
+///////////////////////////////////////////////
+// Voices Done Registers
+///////////////////////////////////////////////
+// A bit is set when the info fetcher writes back a sample with the overflow flag
+// The FW clears the bits by writing 1 (W1C). Set has priority over clear
+
+assign voices_done_set = ( bram_B_we & bram_B_din[ BRAM_B_OVERFLOW_BIT ] ) ? ( 'h1 << bram_B_addr ) : 'h0;
+
+always_comb begin
+    voices_done_clr = 'h0;
+    if ( data_wren & wr_addr_is_control_reg ) begin
+        if ( wr_control_reg_num == 5 ) voices_done_clr[ 31 : 0 ]              = data_in;
+        if ( wr_control_reg_num == 6 ) voices_done_clr[ MAX_VOICES - 1 : 32 ] = data_in[ MAX_VOICES - 33 : 0 ];
+    end
+end
+
+always_ff @(posedge clk, negedge reset_n) begin
+    if ( ~reset_n ) begin
+        voices_done <= 'h0;
+    end
+    else begin
+        voices_done <= ( voices_done & ~voices_done_clr ) | voices_done_set;
+    end
+end
+
 ///////////////////////////////////////////////
 // BRAM Registers
 ///////////////////////////////////////////////
@@ -165,6 +165,9 @@ wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0]  dma_receiver_axi_stream_slave_tuser;
 (* keep = "true" *) wire            sample_valid;
 (* keep = "true" *) wire            sample_overflow;
 (* keep = "true" *) wire            sample_last;
+(* keep = "true" *) wire [ 11 : 0 ] sample_phase_inc;
+(* keep = "true" *) wire [ 11 : 0 ] sample_phase_frac;
+(* keep = "true" *) wire            sample_hist_valid;
 (* keep = "true" *) wire            load_next_sample;
 
 // Interface between the DMA requester and the receiver
@@ -187,6 +190,13 @@ wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0]  dma_receiver_axi_stream_slave_tuser;
 (* keep = "true" *) wire            dma_sample_req_valid;
 (* keep = "true" *) wire            dma_sample_req_done;
 
+// Interface between the receiver and the resampler //
+wire [C_AXI_STREAM_TDATA_WIDTH-1 : 0]  resampler_axi_stream_slave_tdata;
+wire                                   resampler_axi_stream_slave_tready;
+wire                                   resampler_axi_stream_slave_tvalid;
+wire                                   resampler_axi_stream_slave_tlast;
+wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0]  resampler_axi_stream_slave_tuser;
+
     axi_dma_bridge # (
         // AXI Parameters
         .C_M_TARGET_SLAVE_BASE_ADDR( C_AXI_DMA_MASTER_TARGET_SLAVE_BASE_ADDR ),
@@ -366,6 +376,9 @@ wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0]  dma_receiver_axi_stream_slave_tuser;
         .sample_valid        ( sample_valid        ),
         .sample_overflow     ( sample_overflow     ),
         .sample_last         ( sample_last         ),
+        .sample_phase_inc    ( sample_phase_inc    ),
+        .sample_phase_frac   ( sample_phase_frac   ),
+        .sample_hist_valid   ( sample_hist_valid   ),
         .load_next_sample    ( load_next_sample    ),
         .all_samples_invalid ( all_samples_invalid )
     );
@@ -428,6 +441,41 @@ wire [C_AXI_STREAM_TUSER_WIDTH-1 : 0]  dma_receiver_axi_stream_slave_tuser;
         .axi_stream_slave_tuser  ( dma_receiver_axi_stream_slave_tuser  ),
         .axi_stream_slave_tready ( dma_receiver_axi_stream_slave_tready ),
 
+        // Output AXI Stream interface
+        .axi_stream_master_tdata  ( resampler_axi_stream_slave_tdata  ),
+        .axi_stream_master_tvalid ( resampler_axi_stream_slave_tvalid ),
+        .axi_stream_master_tlast  ( resampler_axi_stream_slave_tlast  ),
+        .axi_stream_master_tuser  ( resampler_axi_stream_slave_tuser  ),
+        .axi_stream_master_tready ( resampler_axi_stream_slave_tready )
+    );
+
+    // The phase information of each request is captured when the request is sent
+    // The fetcher holds the information of the slot until the next one is loaded
+    sample_resampler # (
+        .C_AXI_STREAM_TDATA_WIDTH ( C_AXI_STREAM_TDATA_WIDTH ),
+        .C_AXI_STREAM_TUSER_WIDTH ( C_AXI_STREAM_TUSER_WIDTH )
+    )
+    sample_resampler (
+        .clk     ( axi_clk                ),
+        .reset_n ( axi_lite_slave_aresetn ),
+
+        // Stop bit
+        .stop    ( stop ),
+
+        // Phase information of the DMA requests //
+        .phase_info_wr         ( dma_sample_req_valid ),
+        .phase_info_id         ( dma_sample_req_id    ),
+        .phase_info_inc        ( sample_phase_inc     ),
+        .phase_info_frac       ( sample_phase_frac    ),
+        .phase_info_hist_valid ( sample_hist_valid    ),
+
+        // Input AXI Stream interface from the receiver
+        .axi_stream_slave_tdata  ( resampler_axi_stream_slave_tdata  ),
+        .axi_stream_slave_tvalid ( resampler_axi_stream_slave_tvalid ),
+        .axi_stream_slave_tlast  ( resampler_axi_stream_slave_tlast  ),
+        .axi_stream_slave_tuser  ( resampler_axi_stream_slave_tuser  ),
+        .axi_stream_slave_tready ( resampler_axi_stream_slave_tready ),
+
         // Output AXI Stream interface
         .axi_stream_master_tdata  ( axi_stream_master_tdata  ),
         .axi_stream_master_tvalid ( axi_stream_master_tvalid ),